@@ -45,9 +45,19 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  *     extract the contents of an LZH file from a stream.
  * @li @link lha_file_header.h @endlink - structure
  *     representing the decoded contents of an LZH file header.
+ * @li @link lha_output_stream.h @endlink - abstracts
+ *     the process of writing data to an LZH file.
+ * @li @link lha_writer.h @endlink - routines to create an LZH file,
+ *     compressing the files added to it.
  *
  * @section Additional_interfaces Additional interfaces
  *
  * @li @link lha_decoder.h @endlink - routines to decode raw LZH
  *     compressed data.
+ * @li @link lha_encoder.h @endlink - routines to generate raw LZH
+ *     compressed data.
+ * @li @link lha_allocator.h @endlink - hooks to replace the memory
+ *     allocator used by the library.
+ * @li @link lha_stats.h @endlink - performance counters collected
+ *     by readers and decoders.
  */
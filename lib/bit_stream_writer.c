@@ -0,0 +1,127 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Data structure used to write bits to an output stream.
+//
+// This is the counterpart of bit_stream_reader.c, and is designed to be
+// #included by other source files to make a complete encoder.
+//
+
+// Size of the buffer in which output is accumulated before it is
+// passed to the callback function.
+
+#define BIT_STREAM_BUFFER_SIZE 4096
+
+typedef struct {
+
+	// Callback function to invoke to write data to the output
+	// stream.
+
+	LHAEncoderCallback callback;
+	void *callback_data;
+
+	// Bits waiting to be written. These are stored in the upper
+	// bits of bit_buffer.
+
+	uint32_t bit_buffer;
+	unsigned int bits;
+
+	// Whole bytes waiting to be passed to the callback.
+
+	uint8_t buf[BIT_STREAM_BUFFER_SIZE];
+	size_t buf_len;
+
+	// If non-zero, a write to the output stream has failed.
+
+	int failed;
+
+} BitStreamWriter;
+
+// Initialize bit stream writer structure.
+
+static void bit_stream_writer_init(BitStreamWriter *writer,
+                                   LHAEncoderCallback callback,
+                                   void *callback_data)
+{
+	writer->callback = callback;
+	writer->callback_data = callback_data;
+
+	writer->bit_buffer = 0;
+	writer->bits = 0;
+	writer->buf_len = 0;
+	writer->failed = 0;
+}
+
+// Pass the contents of the byte buffer to the callback.
+
+static void flush_buffer(BitStreamWriter *writer)
+{
+	if (writer->buf_len > 0 && !writer->failed
+	 && writer->callback(writer->buf, writer->buf_len,
+	                     writer->callback_data) < writer->buf_len) {
+		writer->failed = 1;
+	}
+
+	writer->buf_len = 0;
+}
+
+// Write the low n bits of value to the output stream, most significant
+// bit first. n must be no more than 16.
+
+static void write_bits(BitStreamWriter *writer, unsigned int value,
+                       unsigned int n)
+{
+	if (n == 0) {
+		return;
+	}
+
+	writer->bit_buffer |= (uint32_t) (value & ((1U << n) - 1))
+	                   << (32 - writer->bits - n);
+	writer->bits += n;
+
+	// Move whole bytes into the byte buffer.
+
+	while (writer->bits >= 8) {
+		if (writer->buf_len >= BIT_STREAM_BUFFER_SIZE) {
+			flush_buffer(writer);
+		}
+
+		writer->buf[writer->buf_len]
+		    = (uint8_t) (writer->bit_buffer >> 24);
+		++writer->buf_len;
+		writer->bit_buffer <<= 8;
+		writer->bits -= 8;
+	}
+}
+
+// Write any remaining bits, padding to a whole byte with zeros, and
+// pass all output to the callback. Returns zero if writing failed.
+
+static int bit_stream_writer_flush(BitStreamWriter *writer)
+{
+	if (writer->bits > 0) {
+		write_bits(writer, 0, 8 - writer->bits);
+	}
+
+	flush_buffer(writer);
+
+	return !writer->failed;
+}
@@ -20,6 +20,11 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "crc16.h"
 
+#ifdef LHA_HAVE_PCLMUL
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
+
 static unsigned int crc16_table[] = {
 	0x0000, 0xc0c1, 0xc181, 0x0140, 0xc301, 0x03c0, 0x0280, 0xc241,
 	0xc601, 0x06c0, 0x0780, 0xc741, 0x0500, 0xc5c1, 0xc481, 0x0440,
@@ -55,6 +60,159 @@ static unsigned int crc16_table[] = {
 	0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040
 };
 
+#ifdef LHA_HAVE_PCLMUL
+
+// On x86 CPUs that support the PCLMULQDQ (carry-less multiply)
+// instruction, the CRC can be calculated 16 bytes at a time by
+// "folding" the data, as described in Intel's white paper "Fast CRC
+// Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+//
+// The algorithm is normally used for 32-bit CRCs. If P(x) is the CRC-16
+// polynomial, calculating a 32-bit CRC with the polynomial P(x) * x^16
+// gives the CRC-16 shifted up by 16 bits; in the bit-reflected form
+// used here, that is the CRC-16 in the low 16 bits. The constants
+// below are for that polynomial (0x8005 * x^16), bit-reflected and
+// shifted as described in the paper.
+
+// x^(4*128+32) mod P, x^(4*128-32) mod P: fold by four 128-bit blocks.
+static const uint64_t crc16_k1k2[2] = { 0x1b0c2, 0xbffa };
+
+// x^(128+32) mod P, x^(128-32) mod P: fold by one 128-bit block.
+static const uint64_t crc16_k3k4[2] = { 0x1d0c2, 0x18cc2 };
+
+// x^64 mod P: reduce 96 bits to 64.
+static const uint64_t crc16_k5k0[2] = { 0x1bc02, 0 };
+
+// P itself and floor(x^64 / P), for the final Barrett reduction.
+static const uint64_t crc16_poly[2] = { 0x14003, 0x1cfffbfff };
+
+// Calculate the CRC of a buffer using PCLMULQDQ. The buffer length must
+// be a multiple of 16 bytes, and at least 64 bytes.
+
+__attribute__((target("pclmul,sse4.1")))
+static uint16_t crc16_pclmul(uint16_t crc, uint8_t *buf, size_t buf_len)
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	// Load the first 64 bytes, and fold in the initial CRC value.
+
+	x1 = _mm_loadu_si128((__m128i *) (buf + 0x00));
+	x2 = _mm_loadu_si128((__m128i *) (buf + 0x10));
+	x3 = _mm_loadu_si128((__m128i *) (buf + 0x20));
+	x4 = _mm_loadu_si128((__m128i *) (buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+	x0 = _mm_loadu_si128((__m128i *) crc16_k1k2);
+
+	buf += 64;
+	buf_len -= 64;
+
+	// Fold 64 bytes at a time, in four parallel lanes.
+
+	while (buf_len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((__m128i *) (buf + 0x00));
+		y6 = _mm_loadu_si128((__m128i *) (buf + 0x10));
+		y7 = _mm_loadu_si128((__m128i *) (buf + 0x20));
+		y8 = _mm_loadu_si128((__m128i *) (buf + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		buf += 64;
+		buf_len -= 64;
+	}
+
+	// Fold the four lanes into one.
+
+	x0 = _mm_loadu_si128((__m128i *) crc16_k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// Fold in any remaining 16 byte blocks.
+
+	while (buf_len >= 16) {
+		x2 = _mm_loadu_si128((__m128i *) buf);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		buf += 16;
+		buf_len -= 16;
+	}
+
+	// Reduce 128 bits to 64 bits.
+
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((__m128i *) crc16_k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to get the final CRC value.
+
+	x0 = _mm_loadu_si128((__m128i *) crc16_poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint16_t) _mm_extract_epi32(x1, 1);
+}
+
+// Returns true if the CPU supports the instructions needed by
+// crc16_pclmul(). The result is checked on first use, and kept in an
+// atomic variable, as the writer can call this from several threads
+// at once; if they race, they all store the same value.
+
+static int have_pclmul(void)
+{
+	static int cached = -1;
+	int result;
+
+	result = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+
+	if (result < 0) {
+		result = __builtin_cpu_supports("pclmul")
+		      && __builtin_cpu_supports("sse4.1");
+		__atomic_store_n(&cached, result, __ATOMIC_RELAXED);
+	}
+
+	return result;
+}
+
+#endif /* #ifdef LHA_HAVE_PCLMUL */
+
 void lha_crc16_buf(uint16_t *crc, uint8_t *buf, size_t buf_len)
 {
 	uint16_t tmp;
@@ -63,6 +221,20 @@ void lha_crc16_buf(uint16_t *crc, uint8_t *buf, size_t buf_len)
 
 	tmp = *crc;
 
+#ifdef LHA_HAVE_PCLMUL
+	// Process as much of the buffer as possible using the fast
+	// version, if the CPU supports it. The table lookup below then
+	// handles any remainder.
+
+	if (buf_len >= 64 && have_pclmul()) {
+		size_t blocks_len = buf_len & ~(size_t) 15;
+
+		tmp = crc16_pclmul(tmp, buf, blocks_len);
+		buf += blocks_len;
+		buf_len -= blocks_len;
+	}
+#endif
+
 	for (i = 0; i < buf_len; ++i) {
 		index = (tmp ^ buf[i]) & 0xff;
 		tmp = ((tmp >> 8) ^ crc16_table[index]) & 0xffff;
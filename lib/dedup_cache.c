@@ -0,0 +1,222 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lha_allocator.h"
+#include "lha_decoder.h"
+#include "dedup_cache.h"
+
+// Structure used to decompress the data for an entry, to check it.
+
+typedef struct {
+	const LHADedupEntry *entry;
+	size_t pos;
+} EntryReader;
+
+void lha_dedup_cache_init(LHADedupCache *cache, size_t max_size)
+{
+	memset(cache->buckets, 0, sizeof(cache->buckets));
+	cache->oldest = NULL;
+	cache->newest = NULL;
+	cache->size = 0;
+	cache->max_size = max_size;
+}
+
+void lha_dedup_cache_free(LHADedupCache *cache)
+{
+	LHADedupEntry *entry, *next;
+
+	for (entry = cache->oldest; entry != NULL; entry = next) {
+		next = entry->next;
+		lha_free(entry->data);
+		lha_free(entry);
+	}
+
+	lha_dedup_cache_init(cache, cache->max_size);
+}
+
+static unsigned int hash_entry(uint64_t length, uint16_t crc)
+{
+	return (unsigned int) ((length * 31 + crc) % DEDUP_CACHE_BUCKETS);
+}
+
+static size_t entry_read(void *buf, size_t buf_len, void *user_data)
+{
+	EntryReader *reader = user_data;
+	size_t remaining;
+
+	remaining = reader->entry->data_len - reader->pos;
+
+	if (buf_len > remaining) {
+		buf_len = remaining;
+	}
+
+	memcpy(buf, reader->entry->data + reader->pos, buf_len);
+	reader->pos += buf_len;
+
+	return buf_len;
+}
+
+// Decompress the data for an entry, and compare it with the given data.
+
+static int entry_matches(const LHADedupEntry *entry,
+                         const uint8_t *data, size_t data_len)
+{
+	const LHADecoderType *dtype;
+	LHADecoder *decoder;
+	EntryReader reader;
+	uint8_t buf[4096];
+	size_t pos, n;
+
+	dtype = lha_decoder_for_name(entry->compress_method);
+
+	if (dtype == NULL) {
+		return 0;
+	}
+
+	reader.entry = entry;
+	reader.pos = 0;
+	decoder = lha_decoder_new(dtype, entry_read, &reader, data_len);
+
+	if (decoder == NULL) {
+		return 0;
+	}
+
+	for (pos = 0; pos < data_len; pos += n) {
+		n = lha_decoder_read(decoder, buf, sizeof(buf));
+
+		if (n == 0 || n > data_len - pos
+		 || memcmp(buf, data + pos, n) != 0) {
+			break;
+		}
+	}
+
+	lha_decoder_free(decoder);
+
+	return pos == data_len;
+}
+
+const LHADedupEntry *lha_dedup_cache_find(LHADedupCache *cache,
+                                          const char *method, int level,
+                                          const uint8_t *data,
+                                          size_t data_len, uint16_t crc)
+{
+	LHADedupEntry *entry;
+
+	entry = cache->buckets[hash_entry(data_len, crc)];
+
+	for (; entry != NULL; entry = entry->bucket_next) {
+		if (entry->length == data_len && entry->crc == crc
+		 && entry->level == level
+		 && !strcmp(entry->requested_method, method)
+		 && entry_matches(entry, data, data_len)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+// Remove the oldest entry from the cache.
+
+static void remove_oldest(LHADedupCache *cache)
+{
+	LHADedupEntry *entry, **rover;
+
+	entry = cache->oldest;
+	rover = &cache->buckets[hash_entry(entry->length, entry->crc)];
+
+	while (*rover != entry) {
+		rover = &(*rover)->bucket_next;
+	}
+
+	*rover = entry->bucket_next;
+
+	cache->oldest = entry->next;
+
+	if (cache->oldest == NULL) {
+		cache->newest = NULL;
+	}
+
+	cache->size -= entry->data_len + sizeof(LHADedupEntry);
+
+	lha_free(entry->data);
+	lha_free(entry);
+}
+
+void lha_dedup_cache_add(LHADedupCache *cache, const char *method,
+                         int level, LHAFileHeader *header,
+                         const uint8_t *data, size_t data_len)
+{
+	LHADedupEntry *entry;
+	unsigned int b;
+	size_t size;
+
+	size = data_len + sizeof(LHADedupEntry);
+
+	if (size > cache->max_size) {
+		return;
+	}
+
+	while (cache->size + size > cache->max_size) {
+		remove_oldest(cache);
+	}
+
+	// Failing to allocate memory is not an error: the file just
+	// cannot be reused.
+
+	entry = lha_malloc(sizeof(LHADedupEntry));
+
+	if (entry == NULL) {
+		return;
+	}
+
+	entry->data = lha_malloc(data_len + 1);
+
+	if (entry->data == NULL) {
+		lha_free(entry);
+		return;
+	}
+
+	memcpy(entry->data, data, data_len);
+	entry->data_len = data_len;
+	memcpy(entry->requested_method, method, 6);
+	entry->level = level;
+	entry->length = header->length;
+	entry->crc = header->crc;
+	memcpy(entry->compress_method, header->compress_method, 6);
+
+	b = hash_entry(entry->length, entry->crc);
+	entry->bucket_next = cache->buckets[b];
+	cache->buckets[b] = entry;
+
+	entry->next = NULL;
+
+	if (cache->newest != NULL) {
+		cache->newest->next = entry;
+	} else {
+		cache->oldest = entry;
+	}
+
+	cache->newest = entry;
+	cache->size += size;
+}
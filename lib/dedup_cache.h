@@ -0,0 +1,121 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_DEDUP_CACHE_H
+#define LHASA_DEDUP_CACHE_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "lha_file_header.h"
+
+#define DEDUP_CACHE_BUCKETS 1024
+
+typedef struct _LHADedupEntry LHADedupEntry;
+typedef struct _LHADedupCache LHADedupCache;
+
+// Compressed data for a file that has been written to an archive, so
+// that it can be reused if a later file has the same contents.
+
+struct _LHADedupEntry {
+
+	// The compression method and level that were requested for the
+	// file; the data is only reused for files written with the same.
+
+	char requested_method[6];
+	int level;
+
+	// Length and CRC of the uncompressed data.
+
+	uint64_t length;
+	uint16_t crc;
+
+	// The compression method actually used, and the compressed data.
+
+	char compress_method[6];
+	uint8_t *data;
+	size_t data_len;
+
+	LHADedupEntry *next, *bucket_next;
+};
+
+// Cache of the compressed data of files written by LHAWriter. Entries
+// are looked up by the length and CRC of the uncompressed data, and
+// checked by decompressing them. The oldest entries are discarded to
+// keep the total size within a limit.
+
+struct _LHADedupCache {
+	LHADedupEntry *buckets[DEDUP_CACHE_BUCKETS];
+	LHADedupEntry *oldest, *newest;
+	size_t size, max_size;
+};
+
+/**
+ * Initialize a @ref LHADedupCache structure.
+ *
+ * @param cache        The cache structure to initialize.
+ * @param max_size     Limit on the total size of the cached data.
+ */
+
+void lha_dedup_cache_init(LHADedupCache *cache, size_t max_size);
+
+/**
+ * Free all the entries in a @ref LHADedupCache structure.
+ *
+ * @param cache        The cache structure.
+ */
+
+void lha_dedup_cache_free(LHADedupCache *cache);
+
+/**
+ * Look for a file with the given contents in the cache.
+ *
+ * @param cache        The cache structure.
+ * @param method       Compression method requested for the file.
+ * @param level        Compression level requested for the file.
+ * @param data         Uncompressed contents of the file.
+ * @param data_len     Length of the file.
+ * @param crc          CRC of the file contents.
+ * @return             Pointer to the entry for a file with the same
+ *                     contents, or NULL if there is none.
+ */
+
+const LHADedupEntry *lha_dedup_cache_find(LHADedupCache *cache,
+                                          const char *method, int level,
+                                          const uint8_t *data,
+                                          size_t data_len, uint16_t crc);
+
+/**
+ * Add a file to the cache, if it is not too large.
+ *
+ * @param cache        The cache structure.
+ * @param method       Compression method requested for the file.
+ * @param level        Compression level requested for the file.
+ * @param header       Header of the file as written, containing the
+ *                     method used, length and CRC.
+ * @param data         Compressed data for the file, which is copied.
+ * @param data_len     Length of the compressed data.
+ */
+
+void lha_dedup_cache_add(LHADedupCache *cache, const char *method,
+                         int level, LHAFileHeader *header,
+                         const uint8_t *data, size_t data_len);
+
+#endif /* #ifndef LHASA_DEDUP_CACHE_H */
@@ -22,6 +22,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <string.h>
 
 #include "ext_header.h"
+#include "lha_allocator.h"
 #include "lha_endian.h"
 
 //
@@ -78,6 +79,19 @@ typedef struct {
 	/** Minimum length for a header of this type. */
 	size_t min_len;
 
+	/**
+	 * Callback function for encoding an extended header block, or
+	 * NULL if headers of this type are never written.
+	 *
+	 * @param header     The file header containing the data to encode.
+	 * @param data       Pointer to a buffer in which to store the
+	 *                   encoded data, or NULL to just calculate its
+	 *                   length.
+	 * @return           Length of the encoded data, or zero if there
+	 *                   is no header of this type for the file.
+	 */
+	size_t (*encoder)(LHAFileHeader *header, uint8_t *data);
+
 } LHAExtHeaderType;
 
 // Common header (0x00).
@@ -107,10 +121,23 @@ static int ext_header_common_decoder(LHAFileHeader *header,
 	return 1;
 }
 
+// The CRC is calculated once the rest of the header has been encoded;
+// see lha_file_header_encode().
+
+static size_t ext_header_common_encoder(LHAFileHeader *header, uint8_t *data)
+{
+	if (data != NULL) {
+		lha_encode_uint16(data, 0);
+	}
+
+	return 2;
+}
+
 static const LHAExtHeaderType lha_ext_header_common = {
 	LHA_EXT_HEADER_COMMON,
 	ext_header_common_decoder,
-	2
+	2,
+	ext_header_common_encoder
 };
 
 // Filename header (0x01).
@@ -126,7 +153,7 @@ static int ext_header_filename_decoder(LHAFileHeader *header,
 	char *new_filename;
 	unsigned int i;
 
-	new_filename = malloc(data_len + 1);
+	new_filename = lha_malloc(data_len + 1);
 
 	if (new_filename == NULL) {
 		return 0;
@@ -145,16 +172,95 @@ static int ext_header_filename_decoder(LHAFileHeader *header,
 		}
 	}
 
-	free(header->filename);
+	lha_free(header->filename);
 	header->filename = new_filename;
 
 	return 1;
 }
 
+// Symbolic links are stored as "path/filename|target", divided between
+// the path and filename headers at the last path separator, as the Unix
+// LHA tool does; parse_symlink() in lha_file_header.c joins them back
+// together. This gets the pieces of the joined string, and returns the
+// length of the part of it that goes in the path header.
+
+static size_t symlink_pieces(LHAFileHeader *header, const char *pieces[4])
+{
+	const char *p;
+
+	pieces[0] = header->path != NULL ? header->path : "";
+	pieces[1] = header->filename;
+	pieces[2] = "|";
+	pieces[3] = header->symlink_target;
+
+	p = strrchr(pieces[3], '/');
+
+	if (p != NULL) {
+		return strlen(pieces[0]) + strlen(pieces[1]) + 1
+		     + (size_t) (p - pieces[3]) + 1;
+	}
+
+	p = strrchr(pieces[0], '/');
+
+	if (p != NULL) {
+		return (size_t) (p - pieces[0]) + 1;
+	}
+
+	return 0;
+}
+
+// Copy the part of the joined string from position 'start' onwards,
+// and up to 'end' if it is not zero. Returns the length of the part.
+
+static size_t copy_pieces(const char *pieces[4], size_t start, size_t end,
+                          uint8_t *data)
+{
+	size_t pos, len, i, j;
+
+	pos = 0;
+
+	for (i = 0; i < 4; ++i) {
+		len = strlen(pieces[i]);
+
+		for (j = 0; j < len && (end == 0 || pos < end); ++j, ++pos) {
+			if (data != NULL && pos >= start) {
+				data[pos - start] = (uint8_t) pieces[i][j];
+			}
+		}
+	}
+
+	return pos - start;
+}
+
+static size_t ext_header_filename_encoder(LHAFileHeader *header,
+                                          uint8_t *data)
+{
+	const char *pieces[4];
+	size_t len;
+
+	if (header->filename == NULL) {
+		return 0;
+	}
+
+	if (header->symlink_target != NULL) {
+		return copy_pieces(pieces, symlink_pieces(header, pieces),
+		                   0, data);
+	}
+
+	len = strlen(header->filename);
+
+	if (data != NULL) {
+		memcpy(data, header->filename, len);
+	}
+
+	return len;
+}
+
 static const LHAExtHeaderType lha_ext_header_filename = {
 	LHA_EXT_HEADER_FILENAME,
 	ext_header_filename_decoder,
-	1
+	1,
+	ext_header_filename_encoder
 };
 
 // Path header (0x02).
@@ -170,7 +276,7 @@ static int ext_header_path_decoder(LHAFileHeader *header,
 	unsigned int i;
 	uint8_t *new_path;
 
-	new_path = malloc(data_len + 2);
+	new_path = lha_malloc(data_len + 2);
 
 	if (new_path == NULL) {
 		return 0;
@@ -189,7 +295,7 @@ static int ext_header_path_decoder(LHAFileHeader *header,
 		++data_len;
 	}
 
-	free(header->path);
+	lha_free(header->path);
 	header->path = (char *) new_path;
 
 	for (i = 0; i < data_len; ++i) {
@@ -201,10 +307,59 @@ static int ext_header_path_decoder(LHAFileHeader *header,
 	return 1;
 }
 
+static size_t ext_header_path_encoder(LHAFileHeader *header, uint8_t *data)
+{
+	const char *pieces[4];
+	size_t i, len;
+
+	if (header->symlink_target != NULL && header->filename != NULL) {
+
+		// This part of a symbolic link always ends with a path
+		// separator, if there is one.
+
+		len = symlink_pieces(header, pieces);
+
+		if (len == 0) {
+			return 0;
+		}
+
+		copy_pieces(pieces, 0, len, data);
+	} else if (header->path != NULL && header->path[0] != '\0') {
+		len = strlen(header->path);
+
+		if (data != NULL) {
+			memcpy(data, header->path, len);
+		}
+
+		// Add the terminating path separator if it is missing.
+
+		if (header->path[len - 1] != '/') {
+			if (data != NULL) {
+				data[len] = '/';
+			}
+
+			++len;
+		}
+	} else {
+		return 0;
+	}
+
+	if (data != NULL) {
+		for (i = 0; i < len; ++i) {
+			if (data[i] == '/') {
+				data[i] = 0xff;
+			}
+		}
+	}
+
+	return len;
+}
+
 static const LHAExtHeaderType lha_ext_header_path = {
 	LHA_EXT_HEADER_PATH,
 	ext_header_path_decoder,
-	1
+	1,
+	ext_header_path_encoder
 };
 
 // Windows timestamp header (0x41).
@@ -225,10 +380,27 @@ static int ext_header_windows_timestamps(LHAFileHeader *header,
 	return 1;
 }
 
+static size_t ext_header_windows_timestamps_encoder(LHAFileHeader *header,
+                                                    uint8_t *data)
+{
+	if (!LHA_FILE_HAVE_EXTRA(header, LHA_FILE_WINDOWS_TIMESTAMPS)) {
+		return 0;
+	}
+
+	if (data != NULL) {
+		lha_encode_uint64(data, header->win_creation_time);
+		lha_encode_uint64(data + 8, header->win_modification_time);
+		lha_encode_uint64(data + 16, header->win_access_time);
+	}
+
+	return 24;
+}
+
 static const LHAExtHeaderType lha_ext_header_windows_timestamps = {
 	LHA_EXT_HEADER_WINDOWS_TIMESTAMPS,
 	ext_header_windows_timestamps,
-	24
+	24,
+	ext_header_windows_timestamps_encoder
 };
 
 // File sizes header (0x42).
@@ -261,10 +433,26 @@ static int ext_header_file_size_decoder(LHAFileHeader *header, uint8_t *data,
 	return 1;
 }
 
+static size_t ext_header_file_size_encoder(LHAFileHeader *header,
+                                           uint8_t *data)
+{
+	if (!LHA_FILE_HAVE_EXTRA(header, LHA_FILE_64BIT_SIZES)) {
+		return 0;
+	}
+
+	if (data != NULL) {
+		lha_encode_uint64(data, header->compressed_length);
+		lha_encode_uint64(data + 8, header->length);
+	}
+
+	return 16;
+}
+
 static const LHAExtHeaderType lha_ext_header_file_sizes = {
 	LHA_EXT_HEADER_FILE_SIZES,
 	ext_header_file_size_decoder,
-	16
+	16,
+	ext_header_file_size_encoder
 };
 
 // Unix permissions header (0x50).
@@ -279,10 +467,38 @@ static int ext_header_unix_perms_decoder(LHAFileHeader *header,
 	return 1;
 }
 
+static size_t ext_header_unix_perms_encoder(LHAFileHeader *header,
+                                            uint8_t *data)
+{
+	unsigned int perms;
+
+	// OS-9/68k LHA stores OS-9 permissions in this header (see the
+	// decoder in lha_file_header.c).
+
+	if (header->os_type == LHA_OS_TYPE_OS9_68K) {
+		if (!LHA_FILE_HAVE_EXTRA(header, LHA_FILE_OS9_PERMS)) {
+			return 0;
+		}
+
+		perms = header->os9_perms;
+	} else if (LHA_FILE_HAVE_EXTRA(header, LHA_FILE_UNIX_PERMS)) {
+		perms = header->unix_perms;
+	} else {
+		return 0;
+	}
+
+	if (data != NULL) {
+		lha_encode_uint16(data, (uint16_t) perms);
+	}
+
+	return 2;
+}
+
 static const LHAExtHeaderType lha_ext_header_unix_perms = {
 	LHA_EXT_HEADER_UNIX_PERMISSION,
 	ext_header_unix_perms_decoder,
-	2
+	2,
+	ext_header_unix_perms_encoder
 };
 
 // Unix UID/GID header (0x51).
@@ -298,10 +514,26 @@ static int ext_header_unix_uid_gid_decoder(LHAFileHeader *header,
 	return 1;
 }
 
+static size_t ext_header_unix_uid_gid_encoder(LHAFileHeader *header,
+                                              uint8_t *data)
+{
+	if (!LHA_FILE_HAVE_EXTRA(header, LHA_FILE_UNIX_UID_GID)) {
+		return 0;
+	}
+
+	if (data != NULL) {
+		lha_encode_uint16(data, (uint16_t) header->unix_gid);
+		lha_encode_uint16(data + 2, (uint16_t) header->unix_uid);
+	}
+
+	return 4;
+}
+
 static const LHAExtHeaderType lha_ext_header_unix_uid_gid = {
 	LHA_EXT_HEADER_UNIX_UID_GID,
 	ext_header_unix_uid_gid_decoder,
-	4
+	4,
+	ext_header_unix_uid_gid_encoder
 };
 
 // Unix username header (0x53).
@@ -315,7 +547,7 @@ static int ext_header_unix_username_decoder(LHAFileHeader *header,
 {
 	char *username;
 
-	username = malloc(data_len + 1);
+	username = lha_malloc(data_len + 1);
 
 	if (username == NULL) {
 		return 0;
@@ -324,16 +556,42 @@ static int ext_header_unix_username_decoder(LHAFileHeader *header,
 	memcpy(username, data, data_len);
 	username[data_len] = '\0';
 
-	free(header->unix_username);
+	lha_free(header->unix_username);
 	header->unix_username = username;
 
 	return 1;
 }
 
+// Encode a string header: the username and group headers.
+
+static size_t encode_string(char *value, uint8_t *data)
+{
+	size_t len;
+
+	if (value == NULL) {
+		return 0;
+	}
+
+	len = strlen(value);
+
+	if (data != NULL) {
+		memcpy(data, value, len);
+	}
+
+	return len;
+}
+
+static size_t ext_header_unix_username_encoder(LHAFileHeader *header,
+                                               uint8_t *data)
+{
+	return encode_string(header->unix_username, data);
+}
+
 static const LHAExtHeaderType lha_ext_header_unix_username = {
 	LHA_EXT_HEADER_UNIX_USER,
 	ext_header_unix_username_decoder,
-	1
+	1,
+	ext_header_unix_username_encoder
 };
 
 // Unix group header (0x52).
@@ -348,7 +606,7 @@ static int ext_header_unix_group_decoder(LHAFileHeader *header,
 {
 	char *group;
 
-	group = malloc(data_len + 1);
+	group = lha_malloc(data_len + 1);
 
 	if (group == NULL) {
 		return 0;
@@ -357,22 +615,30 @@ static int ext_header_unix_group_decoder(LHAFileHeader *header,
 	memcpy(group, data, data_len);
 	group[data_len] = '\0';
 
-	free(header->unix_group);
+	lha_free(header->unix_group);
 	header->unix_group = group;
 
 	return 1;
 }
 
+static size_t ext_header_unix_group_encoder(LHAFileHeader *header,
+                                            uint8_t *data)
+{
+	return encode_string(header->unix_group, data);
+}
+
 static const LHAExtHeaderType lha_ext_header_unix_group = {
 	LHA_EXT_HEADER_UNIX_GROUP,
 	ext_header_unix_group_decoder,
-	1
+	1,
+	ext_header_unix_group_encoder
 };
 
 // Unix timestamp header (0x54).
 //
 // This stores a 32-bit Unix time_t timestamp representing the
-// modification time of the file.
+// modification time of the file. It is not written, as level 2 headers
+// already store a Unix timestamp.
 
 static int ext_header_unix_timestamp_decoder(LHAFileHeader *header,
                                              uint8_t *data,
@@ -386,7 +652,8 @@ static int ext_header_unix_timestamp_decoder(LHAFileHeader *header,
 static const LHAExtHeaderType lha_ext_header_unix_timestamp = {
 	LHA_EXT_HEADER_UNIX_TIMESTAMP,
 	ext_header_unix_timestamp_decoder,
-	4
+	4,
+	NULL
 };
 
 // OS-9 (6809) header (0xcc)
@@ -410,10 +677,12 @@ static int ext_header_os9_decoder(LHAFileHeader *header,
 static const LHAExtHeaderType lha_ext_header_os9 = {
 	LHA_EXT_HEADER_OS9,
 	ext_header_os9_decoder,
-	12
+	12,
+	NULL
 };
 
-// Table of extended headers.
+// Table of extended headers. Headers are encoded in this order; the
+// common header must be first.
 
 static const LHAExtHeaderType *const ext_header_types[] = {
 	&lha_ext_header_common,
@@ -471,3 +740,45 @@ int lha_ext_header_decode(LHAFileHeader *header,
 
 	return htype->decoder(header, data, data_len);
 }
+
+size_t lha_ext_header_encode(LHAFileHeader *header, uint8_t *buf)
+{
+	const LHAExtHeaderType *htype;
+	size_t len, data_len;
+	unsigned int i;
+
+	len = 0;
+
+	for (i = 0; i < NUM_HEADER_TYPES; ++i) {
+		htype = ext_header_types[i];
+
+		if (htype->encoder == NULL) {
+			continue;
+		}
+
+		// Each header is preceded by its length, which includes
+		// the length field and the header type byte.
+
+		data_len = htype->encoder(header,
+		                          buf != NULL ? buf + len + 3 : NULL);
+
+		if (data_len == 0) {
+			continue;
+		}
+
+		if (buf != NULL) {
+			lha_encode_uint16(buf + len, (uint16_t) (data_len + 3));
+			buf[len + 2] = htype->num;
+		}
+
+		len += data_len + 3;
+	}
+
+	// A zero length ends the chain.
+
+	if (buf != NULL) {
+		lha_encode_uint16(buf + len, 0);
+	}
+
+	return len + 2;
+}
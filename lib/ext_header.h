@@ -40,4 +40,18 @@ int lha_ext_header_decode(LHAFileHeader *header,
                           uint8_t *data,
                           size_t data_len);
 
+/**
+ * Encode the extended headers for a file header, in the format used by
+ * level 2 headers: each header is preceded by a 16-bit length field,
+ * and the last is followed by a zero length. The "common" header is
+ * always the first, with its CRC field set to zero.
+ *
+ * @param header    The file header containing the data to encode.
+ * @param buf       Pointer to a buffer in which to store the encoded
+ *                  headers, or NULL to just calculate their length.
+ * @return          Length of the encoded headers, in bytes.
+ */
+
+size_t lha_ext_header_encode(LHAFileHeader *header, uint8_t *buf);
+
 #endif /* #ifndef LHASA_EXT_HEADER_H */
@@ -55,22 +55,33 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define COPY_THRESHOLD       3 /* bytes */
 
-// Required size of the output buffer.  At most, a single call to read()
-// might result in a copy of the entire ring buffer.
+// Maximum number of bytes that a single copy code can output.
+
+#define MAX_COPY_LENGTH      (NUM_CODES - 0x100 - 1 + COPY_THRESHOLD)
+
+// Size of the output buffer. Each call to read() decodes codes until
+// the buffer is too full to be sure of holding the output of another.
 
 #define OUTPUT_BUFFER_SIZE   RING_BUFFER_SIZE
 
-typedef struct {
+// Number of bits decoded at once by the lookup table used to traverse
+// the top levels of the code tree.
+
+#define DECODE_TABLE_BITS    8
+
+// Flag set in the child field of a node to mark it as a leaf node.
 
-	// If true, this node is a leaf node.
+#define NODE_LEAF            0x8000
 
-	unsigned int leaf        :1;
+typedef struct {
 
-	// If this is a leaf node, child_index is the code represented by
-	// this node. Otherwise, nodes[child_index] and nodes[child_index-1]
-	// are the children of this node.
+	// If the NODE_LEAF bit is set, this is a leaf node and the
+	// remaining bits are the code represented by this node.
+	// Otherwise, nodes[child] and nodes[child-1] are the children of
+	// this node. Packing both into a single field means that nodes
+	// can be swapped in a single operation.
 
-	unsigned int child_index :15;
+	uint16_t child;
 
 	// Index of the parent node of this node.
 
@@ -121,6 +132,20 @@ typedef struct {
 
 	uint16_t group_leader[NUM_TREE_NODES];
 
+	// Lookup table used to decode the first DECODE_TABLE_BITS bits of
+	// a code. Maps from the next bits in the input stream to the node
+	// reached (high bits) and the number of bits consumed (low 4 bits).
+
+	uint16_t decode_table[1 << DECODE_TABLE_BITS];
+
+	// Branch nodes that were traversed when building decode_table.
+	// If the children of one of these change, the table is stale and
+	// decode_table_dirty is set so that it is rebuilt before the next
+	// code is read.
+
+	uint8_t in_decode_table[NUM_TREE_NODES];
+	int decode_table_dirty;
+
 	// Offset lookup table.  Maps from a byte value (sequence of next
 	// 8 bits from input stream) to an offset value.
 
@@ -129,6 +154,10 @@ typedef struct {
 	// Length of offsets, in bits.
 
 	uint8_t offset_lengths[NUM_OFFSETS];
+
+	// Counters, if being collected.
+
+	LHAStats *stats;
 } LHALH1Decoder;
 
 // Frequency distribution used to calculate the offset codes.
@@ -192,8 +221,7 @@ static void init_tree(LHALH1Decoder *decoder)
 
 	for (i = 0; i < NUM_CODES; ++i) {
 		node = &decoder->nodes[node_index];
-		node->leaf = 1;
-		node->child_index = (unsigned short) i;
+		node->child = (uint16_t) (NODE_LEAF | i);
 		node->freq = 1;
 		node->group = leaf_group;
 
@@ -210,12 +238,11 @@ static void init_tree(LHALH1Decoder *decoder)
 
 	while (node_index >= 0) {
 		node = &decoder->nodes[node_index];
-		node->leaf = 0;
 
 		// Set child pointer and update the parent pointers of the
 		// children.
 
-		node->child_index = child;
+		node->child = (uint16_t) child;
 		decoder->nodes[child].parent = (uint16_t) node_index;
 		decoder->nodes[child - 1].parent = (uint16_t) node_index;
 
@@ -243,6 +270,8 @@ static void init_tree(LHALH1Decoder *decoder)
 		--node_index;
 		child -= 2;
 	}
+
+	decoder->decode_table_dirty = 1;
 }
 
 // Fill in a range of values in the offset_lookup table, which have
@@ -332,9 +361,18 @@ static int lha_lh1_init(void *data, LHADecoderCallback callback,
 	init_offset_table(decoder);
 	init_ring_buffer(decoder);
 
+	decoder->stats = NULL;
+
 	return 1;
 }
 
+static void lha_lh1_set_stats(void *data, LHAStats *stats)
+{
+	LHALH1Decoder *decoder = data;
+
+	decoder->stats = stats;
+}
+
 // Make the given node the leader of its group: swap it with the current
 // leader so that it is in the left-most position.  Returns the new index
 // of the node.
@@ -345,7 +383,7 @@ static uint16_t make_group_leader(LHALH1Decoder *decoder,
 	Node *node, *leader;
 	uint16_t group;
 	uint16_t leader_index;
-	unsigned int tmp;
+	uint16_t tmp;
 
 	group = decoder->nodes[node_index].group;
 	leader_index = decoder->group_leader[group];
@@ -359,28 +397,32 @@ static uint16_t make_group_leader(LHALH1Decoder *decoder,
 	node = &decoder->nodes[node_index];
 	leader = &decoder->nodes[leader_index];
 
-	// Swap leaf and child indices in the two nodes:
+	// If either node was used to build the decode table, the table
+	// no longer reflects the shape of the tree.
 
-	tmp = leader->leaf;
-	leader->leaf = node->leaf;
-	node->leaf = tmp;
+	if (decoder->in_decode_table[node_index]
+	 || decoder->in_decode_table[leader_index]) {
+		decoder->decode_table_dirty = 1;
+	}
+
+	// Swap the contents of the two nodes:
 
-	tmp = leader->child_index;
-	leader->child_index = node->child_index;
-	node->child_index = tmp;
+	tmp = leader->child;
+	leader->child = node->child;
+	node->child = tmp;
 
-	if (node->leaf) {
-		decoder->leaf_nodes[node->child_index] = node_index;
+	if (node->child & NODE_LEAF) {
+		decoder->leaf_nodes[node->child & ~NODE_LEAF] = node_index;
 	} else {
-		decoder->nodes[node->child_index].parent = node_index;
-		decoder->nodes[node->child_index - 1].parent = node_index;
+		decoder->nodes[node->child].parent = node_index;
+		decoder->nodes[node->child - 1].parent = node_index;
 	}
 
-	if (leader->leaf) {
-		decoder->leaf_nodes[leader->child_index] = leader_index;
+	if (leader->child & NODE_LEAF) {
+		decoder->leaf_nodes[leader->child & ~NODE_LEAF] = leader_index;
 	} else {
-		decoder->nodes[leader->child_index].parent = leader_index;
-		decoder->nodes[leader->child_index - 1].parent = leader_index;
+		decoder->nodes[leader->child].parent = leader_index;
+		decoder->nodes[leader->child - 1].parent = leader_index;
 	}
 
 	return leader_index;
@@ -446,9 +488,8 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 	leaf = decoder->nodes;
 
 	for (i = 0; i < NUM_TREE_NODES; ++i) {
-		if (decoder->nodes[i].leaf) {
-			leaf->leaf = 1;
-			leaf->child_index = decoder->nodes[i].child_index;
+		if (decoder->nodes[i].child & NODE_LEAF) {
+			leaf->child = decoder->nodes[i].child;
 
 			// Frequency of the nodes in the new tree is halved,
 			// this acts as a running average each time the
@@ -479,7 +520,8 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 
 		while ((int) child - i < 2) {
 			decoder->nodes[i] = *leaf;
-			decoder->leaf_nodes[leaf->child_index] = (uint16_t) i;
+			decoder->leaf_nodes[leaf->child & ~NODE_LEAF]
+			    = (uint16_t) i;
 
 			--i;
 			--leaf;
@@ -497,7 +539,8 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 
 		while (leaf >= decoder->nodes && freq >= leaf->freq) {
 			decoder->nodes[i] = *leaf;
-			decoder->leaf_nodes[leaf->child_index] = (uint16_t) i;
+			decoder->leaf_nodes[leaf->child & ~NODE_LEAF]
+			    = (uint16_t) i;
 
 			--i;
 			--leaf;
@@ -505,9 +548,8 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 
 		// The new branch node can now be inserted.
 
-		decoder->nodes[i].leaf = 0;
 		decoder->nodes[i].freq = (uint16_t) freq;
-		decoder->nodes[i].child_index = (uint16_t) child;
+		decoder->nodes[i].child = (uint16_t) child;
 
 		decoder->nodes[child].parent = (uint16_t) i;
 		decoder->nodes[child - 1].parent = (uint16_t) i;
@@ -544,6 +586,8 @@ static void reconstruct_tree(LHALH1Decoder *decoder)
 			decoder->group_leader[group] = (uint16_t) i;
 		}
 	}
+
+	decoder->decode_table_dirty = 1;
 }
 
 // Increment the counter for the specific code, reordering the tree as
@@ -558,6 +602,10 @@ static void increment_for_code(LHALH1Decoder *decoder, uint16_t code)
 
 	if (decoder->nodes[0].freq >= TREE_REORDER_LIMIT) {
 		reconstruct_tree(decoder);
+
+		if (decoder->stats != NULL) {
+			++decoder->stats->table_rebuilds;
+		}
 	}
 
 	++decoder->nodes[0].freq;
@@ -582,20 +630,76 @@ static void increment_for_code(LHALH1Decoder *decoder, uint16_t code)
 	}
 }
 
+// Fill in the entries in the decode table for codes that begin with
+// the given bits, which lead to the given node.
+
+static void fill_decode_table(LHALH1Decoder *decoder, unsigned int node_index,
+                              unsigned int code, unsigned int code_len)
+{
+	unsigned int child;
+	unsigned int i, start, count;
+	uint16_t entry;
+
+	child = decoder->nodes[node_index].child;
+
+	// Stop at leaf nodes, or when the table is exhausted. All
+	// entries that begin with this code map to this node.
+
+	if ((child & NODE_LEAF) != 0 || code_len >= DECODE_TABLE_BITS) {
+		start = code << (DECODE_TABLE_BITS - code_len);
+		count = 1U << (DECODE_TABLE_BITS - code_len);
+		entry = (uint16_t) ((node_index << 4) | code_len);
+
+		for (i = 0; i < count; ++i) {
+			decoder->decode_table[start + i] = entry;
+		}
+
+		return;
+	}
+
+	decoder->in_decode_table[node_index] = 1;
+
+	fill_decode_table(decoder, child, code << 1, code_len + 1);
+	fill_decode_table(decoder, child - 1, (code << 1) | 1, code_len + 1);
+}
+
+// Rebuild the decode table from the current state of the tree.
+
+static void build_decode_table(LHALH1Decoder *decoder)
+{
+	memset(decoder->in_decode_table, 0, sizeof(decoder->in_decode_table));
+	fill_decode_table(decoder, 0, 0, 0);
+	decoder->decode_table_dirty = 0;
+}
+
 // Read a code from the input stream.
 
 static int read_code(LHALH1Decoder *decoder, uint16_t *result)
 {
-	unsigned int node_index;
-	int bit;
+	unsigned int node_index, entry;
+	int bits, bit;
+
+	if (decoder->decode_table_dirty) {
+		build_decode_table(decoder);
+	}
 
-	// Start from the root node, and traverse down until a leaf is
-	// reached.
+	// Use the decode table to skip through the top levels of the
+	// tree. Near the end of the stream there may not be enough bits
+	// left to do this, in which case we start from the root node.
 
 	node_index = 0;
+	bits = peek_bits(&decoder->bit_stream_reader, DECODE_TABLE_BITS);
+
+	if (bits >= 0) {
+		entry = decoder->decode_table[bits];
+		read_bits(&decoder->bit_stream_reader, entry & 0xf);
+		node_index = entry >> 4;
+	}
+
+	// Traverse down the rest of the way until a leaf is reached.
 
 	//printf("<root ");
-	while (!decoder->nodes[node_index].leaf) {
+	while ((decoder->nodes[node_index].child & NODE_LEAF) == 0) {
 		bit = read_bit(&decoder->bit_stream_reader);
 
 		if (bit < 0) {
@@ -607,11 +711,11 @@ static int read_code(LHALH1Decoder *decoder, uint16_t *result)
 		// Choose one of the two children depending on the
 		// bit that was read.
 
-		node_index = decoder->nodes[node_index].child_index
+		node_index = decoder->nodes[node_index].child
 		           - (unsigned int) bit;
 	}
 
-	*result = decoder->nodes[node_index].child_index;
+	*result = decoder->nodes[node_index].child & ~NODE_LEAF;
 	//printf(" -> %i!>\n", *result);
 
 	increment_for_code(decoder, *result);
@@ -665,14 +769,14 @@ static void output_byte(LHALH1Decoder *decoder, uint8_t *buf,
 	decoder->ringbuf_pos = (decoder->ringbuf_pos + 1) % RING_BUFFER_SIZE;
 }
 
-static size_t lha_lh1_read(void *data, uint8_t *buf)
+// Decode a single command from the input stream, appending the output
+// to the buffer. Returns zero for failure.
+
+static int decode_command(LHALH1Decoder *decoder, uint8_t *buf,
+                          size_t *buf_len)
 {
-	LHALH1Decoder *decoder = data;
-	size_t result;
 	uint16_t code;
 
-	result = 0;
-
 	// Read the next code from the input stream.
 
 	if (!read_code(decoder, &code)) {
@@ -685,7 +789,11 @@ static size_t lha_lh1_read(void *data, uint8_t *buf)
 	// stream.
 
 	if (code < 0x100) {
-		output_byte(decoder, buf, &result, (uint8_t) code);
+		output_byte(decoder, buf, buf_len, (uint8_t) code);
+
+		if (decoder->stats != NULL) {
+			++decoder->stats->literals;
+		}
 	} else {
 		unsigned int count, start, i, pos, offset;
 
@@ -697,6 +805,11 @@ static size_t lha_lh1_read(void *data, uint8_t *buf)
 		}
 
 		count = code - 0x100U + COPY_THRESHOLD;
+
+		if (decoder->stats != NULL) {
+			lha_decoder_count_copy(decoder->stats, count);
+		}
+
 		start = decoder->ringbuf_pos - offset + RING_BUFFER_SIZE - 1;
 
 		// Copy from history into output buffer:
@@ -704,11 +817,32 @@ static size_t lha_lh1_read(void *data, uint8_t *buf)
 		for (i = 0; i < count; ++i) {
 			pos = (start + i) % RING_BUFFER_SIZE;
 
-			output_byte(decoder, buf, &result,
+			output_byte(decoder, buf, buf_len,
 			            decoder->ringbuf[pos]);
 		}
 	}
 
+	return 1;
+}
+
+static size_t lha_lh1_read(void *data, uint8_t *buf)
+{
+	LHALH1Decoder *decoder = data;
+	size_t result;
+
+	result = 0;
+
+	// Decode as many commands as will fit in the output buffer,
+	// rather than just one, to reduce the per-call overhead. If a
+	// read fails part way through, return the data decoded so far;
+	// the failure will be hit again on the next call.
+
+	while (result + MAX_COPY_LENGTH <= OUTPUT_BUFFER_SIZE) {
+		if (!decode_command(decoder, buf, &result)) {
+			break;
+		}
+	}
+
 	return result;
 }
 
@@ -718,5 +852,6 @@ const LHADecoderType lha_lh1_decoder = {
 	lha_lh1_read,
 	sizeof(LHALH1Decoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_lh1_set_stats
 };
@@ -0,0 +1,46 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+//
+// Encoder for the -lh6- algorithm.
+//
+
+// 32 KiB history. As with -lh5-, the decoder has a larger ring buffer
+// than the standard dictionary size.
+
+#define HISTORY_BITS    15   /* 2^15 = 32768 */
+
+// Number of bits to encode HISTORY_BITS:
+
+#define OFFSET_BITS     5
+
+// Name of the variable for the encoder:
+
+#define ENCODER_NAME lha_lh6_encoder
+
+// Number of different command codes. 0-255 range are literal byte
+// values, while higher values indicate copy from history.
+
+#define NUM_CODES            510
+
+// The actual algorithm code is contained in lh_new_encoder.c, which
+// acts as a template for -lh5-, -lh6- and -lh7-.
+
+#include "lh_new_encoder.c"
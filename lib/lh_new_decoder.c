@@ -47,10 +47,18 @@ typedef uint16_t TreeElement;
 
 #define RING_BUFFER_SIZE     (1 << HISTORY_BITS)
 
-// Required size of the output buffer.  At most, a single call to read()
-// might result in a copy of the entire ring buffer.
+// Maximum number of bytes that a single copy command can output.
 
-#define OUTPUT_BUFFER_SIZE   RING_BUFFER_SIZE
+#ifdef LHARK
+#define MAX_COPY_LENGTH      514
+#else
+#define MAX_COPY_LENGTH      (NUM_CODES - 256 - 1 + COPY_THRESHOLD)
+#endif
+
+// Size of the output buffer. Each call to read() decodes commands until
+// the buffer is too full to be sure of holding the output of another.
+
+#define OUTPUT_BUFFER_SIZE   4096
 
 // Number of possible codes in the "temporary table" used to encode the
 // codes table. This is a function of the number of bits used to encode
@@ -64,6 +72,12 @@ typedef uint16_t TreeElement;
 
 #define MAX_OFFSET_CODES     ((1 << OFFSET_BITS) - 1)
 
+// Number of bits decoded in a single step by the lookup tables built
+// for the code and offset trees.
+
+#define CODE_LOOKUP_BITS     10
+#define OFFSET_LOOKUP_BITS   8
+
 typedef struct {
 	// Input bit stream.
 
@@ -87,10 +101,22 @@ typedef struct {
 
 	TreeElement code_tree[NUM_CODES * 2];
 
+	// Lookup table built from code_tree to decode codes quickly.
+
+	TreeLookupEntry code_lookup[1 << CODE_LOOKUP_BITS];
+
 	// Table used to encode the offset tree, used to read offsets
 	// into the history buffer.
 
 	TreeElement offset_tree[MAX_OFFSET_CODES * 2];
+
+	// Lookup table built from offset_tree.
+
+	TreeLookupEntry offset_lookup[1 << OFFSET_LOOKUP_BITS];
+
+	// Counters, if being collected.
+
+	LHAStats *stats;
 } LHANewDecoder;
 
 // Initialize the history ring buffer.
@@ -125,9 +151,18 @@ static int lha_lh_new_init(void *data, LHADecoderCallback callback,
 	init_tree(decoder->offset_tree, MAX_OFFSET_CODES * 2);
 	init_tree(decoder->temp_tree, MAX_TEMP_CODES * 2);
 
+	decoder->stats = NULL;
+
 	return 1;
 }
 
+static void lha_lh_new_set_stats(void *data, LHAStats *stats)
+{
+	LHANewDecoder *decoder = data;
+
+	decoder->stats = stats;
+}
+
 // Read a length value - this is normally a value in the 0-7 range, but
 // sometimes can be longer.
 
@@ -427,6 +462,17 @@ static int start_new_block(LHANewDecoder *decoder)
 		return 0;
 	}
 
+	// Build lookup tables for the new trees.
+
+	build_tree_lookup(decoder->code_tree, decoder->code_lookup,
+	                  CODE_LOOKUP_BITS);
+	build_tree_lookup(decoder->offset_tree, decoder->offset_lookup,
+	                  OFFSET_LOOKUP_BITS);
+
+	if (decoder->stats != NULL) {
+		++decoder->stats->table_rebuilds;
+	}
+
 	return 1;
 }
 
@@ -435,7 +481,9 @@ static int start_new_block(LHANewDecoder *decoder)
 
 static int read_code(LHANewDecoder *decoder)
 {
-	return read_from_tree(&decoder->bit_stream_reader, decoder->code_tree);
+	return read_from_tree_lookup(&decoder->bit_stream_reader,
+	                             decoder->code_tree, decoder->code_lookup,
+	                             CODE_LOOKUP_BITS);
 }
 
 #ifdef LHARK
@@ -465,8 +513,10 @@ static int read_offset_code(LHANewDecoder *decoder)
 {
 	int bits;
 
-	bits = read_from_tree(&decoder->bit_stream_reader,
-	                      decoder->offset_tree);
+	bits = read_from_tree_lookup(&decoder->bit_stream_reader,
+	                             decoder->offset_tree,
+	                             decoder->offset_lookup,
+	                             OFFSET_LOOKUP_BITS);
 
 	if (bits < 0) {
 		return -1;
@@ -518,8 +568,8 @@ static void output_byte(LHANewDecoder *decoder, uint8_t *buf,
 
 // Copy a block from the history buffer.
 
-static void copy_from_history(LHANewDecoder *decoder, uint8_t *buf,
-                              size_t *buf_len, size_t count)
+static int copy_from_history(LHANewDecoder *decoder, uint8_t *buf,
+                             size_t *buf_len, size_t count)
 {
 	int offset;
 	unsigned int i, start;
@@ -527,7 +577,7 @@ static void copy_from_history(LHANewDecoder *decoder, uint8_t *buf,
 	offset = read_offset_code(decoder);
 
 	if (offset < 0) {
-		return;
+		return 0;
 	}
 
 	start = decoder->ringbuf_pos + RING_BUFFER_SIZE
@@ -537,6 +587,8 @@ static void copy_from_history(LHANewDecoder *decoder, uint8_t *buf,
 		output_byte(decoder, buf, buf_len,
 		            decoder->ringbuf[(start + i) % RING_BUFFER_SIZE]);
 	}
+
+	return 1;
 }
 
 #ifdef LHARK
@@ -559,10 +611,12 @@ static int lhark_decode_copy_count(LHANewDecoder *decoder, int code)
 }
 #endif
 
-static size_t lha_lh_new_read(void *data, uint8_t *buf)
+// Decode a single command from the input stream, appending the output
+// to the buffer. Returns zero for failure.
+
+static int decode_command(LHANewDecoder *decoder, uint8_t *buf,
+                          size_t *buf_len)
 {
-	LHANewDecoder *decoder = data;
-	size_t result;
 	int code, copy_count;
 
 	// Start of new block?
@@ -577,8 +631,6 @@ static size_t lha_lh_new_read(void *data, uint8_t *buf)
 
 	// Read next command from input stream.
 
-	result = 0;
-
 	code = read_code(decoder);
 
 	if (code < 0) {
@@ -588,7 +640,11 @@ static size_t lha_lh_new_read(void *data, uint8_t *buf)
 	// The code may be either a literal byte value or a copy command.
 
 	if (code < 256) {
-		output_byte(decoder, buf, &result, (uint8_t) code);
+		output_byte(decoder, buf, buf_len, (uint8_t) code);
+
+		if (decoder->stats != NULL) {
+			++decoder->stats->literals;
+		}
 	} else {
 #ifdef LHARK
 		copy_count = lhark_decode_copy_count(decoder, code);
@@ -599,7 +655,34 @@ static size_t lha_lh_new_read(void *data, uint8_t *buf)
 		copy_count = code - 256 + COPY_THRESHOLD;
 #endif
 
-		copy_from_history(decoder, buf, &result, copy_count);
+		if (decoder->stats != NULL) {
+			lha_decoder_count_copy(decoder->stats,
+			                       (size_t) copy_count);
+		}
+
+		return copy_from_history(decoder, buf, buf_len,
+		                         (size_t) copy_count);
+	}
+
+	return 1;
+}
+
+static size_t lha_lh_new_read(void *data, uint8_t *buf)
+{
+	LHANewDecoder *decoder = data;
+	size_t result;
+
+	result = 0;
+
+	// Decode as many commands as will fit in the output buffer,
+	// rather than just one, to reduce the per-call overhead. If a
+	// read fails part way through, return the data decoded so far;
+	// the failure will be hit again on the next call.
+
+	while (result + MAX_COPY_LENGTH <= OUTPUT_BUFFER_SIZE) {
+		if (!decode_command(decoder, buf, &result)) {
+			break;
+		}
 	}
 
 	return result;
@@ -611,7 +694,8 @@ const LHADecoderType DECODER_NAME = {
 	lha_lh_new_read,
 	sizeof(LHANewDecoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE / 2
+	RING_BUFFER_SIZE / 2,
+	lha_lh_new_set_stats
 };
 
 // This is a hack for -lh4-:
@@ -623,6 +707,7 @@ const LHADecoderType DECODER2_NAME = {
 	lha_lh_new_read,
 	sizeof(LHANewDecoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE / 4
+	RING_BUFFER_SIZE / 4,
+	lha_lh_new_set_stats
 };
 #endif
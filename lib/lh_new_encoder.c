@@ -0,0 +1,2012 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Encoder for "new-style" LHA algorithms, used with LHA v2 and onwards
+// (-lh5-, -lh6-, -lh7-).
+//
+// This file is designed to be a template. It is #included by other
+// files to generate an optimized encoder. The compressed data is in the
+// format read by lh_new_decoder.c.
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lha_allocator.h"
+#include "lha_arch.h"
+#include "lha_encoder.h"
+
+#include "bit_stream_writer.c"
+#include "tree_encode.c"
+
+// Threshold for copying. The first copy code starts from here.
+
+#define COPY_THRESHOLD       3 /* bytes */
+
+// Size of the history (dictionary), a power of two. Copies can be from
+// up to this many bytes back.
+
+#define HISTORY_SIZE         (1 << HISTORY_BITS)
+#define HISTORY_MASK         (HISTORY_SIZE - 1)
+
+// Maximum number of bytes that a single copy command can output.
+
+#define MAX_COPY_LENGTH      (NUM_CODES - 256 - 1 + COPY_THRESHOLD)
+
+// Number of offset codes: one for each possible bit length of an
+// offset, from zero to HISTORY_BITS bits.
+
+#define NUM_OFFSET_CODES     (HISTORY_BITS + 1)
+
+// Number of codes in the "temporary table" used to encode the code
+// table: three codes for runs of unused codes, then one for each code
+// length.
+
+#define NUM_TEMP_CODES       (MAX_CODE_LENGTH + 3)
+#define TEMP_CODE_BITS       5
+
+// Number of bits for the field containing the number of codes in the
+// code table.
+
+#define CODE_TABLE_BITS      9
+
+// Amount of data needed after a position before it can be compressed:
+// enough for a copy of the maximum length from each of the positions
+// looked at by lazy evaluation.
+
+#define LOOKAHEAD            (MAX_COPY_LENGTH + 2)
+
+// With optimal parsing, data is parsed in blocks of this many bytes,
+// each priced using the codes built from its own commands.
+
+#define OPTIMAL_BLOCK        16384
+
+// Optimal parsing: maximum number of matches recorded for each
+// position (one for each of the lengths at which the closest match
+// gets longer), and the number of times that each block is parsed.
+
+#define OPTIMAL_MATCHES      8
+#define OPTIMAL_PASSES       3
+
+// Price, in bits, given to a code that was not used in the last parse
+// of a block.
+
+#define UNUSED_PRICE         16
+
+// Input data is accumulated in a window that holds the history as well
+// as data still to be compressed. When the window is full, it is moved
+// down by WINDOW_SLIDE bytes. This must be a multiple of the history
+// size, so that the positions in the match finder stay valid, and of
+// OPTIMAL_BLOCK. There is room for one more optimal parsing block, as
+// optimal parsing may leave up to that much data uncompressed.
+
+#define WINDOW_SLIDE         (HISTORY_SIZE < 65536 ? 65536 : HISTORY_SIZE)
+#define WINDOW_SIZE          (HISTORY_SIZE + WINDOW_SLIDE + OPTIMAL_BLOCK \
+                              + LOOKAHEAD)
+
+// The match finders hash the first three bytes of each position, to
+// find earlier positions that might begin with the same bytes.
+
+#define HASH_BITS            15
+#define HASH_SIZE            (1 << HASH_BITS)
+#define NO_POSITION          0xffffffffUL
+
+typedef enum {
+	// Each hash value has a chain of positions, most recent first.
+	// Fast, but only finds the longest match if it is near the
+	// start of the chain.
+
+	MATCH_HASH_CHAIN,
+
+	// Each hash value has a binary search tree of positions, ordered
+	// by the data that follows them. Slower to update, but finds
+	// long matches in far fewer steps.
+
+	MATCH_BINARY_TREE
+} LHAMatchFinder;
+
+// Settings for each compression level.
+
+typedef struct {
+	LHAMatchFinder match_finder;
+
+	// Maximum number of positions examined by the match finder.
+
+	unsigned int chain_depth;
+
+	// A match at least this long is taken without looking further.
+
+	unsigned int nice_length;
+
+	// Lazy evaluation: before a match is used, check whether a longer
+	// match starts at the next one (1) or two (2) positions.
+
+	unsigned int lazy;
+
+	// If non-zero, use optimal parsing instead of lazy evaluation:
+	// find the cheapest sequence of commands for each block, priced
+	// using the codes that were built for the block the last time it
+	// was parsed.
+
+	int optimal;
+} LHALevelSettings;
+
+static const LHALevelSettings level_settings[] = {
+	{ MATCH_HASH_CHAIN,     4,  16, 0, 0 },    // 1
+	{ MATCH_HASH_CHAIN,     8,  32, 0, 0 },
+	{ MATCH_HASH_CHAIN,    16,  64, 1, 0 },
+	{ MATCH_HASH_CHAIN,    24,  64, 1, 0 },
+	{ MATCH_BINARY_TREE,   16,  64, 1, 0 },    // 5
+	{ MATCH_BINARY_TREE,   24, 128, 1, 0 },
+	{ MATCH_BINARY_TREE,   32, 128, 2, 0 },
+	{ MATCH_BINARY_TREE,   48, 256, 2, 0 },
+	{ MATCH_BINARY_TREE,  128, 256, 0, 1 },    // 9
+};
+
+// A match found for optimal parsing.
+
+typedef struct {
+	uint16_t len, offset;
+} LHAMatch;
+
+// A copy of the minimum length from further back than this is no
+// smaller than writing the bytes as literals.
+
+#define TOO_FAR              4096
+
+// Maximum number of commands in a block; the count is written as a
+// 16-bit field.
+
+#define BLOCK_COMMANDS       65535
+
+// Commands are collected in segments of this many commands. At the
+// end of each segment, the encoder decides whether to write the block
+// so far, so that the segment starts a new block with its own codes.
+
+#define SEGMENT_COMMANDS     8192
+
+// When looking for where to end a block in a segment, the segment is
+// divided into this many steps, then the steps around the best place
+// are divided again, this many times.
+
+#define SPLIT_STEPS          8
+#define SPLIT_ROUNDS         2
+
+// When compressing with more than one thread, the data is divided into
+// chunks of this size, and the commands for each chunk are found by a
+// separate parser. Each parser is first given the history before its
+// chunk, so copies can still refer back into the chunk before.
+
+#define PARALLEL_CHUNK       (1 << 20)
+#define MAX_THREADS          64
+
+// A chunk of data being compressed by a parser, and the commands found
+// for it: a code for each command, and the offset of each copy.
+
+typedef struct {
+	const uint8_t *data, *history;
+	unsigned int len, history_len;
+
+	uint16_t *codes, *offsets;
+	unsigned int num_codes, num_copies;
+} LHAChunk;
+
+typedef struct _LHANewEncoder LHANewEncoder;
+
+struct _LHANewEncoder {
+	// Output bit stream.
+
+	BitStreamWriter bit_stream_writer;
+
+	// Window containing the history and the data still to be
+	// compressed. window_pos is the position of the next byte to
+	// compress.
+
+	uint8_t window[WINDOW_SIZE];
+	unsigned int window_pos, window_len;
+
+	// Match finder settings.
+
+	LHAMatchFinder match_finder;
+	unsigned int chain_depth, nice_length, lazy;
+	int optimal;
+
+	// hash_head contains the most recent position for each hash
+	// value. With hash chains, the first half of 'links' links each
+	// position to the previous one with the same hash; with binary
+	// trees, it contains a pair of child nodes for each position.
+
+	uint32_t hash_head[HASH_SIZE];
+	uint32_t links[HISTORY_SIZE * 2];
+
+	// All positions before insert_pos have been added to the match
+	// finder. If insert_pos is past window_pos, the match at
+	// window_pos was already found by lazy evaluation, and is here.
+
+	unsigned int insert_pos;
+	unsigned int next_len, next_offset;
+
+	// Commands waiting to be written: a code for each command, and
+	// the offset of each copy. The commands from segment_start
+	// onwards (and the copies from segment_copies onwards) are in
+	// the current segment, which may yet start a new block.
+
+	uint16_t block_codes[BLOCK_COMMANDS];
+	uint16_t block_offsets[BLOCK_COMMANDS];
+	unsigned int block_len, block_copies;
+	unsigned int segment_start, segment_copies;
+
+	// Frequency of each code and offset code in the current block,
+	// before the current segment, and in the current segment.
+
+	uint32_t code_freq[NUM_CODES];
+	uint32_t offset_freq[NUM_OFFSET_CODES];
+	uint32_t segment_code_freq[NUM_CODES];
+	uint32_t segment_offset_freq[NUM_OFFSET_CODES];
+
+	// Estimated size of the current block before the current
+	// segment, calculated by block_bits().
+
+	unsigned int block_cost;
+
+	// Optimal parsing: the matches at each position in the block
+	// being compressed; the price of the cheapest way found to reach
+	// each position, and the length and offset of the last command
+	// on the way; and the commands on the cheapest path through the
+	// block, which are stored at the end of the arrays.
+
+	LHAMatch matches[OPTIMAL_BLOCK][OPTIMAL_MATCHES];
+	uint8_t num_matches[OPTIMAL_BLOCK];
+	uint32_t price[OPTIMAL_BLOCK + 1];
+	uint16_t path_len[OPTIMAL_BLOCK + 1];
+	uint16_t path_offset[OPTIMAL_BLOCK + 1];
+	uint16_t cmd_len[OPTIMAL_BLOCK];
+	uint16_t cmd_offset[OPTIMAL_BLOCK];
+
+	// Parallel compression: the number of threads, and a parser and
+	// chunk for each. The data for the chunks is collected in
+	// parallel_buf, after the history before it. If this is one of
+	// the parsers, 'chunk' is where its commands are stored.
+
+	unsigned int threads;
+	LHANewEncoder **parsers;
+	LHAChunk *chunks, *chunk;
+	uint8_t *parallel_buf;
+	unsigned int parallel_len, history_len;
+};
+
+static void lha_lh_new_set_level(void *data, unsigned int level)
+{
+	LHANewEncoder *encoder = data;
+	const LHALevelSettings *settings;
+
+	settings = &level_settings[level - LHA_ENCODER_MIN_LEVEL];
+
+	encoder->match_finder = settings->match_finder;
+	encoder->chain_depth = settings->chain_depth;
+	encoder->nice_length = settings->nice_length;
+	encoder->lazy = settings->lazy;
+	encoder->optimal = settings->optimal;
+}
+
+static int lha_lh_new_encoder_init(void *data, LHAEncoderCallback callback,
+                                   void *callback_data)
+{
+	LHANewEncoder *encoder = data;
+	unsigned int i;
+
+	bit_stream_writer_init(&encoder->bit_stream_writer,
+	                       callback, callback_data);
+
+	encoder->window_pos = 0;
+	encoder->window_len = 0;
+	encoder->insert_pos = 0;
+
+	for (i = 0; i < HASH_SIZE; ++i) {
+		encoder->hash_head[i] = NO_POSITION;
+	}
+
+	lha_lh_new_set_level(encoder, LHA_ENCODER_DEFAULT_LEVEL);
+
+	encoder->block_len = 0;
+	encoder->block_copies = 0;
+	encoder->segment_start = 0;
+	encoder->segment_copies = 0;
+	memset(encoder->code_freq, 0, sizeof(encoder->code_freq));
+	memset(encoder->offset_freq, 0, sizeof(encoder->offset_freq));
+	memset(encoder->segment_code_freq, 0,
+	       sizeof(encoder->segment_code_freq));
+	memset(encoder->segment_offset_freq, 0,
+	       sizeof(encoder->segment_offset_freq));
+
+	encoder->threads = 1;
+	encoder->parsers = NULL;
+	encoder->chunks = NULL;
+	encoder->chunk = NULL;
+	encoder->parallel_buf = NULL;
+	encoder->parallel_len = 0;
+	encoder->history_len = 0;
+
+	return 1;
+}
+
+static void lha_lh_new_set_chain_depth(void *data, unsigned int depth)
+{
+	LHANewEncoder *encoder = data;
+
+	encoder->chain_depth = depth;
+}
+
+// Number of bits needed to represent an offset, which is the offset
+// code that is written for it.
+
+static unsigned int offset_code(unsigned int offset)
+{
+	unsigned int bits;
+
+	for (bits = 0; offset != 0; ++bits) {
+		offset >>= 1;
+	}
+
+	return bits;
+}
+
+// Write a length value in the format read by read_length_value(): three
+// bits for lengths up to 6, otherwise 7 followed by a unary count.
+
+static void write_length_value(LHANewEncoder *encoder, unsigned int len)
+{
+	if (len <= 6) {
+		write_bits(&encoder->bit_stream_writer, len, 3);
+	} else {
+		write_bits(&encoder->bit_stream_writer, 7, 3);
+		write_bits(&encoder->bit_stream_writer,
+		           (1U << (len - 6)) - 2, len - 6);
+	}
+}
+
+// Number of entries in a code length table, ignoring unused codes at
+// the end.
+
+static unsigned int table_length(uint8_t *code_lengths, unsigned int n)
+{
+	while (n > 0 && code_lengths[n - 1] == 0) {
+		--n;
+	}
+
+	return n;
+}
+
+// Return the one symbol with a non-zero frequency, or zero if there
+// are none. Used when a table contains fewer than two codes.
+
+static unsigned int single_symbol(uint32_t *freqs, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; ++i) {
+		if (freqs[i] > 0) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+// Write a table of code lengths in the format read by read_temp_table()
+// and read_offset_table(). With the temp table, the length of the third
+// code is followed by a two-bit count of unused codes.
+
+static void write_length_table(LHANewEncoder *encoder,
+                               uint8_t *code_lengths, unsigned int num_codes,
+                               unsigned int bits, int is_temp_table)
+{
+	unsigned int i, n, skip;
+
+	n = table_length(code_lengths, num_codes);
+	write_bits(&encoder->bit_stream_writer, n, bits);
+
+	for (i = 0; i < n; ++i) {
+		write_length_value(encoder, code_lengths[i]);
+
+		if (is_temp_table && i == 2) {
+			for (skip = 0; skip < 3 && i + 1 < n
+			            && code_lengths[i + 1] == 0; ++skip) {
+				++i;
+			}
+
+			write_bits(&encoder->bit_stream_writer, skip, 2);
+		}
+	}
+}
+
+// Number of bits used by write_length_table() to write a table, or to
+// write the special case for a table with a single code.
+
+static unsigned int length_table_bits(uint8_t *code_lengths,
+                                      unsigned int num_codes,
+                                      unsigned int num_used,
+                                      unsigned int bits, int is_temp_table)
+{
+	unsigned int i, n, skip, result;
+
+	if (num_used < 2) {
+		return bits * 2;
+	}
+
+	n = table_length(code_lengths, num_codes);
+	result = bits;
+
+	for (i = 0; i < n; ++i) {
+		result += code_lengths[i] <= 6 ? 3 : code_lengths[i] - 3U;
+
+		if (is_temp_table && i == 2) {
+			for (skip = 0; skip < 3 && i + 1 < n
+			            && code_lengths[i + 1] == 0; ++skip) {
+				++i;
+			}
+
+			result += 2;
+		}
+	}
+
+	return result;
+}
+
+// The code table is written as a sequence of temp table codes. Runs of
+// unused codes are written using codes 0-2, and the length of a used
+// code is written as the length plus two. This calls the callback for
+// each temp code, with any extra bits that follow it.
+
+typedef void (*TempCodeCallback)(LHANewEncoder *encoder, unsigned int code,
+                                 unsigned int extra, unsigned int extra_bits,
+                                 void *user_data);
+
+// Number of extra bits following each of the temp codes for runs of
+// unused codes, and the shortest and longest run that each can write.
+
+static const unsigned int run_extra_bits[] = { 0, 4, 9 };
+static const unsigned int run_min[] = { 1, 3, 20 };
+static const unsigned int run_max[] = { 1, 18, 20 + 511 };
+
+// Cost in bits of writing a run of unused codes using the specified
+// number of code 1s, with single code 0s for the rest of the run.
+// Returns 0xffffffff if it is not possible.
+
+static uint32_t zero_run_cost(unsigned int run, unsigned int ones,
+                              uint8_t *temp_lengths)
+{
+	unsigned int zeros;
+
+	zeros = run > ones * run_max[1] ? run - ones * run_max[1] : 0;
+
+	if (ones * run_min[1] + zeros > run
+	 || (ones > 0 && temp_lengths[1] == 0)
+	 || (zeros > 0 && temp_lengths[0] == 0)) {
+		return 0xffffffffUL;
+	}
+
+	return ones * (temp_lengths[1] + run_extra_bits[1])
+	     + zeros * temp_lengths[0];
+}
+
+// Write a run of unused codes using codes 0-2. With no temp table
+// lengths given, each run is written with a single code if possible.
+// Otherwise, the combination of codes that is cheapest to write with
+// those lengths is used.
+
+static void zero_run_temp_codes(LHANewEncoder *encoder, unsigned int run,
+                                uint8_t *temp_lengths,
+                                TempCodeCallback callback, void *user_data)
+{
+	uint32_t cost, best_cost;
+	unsigned int ones[3], best_ones, zeros, i, len;
+	int use_long_run;
+
+	if (temp_lengths == NULL) {
+		if (run <= 2) {
+			for (; run > 0; --run) {
+				callback(encoder, 0, 0, 0, user_data);
+			}
+		} else if (run <= 18) {
+			callback(encoder, 1, run - 3, 4, user_data);
+		} else if (run == 19) {
+			callback(encoder, 0, 0, 0, user_data);
+			callback(encoder, 1, 15, 4, user_data);
+		} else {
+			callback(encoder, 2, run - 20, 9, user_data);
+		}
+
+		return;
+	}
+
+	// Each code costs the same whatever length of run it writes.
+	// A run is never longer than NUM_CODES, so a single code 2 can
+	// write any run that is long enough, and no mix including code 2
+	// can be cheaper.
+
+	if (temp_lengths[2] != 0 && run >= run_min[2]) {
+		best_cost = temp_lengths[2] + run_extra_bits[2];
+	} else {
+		best_cost = 0xffffffffUL;
+	}
+
+	// Otherwise, using more code 1s reduces the number of code 0s
+	// until the code 1s cover the whole run, after which they only
+	// add to the cost. So the cheapest number of code 1s is either
+	// none, or one either side of that point.
+
+	ones[0] = 0;
+	ones[1] = run / run_max[1];
+	ones[2] = ones[1] + 1;
+	best_ones = 0;
+	use_long_run = 1;
+
+	for (i = 0; i < 3; ++i) {
+		cost = zero_run_cost(run, ones[i], temp_lengths);
+
+		if (cost < best_cost) {
+			best_cost = cost;
+			best_ones = ones[i];
+			use_long_run = 0;
+		}
+	}
+
+	if (!use_long_run) {
+		zeros = run > best_ones * run_max[1]
+		      ? run - best_ones * run_max[1] : 0;
+
+		for (i = 0; i < zeros; ++i) {
+			callback(encoder, 0, 0, 0, user_data);
+		}
+
+		// Share the rest of the run evenly between the code 1s.
+
+		run -= zeros;
+
+		for (i = best_ones; i > 0; --i) {
+			len = run / i;
+			callback(encoder, 1, len - run_min[1],
+			         run_extra_bits[1], user_data);
+			run -= len;
+		}
+	} else {
+		callback(encoder, 2, run - run_min[2], run_extra_bits[2],
+		         user_data);
+	}
+}
+
+static void code_table_temp_codes(LHANewEncoder *encoder,
+                                  uint8_t *code_lengths, unsigned int n,
+                                  uint8_t *temp_lengths,
+                                  TempCodeCallback callback, void *user_data)
+{
+	unsigned int i, run;
+
+	i = 0;
+
+	while (i < n) {
+		if (code_lengths[i] != 0) {
+			callback(encoder, code_lengths[i] + 2U, 0, 0,
+			         user_data);
+			++i;
+			continue;
+		}
+
+		for (run = 0; i < n && code_lengths[i] == 0; ++run) {
+			++i;
+		}
+
+		zero_run_temp_codes(encoder, run, temp_lengths,
+		                    callback, user_data);
+	}
+}
+
+static void count_temp_code(LHANewEncoder *encoder, unsigned int code,
+                            unsigned int extra, unsigned int extra_bits,
+                            void *user_data)
+{
+	uint32_t *temp_freq = user_data;
+
+	++temp_freq[code];
+}
+
+typedef struct {
+	uint8_t lengths[NUM_TEMP_CODES];
+	uint16_t codes[NUM_TEMP_CODES];
+	uint32_t freqs[NUM_TEMP_CODES];
+	unsigned int num_used;
+} TempTable;
+
+// Build a temp table for writing the code table, with runs of unused
+// codes written as chosen by zero_run_temp_codes(). Returns the number
+// of bits needed to write the temp table and the code table.
+
+static unsigned int build_temp_table(LHANewEncoder *encoder,
+                                     uint8_t *code_lengths, unsigned int n,
+                                     uint8_t *run_lengths,
+                                     TempTable *temp_table)
+{
+	unsigned int i, result;
+
+	memset(temp_table->freqs, 0, sizeof(temp_table->freqs));
+	code_table_temp_codes(encoder, code_lengths, n, run_lengths,
+	                      count_temp_code, temp_table->freqs);
+
+	temp_table->num_used = build_code_lengths(temp_table->freqs,
+	                                          NUM_TEMP_CODES,
+	                                          temp_table->lengths);
+
+	result = length_table_bits(temp_table->lengths, NUM_TEMP_CODES,
+	                           temp_table->num_used, TEMP_CODE_BITS, 1)
+	       + CODE_TABLE_BITS;
+
+	for (i = 0; i < NUM_TEMP_CODES; ++i) {
+		result += temp_table->freqs[i] * temp_table->lengths[i];
+	}
+
+	for (i = 0; i < 3; ++i) {
+		result += temp_table->freqs[i] * run_extra_bits[i];
+	}
+
+	return result;
+}
+
+static void write_temp_code(LHANewEncoder *encoder, unsigned int code,
+                            unsigned int extra, unsigned int extra_bits,
+                            void *user_data)
+{
+	TempTable *temp_table = user_data;
+
+	write_bits(&encoder->bit_stream_writer, temp_table->codes[code],
+	           temp_table->lengths[code]);
+	write_bits(&encoder->bit_stream_writer, extra, extra_bits);
+}
+
+// Write the temp table and the code table, given the lengths of the
+// codes.
+
+static void write_code_table(LHANewEncoder *encoder, uint8_t *code_lengths,
+                             unsigned int num_used)
+{
+	TempTable tables[2];
+	TempTable *temp_table;
+	uint8_t *run_lengths;
+	unsigned int n, bits;
+
+	// A single code is written as a special case, with empty temp
+	// and code tables.
+
+	if (num_used < 2) {
+		write_bits(&encoder->bit_stream_writer, 0, TEMP_CODE_BITS);
+		write_bits(&encoder->bit_stream_writer, 0, TEMP_CODE_BITS);
+		write_bits(&encoder->bit_stream_writer, 0, CODE_TABLE_BITS);
+		write_bits(&encoder->bit_stream_writer,
+		           single_symbol(encoder->code_freq, NUM_CODES),
+		           CODE_TABLE_BITS);
+		return;
+	}
+
+	n = table_length(code_lengths, NUM_CODES);
+
+	// Build the temp table from the codes needed to write the code
+	// table, writing each run of unused codes with a single code.
+	// Then try writing the runs in the way that is cheapest with the
+	// resulting temp table, and building another from that; use
+	// whichever is smaller.
+
+	temp_table = &tables[0];
+	run_lengths = NULL;
+	bits = build_temp_table(encoder, code_lengths, n, NULL, &tables[0]);
+
+	if (tables[0].num_used >= 2
+	 && build_temp_table(encoder, code_lengths, n, tables[0].lengths,
+	                     &tables[1]) < bits) {
+		temp_table = &tables[1];
+		run_lengths = tables[0].lengths;
+	}
+
+	if (temp_table->num_used < 2) {
+		write_bits(&encoder->bit_stream_writer, 0, TEMP_CODE_BITS);
+		write_bits(&encoder->bit_stream_writer,
+		           single_symbol(temp_table->freqs, NUM_TEMP_CODES),
+		           TEMP_CODE_BITS);
+	} else {
+		write_length_table(encoder, temp_table->lengths,
+		                   NUM_TEMP_CODES, TEMP_CODE_BITS, 1);
+	}
+
+	build_codes(temp_table->lengths, NUM_TEMP_CODES, temp_table->codes);
+
+	// Write the code table using the temp table.
+
+	write_bits(&encoder->bit_stream_writer, n, CODE_TABLE_BITS);
+	code_table_temp_codes(encoder, code_lengths, n, run_lengths,
+	                      write_temp_code, temp_table);
+}
+
+// Estimate the number of bits needed to write a block of commands with
+// the given code frequencies, not including the extra bits that follow
+// the offset codes, which do not depend on how the data is divided
+// into blocks.
+
+static unsigned int block_bits(LHANewEncoder *encoder, uint32_t *code_freq,
+                               uint32_t *offset_freq)
+{
+	uint8_t code_lengths[NUM_CODES];
+	uint8_t offset_lengths[NUM_OFFSET_CODES];
+	TempTable temp_table;
+	unsigned int i, num_used, result;
+
+	result = 16;
+
+	num_used = build_code_lengths(code_freq, NUM_CODES, code_lengths);
+
+	if (num_used < 2) {
+		result += TEMP_CODE_BITS * 2 + CODE_TABLE_BITS * 2;
+	} else {
+		result += build_temp_table(encoder, code_lengths,
+		                           table_length(code_lengths,
+		                                        NUM_CODES),
+		                           NULL, &temp_table);
+	}
+
+	for (i = 0; i < NUM_CODES; ++i) {
+		result += code_freq[i] * code_lengths[i];
+	}
+
+	num_used = build_code_lengths(offset_freq, NUM_OFFSET_CODES,
+	                              offset_lengths);
+	result += length_table_bits(offset_lengths, NUM_OFFSET_CODES,
+	                            num_used, OFFSET_BITS, 0);
+
+	for (i = 0; i < NUM_OFFSET_CODES; ++i) {
+		result += offset_freq[i] * offset_lengths[i];
+	}
+
+	return result;
+}
+
+// Write the commands before the current segment as a block, and remove
+// them from the list of commands waiting to be written.
+
+static void write_block(LHANewEncoder *encoder)
+{
+	uint8_t code_lengths[NUM_CODES];
+	uint16_t codes[NUM_CODES];
+	uint8_t offset_lengths[NUM_OFFSET_CODES];
+	uint16_t offset_codes[NUM_OFFSET_CODES];
+	unsigned int i, num_used, code, offset, copy, bits;
+
+	write_bits(&encoder->bit_stream_writer, encoder->segment_start, 16);
+
+	// Code table:
+
+	num_used = build_code_lengths(encoder->code_freq, NUM_CODES,
+	                              code_lengths);
+	build_codes(code_lengths, NUM_CODES, codes);
+	write_code_table(encoder, code_lengths, num_used);
+
+	// Offset table:
+
+	num_used = build_code_lengths(encoder->offset_freq, NUM_OFFSET_CODES,
+	                              offset_lengths);
+	build_codes(offset_lengths, NUM_OFFSET_CODES, offset_codes);
+
+	if (num_used < 2) {
+		write_bits(&encoder->bit_stream_writer, 0, OFFSET_BITS);
+		write_bits(&encoder->bit_stream_writer,
+		           single_symbol(encoder->offset_freq,
+		                         NUM_OFFSET_CODES),
+		           OFFSET_BITS);
+	} else {
+		write_length_table(encoder, offset_lengths, NUM_OFFSET_CODES,
+		                   OFFSET_BITS, 0);
+	}
+
+	// Commands:
+
+	copy = 0;
+
+	for (i = 0; i < encoder->segment_start; ++i) {
+		code = encoder->block_codes[i];
+		write_bits(&encoder->bit_stream_writer,
+		           codes[code], code_lengths[code]);
+
+		if (code >= 256) {
+			offset = encoder->block_offsets[copy];
+			++copy;
+
+			bits = offset_code(offset);
+			write_bits(&encoder->bit_stream_writer,
+			           offset_codes[bits], offset_lengths[bits]);
+
+			if (bits > 1) {
+				write_bits(&encoder->bit_stream_writer,
+				           offset, bits - 1);
+			}
+		}
+	}
+
+	// The current segment becomes the start of the next block.
+
+	memmove(encoder->block_codes,
+	        encoder->block_codes + encoder->segment_start,
+	        (encoder->block_len - encoder->segment_start)
+	        * sizeof(uint16_t));
+	memmove(encoder->block_offsets,
+	        encoder->block_offsets + encoder->segment_copies,
+	        (encoder->block_copies - encoder->segment_copies)
+	        * sizeof(uint16_t));
+	encoder->block_len -= encoder->segment_start;
+	encoder->block_copies -= encoder->segment_copies;
+	encoder->segment_start = 0;
+	encoder->segment_copies = 0;
+	memset(encoder->code_freq, 0, sizeof(encoder->code_freq));
+	memset(encoder->offset_freq, 0, sizeof(encoder->offset_freq));
+}
+
+// Move the commands in the current segment up to 'end' into the block
+// before it.
+
+static void extend_block(LHANewEncoder *encoder, unsigned int end)
+{
+	unsigned int code, bits;
+
+	while (encoder->segment_start < end) {
+		code = encoder->block_codes[encoder->segment_start];
+		++encoder->code_freq[code];
+		--encoder->segment_code_freq[code];
+
+		if (code >= 256) {
+			bits = offset_code(
+			    encoder->block_offsets[encoder->segment_copies]);
+			++encoder->offset_freq[bits];
+			--encoder->segment_offset_freq[bits];
+			++encoder->segment_copies;
+		}
+
+		++encoder->segment_start;
+	}
+}
+
+// Estimate the size of the block before the current segment and the
+// segment, if the block is extended to end at 'end' in the segment.
+
+static unsigned int split_bits(LHANewEncoder *encoder, unsigned int end)
+{
+	uint32_t code_freq[NUM_CODES], offset_freq[NUM_OFFSET_CODES];
+	uint32_t segment_code_freq[NUM_CODES];
+	uint32_t segment_offset_freq[NUM_OFFSET_CODES];
+	unsigned int pos, copy, code, bits;
+
+	memcpy(code_freq, encoder->code_freq, sizeof(code_freq));
+	memcpy(offset_freq, encoder->offset_freq, sizeof(offset_freq));
+	memcpy(segment_code_freq, encoder->segment_code_freq,
+	       sizeof(segment_code_freq));
+	memcpy(segment_offset_freq, encoder->segment_offset_freq,
+	       sizeof(segment_offset_freq));
+
+	copy = encoder->segment_copies;
+
+	for (pos = encoder->segment_start; pos < end; ++pos) {
+		code = encoder->block_codes[pos];
+		++code_freq[code];
+		--segment_code_freq[code];
+
+		if (code >= 256) {
+			bits = offset_code(encoder->block_offsets[copy]);
+			++offset_freq[bits];
+			--segment_offset_freq[bits];
+			++copy;
+		}
+	}
+
+	return block_bits(encoder, code_freq, offset_freq)
+	     + block_bits(encoder, segment_code_freq, segment_offset_freq);
+}
+
+// Look for a place in the current segment where the data changes, to
+// end the current block. The size is estimated for the block ending
+// at SPLIT_STEPS places through the segment, then again at places
+// around the best of those, and compared with best_bits, the size if
+// the block ends at the start of the segment. If ending it at one of
+// these places is smaller, or the segment is the start of the block
+// and best_bits is the size of the whole block, the block is written
+// up to that place. Returns non-zero if a block was written.
+
+static int split_segment(LHANewEncoder *encoder, unsigned int best_bits)
+{
+	unsigned int start, limit, step, end, best_end, bits, round;
+
+	start = encoder->segment_start;
+	limit = encoder->block_len;
+	step = (limit - start) / SPLIT_STEPS;
+	best_end = start;
+
+	for (round = 0; round < SPLIT_ROUNDS && step > 0; ++round) {
+		for (end = start + step; end < limit; end += step) {
+			bits = split_bits(encoder, end);
+
+			if (bits < best_bits) {
+				best_bits = bits;
+				best_end = end;
+			}
+		}
+
+		start = best_end;
+		limit = best_end + step;
+
+		if (start - encoder->segment_start > step) {
+			start -= step;
+		} else {
+			start = encoder->segment_start;
+		}
+
+		if (limit > encoder->block_len) {
+			limit = encoder->block_len;
+		}
+
+		step /= SPLIT_STEPS;
+	}
+
+	if (best_end == 0) {
+		return 0;
+	}
+
+	extend_block(encoder, best_end);
+	write_block(encoder);
+
+	return 1;
+}
+
+// End the current segment. If the codes used in it are different
+// enough from those in the block before it that writing them as two
+// blocks is smaller, the block before it is written, and the segment
+// (or the part of it after the change) starts a new block; otherwise,
+// the segment is added to the block.
+
+static void end_segment(LHANewEncoder *encoder)
+{
+	uint32_t code_freq[NUM_CODES], offset_freq[NUM_OFFSET_CODES];
+	unsigned int i, segment_bits, merged_bits;
+
+	segment_bits = block_bits(encoder, encoder->segment_code_freq,
+	                          encoder->segment_offset_freq);
+
+	// If the segment is the start of a block, the data may still
+	// have changed part of the way through it.
+
+	if (encoder->segment_start == 0) {
+		if (split_segment(encoder, segment_bits)) {
+			segment_bits = block_bits(
+			    encoder, encoder->segment_code_freq,
+			    encoder->segment_offset_freq);
+		}
+
+		encoder->block_cost = segment_bits;
+	} else {
+		for (i = 0; i < NUM_CODES; ++i) {
+			code_freq[i] = encoder->code_freq[i]
+			             + encoder->segment_code_freq[i];
+		}
+
+		for (i = 0; i < NUM_OFFSET_CODES; ++i) {
+			offset_freq[i] = encoder->offset_freq[i]
+			               + encoder->segment_offset_freq[i];
+		}
+
+		merged_bits = block_bits(encoder, code_freq, offset_freq);
+
+		if (encoder->block_cost + segment_bits < merged_bits) {
+			split_segment(encoder,
+			              encoder->block_cost + segment_bits);
+			encoder->block_cost = block_bits(
+			    encoder, encoder->segment_code_freq,
+			    encoder->segment_offset_freq);
+		} else {
+			encoder->block_cost = merged_bits;
+		}
+	}
+
+	for (i = 0; i < NUM_CODES; ++i) {
+		encoder->code_freq[i] += encoder->segment_code_freq[i];
+	}
+
+	for (i = 0; i < NUM_OFFSET_CODES; ++i) {
+		encoder->offset_freq[i] += encoder->segment_offset_freq[i];
+	}
+
+	memset(encoder->segment_code_freq, 0,
+	       sizeof(encoder->segment_code_freq));
+	memset(encoder->segment_offset_freq, 0,
+	       sizeof(encoder->segment_offset_freq));
+	encoder->segment_start = encoder->block_len;
+	encoder->segment_copies = encoder->block_copies;
+
+	// Write the block if there is no room for another segment.
+
+	if (encoder->block_len + SEGMENT_COMMANDS > BLOCK_COMMANDS) {
+		write_block(encoder);
+	}
+}
+
+// Add a command to the current segment, ending the segment if it is
+// full.
+
+static void add_command(LHANewEncoder *encoder, unsigned int code,
+                        unsigned int offset)
+{
+	LHAChunk *chunk = encoder->chunk;
+
+	// A parser only stores its commands, to be added in order later.
+
+	if (chunk != NULL) {
+		chunk->codes[chunk->num_codes] = (uint16_t) code;
+		++chunk->num_codes;
+
+		if (code >= 256) {
+			chunk->offsets[chunk->num_copies] = (uint16_t) offset;
+			++chunk->num_copies;
+		}
+
+		return;
+	}
+
+	encoder->block_codes[encoder->block_len] = (uint16_t) code;
+	++encoder->block_len;
+	++encoder->segment_code_freq[code];
+
+	if (code >= 256) {
+		encoder->block_offsets[encoder->block_copies] =
+		    (uint16_t) offset;
+		++encoder->block_copies;
+		++encoder->segment_offset_freq[offset_code(offset)];
+	}
+
+	if (encoder->block_len - encoder->segment_start >= SEGMENT_COMMANDS) {
+		end_segment(encoder);
+	}
+}
+
+static unsigned int hash_position(LHANewEncoder *encoder, unsigned int pos)
+{
+	uint32_t value;
+
+	value = ((uint32_t) encoder->window[pos] << 16)
+	      | ((uint32_t) encoder->window[pos + 1] << 8)
+	      | encoder->window[pos + 2];
+
+	return (unsigned int) ((value * 2654435761UL) & 0xffffffffUL)
+	       >> (32 - HASH_BITS);
+}
+
+// Search the hash chain for the longest match for the data at pos, and
+// add pos to the chain. Returns the length of the match.
+
+static unsigned int hash_chain_find(LHANewEncoder *encoder, unsigned int pos,
+                                    unsigned int max_len,
+                                    unsigned int *match_pos)
+{
+	const uint8_t *window = encoder->window;
+	unsigned int hash, best_len, len, depth;
+	uint32_t cur;
+
+	hash = hash_position(encoder, pos);
+	best_len = 0;
+	depth = encoder->chain_depth;
+	cur = encoder->hash_head[hash];
+
+	while (cur != NO_POSITION && pos - cur <= HISTORY_SIZE && depth > 0) {
+
+		// Check the byte that would make this match longer than
+		// the best so far first, as it is most likely to differ.
+
+		if (window[cur + best_len] == window[pos + best_len]
+		 && window[cur] == window[pos]) {
+			for (len = 1; len < max_len
+			           && window[cur + len] == window[pos + len];
+			     ++len);
+
+			if (len > best_len) {
+				best_len = len;
+				*match_pos = cur;
+
+				if (len >= max_len
+				 || len >= encoder->nice_length) {
+					break;
+				}
+			}
+		}
+
+		cur = encoder->links[cur & HISTORY_MASK];
+		--depth;
+	}
+
+	encoder->links[pos & HISTORY_MASK] = encoder->hash_head[hash];
+	encoder->hash_head[hash] = (uint32_t) pos;
+
+	return best_len;
+}
+
+// Add a match to a list of matches of increasing length. If the list
+// is full, the longest match in it is replaced.
+
+static void add_match(LHAMatch *matches, unsigned int *num_matches,
+                      unsigned int len, unsigned int offset)
+{
+	if (*num_matches >= OPTIMAL_MATCHES) {
+		--*num_matches;
+	}
+
+	matches[*num_matches].len = (uint16_t) len;
+	matches[*num_matches].offset = (uint16_t) offset;
+	++*num_matches;
+}
+
+// Search the binary tree for the longest match for the data at pos,
+// and make pos the new root of the tree. The tree is ordered by the
+// data following each position, up to max_len bytes; as the search
+// goes down the tree, it is split into the positions less than and
+// greater than pos, which become its two subtrees. Returns the length
+// of the match. If 'matches' is not NULL, each match found that is
+// longer than the previous ones is also added to it.
+
+static unsigned int binary_tree_find(LHANewEncoder *encoder,
+                                     unsigned int pos, unsigned int max_len,
+                                     unsigned int *match_pos,
+                                     LHAMatch *matches,
+                                     unsigned int *num_matches)
+{
+	const uint8_t *window = encoder->window;
+	unsigned int hash, best_len, len, less_len, greater_len, depth;
+	uint32_t *less, *greater, *node;
+	uint32_t cur;
+
+	hash = hash_position(encoder, pos);
+	cur = encoder->hash_head[hash];
+	encoder->hash_head[hash] = (uint32_t) pos;
+
+	less = &encoder->links[(pos & HISTORY_MASK) * 2];
+	greater = less + 1;
+	less_len = 0;
+	greater_len = 0;
+	best_len = 0;
+	depth = encoder->chain_depth;
+
+	for (;;) {
+		// A node as far back as the history size would share its
+		// entry in 'links' with pos, so stop just before it.
+
+		if (cur == NO_POSITION || pos - cur >= HISTORY_SIZE
+		 || depth == 0) {
+			*less = NO_POSITION;
+			*greater = NO_POSITION;
+			break;
+		}
+
+		--depth;
+		node = &encoder->links[(cur & HISTORY_MASK) * 2];
+
+		// Both subtrees being searched share at least this many
+		// bytes with pos, so the comparison can start here.
+
+		len = less_len < greater_len ? less_len : greater_len;
+
+		if (window[cur + len] == window[pos + len]) {
+			while (++len < max_len
+			    && window[cur + len] == window[pos + len]);
+
+			if (len > best_len) {
+				best_len = len;
+				*match_pos = cur;
+
+				if (matches != NULL && len >= COPY_THRESHOLD) {
+					add_match(matches, num_matches,
+					          len, pos - cur - 1);
+				}
+			}
+
+			// Identical as far as the tree is ordered: pos
+			// replaces this node.
+
+			if (len >= max_len) {
+				*less = node[0];
+				*greater = node[1];
+				break;
+			}
+		}
+
+		if (window[cur + len] < window[pos + len]) {
+			*less = cur;
+			less = &node[1];
+			cur = *less;
+			less_len = len;
+		} else {
+			*greater = cur;
+			greater = &node[0];
+			cur = *greater;
+			greater_len = len;
+		}
+	}
+
+	return best_len;
+}
+
+// Find the longest match for the data at pos, adding pos to the match
+// finder. Returns the length of the match, or zero if no usable match
+// was found.
+
+static unsigned int find_match(LHANewEncoder *encoder, unsigned int pos,
+                               unsigned int *offset)
+{
+	const uint8_t *window = encoder->window;
+	unsigned int max_len, tree_len, len, match_pos;
+
+	encoder->insert_pos = pos + 1;
+
+	max_len = encoder->window_len - pos;
+
+	if (max_len > MAX_COPY_LENGTH) {
+		max_len = MAX_COPY_LENGTH;
+	}
+
+	if (max_len < COPY_THRESHOLD) {
+		return 0;
+	}
+
+	match_pos = 0;
+
+	if (encoder->match_finder == MATCH_HASH_CHAIN) {
+		len = hash_chain_find(encoder, pos, max_len, &match_pos);
+	} else {
+		// The tree is only ordered up to nice_length bytes;
+		// extend a match that reaches that far.
+
+		tree_len = max_len;
+
+		if (tree_len > encoder->nice_length) {
+			tree_len = encoder->nice_length;
+		}
+
+		len = binary_tree_find(encoder, pos, tree_len, &match_pos,
+		                       NULL, NULL);
+
+		if (len >= tree_len) {
+			while (len < max_len
+			    && window[match_pos + len] == window[pos + len]) {
+				++len;
+			}
+		}
+	}
+
+	if (len < COPY_THRESHOLD
+	 || (len == COPY_THRESHOLD && pos - match_pos > TOO_FAR)) {
+		return 0;
+	}
+
+	*offset = pos - match_pos - 1;
+
+	return len;
+}
+
+// Add a position to the match finder without looking for a match. The
+// binary tree is still searched, as that is how it is updated, but a
+// match is not extended past nice_length.
+
+static void insert_position(LHANewEncoder *encoder, unsigned int pos)
+{
+	unsigned int max_len, hash, match_pos;
+
+	encoder->insert_pos = pos + 1;
+
+	max_len = encoder->window_len - pos;
+
+	if (max_len > encoder->nice_length) {
+		max_len = encoder->nice_length;
+	}
+
+	if (max_len < COPY_THRESHOLD) {
+		return;
+	}
+
+	if (encoder->match_finder == MATCH_HASH_CHAIN) {
+		hash = hash_position(encoder, pos);
+		encoder->links[pos & HISTORY_MASK] = encoder->hash_head[hash];
+		encoder->hash_head[hash] = (uint32_t) pos;
+	} else {
+		binary_tree_find(encoder, pos, max_len, &match_pos,
+		                 NULL, NULL);
+	}
+}
+
+// Add all positions before the specified position to the match finder.
+
+static void skip_to_position(LHANewEncoder *encoder, unsigned int end)
+{
+	while (encoder->insert_pos < end) {
+		insert_position(encoder, encoder->insert_pos);
+	}
+}
+
+// Find all matches for the data at pos for optimal parsing, adding pos
+// to the binary tree. Returns the number of matches found.
+
+static unsigned int find_matches(LHANewEncoder *encoder, unsigned int pos,
+                                 LHAMatch *matches)
+{
+	const uint8_t *window = encoder->window;
+	unsigned int max_len, tree_len, len, match_pos, num_matches;
+
+	encoder->insert_pos = pos + 1;
+
+	max_len = encoder->window_len - pos;
+
+	if (max_len > MAX_COPY_LENGTH) {
+		max_len = MAX_COPY_LENGTH;
+	}
+
+	if (max_len < COPY_THRESHOLD) {
+		return 0;
+	}
+
+	tree_len = max_len;
+
+	if (tree_len > encoder->nice_length) {
+		tree_len = encoder->nice_length;
+	}
+
+	num_matches = 0;
+	len = binary_tree_find(encoder, pos, tree_len, &match_pos,
+	                       matches, &num_matches);
+
+	if (num_matches > 0 && len >= tree_len) {
+		while (len < max_len
+		    && window[match_pos + len] == window[pos + len]) {
+			++len;
+		}
+
+		matches[num_matches - 1].len = (uint16_t) len;
+	}
+
+	return num_matches;
+}
+
+// Price a block of commands, setting the price of each code to the
+// length of the code that would be built from the frequencies given.
+
+static void set_prices(uint32_t *freqs, unsigned int n, uint32_t *prices)
+{
+	uint8_t lengths[MAX_TREE_CODES];
+	unsigned int i;
+
+	build_code_lengths(freqs, n, lengths);
+
+	for (i = 0; i < n; ++i) {
+		prices[i] = lengths[i] != 0 ? lengths[i] : UNUSED_PRICE;
+	}
+}
+
+// Store the commands on the path through a block that ends at
+// position n, using the path_len and path_offset arrays. Returns the
+// index of the first command in the cmd_len and cmd_offset arrays.
+
+static unsigned int store_path(LHANewEncoder *encoder, unsigned int n)
+{
+	unsigned int i, cmd;
+
+	cmd = n;
+
+	for (i = n; i > 0; i -= encoder->path_len[i]) {
+		--cmd;
+		encoder->cmd_len[cmd] = encoder->path_len[i];
+		encoder->cmd_offset[cmd] = encoder->path_offset[i];
+	}
+
+	return cmd;
+}
+
+// Parse a block greedily, using the longest match at each position,
+// to get the code frequencies for the first optimal parse.
+
+static unsigned int greedy_parse(LHANewEncoder *encoder, unsigned int n)
+{
+	LHAMatch *match;
+	unsigned int i, len;
+
+	for (i = 0; i < n; i += len) {
+		len = 1;
+
+		if (encoder->num_matches[i] > 0) {
+			match = &encoder->matches[i][0]
+			      + encoder->num_matches[i] - 1;
+			len = match->len < n - i ? match->len : n - i;
+		}
+
+		if (len < COPY_THRESHOLD) {
+			len = 1;
+		} else {
+			encoder->path_offset[i + len] = match->offset;
+		}
+
+		encoder->path_len[i + len] = (uint16_t) len;
+	}
+
+	return store_path(encoder, n);
+}
+
+// Find the cheapest sequence of commands for a block of n bytes, given
+// the price of each code. Each position in the block is reached either
+// by a literal from the position before, or by a copy from an earlier
+// position; a copy can be of any length up to the length of the match.
+
+static unsigned int optimal_parse(LHANewEncoder *encoder, unsigned int n,
+                                  uint32_t *code_prices,
+                                  uint32_t *offset_prices)
+{
+	const uint8_t *window = encoder->window + encoder->window_pos;
+	LHAMatch *match;
+	uint32_t price, copy_price;
+	unsigned int i, j, len, max_len;
+
+	encoder->price[0] = 0;
+
+	for (i = 1; i <= n; ++i) {
+		encoder->price[i] = 0xffffffffUL;
+	}
+
+	for (i = 0; i < n; ++i) {
+		price = encoder->price[i] + code_prices[window[i]];
+
+		if (price < encoder->price[i + 1]) {
+			encoder->price[i + 1] = price;
+			encoder->path_len[i + 1] = 1;
+		}
+
+		len = COPY_THRESHOLD;
+
+		for (j = 0; j < encoder->num_matches[i]; ++j) {
+			match = &encoder->matches[i][j];
+			max_len = match->len < n - i ? match->len : n - i;
+			copy_price = encoder->price[i]
+			           + offset_prices[offset_code(match->offset)];
+
+			// Only the full length of a long match is tried.
+
+			if (match->len >= encoder->nice_length
+			 && max_len > len) {
+				len = max_len;
+			}
+
+			for (; len <= max_len; ++len) {
+				price = copy_price
+				      + code_prices[256 + len - COPY_THRESHOLD];
+
+				if (price < encoder->price[i + len]) {
+					encoder->price[i + len] = price;
+					encoder->path_len[i + len] =
+					    (uint16_t) len;
+					encoder->path_offset[i + len] =
+					    match->offset;
+				}
+			}
+		}
+	}
+
+	return store_path(encoder, n);
+}
+
+// Compress a block of n bytes using optimal parsing. The block is first
+// parsed greedily; each following parse prices the commands using the
+// codes built from the result of the one before, and the result of the
+// last is added to the commands to write.
+
+static void compress_block_optimal(LHANewEncoder *encoder, unsigned int n)
+{
+	uint32_t code_freq[NUM_CODES], offset_freq[NUM_OFFSET_CODES];
+	uint32_t code_prices[NUM_CODES], offset_prices[NUM_OFFSET_CODES];
+	const uint8_t *window;
+	unsigned int i, num_matches, long_end, first, pass, pos, len, bits;
+
+	// Find the matches at every position. Positions covered by a
+	// long match are only added to the binary tree, as the long
+	// match is always used.
+
+	long_end = 0;
+
+	for (i = 0; i < n; ++i) {
+		if (i < long_end) {
+			insert_position(encoder, encoder->window_pos + i);
+			encoder->num_matches[i] = 0;
+			continue;
+		}
+
+		num_matches = find_matches(encoder, encoder->window_pos + i,
+		                           encoder->matches[i]);
+
+		if (num_matches > 0
+		        && encoder->matches[i][num_matches - 1].len
+		           >= encoder->nice_length) {
+			encoder->matches[i][0] =
+			    encoder->matches[i][num_matches - 1];
+			num_matches = 1;
+			long_end = i + encoder->matches[i][0].len;
+		}
+
+		encoder->num_matches[i] = (uint8_t) num_matches;
+	}
+
+	window = encoder->window + encoder->window_pos;
+	first = greedy_parse(encoder, n);
+
+	for (pass = 1; pass < OPTIMAL_PASSES; ++pass) {
+		memset(code_freq, 0, sizeof(code_freq));
+		memset(offset_freq, 0, sizeof(offset_freq));
+
+		for (i = first, pos = 0; i < n; ++i, pos += len) {
+			len = encoder->cmd_len[i];
+
+			if (len == 1) {
+				++code_freq[window[pos]];
+			} else {
+				++code_freq[256 + len - COPY_THRESHOLD];
+				++offset_freq[offset_code(
+				    encoder->cmd_offset[i])];
+			}
+		}
+
+		set_prices(code_freq, NUM_CODES, code_prices);
+		set_prices(offset_freq, NUM_OFFSET_CODES, offset_prices);
+
+		for (bits = 2; bits < NUM_OFFSET_CODES; ++bits) {
+			offset_prices[bits] += bits - 1;
+		}
+
+		first = optimal_parse(encoder, n, code_prices, offset_prices);
+	}
+
+	for (i = first, pos = 0; i < n; ++i, pos += len) {
+		len = encoder->cmd_len[i];
+
+		if (len == 1) {
+			add_command(encoder, window[pos], 0);
+		} else {
+			add_command(encoder, 256 + len - COPY_THRESHOLD,
+			            encoder->cmd_offset[i]);
+		}
+	}
+
+	encoder->window_pos += n;
+}
+
+// Compress the data in the window. Unless this is the end of the
+// stream, stop while there is still enough data after the current
+// position for lazy evaluation to look at. Optimal parsing only
+// compresses whole blocks until the end of the stream.
+
+static void compress_window(LHANewEncoder *encoder, int final)
+{
+	unsigned int limit, pos, len, offset, next_len, next_offset;
+
+	if (final) {
+		limit = encoder->window_len;
+	} else if (encoder->window_len > LOOKAHEAD) {
+		limit = encoder->window_len - LOOKAHEAD;
+	} else {
+		return;
+	}
+
+	while (encoder->optimal && encoder->window_pos < limit) {
+		len = limit - encoder->window_pos;
+
+		if (len > OPTIMAL_BLOCK) {
+			len = OPTIMAL_BLOCK;
+		} else if (len < OPTIMAL_BLOCK && !final) {
+			return;
+		}
+
+		compress_block_optimal(encoder, len);
+	}
+
+	while (encoder->window_pos < limit) {
+		pos = encoder->window_pos;
+
+		if (encoder->insert_pos > pos) {
+			len = encoder->next_len;
+			offset = encoder->next_offset;
+		} else {
+			len = find_match(encoder, pos, &offset);
+		}
+
+		// Lazy evaluation: if there is a longer match at the next
+		// position, write a literal and use that instead. With
+		// two-step evaluation, a match two positions on is worth
+		// writing two literals if it is longer by more than one.
+
+		if (len > 0 && len < encoder->nice_length && encoder->lazy > 0
+		 && pos + 1 < encoder->window_len) {
+			next_len = find_match(encoder, pos + 1, &next_offset);
+
+			if (next_len <= len && encoder->lazy > 1
+			 && pos + 2 < encoder->window_len) {
+				next_len = find_match(encoder, pos + 2,
+				                      &next_offset);
+
+				if (next_len > len + 1) {
+					add_command(encoder,
+					            encoder->window[pos], 0);
+					++pos;
+				} else {
+					next_len = 0;
+				}
+			}
+
+			if (next_len > len) {
+				add_command(encoder, encoder->window[pos], 0);
+				encoder->window_pos = pos + 1;
+				encoder->next_len = next_len;
+				encoder->next_offset = next_offset;
+				continue;
+			}
+		}
+
+		if (len == 0) {
+			add_command(encoder, encoder->window[pos], 0);
+			len = 1;
+		} else {
+			add_command(encoder, 256 + len - COPY_THRESHOLD,
+			            offset);
+		}
+
+		encoder->window_pos = pos + len;
+		skip_to_position(encoder, encoder->window_pos);
+	}
+}
+
+// Move the contents of the window down to make space for more data.
+
+static uint32_t slide_position(uint32_t pos)
+{
+	if (pos == NO_POSITION || pos < WINDOW_SLIDE) {
+		return NO_POSITION;
+	}
+
+	return pos - WINDOW_SLIDE;
+}
+
+static void slide_window(LHANewEncoder *encoder)
+{
+	unsigned int i;
+
+	memmove(encoder->window, encoder->window + WINDOW_SLIDE,
+	        encoder->window_len - WINDOW_SLIDE);
+	encoder->window_pos -= WINDOW_SLIDE;
+	encoder->window_len -= WINDOW_SLIDE;
+	encoder->insert_pos -= WINDOW_SLIDE;
+
+	for (i = 0; i < HASH_SIZE; ++i) {
+		encoder->hash_head[i] = slide_position(encoder->hash_head[i]);
+	}
+
+	for (i = 0; i < HISTORY_SIZE * 2; ++i) {
+		encoder->links[i] = slide_position(encoder->links[i]);
+	}
+}
+
+static int write_chunks(LHANewEncoder *encoder, const uint8_t *buf,
+                        size_t buf_len);
+
+static int lha_lh_new_write(void *data, const uint8_t *buf, size_t buf_len)
+{
+	LHANewEncoder *encoder = data;
+	size_t bytes;
+
+	if (encoder->threads > 1) {
+		return write_chunks(encoder, buf, buf_len);
+	}
+
+	while (buf_len > 0) {
+
+		// When the window is full, everything but the last
+		// LOOKAHEAD bytes has been compressed (or with optimal
+		// parsing, up to OPTIMAL_BLOCK bytes more), so there is
+		// at least a full history before the current position.
+
+		if (encoder->window_len >= WINDOW_SIZE) {
+			slide_window(encoder);
+		}
+
+		bytes = WINDOW_SIZE - encoder->window_len;
+
+		if (bytes > buf_len) {
+			bytes = buf_len;
+		}
+
+		memcpy(encoder->window + encoder->window_len, buf, bytes);
+		encoder->window_len += (unsigned int) bytes;
+		buf += bytes;
+		buf_len -= bytes;
+
+		compress_window(encoder, 0);
+	}
+
+	return !encoder->bit_stream_writer.failed;
+}
+
+// Thread function to find the commands for a chunk of data. The
+// history before the chunk is put at the start of the window and added
+// to the match finder, then the chunk is compressed after it.
+
+static void parse_chunk(void *data)
+{
+	LHANewEncoder *parser = data;
+	LHAChunk *chunk = parser->chunk;
+	unsigned int bytes;
+
+	chunk->num_codes = 0;
+	chunk->num_copies = 0;
+
+	bytes = WINDOW_SIZE - chunk->history_len;
+
+	if (bytes > chunk->len) {
+		bytes = chunk->len;
+	}
+
+	memcpy(parser->window, chunk->history, chunk->history_len);
+	memcpy(parser->window + chunk->history_len, chunk->data, bytes);
+	parser->window_len = chunk->history_len + bytes;
+
+	skip_to_position(parser, chunk->history_len);
+	parser->window_pos = chunk->history_len;
+
+	compress_window(parser, 0);
+	lha_lh_new_write(parser, chunk->data + bytes, chunk->len - bytes);
+	compress_window(parser, 1);
+}
+
+// Compress the data collected in parallel_buf. It is divided into
+// chunks, which are parsed at the same time: each in a new thread,
+// except the last, which is parsed in this one. The commands for each
+// chunk are then added in order, so the output does not depend on the
+// number of threads.
+
+static void compress_chunks(LHANewEncoder *encoder)
+{
+	LHAArchThread *threads[MAX_THREADS];
+	uint8_t *data = encoder->parallel_buf + HISTORY_SIZE;
+	LHANewEncoder *parser;
+	LHAChunk *chunk;
+	unsigned int i, j, n, start, history_len, copies;
+
+	n = 0;
+
+	for (start = 0; start < encoder->parallel_len;
+	     start += chunk->len) {
+		chunk = &encoder->chunks[n];
+		chunk->data = data + start;
+		chunk->len = encoder->parallel_len - start;
+
+		if (chunk->len > PARALLEL_CHUNK) {
+			chunk->len = PARALLEL_CHUNK;
+		}
+
+		history_len = encoder->history_len + start;
+
+		if (history_len > HISTORY_SIZE) {
+			history_len = HISTORY_SIZE;
+		}
+
+		chunk->history = chunk->data - history_len;
+		chunk->history_len = history_len;
+
+		parser = encoder->parsers[n];
+		lha_lh_new_encoder_init(parser, NULL, NULL);
+		parser->match_finder = encoder->match_finder;
+		parser->chain_depth = encoder->chain_depth;
+		parser->nice_length = encoder->nice_length;
+		parser->lazy = encoder->lazy;
+		parser->optimal = encoder->optimal;
+		parser->chunk = chunk;
+		++n;
+	}
+
+	// If a thread cannot be started, the chunk is parsed here.
+
+	for (i = 0; i + 1 < n; ++i) {
+		threads[i] = lha_arch_thread_new(parse_chunk,
+		                                 encoder->parsers[i]);
+
+		if (threads[i] == NULL) {
+			parse_chunk(encoder->parsers[i]);
+		}
+	}
+
+	parse_chunk(encoder->parsers[n - 1]);
+
+	for (i = 0; i < n; ++i) {
+		if (i + 1 < n && threads[i] != NULL) {
+			lha_arch_thread_join(threads[i]);
+		}
+
+		chunk = &encoder->chunks[i];
+		copies = 0;
+
+		for (j = 0; j < chunk->num_codes; ++j) {
+			if (chunk->codes[j] >= 256) {
+				add_command(encoder, chunk->codes[j],
+				            chunk->offsets[copies]);
+				++copies;
+			} else {
+				add_command(encoder, chunk->codes[j], 0);
+			}
+		}
+	}
+
+	// Keep the end of the data as the history for the next chunk.
+
+	history_len = encoder->history_len + encoder->parallel_len;
+
+	if (history_len > HISTORY_SIZE) {
+		history_len = HISTORY_SIZE;
+	}
+
+	memmove(data - history_len,
+	        data + encoder->parallel_len - history_len, history_len);
+	encoder->history_len = history_len;
+	encoder->parallel_len = 0;
+}
+
+// Collect data to compress in parallel, compressing it whenever there
+// is a chunk for every thread.
+
+static int write_chunks(LHANewEncoder *encoder, const uint8_t *buf,
+                        size_t buf_len)
+{
+	size_t bytes;
+
+	while (buf_len > 0) {
+		bytes = encoder->threads * PARALLEL_CHUNK
+		      - encoder->parallel_len;
+
+		if (bytes > buf_len) {
+			bytes = buf_len;
+		}
+
+		memcpy(encoder->parallel_buf + HISTORY_SIZE
+		         + encoder->parallel_len, buf, bytes);
+		encoder->parallel_len += (unsigned int) bytes;
+		buf += bytes;
+		buf_len -= bytes;
+
+		if (encoder->parallel_len
+		    >= encoder->threads * PARALLEL_CHUNK) {
+			compress_chunks(encoder);
+		}
+	}
+
+	return !encoder->bit_stream_writer.failed;
+}
+
+static void free_parallel(LHANewEncoder *encoder)
+{
+	unsigned int i;
+
+	for (i = 0; i < encoder->threads; ++i) {
+		if (encoder->parsers != NULL) {
+			lha_free(encoder->parsers[i]);
+		}
+
+		if (encoder->chunks != NULL) {
+			lha_free(encoder->chunks[i].codes);
+			lha_free(encoder->chunks[i].offsets);
+		}
+	}
+
+	lha_free(encoder->parsers);
+	lha_free(encoder->chunks);
+	lha_free(encoder->parallel_buf);
+
+	encoder->threads = 1;
+	encoder->parsers = NULL;
+	encoder->chunks = NULL;
+	encoder->parallel_buf = NULL;
+}
+
+static int lha_lh_new_set_threads(void *data, unsigned int threads)
+{
+	LHANewEncoder *encoder = data;
+	unsigned int i;
+
+	free_parallel(encoder);
+
+	if (threads <= 1) {
+		return 1;
+	} else if (threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+
+	encoder->threads = threads;
+	encoder->parsers = lha_calloc(threads, sizeof(LHANewEncoder *));
+	encoder->chunks = lha_calloc(threads, sizeof(LHAChunk));
+	encoder->parallel_buf = lha_malloc(HISTORY_SIZE
+	                                   + threads * PARALLEL_CHUNK);
+
+	if (encoder->parsers == NULL || encoder->chunks == NULL
+	 || encoder->parallel_buf == NULL) {
+		free_parallel(encoder);
+		return 0;
+	}
+
+	// Each chunk can have up to one command per byte.
+
+	for (i = 0; i < threads; ++i) {
+		encoder->parsers[i] = lha_malloc(sizeof(LHANewEncoder));
+		encoder->chunks[i].codes =
+		    lha_malloc(PARALLEL_CHUNK * sizeof(uint16_t));
+		encoder->chunks[i].offsets =
+		    lha_malloc(PARALLEL_CHUNK * sizeof(uint16_t));
+
+		if (encoder->parsers[i] == NULL
+		 || encoder->chunks[i].codes == NULL
+		 || encoder->chunks[i].offsets == NULL) {
+			free_parallel(encoder);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void lha_lh_new_free(void *data)
+{
+	free_parallel(data);
+}
+
+static int lha_lh_new_finish(void *data)
+{
+	LHANewEncoder *encoder = data;
+
+	if (encoder->parallel_len > 0) {
+		compress_chunks(encoder);
+	}
+
+	compress_window(encoder, 1);
+
+	if (encoder->block_len > encoder->segment_start) {
+		end_segment(encoder);
+	}
+
+	if (encoder->block_len > 0) {
+		write_block(encoder);
+	}
+
+	return bit_stream_writer_flush(&encoder->bit_stream_writer);
+}
+
+const LHAEncoderType ENCODER_NAME = {
+	lha_lh_new_encoder_init,
+	lha_lh_new_free,
+	lha_lh_new_write,
+	lha_lh_new_finish,
+	lha_lh_new_set_level,
+	lha_lh_new_set_chain_depth,
+	lha_lh_new_set_threads,
+	sizeof(LHANewEncoder)
+};
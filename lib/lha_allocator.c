@@ -0,0 +1,114 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lha_allocator.h"
+
+static void *default_malloc(size_t size, void *user_data)
+{
+	return malloc(size);
+}
+
+static void *default_realloc(void *ptr, size_t size, void *user_data)
+{
+	return realloc(ptr, size);
+}
+
+static void default_free(void *ptr, void *user_data)
+{
+	free(ptr);
+}
+
+static const LHAAllocator default_allocator = {
+	default_malloc,
+	default_realloc,
+	default_free,
+	NULL
+};
+
+static LHAAllocator allocator = {
+	default_malloc,
+	default_realloc,
+	default_free,
+	NULL
+};
+
+void lha_set_allocator(const LHAAllocator *new_allocator)
+{
+	if (new_allocator != NULL) {
+		allocator = *new_allocator;
+	} else {
+		allocator = default_allocator;
+	}
+}
+
+void *lha_malloc(size_t size)
+{
+	return allocator.malloc(size, allocator.user_data);
+}
+
+void *lha_calloc(size_t nmemb, size_t size)
+{
+	void *result;
+
+	// Guard against overflow when calculating the total size.
+
+	if (size != 0 && nmemb > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	result = allocator.malloc(nmemb * size, allocator.user_data);
+
+	if (result != NULL) {
+		memset(result, 0, nmemb * size);
+	}
+
+	return result;
+}
+
+void *lha_realloc(void *ptr, size_t size)
+{
+	return allocator.realloc(ptr, size, allocator.user_data);
+}
+
+void lha_free(void *ptr)
+{
+	if (ptr != NULL) {
+		allocator.free(ptr, allocator.user_data);
+	}
+}
+
+char *lha_strdup(const char *s)
+{
+	size_t len;
+	char *result;
+
+	len = strlen(s) + 1;
+	result = lha_malloc(len);
+
+	if (result != NULL) {
+		memcpy(result, s, len);
+	}
+
+	return result;
+}
@@ -0,0 +1,76 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_LHA_ALLOCATOR_H
+#define LHASA_LHA_ALLOCATOR_H
+
+#include "public/lha_allocator.h"
+
+// Internal memory allocation functions. All memory allocated by the
+// library goes through these, so that it uses the allocator set by
+// lha_set_allocator().
+
+/**
+ * Allocate a block of memory.
+ *
+ * @param size         Size of the block, in bytes.
+ * @return             Pointer to the new block, or NULL for failure.
+ */
+
+void *lha_malloc(size_t size);
+
+/**
+ * Allocate a block of memory, initialized to zero.
+ *
+ * @param nmemb        Number of elements.
+ * @param size         Size of each element, in bytes.
+ * @return             Pointer to the new block, or NULL for failure.
+ */
+
+void *lha_calloc(size_t nmemb, size_t size);
+
+/**
+ * Resize a block of memory.
+ *
+ * @param ptr          Pointer to the block to resize, or NULL.
+ * @param size         New size of the block, in bytes.
+ * @return             Pointer to the resized block, or NULL for failure.
+ */
+
+void *lha_realloc(void *ptr, size_t size);
+
+/**
+ * Free a block of memory.
+ *
+ * @param ptr          Pointer to the block to free, or NULL.
+ */
+
+void lha_free(void *ptr);
+
+/**
+ * Allocate a copy of a string.
+ *
+ * @param s            The string to copy.
+ * @return             Pointer to the new string, or NULL for failure.
+ */
+
+char *lha_strdup(const char *s);
+
+#endif /* #ifndef LHASA_LHA_ALLOCATOR_H */
@@ -34,6 +34,18 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #define LHA_ARCH LHA_ARCH_UNIX
 #endif
 
+/**
+ * Cache of handles to open directories.
+ *
+ * Where the operating system supports it, the functions below that
+ * operate on a path use a handle to the parent directory from this
+ * cache, rather than having the full path resolved again on every
+ * call. A NULL pointer can be passed to any of these functions to
+ * just use the path directly.
+ */
+
+typedef struct _LHAArchDirs LHAArchDirs;
+
 typedef enum {
 	LHA_FILE_NONE,
 	LHA_FILE_FILE,
@@ -61,48 +73,149 @@ int lha_arch_vasprintf(char **result, const char *fmt, va_list args);
 
 void lha_arch_set_binary(FILE *handle);
 
+/**
+ * Read a monotonic clock, for measuring elapsed time.
+ *
+ * @return            Current time in nanoseconds, from an arbitrary
+ *                    starting point.
+ */
+
+uint64_t lha_arch_time_ns(void);
+
+/**
+ * Truncate an open file to the specified length. Any buffered data is
+ * flushed first.
+ *
+ * @param handle      The FILE handle, open for writing.
+ * @param length      New length of the file, in bytes.
+ * @return            Non-zero for success, or zero for failure.
+ */
+
+int lha_arch_truncate(FILE *handle, uint64_t length);
+
+/**
+ * Move to a position in an open file, with a 64-bit offset (fseek()
+ * takes a long, which is only 32 bits on some systems).
+ *
+ * @param handle      The FILE handle.
+ * @param offset      Offset, in bytes.
+ * @param whence      SEEK_SET, SEEK_CUR or SEEK_END, as for fseek().
+ * @return            Non-zero for success, or zero for failure.
+ */
+
+int lha_arch_fseek(FILE *handle, int64_t offset, int whence);
+
+/**
+ * Get the current position in an open file, as a 64-bit offset.
+ *
+ * @param handle      The FILE handle.
+ * @return            Offset from the start of the file, in bytes, or
+ *                    a negative value if the position is not known
+ *                    (for example, because the file is a pipe).
+ */
+
+int64_t lha_arch_ftell(FILE *handle);
+
+/**
+ * Handle to a thread started by @ref lha_arch_thread_new.
+ */
+
+typedef struct _LHAArchThread LHAArchThread;
+
+/**
+ * Start a new thread.
+ *
+ * @param func        Function for the new thread to run.
+ * @param data        Pointer to pass to the function.
+ * @return            Handle to the new thread, or NULL if a thread could
+ *                    not be started, or threads are not supported on
+ *                    this system. The caller can then just call the
+ *                    function itself.
+ */
+
+LHAArchThread *lha_arch_thread_new(void (*func)(void *data), void *data);
+
+/**
+ * Wait for a thread to finish, and free its handle.
+ *
+ * @param thread      Handle to the thread.
+ */
+
+void lha_arch_thread_join(LHAArchThread *thread);
+
+/**
+ * Get the number of processors available to run threads.
+ *
+ * @return            Number of processors; at least one.
+ */
+
+unsigned int lha_arch_num_cpus(void);
+
+/**
+ * Create a new cache of directory handles.
+ *
+ * @return            Pointer to the new cache, or NULL if a cache could
+ *                    not be created or is not supported on this system.
+ */
+
+LHAArchDirs *lha_arch_dirs_new(void);
+
+/**
+ * Free a cache of directory handles, closing any open directories.
+ *
+ * @param dirs        The cache to free, or NULL.
+ */
+
+void lha_arch_dirs_free(LHAArchDirs *dirs);
+
 /**
  * Create a directory.
  *
+ * @param dirs        Cache of directory handles, or NULL.
  * @param path        Path to the directory to create.
  * @param unix_perms  Unix permissions for the directory to create.
  * @return            Non-zero if the directory was created successfully.
  */
 
-int lha_arch_mkdir(char *path, unsigned int unix_perms);
+int lha_arch_mkdir(LHAArchDirs *dirs, char *path, unsigned int unix_perms);
 
 /**
  * Change the Unix ownership of the specified file or directory.
  * If this is not a Unix system, do nothing.
  *
+ * @param dirs       Cache of directory handles, or NULL.
  * @param filename   Path to the file or directory.
  * @param unix_uid   The UID to set.
  * @param unix_gid   The GID to set.
  * @return           Non-zero if set successfully.
  */
 
-int lha_arch_chown(char *filename, int unix_uid, int unix_gid);
+int lha_arch_chown(LHAArchDirs *dirs, char *filename,
+                   int unix_uid, int unix_gid);
 
 /**
  * Change the Unix permissions on the specified file or directory.
  *
+ * @param dirs        Cache of directory handles, or NULL.
  * @param filename    Path to the file or directory.
  * @param unix_perms  The permissions to set.
  * @return            Non-zero if set successfully.
  */
 
-int lha_arch_chmod(char *filename, int unix_perms);
+int lha_arch_chmod(LHAArchDirs *dirs, char *filename, int unix_perms);
 
 /**
  * Set the file creation / modification time on the specified file or
  * directory.
  *
+ * @param dirs        Cache of directory handles, or NULL.
  * @param filename    Path to the file or directory.
  * @param timestamp   The Unix timestamp to set.
  * @return            Non-zero if set successfully.
  */
 
-int lha_arch_utime(char *filename, unsigned int timestamp);
+int lha_arch_utime(LHAArchDirs *dirs, char *filename,
+                   unsigned int timestamp);
 
 /**
  * Set the file creation, modification and access times for the
@@ -123,6 +236,7 @@ int lha_arch_set_windows_timestamps(char *filename,
 /**
  * Open a new file for writing.
  *
+ * @param dirs        Cache of directory handles, or NULL.
  * @param filename    Path to the file or directory.
  * @param unix_uid    Unix UID to set for the new file, or -1 to not set.
  * @param unix_gid    Unix GID to set for the new file, or -1 to not set.
@@ -131,17 +245,18 @@ int lha_arch_set_windows_timestamps(char *filename,
  * @return            Standard C file handle.
  */
 
-FILE *lha_arch_fopen(char *filename, int unix_uid,
+FILE *lha_arch_fopen(LHAArchDirs *dirs, char *filename, int unix_uid,
                      int unix_gid, int unix_perms);
 
 /**
  * Query whether the specified file exists.
  *
+ * @param dirs        Cache of directory handles, or NULL.
  * @param filename    Path to the file.
  * @return            The type of file.
  */
 
-LHAFileType lha_arch_exists(char *filename);
+LHAFileType lha_arch_exists(LHAArchDirs *dirs, char *filename);
 
 /**
  * Create a symbolic link.
@@ -149,11 +264,45 @@ LHAFileType lha_arch_exists(char *filename);
  * If a file already exists at the location of the link to be created, it is
  * overwritten.
  *
+ * @param dirs        Cache of directory handles, or NULL.
  * @param path        Path to the symbolic link to create.
  * @param target      Target for the symbolic link.
  * @return            Non-zero for success.
  */
 
-int lha_arch_symlink(char *path, char *target);
+int lha_arch_symlink(LHAArchDirs *dirs, char *path, char *target);
+
+/**
+ * Query whether a file name refers to the same file as an open file
+ * handle (possibly through a different path, or a link).
+ *
+ * @param handle      The FILE handle.
+ * @param filename    Path to the file.
+ * @return            Non-zero if the file is the same, or zero if it is
+ *                    not, or does not exist.
+ */
+
+int lha_arch_same_file(FILE *handle, char *filename);
+
+/**
+ * Create a new file with a unique name, for writing. The file has the
+ * permissions that a file created with fopen() would have.
+ *
+ * @param filename    Path to the file, ending in "XXXXXX". This is
+ *                    modified to give the name of the new file.
+ * @return            Standard C file handle, or NULL for failure.
+ */
+
+FILE *lha_arch_fopen_temp(char *filename);
+
+/**
+ * Rename a file, replacing any existing file with the new name.
+ *
+ * @param from        Path to the file to rename.
+ * @param to          New path for the file.
+ * @return            Non-zero for success, or zero for failure.
+ */
+
+int lha_arch_rename(char *from, char *to);
 
 #endif /* ifndef LHASA_LHA_ARCH_H */
@@ -23,18 +23,26 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 //
 
 #define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
 #include "lha_arch.h"
+#include "lha_allocator.h"
 
 #if LHA_ARCH == LHA_ARCH_UNIX
 
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef LHA_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 // TODO: This file depends on vasprintf(), which is a non-standard
 // function (_GNU_SOURCE above). Most modern Unix systems have an
 // implementation of it, but develop a compatible workaround for
@@ -51,40 +59,409 @@ void lha_arch_set_binary(FILE *handle)
 	// "text" and "binary" files.
 }
 
-int lha_arch_mkdir(char *path, unsigned int unix_perms)
+uint64_t lha_arch_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+int lha_arch_truncate(FILE *handle, uint64_t length)
 {
-	return mkdir(path, unix_perms) == 0;
+	if ((uint64_t) (off_t) length != length || fflush(handle) != 0) {
+		return 0;
+	}
+
+	return ftruncate(fileno(handle), (off_t) length) == 0;
+}
+
+int lha_arch_fseek(FILE *handle, int64_t offset, int whence)
+{
+	if ((int64_t) (off_t) offset != offset) {
+		return 0;
+	}
+
+	return fseeko(handle, (off_t) offset, whence) == 0;
 }
 
-int lha_arch_chown(char *filename, int unix_uid, int unix_gid)
+int64_t lha_arch_ftell(FILE *handle)
 {
-	return chown(filename, unix_uid, unix_gid) == 0;
+	return (int64_t) ftello(handle);
 }
 
-int lha_arch_chmod(char *filename, int unix_perms)
+#ifdef LHA_HAVE_PTHREAD
+
+struct _LHAArchThread {
+	pthread_t thread;
+	void (*func)(void *data);
+	void *data;
+};
+
+static void *thread_main(void *arg)
 {
-	return chmod(filename, unix_perms) == 0;
+	LHAArchThread *thread = arg;
+
+	thread->func(thread->data);
+
+	return NULL;
 }
 
-int lha_arch_utime(char *filename, unsigned int timestamp)
+LHAArchThread *lha_arch_thread_new(void (*func)(void *data), void *data)
 {
+	LHAArchThread *thread;
+
+	thread = lha_malloc(sizeof(LHAArchThread));
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->func = func;
+	thread->data = data;
+
+	if (pthread_create(&thread->thread, NULL, thread_main, thread) != 0) {
+		lha_free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void lha_arch_thread_join(LHAArchThread *thread)
+{
+	pthread_join(thread->thread, NULL);
+	lha_free(thread);
+}
+
+#else
+
+LHAArchThread *lha_arch_thread_new(void (*func)(void *data), void *data)
+{
+	return NULL;
+}
+
+void lha_arch_thread_join(LHAArchThread *thread)
+{
+}
+
+#endif /* #ifdef LHA_HAVE_PTHREAD */
+
+unsigned int lha_arch_num_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long result;
+
+	result = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (result > 0) {
+		return (unsigned int) result;
+	}
+#endif
+
+	return 1;
+}
+
+// Number of directory handles to keep open in a cache.
+
+#define DIR_CACHE_SIZE 16
+
+// The *at() family of functions (openat(), mkdirat(), etc.) allow a
+// path to be resolved relative to an open directory handle. These were
+// standardized in POSIX.1-2008; AT_FDCWD is defined where they exist.
+// The fallback versions below define AT_FDCWD themselves, so a separate
+// macro is used to test for the real ones.
+
+#ifdef AT_FDCWD
+#define LHA_HAVE_AT_CALLS
+#endif
+
+#ifdef LHA_HAVE_AT_CALLS
+
+typedef struct {
+	char *path;
+	int fd;
+	unsigned int last_used;
+} DirHandle;
+
+struct _LHAArchDirs {
+	DirHandle handles[DIR_CACHE_SIZE];
+	unsigned int clock;
+};
+
+LHAArchDirs *lha_arch_dirs_new(void)
+{
+	LHAArchDirs *dirs;
+	unsigned int i;
+
+	dirs = lha_calloc(1, sizeof(LHAArchDirs));
+
+	if (dirs == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < DIR_CACHE_SIZE; ++i) {
+		dirs->handles[i].path = NULL;
+		dirs->handles[i].fd = -1;
+		dirs->handles[i].last_used = 0;
+	}
+
+	dirs->clock = 0;
+
+	return dirs;
+}
+
+void lha_arch_dirs_free(LHAArchDirs *dirs)
+{
+	unsigned int i;
+
+	if (dirs == NULL) {
+		return;
+	}
+
+	for (i = 0; i < DIR_CACHE_SIZE; ++i) {
+		if (dirs->handles[i].fd >= 0) {
+			close(dirs->handles[i].fd);
+		}
+		lha_free(dirs->handles[i].path);
+	}
+
+	lha_free(dirs);
+}
+
+// Get a handle to the specified directory from the cache, opening it
+// if it is not already open. Returns -1 if it cannot be opened.
+
+static int get_dir_handle(LHAArchDirs *dirs, char *dir)
+{
+	DirHandle *handle;
+	unsigned int i;
+	int fd;
+
+	++dirs->clock;
+
+	// Already open? Otherwise, find the least recently used handle,
+	// which will be replaced.
+
+	handle = &dirs->handles[0];
+
+	for (i = 0; i < DIR_CACHE_SIZE; ++i) {
+		if (dirs->handles[i].path != NULL
+		 && !strcmp(dirs->handles[i].path, dir)) {
+			dirs->handles[i].last_used = dirs->clock;
+			return dirs->handles[i].fd;
+		}
+
+		if (dirs->handles[i].last_used < handle->last_used) {
+			handle = &dirs->handles[i];
+		}
+	}
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (handle->fd >= 0) {
+		close(handle->fd);
+	}
+	lha_free(handle->path);
+
+	handle->path = lha_strdup(dir);
+
+	if (handle->path == NULL) {
+		close(fd);
+		handle->fd = -1;
+		handle->last_used = 0;
+		return -1;
+	}
+
+	handle->fd = fd;
+	handle->last_used = dirs->clock;
+
+	return fd;
+}
+
+// Split a path into the directory containing it and the final path
+// component. A copy of the path is returned in *copy, which must be
+// freed by the caller; *name is set to point to the final component
+// within it. The return value is the handle of the directory to use
+// with the *at() functions; if there is no cache, or the directory
+// cannot be opened, this is AT_FDCWD and *name points to the full path.
+
+static int split_path(LHAArchDirs *dirs, char *path,
+                      char **copy, char **name)
+{
+	char *p;
+	int fd;
+
+	*copy = NULL;
+	*name = path;
+
+	if (dirs == NULL) {
+		return AT_FDCWD;
+	}
+
+	*copy = lha_strdup(path);
+
+	if (*copy == NULL) {
+		return AT_FDCWD;
+	}
+
+	// Strip off any trailing '/'s (directory paths end in a '/').
+
+	p = *copy + strlen(*copy);
+
+	while (p > *copy + 1 && *(p - 1) == '/') {
+		--p;
+		*p = '\0';
+	}
+
+	p = strrchr(*copy, '/');
+
+	// Paths in the current directory, or in the root directory, can
+	// be used as they are.
+
+	if (p == NULL || p == *copy) {
+		return AT_FDCWD;
+	}
+
+	*p = '\0';
+	fd = get_dir_handle(dirs, *copy);
+
+	if (fd < 0) {
+		return AT_FDCWD;
+	}
+
+	*name = p + 1;
+
+	return fd;
+}
+
+#else /* #ifdef LHA_HAVE_AT_CALLS */
+
+// Fallback versions for systems without the *at() functions, that
+// just use the full path. The directory handle is always AT_FDCWD.
+
+#define AT_FDCWD 0
+#define openat(dirfd, path, flags, mode) \
+	((void) (dirfd), open(path, flags, mode))
+#define mkdirat(dirfd, path, mode) ((void) (dirfd), mkdir(path, mode))
+#define fchownat(dirfd, path, uid, gid, flags) \
+	((void) (dirfd), chown(path, uid, gid))
+#define fchmodat(dirfd, path, mode, flags) \
+	((void) (dirfd), chmod(path, mode))
+#define fstatat(dirfd, path, buf, flags) ((void) (dirfd), stat(path, buf))
+#define unlinkat(dirfd, path, flags) ((void) (dirfd), unlink(path))
+#define symlinkat(target, dirfd, path) \
+	((void) (dirfd), symlink(target, path))
+
+LHAArchDirs *lha_arch_dirs_new(void)
+{
+	return NULL;
+}
+
+void lha_arch_dirs_free(LHAArchDirs *dirs)
+{
+}
+
+static int split_path(LHAArchDirs *dirs, char *path,
+                      char **copy, char **name)
+{
+	*copy = NULL;
+	*name = path;
+
+	return AT_FDCWD;
+}
+
+#endif /* #ifdef LHA_HAVE_AT_CALLS */
+
+int lha_arch_mkdir(LHAArchDirs *dirs, char *path, unsigned int unix_perms)
+{
+	char *copy, *name;
+	int dirfd;
+	int result;
+
+	dirfd = split_path(dirs, path, &copy, &name);
+	result = mkdirat(dirfd, name, unix_perms) == 0;
+	lha_free(copy);
+
+	return result;
+}
+
+int lha_arch_chown(LHAArchDirs *dirs, char *filename,
+                   int unix_uid, int unix_gid)
+{
+	char *copy, *name;
+	int dirfd;
+	int result;
+
+	dirfd = split_path(dirs, filename, &copy, &name);
+	result = fchownat(dirfd, name, unix_uid, unix_gid, 0) == 0;
+	lha_free(copy);
+
+	return result;
+}
+
+int lha_arch_chmod(LHAArchDirs *dirs, char *filename, int unix_perms)
+{
+	char *copy, *name;
+	int dirfd;
+	int result;
+
+	dirfd = split_path(dirs, filename, &copy, &name);
+	result = fchmodat(dirfd, name, unix_perms, 0) == 0;
+	lha_free(copy);
+
+	return result;
+}
+
+int lha_arch_utime(LHAArchDirs *dirs, char *filename,
+                   unsigned int timestamp)
+{
+	char *copy, *name;
+	int dirfd;
+	int result;
+#ifdef LHA_HAVE_AT_CALLS
+	struct timespec times[2];
+
+	times[0].tv_sec = (time_t) timestamp;
+	times[0].tv_nsec = 0;
+	times[1] = times[0];
+
+	dirfd = split_path(dirs, filename, &copy, &name);
+	result = utimensat(dirfd, name, times, 0) == 0;
+#else
 	struct utimbuf times;
 
 	times.actime = (time_t) timestamp;
 	times.modtime = (time_t) timestamp;
 
-	return utime(filename, &times) == 0;
+	dirfd = split_path(dirs, filename, &copy, &name);
+	(void) dirfd;
+	result = utime(name, &times) == 0;
+#endif
+	lha_free(copy);
+
+	return result;
 }
 
-FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
+FILE *lha_arch_fopen(LHAArchDirs *dirs, char *filename,
+                     int unix_uid, int unix_gid, int unix_perms)
 {
 	FILE *fstream;
+	char *copy, *name;
+	int dirfd;
 	int fileno;
 
+	dirfd = split_path(dirs, filename, &copy, &name);
+
 	// The O_EXCL flag will cause the open() below to fail if the
 	// file already exists. Remove it first.
 
-	unlink(filename);
+	unlinkat(dirfd, name, 0);
 
 	// If we have file permissions, they must be set after the
 	// file is created and UID/GID have been set.  When open()ing
@@ -94,9 +471,10 @@ FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
 	// a malicious symlink from overwriting arbitrary filesystem
 	// locations.
 
-	fileno = open(filename, O_CREAT|O_WRONLY|O_EXCL, 0600);
+	fileno = openat(dirfd, name, O_CREAT|O_WRONLY|O_EXCL, 0600);
 
 	if (fileno < 0) {
+		lha_free(copy);
 		return NULL;
 	}
 
@@ -126,7 +504,8 @@ FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
 	if (unix_perms >= 0) {
 		if (fchmod(fileno, unix_perms) != 0) {
 			close(fileno);
-			remove(filename);
+			unlinkat(dirfd, name, 0);
+			lha_free(copy);
 			return NULL;
 		}
 	}
@@ -137,36 +516,103 @@ FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
 
 	if (fstream == NULL) {
 		close(fileno);
-		remove(filename);
+		unlinkat(dirfd, name, 0);
+		lha_free(copy);
 		return NULL;
 	}
 
+	lha_free(copy);
+
 	return fstream;
 }
 
-LHAFileType lha_arch_exists(char *filename)
+LHAFileType lha_arch_exists(LHAArchDirs *dirs, char *filename)
 {
 	struct stat statbuf;
+	char *copy, *name;
+	LHAFileType result;
+	int dirfd;
+
+	dirfd = split_path(dirs, filename, &copy, &name);
 
-	if (stat(filename, &statbuf) != 0) {
+	if (fstatat(dirfd, name, &statbuf, 0) != 0) {
 		if (errno == ENOENT) {
-			return LHA_FILE_NONE;
+			result = LHA_FILE_NONE;
 		} else {
-			return LHA_FILE_ERROR;
+			result = LHA_FILE_ERROR;
 		}
+	} else if (S_ISDIR(statbuf.st_mode)) {
+		result = LHA_FILE_DIRECTORY;
+	} else {
+		result = LHA_FILE_FILE;
 	}
 
-	if (S_ISDIR(statbuf.st_mode)) {
-		return LHA_FILE_DIRECTORY;
-	} else {
-		return LHA_FILE_FILE;
+	lha_free(copy);
+
+	return result;
+}
+
+int lha_arch_symlink(LHAArchDirs *dirs, char *path, char *target)
+{
+	char *copy, *name;
+	int dirfd;
+	int result;
+
+	dirfd = split_path(dirs, path, &copy, &name);
+	unlinkat(dirfd, name, 0);
+	result = symlinkat(target, dirfd, name) == 0;
+	lha_free(copy);
+
+	return result;
+}
+
+int lha_arch_same_file(FILE *handle, char *filename)
+{
+	struct stat handle_stat, file_stat;
+
+	return fstat(fileno(handle), &handle_stat) == 0
+	    && stat(filename, &file_stat) == 0
+	    && handle_stat.st_dev == file_stat.st_dev
+	    && handle_stat.st_ino == file_stat.st_ino;
+}
+
+FILE *lha_arch_fopen_temp(char *filename)
+{
+	FILE *fstream;
+	mode_t mask;
+	int fileno;
+
+	fileno = mkstemp(filename);
+
+	if (fileno < 0) {
+		return NULL;
 	}
+
+	// mkstemp() creates the file with permissions for the current
+	// user only. Reading the umask also sets it, so set it back.
+
+	mask = umask(0);
+	umask(mask);
+
+	if (fchmod(fileno, 0666 & ~mask) != 0) {
+		close(fileno);
+		unlink(filename);
+		return NULL;
+	}
+
+	fstream = fdopen(fileno, "wb");
+
+	if (fstream == NULL) {
+		close(fileno);
+		unlink(filename);
+	}
+
+	return fstream;
 }
 
-int lha_arch_symlink(char *path, char *target)
+int lha_arch_rename(char *from, char *to)
 {
-	unlink(path);
-	return symlink(target, path) == 0;
+	return rename(from, to) == 0;
 }
 
 #endif /* LHA_ARCH_UNIX */
@@ -24,6 +24,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 //
 
 #include "lha_arch.h"
+#include "lha_allocator.h"
 
 #if LHA_ARCH == LHA_ARCH_WINDOWS
 
@@ -31,8 +32,12 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <windows.h>
 #include <fcntl.h>
 #include <io.h>
+#include <process.h>
+#include <share.h>
+#include <sys/stat.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 
 static uint64_t unix_epoch_offset = 0;
@@ -58,17 +63,125 @@ void lha_arch_set_binary(FILE *handle)
 	_setmode(_fileno(handle), _O_BINARY);
 }
 
-int lha_arch_mkdir(char *path, unsigned int unix_mode)
+uint64_t lha_arch_time_ns(void)
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	QueryPerformanceCounter(&counter);
+
+	// Split the calculation to avoid overflow.
+
+	return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000000
+	     + (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000000
+	     / (uint64_t) frequency.QuadPart;
+}
+
+int lha_arch_truncate(FILE *handle, uint64_t length)
+{
+	if (length > INT64_MAX || fflush(handle) != 0) {
+		return 0;
+	}
+
+	return _chsize_s(_fileno(handle), (__int64) length) == 0;
+}
+
+int lha_arch_fseek(FILE *handle, int64_t offset, int whence)
+{
+	return _fseeki64(handle, (__int64) offset, whence) == 0;
+}
+
+int64_t lha_arch_ftell(FILE *handle)
+{
+	return (int64_t) _ftelli64(handle);
+}
+
+struct _LHAArchThread {
+	HANDLE handle;
+	void (*func)(void *data);
+	void *data;
+};
+
+// Threads are started with _beginthreadex() rather than CreateThread(),
+// as they use the C library.
+
+static unsigned int __stdcall thread_main(void *arg)
+{
+	LHAArchThread *thread = arg;
+
+	thread->func(thread->data);
+
+	return 0;
+}
+
+LHAArchThread *lha_arch_thread_new(void (*func)(void *data), void *data)
+{
+	LHAArchThread *thread;
+
+	thread = lha_malloc(sizeof(LHAArchThread));
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->func = func;
+	thread->data = data;
+	thread->handle = (HANDLE) _beginthreadex(NULL, 0, thread_main, thread,
+	                                         0, NULL);
+
+	if (thread->handle == NULL) {
+		lha_free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void lha_arch_thread_join(LHAArchThread *thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	lha_free(thread);
+}
+
+unsigned int lha_arch_num_cpus(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	if (info.dwNumberOfProcessors < 1) {
+		return 1;
+	}
+
+	return (unsigned int) info.dwNumberOfProcessors;
+}
+
+LHAArchDirs *lha_arch_dirs_new(void)
+{
+	return NULL;
+}
+
+void lha_arch_dirs_free(LHAArchDirs *dirs)
+{
+}
+
+int lha_arch_mkdir(LHAArchDirs *dirs, char *path, unsigned int unix_mode)
 {
 	return CreateDirectoryA(path, NULL) != 0;
 }
 
-int lha_arch_chown(char *filename, int unix_uid, int unix_gid)
+int lha_arch_chown(LHAArchDirs *dirs, char *filename,
+                   int unix_uid, int unix_gid)
 {
 	return 1;
 }
 
-int lha_arch_chmod(char *filename, int unix_perms)
+int lha_arch_chmod(LHAArchDirs *dirs, char *filename, int unix_perms)
 {
 	return 1;
 }
@@ -134,7 +247,8 @@ int lha_arch_set_windows_timestamps(char *filename,
 	                      &_modification_time, &_access_time);
 }
 
-int lha_arch_utime(char *filename, unsigned int timestamp)
+int lha_arch_utime(LHAArchDirs *dirs, char *filename,
+                   unsigned int timestamp)
 {
 	SYSTEMTIME unix_epoch;
 	FILETIME filetime;
@@ -169,12 +283,13 @@ int lha_arch_utime(char *filename, unsigned int timestamp)
 	return set_timestamps(filename, &filetime, &filetime, &filetime);
 }
 
-FILE *lha_arch_fopen(char *filename, int unix_uid, int unix_gid, int unix_perms)
+FILE *lha_arch_fopen(LHAArchDirs *dirs, char *filename,
+                     int unix_uid, int unix_gid, int unix_perms)
 {
 	return fopen(filename, "wb");
 }
 
-LHAFileType lha_arch_exists(char *filename)
+LHAFileType lha_arch_exists(LHAArchDirs *dirs, char *filename)
 {
 	WIN32_FILE_ATTRIBUTE_DATA file_attr;
 
@@ -194,10 +309,73 @@ LHAFileType lha_arch_exists(char *filename)
 	return LHA_FILE_NONE;
 }
 
-int lha_arch_symlink(char *path, char *target)
+int lha_arch_symlink(LHAArchDirs *dirs, char *path, char *target)
 {
 	// No-op.
 	return 1;
 }
 
+int lha_arch_same_file(FILE *handle, char *filename)
+{
+	BY_HANDLE_FILE_INFORMATION handle_info, file_info;
+	HANDLE file;
+	int result;
+
+	file = CreateFileA(filename, 0,
+	                   FILE_SHARE_READ | FILE_SHARE_WRITE
+	                 | FILE_SHARE_DELETE,
+	                   NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS,
+	                   NULL);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+
+	result = GetFileInformationByHandle(
+	             (HANDLE) _get_osfhandle(_fileno(handle)), &handle_info)
+	      && GetFileInformationByHandle(file, &file_info)
+	      && handle_info.dwVolumeSerialNumber
+	         == file_info.dwVolumeSerialNumber
+	      && handle_info.nFileIndexHigh == file_info.nFileIndexHigh
+	      && handle_info.nFileIndexLow == file_info.nFileIndexLow;
+
+	CloseHandle(file);
+
+	return result;
+}
+
+FILE *lha_arch_fopen_temp(char *filename)
+{
+	FILE *fstream;
+	int fileno;
+
+	if (_mktemp_s(filename, strlen(filename) + 1) != 0) {
+		return NULL;
+	}
+
+	// _mktemp_s() only picks a name that does not exist yet; create
+	// the file with _O_EXCL so that another file created with the
+	// same name in the meantime is not overwritten.
+
+	if (_sopen_s(&fileno, filename,
+	             _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY,
+	             _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0) {
+		return NULL;
+	}
+
+	fstream = _fdopen(fileno, "wb");
+
+	if (fstream == NULL) {
+		_close(fileno);
+		remove(filename);
+	}
+
+	return fstream;
+}
+
+int lha_arch_rename(char *from, char *to)
+{
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
 #endif /* LHA_ARCH_WINDOWS */
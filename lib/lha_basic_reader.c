@@ -24,6 +24,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "crc16.h"
 
+#include "lha_allocator.h"
 #include "lha_decoder.h"
 #include "lha_basic_reader.h"
 
@@ -32,13 +33,23 @@ struct _LHABasicReader {
 	LHAFileHeader *curr_file;
 	size_t curr_file_remaining;
 	int eof;
+	int recover;
 };
 
+// Input stream that reads from a block of data already in memory.
+// Used to check candidate headers when recovering from errors.
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len;
+	int truncated;
+} BufferSource;
+
 LHABasicReader *lha_basic_reader_new(LHAInputStream *stream)
 {
 	LHABasicReader *reader;
 
-	reader = calloc(1, sizeof(LHABasicReader));
+	reader = lha_calloc(1, sizeof(LHABasicReader));
 
 	if (reader == NULL) {
 		return NULL;
@@ -48,6 +59,7 @@ LHABasicReader *lha_basic_reader_new(LHAInputStream *stream)
 	reader->curr_file = NULL;
 	reader->curr_file_remaining = 0;
 	reader->eof = 0;
+	reader->recover = 0;
 
 	return reader;
 }
@@ -58,7 +70,78 @@ void lha_basic_reader_free(LHABasicReader *reader)
 		lha_file_header_free(reader->curr_file);
 	}
 
-	free(reader);
+	lha_free(reader);
+}
+
+void lha_basic_reader_set_recover(LHABasicReader *reader, int recover)
+{
+	reader->recover = recover;
+}
+
+static int buffer_source_read(void *handle, void *buf, size_t buf_len)
+{
+	BufferSource *source = handle;
+
+	if (buf_len > source->data_len) {
+		buf_len = source->data_len;
+		source->truncated = 1;
+	}
+
+	memcpy(buf, source->data, buf_len);
+	source->data += buf_len;
+	source->data_len -= buf_len;
+
+	return (int) buf_len;
+}
+
+static const LHAInputStreamType buffer_source = {
+	buffer_source_read,
+	NULL,
+	NULL
+};
+
+// Check whether the specified data is the start of a valid file header.
+// This is stricter than the checks made when reading headers normally:
+// when scanning through corrupted data, only headers that are protected
+// by a checksum or CRC, and use a known compression method, are trusted.
+// If the header runs past the end of the buffer, more data is asked for.
+
+static int valid_header(uint8_t *buf, size_t buf_len, void *user_data)
+{
+	LHAInputStream *stream;
+	LHAFileHeader *header;
+	BufferSource source;
+	int result;
+
+	source.data = buf;
+	source.data_len = buf_len;
+	source.truncated = 0;
+
+	stream = lha_input_stream_new(&buffer_source, &source);
+
+	if (stream == NULL) {
+		return 0;
+	}
+
+	header = lha_file_header_read(stream);
+	lha_input_stream_free(stream);
+
+	if (header == NULL) {
+		return source.truncated ? -1 : 0;
+	}
+
+	// Level 0/1 headers always have a checksum, which has already
+	// been checked. Level 2/3 headers must have the "common"
+	// extended header containing a CRC.
+
+	result = (header->header_level <= 1
+	       || LHA_FILE_HAVE_EXTRA(header, LHA_FILE_COMMON_CRC))
+	      && (!strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR)
+	       || lha_decoder_for_name(header->compress_method) != NULL);
+
+	lha_file_header_free(header);
+
+	return result;
 }
 
 LHAFileHeader *lha_basic_reader_curr_file(LHABasicReader *reader)
@@ -85,6 +168,15 @@ LHAFileHeader *lha_basic_reader_next_file(LHABasicReader *reader)
 		return NULL;
 	}
 
+	// In recovery mode, skip forward past any corrupted data to the
+	// next valid header.
+
+	if (reader->recover
+	 && !lha_input_stream_resync(reader->stream, valid_header, NULL)) {
+		reader->eof = 1;
+		return NULL;
+	}
+
 	// Read the header for the next file.
 
 	reader->curr_file = lha_file_header_read(reader->stream);
@@ -52,6 +52,19 @@ LHABasicReader *lha_basic_reader_new(LHAInputStream *stream);
 
 void lha_basic_reader_free(LHABasicReader *reader);
 
+/**
+ * Set whether the reader should try to recover from corrupted data.
+ *
+ * In recovery mode, the reader scans forward through the input stream
+ * to find the next valid file header, rather than stopping when an
+ * invalid header is encountered.
+ *
+ * @param reader     The LHABasicReader structure.
+ * @param recover    Non-zero to enable recovery mode.
+ */
+
+void lha_basic_reader_set_recover(LHABasicReader *reader, int recover);
+
 /**
  * Return the last file read by @ref lha_basic_reader_next_file.
  *
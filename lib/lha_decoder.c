@@ -23,6 +23,8 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <limits.h>
 
 #include "crc16.h"
+#include "lha_allocator.h"
+#include "lha_arch.h"
 #include "lha_decoder.h"
 
 // Null decoder, used for -lz4-, -lh0-, -pm0-:
@@ -65,6 +67,29 @@ static const struct {
 	{ "-pm2-", &lha_pm2_decoder },
 };
 
+// Amount of decoded data to accumulate before updating the CRC. This
+// is small enough that the data is still in the CPU's cache.
+
+#define CRC_CHUNK_SIZE 4096
+
+// Callback passed to the decoder to read compressed data. This counts
+// the data read if counters are being collected.
+
+static size_t read_input(void *buf, size_t buf_len, void *user_data)
+{
+	LHADecoder *decoder = user_data;
+	size_t result;
+
+	result = decoder->callback(buf, buf_len, decoder->callback_data);
+
+	if (decoder->stats != NULL) {
+		++decoder->stats->input_calls;
+		decoder->stats->bytes_in += result;
+	}
+
+	return result;
+}
+
 #undef lha_decoder_new
 
 // The "actual" lha_decoder_new; code gets #define-renamed to use this.
@@ -80,7 +105,7 @@ LHADecoder *lha_decoder_new64(const LHADecoderType *dtype,
 	// then the private data area used by the algorithm,
 	// followed by the output buffer,
 
-	decoder = calloc(1, sizeof(LHADecoder) + dtype->extra_size
+	decoder = lha_calloc(1, sizeof(LHADecoder) + dtype->extra_size
 	                        + dtype->max_read);
 
 	if (decoder == NULL) {
@@ -88,6 +113,9 @@ LHADecoder *lha_decoder_new64(const LHADecoderType *dtype,
 	}
 
 	decoder->dtype = dtype;
+	decoder->callback = callback;
+	decoder->callback_data = callback_data;
+	decoder->stats = NULL;
 	decoder->progress_callback = NULL;
 	decoder->last_block = UINT_MAX;
 	decoder->outbuf_pos = 0;
@@ -102,9 +130,19 @@ LHADecoder *lha_decoder_new64(const LHADecoderType *dtype,
 	extra_data = decoder + 1;
 	decoder->outbuf = ((uint8_t *) extra_data) + dtype->extra_size;
 
+	// Input is read through read_input() so that it can be counted.
+	// A decoder with no input callback (the MacBinary passthrough)
+	// uses callback_data for its own purposes, so it is passed
+	// through unchanged.
+
+	if (callback != NULL) {
+		callback = read_input;
+		callback_data = decoder;
+	}
+
 	if (dtype->init != NULL
 	 && !dtype->init(extra_data, callback, callback_data)) {
-		free(decoder);
+		lha_free(decoder);
 		return NULL;
 	}
 
@@ -143,7 +181,7 @@ void lha_decoder_free(LHADecoder *decoder)
 		decoder->dtype->free(decoder + 1);
 	}
 
-	free(decoder);
+	lha_free(decoder);
 }
 
 // Check if the stream has progressed far enough that the progress callback
@@ -196,9 +234,32 @@ void lha_decoder_monitor(LHADecoder *decoder,
 	check_progress_callback(decoder);
 }
 
+// Update the CRC of the output stream, timing the calculation if
+// counters are being collected.
+
+static void update_crc(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
+{
+	uint64_t start;
+
+	if (decoder->stats == NULL) {
+		lha_crc16_buf(&decoder->crc, buf, buf_len);
+		return;
+	}
+
+	start = lha_arch_time_ns();
+	lha_crc16_buf(&decoder->crc, buf, buf_len);
+	decoder->stats->crc_time += lha_arch_time_ns() - start;
+}
+
 size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 {
-	size_t filled, bytes;
+	size_t filled, bytes, crc_pos;
+	uint64_t start = 0, crc_time = 0;
+
+	if (decoder->stats != NULL) {
+		start = lha_arch_time_ns();
+		crc_time = decoder->stats->crc_time;
+	}
 
 	// When we reach the end of the stream, we must truncate the
 	// decompressed data at exactly the right point (stream_length),
@@ -215,7 +276,12 @@ size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 	// with some data; this is then copied into buf, with some
 	// data left at the end for the next call.
 
+	// The CRC is updated as the buffer is filled, a chunk at a time,
+	// so that the data is still in the CPU cache when the CRC is
+	// calculated. crc_pos tracks how much has been processed so far.
+
 	filled = 0;
+	crc_pos = 0;
 
 	while (filled < buf_len) {
 
@@ -239,10 +305,32 @@ size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 			break;
 		}
 
-		// If outbuf is now empty, we can process another run to
-		// re-fill it.
+		if (filled - crc_pos >= CRC_CHUNK_SIZE) {
+			update_crc(decoder, buf + crc_pos, filled - crc_pos);
+			crc_pos = filled;
+		}
+
+		// If outbuf is now empty, we can process another run.
+		// If there is enough space left in the output buffer,
+		// decode directly into it, to avoid copying the data
+		// through outbuf.
 
 		if (decoder->outbuf_pos >= decoder->outbuf_len) {
+			if (buf_len - filled >= decoder->dtype->max_read) {
+				bytes = decoder->dtype->read(decoder + 1,
+				                             buf + filled);
+				filled += bytes;
+				decoder->outbuf_len = 0;
+				decoder->outbuf_pos = 0;
+
+				if (bytes == 0) {
+					decoder->decoder_failed = 1;
+					break;
+				}
+
+				continue;
+			}
+
 			decoder->outbuf_len
 			    = decoder->dtype->read(decoder + 1,
 			                           decoder->outbuf);
@@ -257,14 +345,23 @@ size_t lha_decoder_read(LHADecoder *decoder, uint8_t *buf, size_t buf_len)
 		}
 	}
 
-	// Update CRC.
+	// Update CRC for the remainder of the buffer.
 
-	lha_crc16_buf(&decoder->crc, buf, filled);
+	update_crc(decoder, buf + crc_pos, filled - crc_pos);
 
 	// Track stream position.
 
 	decoder->stream_pos += filled;
 
+	// Time spent decoding is the time for the whole call, less the
+	// time spent calculating the CRC.
+
+	if (decoder->stats != NULL) {
+		decoder->stats->bytes_out += filled;
+		decoder->stats->decode_time += lha_arch_time_ns() - start
+		    - (decoder->stats->crc_time - crc_time);
+	}
+
 	// Check progress callback, if one is set:
 
 	if (decoder->progress_callback != NULL) {
@@ -296,3 +393,26 @@ uint64_t lha_decoder_get_length64(LHADecoder *decoder)
 {
 	return decoder->stream_pos;
 }
+
+void lha_decoder_set_stats(LHADecoder *decoder, LHAStats *stats)
+{
+	decoder->stats = stats;
+
+	if (decoder->dtype->set_stats != NULL) {
+		decoder->dtype->set_stats(decoder + 1, stats);
+	}
+}
+
+void lha_decoder_count_copy(LHAStats *stats, size_t length)
+{
+	unsigned int bucket;
+
+	bucket = 0;
+
+	while (bucket < LHA_STATS_COPY_LENGTH_BUCKETS - 1
+	    && (length >> (bucket + 1)) != 0) {
+		++bucket;
+	}
+
+	++stats->copy_lengths[bucket];
+}
@@ -75,6 +75,19 @@ struct _LHADecoderType {
 	    progress bar. */
 
 	size_t block_size;
+
+	/**
+	 * Callback function to set the structure in which the decoder
+	 * records counters about the compressed data: Huffman table
+	 * rebuilds, literals and copies. This may be NULL if the decoder
+	 * does not record any.
+	 *
+	 * @param extra_data     Pointer to the decoder's custom data.
+	 * @param stats          Pointer to the structure in which to
+	 *                       record counters, or NULL to stop.
+	 */
+
+	void (*set_stats)(void *extra_data, LHAStats *stats);
 };
 
 struct _LHADecoder {
@@ -83,6 +96,15 @@ struct _LHADecoder {
 
 	const LHADecoderType *dtype;
 
+	/** Callback function to read compressed data, and its data. */
+
+	LHADecoderCallback callback;
+	void *callback_data;
+
+	/** Structure in which to accumulate counters, or NULL. */
+
+	LHAStats *stats;
+
 	/** Callback function to monitor decoder progress. */
 
 	LHADecoderProgressCallback progress_callback;
@@ -114,4 +136,14 @@ struct _LHADecoder {
 	uint16_t crc;
 };
 
+/**
+ * Record a copy from the history buffer in the copy length histogram.
+ * Decoders call this only when counters are being collected.
+ *
+ * @param stats          Pointer to the structure containing counters.
+ * @param length         Length of the copy, in bytes.
+ */
+
+void lha_decoder_count_copy(LHAStats *stats, size_t length);
+
 #endif /* #ifndef LHASA_LHA_DECODER_H */
@@ -0,0 +1,178 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc16.h"
+#include "lha_allocator.h"
+#include "lha_arch.h"
+#include "lha_encoder.h"
+
+// LHarc compression algorithms:
+extern const LHAEncoderType lha_lh5_encoder;
+extern const LHAEncoderType lha_lh6_encoder;
+extern const LHAEncoderType lha_lh7_encoder;
+
+static const struct {
+	const char *name;
+	const LHAEncoderType *etype;
+} encoders[] = {
+	{ "-lh5-", &lha_lh5_encoder },
+	{ "-lh6-", &lha_lh6_encoder },
+	{ "-lh7-", &lha_lh7_encoder },
+};
+
+// Callback passed to the encoder to write compressed data. This counts
+// the compressed data, so that its length is known for the header.
+
+static size_t write_output(const void *buf, size_t buf_len, void *user_data)
+{
+	LHAEncoder *encoder = user_data;
+	size_t result;
+
+	result = encoder->callback(buf, buf_len, encoder->callback_data);
+	encoder->compressed_length += result;
+
+	return result;
+}
+
+LHAEncoder *lha_encoder_new(const LHAEncoderType *etype,
+                            LHAEncoderCallback callback,
+                            void *callback_data)
+{
+	LHAEncoder *encoder;
+	void *extra_data;
+
+	// Space is allocated together: the LHAEncoder structure,
+	// followed by the private data area used by the algorithm.
+
+	encoder = lha_calloc(1, sizeof(LHAEncoder) + etype->extra_size);
+
+	if (encoder == NULL) {
+		return NULL;
+	}
+
+	encoder->etype = etype;
+	encoder->callback = callback;
+	encoder->callback_data = callback_data;
+	encoder->stream_pos = 0;
+	encoder->compressed_length = 0;
+	encoder->crc = 0;
+
+	extra_data = encoder + 1;
+
+	if (etype->init != NULL
+	 && !etype->init(extra_data, write_output, encoder)) {
+		lha_free(encoder);
+		return NULL;
+	}
+
+	return encoder;
+}
+
+const LHAEncoderType *lha_encoder_for_name(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(encoders) / sizeof(*encoders); ++i) {
+		if (!strcmp(name, encoders[i].name)) {
+			return encoders[i].etype;
+		}
+	}
+
+	// Unknown?
+
+	return NULL;
+}
+
+void lha_encoder_free(LHAEncoder *encoder)
+{
+	if (encoder->etype->free != NULL) {
+		encoder->etype->free(encoder + 1);
+	}
+
+	lha_free(encoder);
+}
+
+void lha_encoder_set_level(LHAEncoder *encoder, int level)
+{
+	if (level < LHA_ENCODER_MIN_LEVEL) {
+		level = LHA_ENCODER_MIN_LEVEL;
+	} else if (level > LHA_ENCODER_MAX_LEVEL) {
+		level = LHA_ENCODER_MAX_LEVEL;
+	}
+
+	if (encoder->etype->set_level != NULL) {
+		encoder->etype->set_level(encoder + 1, (unsigned int) level);
+	}
+}
+
+void lha_encoder_set_chain_depth(LHAEncoder *encoder, unsigned int depth)
+{
+	if (encoder->etype->set_chain_depth != NULL && depth > 0) {
+		encoder->etype->set_chain_depth(encoder + 1, depth);
+	}
+}
+
+int lha_encoder_set_threads(LHAEncoder *encoder, unsigned int threads)
+{
+	if (threads == 0) {
+		threads = lha_arch_num_cpus();
+	}
+
+	if (encoder->etype->set_threads == NULL) {
+		return 1;
+	}
+
+	return encoder->etype->set_threads(encoder + 1, threads);
+}
+
+int lha_encoder_write(LHAEncoder *encoder, const uint8_t *buf,
+                      size_t buf_len)
+{
+	// The CRC is calculated here, rather than by each algorithm, in
+	// the same way as lha_decoder_read() does for decompressed data.
+
+	lha_crc16_buf(&encoder->crc, (uint8_t *) buf, buf_len);
+	encoder->stream_pos += buf_len;
+
+	return encoder->etype->write(encoder + 1, buf, buf_len);
+}
+
+int lha_encoder_finish(LHAEncoder *encoder)
+{
+	return encoder->etype->finish(encoder + 1);
+}
+
+uint16_t lha_encoder_get_crc(LHAEncoder *encoder)
+{
+	return encoder->crc;
+}
+
+uint64_t lha_encoder_get_length(LHAEncoder *encoder)
+{
+	return encoder->stream_pos;
+}
+
+uint64_t lha_encoder_get_compressed_length(LHAEncoder *encoder)
+{
+	return encoder->compressed_length;
+}
@@ -0,0 +1,132 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_LHA_ENCODER_H
+#define LHASA_LHA_ENCODER_H
+
+#include "public/lha_encoder.h"
+
+struct _LHAEncoderType {
+
+	/**
+	 * Callback function to initialize the encoder.
+	 *
+	 * @param extra_data     Pointer to the extra data area allocated for
+	 *                       the encoder.
+	 * @param callback       Callback function to invoke to write
+	 *                       compressed data.
+	 * @param callback_data  Extra pointer to pass to the callback.
+	 * @return               Non-zero for success.
+	 */
+
+	int (*init)(void *extra_data,
+	            LHAEncoderCallback callback,
+	            void *callback_data);
+
+	/**
+	 * Callback function to free the encoder.
+	 *
+	 * @param extra_data     Pointer to the extra data area allocated for
+	 *                       the encoder.
+	 */
+
+	void (*free)(void *extra_data);
+
+	/**
+	 * Callback function to compress more data.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @param buf            Pointer to the data to compress.
+	 * @param buf_len        Size of the data, in bytes.
+	 * @return               Non-zero for success.
+	 */
+
+	int (*write)(void *extra_data, const uint8_t *buf, size_t buf_len);
+
+	/**
+	 * Callback function to write all remaining compressed data at
+	 * the end of the stream.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @return               Non-zero for success.
+	 */
+
+	int (*finish)(void *extra_data);
+
+	/**
+	 * Callback function to set the compression level. This may be
+	 * NULL if the encoder has only one level.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @param level          The compression level, in the range
+	 *                       LHA_ENCODER_MIN_LEVEL to
+	 *                       LHA_ENCODER_MAX_LEVEL.
+	 */
+
+	void (*set_level)(void *extra_data, unsigned int level);
+
+	/**
+	 * Callback function to set the match finder chain depth. This
+	 * may be NULL if the encoder does not search for matches.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @param depth          Maximum number of positions to examine.
+	 */
+
+	void (*set_chain_depth)(void *extra_data, unsigned int depth);
+
+	/**
+	 * Callback function to set the number of threads to use to
+	 * compress. This may be NULL if the encoder always uses one.
+	 *
+	 * @param extra_data     Pointer to the encoder's custom data.
+	 * @param threads        Number of threads; at least one.
+	 * @return               Non-zero for success, or zero if memory
+	 *                       could not be allocated for the threads.
+	 */
+
+	int (*set_threads)(void *extra_data, unsigned int threads);
+
+	/** Number of bytes of extra data to allocate for the encoder. */
+
+	size_t extra_size;
+};
+
+struct _LHAEncoder {
+
+	/** Type of encoder (algorithm) */
+
+	const LHAEncoderType *etype;
+
+	/** Callback function to write compressed data, and its data. */
+
+	LHAEncoderCallback callback;
+	void *callback_data;
+
+	/** Number of bytes written to the encoder, and compressed. */
+
+	uint64_t stream_pos, compressed_length;
+
+	/** CRC of the data written to the encoder. */
+
+	uint16_t crc;
+};
+
+#endif /* #ifndef LHASA_LHA_ENCODER_H */
@@ -23,6 +23,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <ctype.h>
 #include <time.h>
 
+#include "lha_allocator.h"
 #include "lha_endian.h"
 #include "lha_file_header.h"
 #include "ext_header.h"
@@ -39,6 +40,11 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 // Length of a level 2 base header.
 #define LEVEL_2_HEADER_LEN 26 /* bytes */
 
+// Maximum length of a level 2 header, and the offset of the CRC field
+// in the common extended header, which is the first to be written.
+#define LEVEL_2_MAX_HEADER_LEN 0xffff /* bytes */
+#define LEVEL_2_COMMON_CRC_OFFSET 27 /* bytes */
+
 // Length of a level 3 base header.
 #define LEVEL_3_HEADER_LEN 32 /* bytes */
 
@@ -72,7 +78,7 @@ char *lha_file_header_full_path(LHAFileHeader *header)
 		filename = "";
 	}
 
-	result = malloc(strlen(path) + strlen(filename) + 1);
+	result = lha_malloc(strlen(path) + strlen(filename) + 1);
 
 	if (result == NULL) {
 		return NULL;
@@ -102,7 +108,7 @@ static int split_header_filename(LHAFileHeader *header)
 	sep = strrchr(header->filename, '/');
 
 	if (sep != NULL) {
-		new_filename = strdup(sep + 1);
+		new_filename = lha_strdup(sep + 1);
 
 		if (new_filename == NULL) {
 			return 0;
@@ -276,14 +282,14 @@ static int parse_symlink(LHAFileHeader *header)
 	p = strchr(fullpath, '|');
 
 	if (p == NULL) {
-		free(fullpath);
+		lha_free(fullpath);
 		return 0;
 	}
 
-	header->symlink_target = strdup(p + 1);
+	header->symlink_target = lha_strdup(p + 1);
 
 	if (header->symlink_target == NULL) {
-		free(fullpath);
+		lha_free(fullpath);
 		return 0;
 	}
 
@@ -292,8 +298,8 @@ static int parse_symlink(LHAFileHeader *header)
 
 	*p = '\0';
 
-	free(header->path);
-	free(header->filename);
+	lha_free(header->path);
+	lha_free(header->filename);
 	header->path = NULL;
 	header->filename = fullpath;
 
@@ -320,7 +326,7 @@ static int process_level0_path(LHAFileHeader *header, uint8_t *data,
 		return 1;
 	}
 
-	header->filename = malloc(data_len + 1);
+	header->filename = lha_malloc(data_len + 1);
 
 	if (header->filename == NULL) {
 		return 0;
@@ -358,7 +364,7 @@ static uint8_t *extend_raw_data(LHAFileHeader **header,
 	// Reallocate the header and raw_data area to be larger.
 
 	new_raw_len = RAW_DATA_LEN(header) + nbytes;
-	new_header = realloc(*header, sizeof(LHAFileHeader) + new_raw_len);
+	new_header = lha_realloc(*header, sizeof(LHAFileHeader) + new_raw_len);
 
 	if (new_header == NULL) {
 		return NULL;
@@ -936,7 +942,7 @@ LHAFileHeader *lha_file_header_read(LHAInputStream *stream)
 
 	// Allocate result structure.
 
-	header = calloc(1, sizeof(LHAFileHeader) + COMMON_HEADER_LEN);
+	header = lha_calloc(1, sizeof(LHAFileHeader) + COMMON_HEADER_LEN);
 
 	if (header == NULL) {
 		return NULL;
@@ -1093,15 +1099,72 @@ void lha_file_header_free(LHAFileHeader *header)
 		return;
 	}
 
-	free(header->filename);
-	free(header->path);
-	free(header->symlink_target);
-	free(header->unix_username);
-	free(header->unix_group);
-	free(header);
+	lha_free(header->filename);
+	lha_free(header->path);
+	lha_free(header->symlink_target);
+	lha_free(header->unix_username);
+	lha_free(header->unix_group);
+	lha_free(header);
 }
 
 void lha_file_header_add_ref(LHAFileHeader *header)
 {
 	++header->_refcount;
 }
+
+size_t lha_file_header_encode(LHAFileHeader *header, uint8_t *buf)
+{
+	size_t header_len, len_field;
+	uint16_t crc;
+
+	// The base header is followed by the extended headers, from the
+	// first length field. OS-9/68k LHA writes a length that is two
+	// bytes short, and the decoder compensates for this, so the same
+	// has to be done here to preserve the OS type.
+
+	header_len = LEVEL_2_HEADER_LEN - 2
+	           + lha_ext_header_encode(header, NULL);
+	len_field = header_len;
+
+	if (header->os_type == LHA_OS_TYPE_OS9_68K) {
+		len_field -= 2;
+	}
+
+	// If the low byte of the header length is zero, it looks like the
+	// end of the archive to some tools, so a byte of padding is added.
+
+	if ((len_field & 0xff) == 0) {
+		++header_len;
+		++len_field;
+	}
+
+	if (header_len > LEVEL_2_MAX_HEADER_LEN) {
+		return 0;
+	}
+
+	if (buf == NULL) {
+		return header_len;
+	}
+
+	memset(buf, 0, header_len);
+	lha_encode_uint16(buf, (uint16_t) len_field);
+	memcpy(buf + 2, header->compress_method, 5);
+	lha_encode_uint32(buf + 7, (uint32_t) header->compressed_length);
+	lha_encode_uint32(buf + 11, (uint32_t) header->length);
+	lha_encode_uint32(buf + 15, header->timestamp);
+	buf[19] = 0x20;
+	buf[20] = 2;
+	lha_encode_uint16(buf + 21, header->crc);
+	buf[23] = header->os_type;
+
+	lha_ext_header_encode(header, buf + LEVEL_2_HEADER_LEN - 2);
+
+	// The common header contains a CRC of the whole header, which is
+	// calculated with the CRC field set to zero.
+
+	crc = 0;
+	lha_crc16_buf(&crc, buf, header_len);
+	lha_encode_uint16(buf + LEVEL_2_COMMON_CRC_OFFSET, crc);
+
+	return header_len;
+}
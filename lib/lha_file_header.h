@@ -64,4 +64,17 @@ void lha_file_header_add_ref(LHAFileHeader *header);
 
 char *lha_file_header_full_path(LHAFileHeader *header);
 
+/**
+ * Encode a file header in the level 2 header format. The header level
+ * field of the header is ignored.
+ *
+ * @param header     The file header to encode.
+ * @param buf        Pointer to a buffer in which to store the encoded
+ *                   header, or NULL to just calculate its length.
+ * @return           Length of the encoded header, in bytes, or zero if
+ *                   the header is too long to be encoded.
+ */
+
+size_t lha_file_header_encode(LHAFileHeader *header, uint8_t *buf);
+
 #endif /* #ifndef LHASA_LHA_FILE_HEADER_H */
@@ -24,6 +24,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <ctype.h>
 #include <errno.h>
 
+#include "lha_allocator.h"
 #include "lha_arch.h"
 #include "lha_input_stream.h"
 
@@ -33,9 +34,24 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define MAX_SFX_HEADER_LEN (256 * 1024)
 
-// Size of the lead-in buffer used to skip the self-extractor.
+// Size of the lead-in buffer used to skip the self-extractor. The
+// self-extractor is scanned a block at a time; any data left over
+// after the header is found is returned by later reads.
 
-#define LEADIN_BUFFER_LEN 24
+#define LEADIN_BUFFER_LEN 4096
+
+// Number of bytes that must follow a position in the lead-in buffer
+// before it can be checked for a file header.
+
+#define LEADIN_MATCH_LEN 13
+
+// When resynchronizing, the number of bytes after a candidate position
+// that are initially made available to check for a valid header. This
+// is increased if the header turns out to be longer, up to the maximum
+// length of a level 3 header.
+
+#define RESYNC_WINDOW_LEN LEADIN_BUFFER_LEN
+#define RESYNC_MAX_WINDOW_LEN (1024 * 1024)
 
 // Magic strings to detect certain self-extracting files.
 // These types of self-extractor are special because the program itself
@@ -55,8 +71,12 @@ struct _LHAInputStream {
 	const LHAInputStreamType *type;
 	void *handle;
 	LHAInputStreamState state;
-	uint8_t leadin[LEADIN_BUFFER_LEN];
-	size_t leadin_len;
+	uint8_t *leadin;
+	size_t leadin_pos, leadin_len, leadin_size;
+
+	// Number of bytes read (or skipped) from the underlying stream.
+
+	uint64_t stream_pos;
 };
 
 LHAInputStream *lha_input_stream_new(const LHAInputStreamType *type,
@@ -64,15 +84,25 @@ LHAInputStream *lha_input_stream_new(const LHAInputStreamType *type,
 {
 	LHAInputStream *result;
 
-	result = calloc(1, sizeof(LHAInputStream));
+	result = lha_calloc(1, sizeof(LHAInputStream));
 
 	if (result == NULL) {
 		return NULL;
 	}
 
+	result->leadin = lha_malloc(LEADIN_BUFFER_LEN);
+
+	if (result->leadin == NULL) {
+		lha_free(result);
+		return NULL;
+	}
+
 	result->type = type;
 	result->handle = handle;
+	result->leadin_pos = 0;
 	result->leadin_len = 0;
+	result->leadin_size = LEADIN_BUFFER_LEN;
+	result->stream_pos = 0;
 	result->state = LHA_INPUT_STREAM_INIT;
 
 	return result;
@@ -86,7 +116,8 @@ void lha_input_stream_free(LHAInputStream *stream)
 		stream->type->close(stream->handle);
 	}
 
-	free(stream);
+	lha_free(stream->leadin);
+	lha_free(stream);
 }
 
 // Check if the specified buffer is the start of a file header.
@@ -125,8 +156,7 @@ static int file_header_match(uint8_t *buf)
 
 static void empty_leadin(LHAInputStream *stream, size_t bytes)
 {
-	memmove(stream->leadin, stream->leadin + bytes,
-	        stream->leadin_len - bytes);
+	stream->leadin_pos += bytes;
 	stream->leadin_len -= bytes;
 }
 
@@ -134,7 +164,100 @@ static void empty_leadin(LHAInputStream *stream, size_t bytes)
 
 static int do_read(LHAInputStream *stream, void *buf, size_t buf_len)
 {
-	return stream->type->read(stream->handle, buf, buf_len);
+	int result;
+
+	result = stream->type->read(stream->handle, buf, buf_len);
+
+	if (result > 0) {
+		stream->stream_pos += (unsigned int) result;
+	}
+
+	return result;
+}
+
+// Move the remaining contents of the lead-in buffer to the start of the
+// buffer, and fill the rest of it with more data from the input stream.
+// Returns zero if no more data could be read.
+
+static int fill_leadin(LHAInputStream *stream)
+{
+	int read;
+
+	memmove(stream->leadin, stream->leadin + stream->leadin_pos,
+	        stream->leadin_len);
+	stream->leadin_pos = 0;
+
+	read = do_read(stream, stream->leadin + stream->leadin_len,
+	               stream->leadin_size - stream->leadin_len);
+
+	if (read <= 0) {
+		return 0;
+	}
+
+	stream->leadin_len += (unsigned int) read;
+
+	return 1;
+}
+
+// Search the range start..end-1 of the specified buffer for the next
+// position that is the start of a file header. Every header contains a
+// '-' two bytes in, so memchr() is used to skip quickly to candidate
+// positions, and only those are checked fully. Returns 'end' if no
+// header is found.
+
+static size_t find_file_header(uint8_t *buf, size_t start, size_t end)
+{
+	uint8_t *p;
+	size_t i;
+
+	i = start;
+
+	while (i < end) {
+		p = memchr(buf + i + 2, '-', end - i);
+
+		if (p == NULL) {
+			break;
+		}
+
+		i = (size_t) (p - buf) - 2;
+
+		if (file_header_match(buf + i)) {
+			return i;
+		}
+
+		++i;
+	}
+
+	return end;
+}
+
+// Search the range start..end-1 of the specified buffer for one of the
+// magic strings that identify a special case self-extractor. These all
+// begin with an 'L', so only positions with that character are checked.
+
+static int find_sfx_id(uint8_t *buf, size_t start, size_t end)
+{
+	uint8_t *p;
+	size_t i;
+
+	i = start;
+
+	while (i < end) {
+		p = memchr(buf + i, 'L', end - i);
+
+		if (p == NULL) {
+			break;
+		}
+
+		if (!memcmp(p, DECLHA_SFX_ID, strlen(DECLHA_SFX_ID))
+		 || !memcmp(p, AMIGA_LHASFX_ID, strlen(AMIGA_LHASFX_ID))) {
+			return 1;
+		}
+
+		i = (size_t) (p - buf) + 1;
+	}
+
+	return 0;
 }
 
 // Skip the self-extractor header at the start of the file.
@@ -143,9 +266,9 @@ static int do_read(LHAInputStream *stream, void *buf, size_t buf_len)
 static int skip_sfx(LHAInputStream *stream)
 {
 	size_t filepos;
-	unsigned int i;
+	size_t end, header;
+	size_t i;
 	int skip_files;
-	int read;
 
 	filepos = 0;
 	skip_files = 0;
@@ -154,34 +277,41 @@ static int skip_sfx(LHAInputStream *stream)
 
 		// Add some more bytes to the lead-in buffer:
 
-		read = do_read(stream, stream->leadin + stream->leadin_len,
-		               LEADIN_BUFFER_LEN - stream->leadin_len);
-
-		if (read <= 0) {
+		if (!fill_leadin(stream)) {
 			break;
 		}
 
-		stream->leadin_len += (unsigned int) read;
+		if (stream->leadin_len < LEADIN_MATCH_LEN) {
+			continue;
+		}
 
-		// Check the lead-in buffer for a file header.
+		// Check the lead-in buffer for a file header. Special
+		// case self-extractors contain something resembling a
+		// header that must be skipped over, so look for their
+		// magic strings before each header that is found.
 
-		for (i = 0; i + 12 < stream->leadin_len; ++i) {
-			if (file_header_match(stream->leadin + i)) {
-				if (skip_files == 0) {
-					empty_leadin(stream, i);
-					return 1;
-				} else {
-					--skip_files;
-				}
-			}
+		end = stream->leadin_len - LEADIN_MATCH_LEN + 1;
+		i = 0;
 
-			// Detect special case self-extractors.
-			if (!memcmp(stream->leadin + i, DECLHA_SFX_ID,
-			            strlen(DECLHA_SFX_ID))
-			 || !memcmp(stream->leadin + i, AMIGA_LHASFX_ID,
-			            strlen(AMIGA_LHASFX_ID))) {
+		while (i < end) {
+			header = find_file_header(stream->leadin, i, end);
+
+			if (find_sfx_id(stream->leadin, i, header)) {
 				skip_files = 1;
 			}
+
+			if (header >= end) {
+				i = end;
+				break;
+			}
+
+			if (skip_files == 0) {
+				empty_leadin(stream, header);
+				return 1;
+			}
+
+			--skip_files;
+			i = header + 1;
 		}
 
 		empty_leadin(stream, i);
@@ -191,13 +321,11 @@ static int skip_sfx(LHAInputStream *stream)
 	return 0;
 }
 
-int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
-{
-	size_t total_bytes, n;
-	int result;
-
-	// Start of the stream?  Skip self-extract header, if there is one.
+// Start of the stream?  Skip self-extract header, if there is one.
+// Returns zero if the stream cannot be read.
 
+static int check_stream_start(LHAInputStream *stream)
+{
 	if (stream->state == LHA_INPUT_STREAM_INIT) {
 		if (skip_sfx(stream)) {
 			stream->state = LHA_INPUT_STREAM_READING;
@@ -206,7 +334,15 @@ int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
 		}
 	}
 
-	if (stream->state == LHA_INPUT_STREAM_FAIL) {
+	return stream->state != LHA_INPUT_STREAM_FAIL;
+}
+
+int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
+{
+	size_t total_bytes, n;
+	int result;
+
+	if (!check_stream_start(stream)) {
 		return 0;
 	}
 
@@ -221,7 +357,7 @@ int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
 			n = stream->leadin_len;
 		}
 
-		memcpy(buf, stream->leadin, n);
+		memcpy(buf, stream->leadin + stream->leadin_pos, n);
 		empty_leadin(stream, n);
 		total_bytes += n;
 	}
@@ -242,13 +378,141 @@ int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len)
 	return total_bytes == buf_len;
 }
 
+// Enlarge the lead-in buffer so that it can hold at least the specified
+// number of bytes.
+
+static int grow_leadin(LHAInputStream *stream, size_t size)
+{
+	uint8_t *new_leadin;
+
+	if (stream->leadin_size >= size) {
+		return 1;
+	}
+
+	memmove(stream->leadin, stream->leadin + stream->leadin_pos,
+	        stream->leadin_len);
+	stream->leadin_pos = 0;
+
+	new_leadin = lha_realloc(stream->leadin, size);
+
+	if (new_leadin == NULL) {
+		return 0;
+	}
+
+	stream->leadin = new_leadin;
+	stream->leadin_size = size;
+
+	return 1;
+}
+
+int lha_input_stream_resync(LHAInputStream *stream,
+                            LHAInputStreamValidate validate,
+                            void *user_data)
+{
+	size_t end, window;
+	int eof, result;
+
+	if (!check_stream_start(stream)) {
+		return 0;
+	}
+
+	// The buffer is twice the size of the window needed to check a
+	// candidate, so that it only has to be refilled (and its contents
+	// moved) once for each window's worth of data that is scanned.
+
+	window = RESYNC_WINDOW_LEN;
+
+	if (!grow_leadin(stream, window * 2)) {
+		return 0;
+	}
+
+	eof = 0;
+
+	for (;;) {
+
+		// Skip forward to the next candidate position in the data
+		// that is already in the buffer.
+
+		if (stream->leadin_len >= LEADIN_MATCH_LEN) {
+			end = stream->leadin_len - LEADIN_MATCH_LEN + 1;
+			empty_leadin(stream,
+			             find_file_header(stream->leadin
+			                              + stream->leadin_pos,
+			                              0, end));
+		}
+
+		// If the candidate is too close to the end of the buffer for
+		// a complete header to be checked, read more data and look
+		// again.
+
+		if (!eof && stream->leadin_len < window) {
+			if (!fill_leadin(stream)) {
+				eof = 1;
+			}
+			continue;
+		}
+
+		if (stream->leadin_len < LEADIN_MATCH_LEN) {
+			return 0;
+		}
+
+		result = validate(stream->leadin + stream->leadin_pos,
+		                  stream->leadin_len, user_data);
+
+		if (result > 0) {
+			return 1;
+		}
+
+		// The callback can ask for more data if the header is
+		// longer than the window; the candidate is checked again
+		// with a larger one.
+
+		if (result < 0 && !eof && window < RESYNC_MAX_WINDOW_LEN) {
+			window *= 2;
+
+			if (!grow_leadin(stream, window * 2)) {
+				return 0;
+			}
+
+			continue;
+		}
+
+		empty_leadin(stream, 1);
+	}
+}
+
 int lha_input_stream_skip(LHAInputStream *stream, size_t bytes)
 {
+	size_t n;
+
+	// Any data still in the lead-in buffer must be skipped first.
+
+	if (stream->leadin_len > 0) {
+		if (bytes < stream->leadin_len) {
+			n = bytes;
+		} else {
+			n = stream->leadin_len;
+		}
+
+		empty_leadin(stream, n);
+		bytes -= n;
+
+		if (bytes == 0) {
+			return 1;
+		}
+	}
+
 	// If we have a dedicated skip function, use it; otherwise,
 	// the read function can be used to perform a skip.
 
 	if (stream->type->skip != NULL) {
-		return stream->type->skip(stream->handle, bytes);
+		if (!stream->type->skip(stream->handle, bytes)) {
+			return 0;
+		}
+
+		stream->stream_pos += bytes;
+
+		return 1;
 	} else {
 		uint8_t data[32];
 		unsigned int len;
@@ -278,6 +542,11 @@ int lha_input_stream_skip(LHAInputStream *stream, size_t bytes)
 	}
 }
 
+uint64_t lha_input_stream_tell(LHAInputStream *stream)
+{
+	return stream->stream_pos - stream->leadin_len;
+}
+
 // Read data from a FILE * source.
 
 static int file_source_read(void *handle, void *buf, size_t buf_len)
@@ -337,13 +606,13 @@ static int file_source_skip(void *handle, size_t bytes)
 	// seek half-way on a stream and *then* fail, leaving us in an
 	// unworkable situation.
 
-	if (ftell(handle) < 0) {
+	if (lha_arch_ftell(handle) < 0) {
 		return file_source_skip_fallback(handle, bytes);
 	}
 
-	result = fseek(handle, (long) bytes, SEEK_CUR);
+	result = lha_arch_fseek(handle, (int64_t) bytes, SEEK_CUR);
 
-	if (result < 0) {
+	if (!result) {
 		if (errno == EBADF || errno == ESPIPE) {
 			return file_source_skip_fallback(handle, bytes);
 		} else {
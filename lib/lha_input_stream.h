@@ -47,4 +47,47 @@ int lha_input_stream_read(LHAInputStream *stream, void *buf, size_t buf_len);
 
 int lha_input_stream_skip(LHAInputStream *stream, size_t bytes);
 
+/**
+ * Get the current position in the input stream.
+ *
+ * @param stream       The input stream.
+ * @return             Offset of the next byte to be read, relative to
+ *                     the start of the underlying stream (including
+ *                     any self-extractor header that was skipped).
+ */
+
+uint64_t lha_input_stream_tell(LHAInputStream *stream);
+
+/**
+ * Callback function used to check whether a candidate position found by
+ * @ref lha_input_stream_resync is the start of a valid file header.
+ *
+ * @param buf          Pointer to the data at the candidate position.
+ * @param buf_len      Number of bytes of data available in the buffer.
+ * @param user_data    Extra pointer passed to the callback.
+ * @return             Positive if the data is the start of a valid
+ *                     header, zero if it is not, or negative if more
+ *                     data is needed to tell.
+ */
+
+typedef int (*LHAInputStreamValidate)(uint8_t *buf, size_t buf_len,
+                                      void *user_data);
+
+/**
+ * Scan forward through the input stream to find the start of the next
+ * valid file header, discarding any data before it. Candidate positions
+ * are located using the same method used to skip self-extractors, and
+ * each one is passed to a callback function to confirm that it is valid.
+ *
+ * @param stream       The input stream.
+ * @param validate     Callback function to check candidate positions.
+ * @param user_data    Extra pointer to pass to the callback function.
+ * @return             Non-zero if a valid header was found, or zero if
+ *                     the end of the stream was reached first.
+ */
+
+int lha_input_stream_resync(LHAInputStream *stream,
+                            LHAInputStreamValidate validate,
+                            void *user_data);
+
 #endif /* #ifndef LHASA_LHA_INPUT_STREAM_H */
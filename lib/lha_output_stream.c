@@ -0,0 +1,275 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "lha_allocator.h"
+#include "lha_arch.h"
+#include "lha_file_header.h"
+#include "lha_input_stream.h"
+#include "lha_output_stream.h"
+
+struct _LHAOutputStream {
+	const LHAOutputStreamType *type;
+	void *handle;
+	int failed;
+};
+
+LHAOutputStream *lha_output_stream_new(const LHAOutputStreamType *type,
+                                       void *handle)
+{
+	LHAOutputStream *result;
+
+	result = lha_calloc(1, sizeof(LHAOutputStream));
+
+	if (result == NULL) {
+		return NULL;
+	}
+
+	result->type = type;
+	result->handle = handle;
+	result->failed = 0;
+
+	return result;
+}
+
+void lha_output_stream_free(LHAOutputStream *stream)
+{
+	// Close the output stream.
+
+	if (stream->type->close != NULL) {
+		stream->type->close(stream->handle);
+	}
+
+	lha_free(stream);
+}
+
+int lha_output_stream_write(LHAOutputStream *stream, const void *buf,
+                            size_t buf_len)
+{
+	// Once a write has failed, the stream is in an unknown state,
+	// so all later writes fail too.
+
+	if (stream->failed) {
+		return 0;
+	}
+
+	if (buf_len > 0 && !stream->type->write(stream->handle, buf, buf_len)) {
+		stream->failed = 1;
+	}
+
+	return !stream->failed;
+}
+
+int lha_output_stream_seek(LHAOutputStream *stream, int64_t offset)
+{
+	if (stream->failed || stream->type->seek == NULL) {
+		return 0;
+	}
+
+	return stream->type->seek(stream->handle, offset);
+}
+
+// Write data to a FILE * sink.
+
+static int file_sink_write(void *handle, const void *buf, size_t buf_len)
+{
+	return fwrite(buf, 1, buf_len, handle) == buf_len;
+}
+
+static int file_sink_seek(void *handle, int64_t offset)
+{
+	// As when skipping input data, check with ftell() that this is
+	// a seekable stream before trying to seek.
+
+	if (lha_arch_ftell(handle) < 0) {
+		return 0;
+	}
+
+	return lha_arch_fseek(handle, offset, SEEK_CUR);
+}
+
+static void file_sink_close(void *handle)
+{
+	fclose(handle);
+}
+
+// "Owned" file sink - the stream will be closed when the output
+// stream is freed.
+
+static const LHAOutputStreamType file_sink_owned = {
+	file_sink_write,
+	file_sink_seek,
+	file_sink_close
+};
+
+// "Unowned" file sink - the stream is owned by the calling code.
+
+static const LHAOutputStreamType file_sink_unowned = {
+	file_sink_write,
+	file_sink_seek,
+	NULL
+};
+
+LHAOutputStream *lha_output_stream_to(char *filename)
+{
+	LHAOutputStream *result;
+	FILE *fstream;
+
+	fstream = fopen(filename, "wb");
+
+	if (fstream == NULL) {
+		return NULL;
+	}
+
+	result = lha_output_stream_new(&file_sink_owned, fstream);
+
+	if (result == NULL) {
+		fclose(fstream);
+	}
+
+	return result;
+}
+
+// Find the end of the archive in an LZH file, by reading each header in
+// turn and skipping the compressed data that follows it. The result is
+// the offset of the zero byte that marks the end of the archive, or
+// the end of the file if it has no end marker.
+
+static int find_archive_end(FILE *fstream, uint64_t *result)
+{
+	LHAInputStream *input;
+	LHAFileHeader *header;
+	unsigned int num_files;
+	uint64_t pos;
+	int64_t size;
+	int success, c;
+
+	input = lha_input_stream_from_FILE(fstream);
+
+	if (input == NULL) {
+		return 0;
+	}
+
+	success = 1;
+	num_files = 0;
+
+	for (;;) {
+		pos = lha_input_stream_tell(input);
+		header = lha_file_header_read(input);
+
+		if (header == NULL) {
+			break;
+		}
+
+		++num_files;
+
+		success = header->compressed_length <= SIZE_MAX
+		       && lha_input_stream_skip(input,
+		                (size_t) header->compressed_length);
+
+		lha_file_header_free(header);
+
+		if (!success) {
+			break;
+		}
+	}
+
+	lha_input_stream_free(input);
+
+	// Skipping the data of the last file can seek past the end of
+	// the file if it is cut short, so compare with the real length.
+
+	if (!success || !lha_arch_fseek(fstream, 0, SEEK_END)) {
+		return 0;
+	}
+
+	size = lha_arch_ftell(fstream);
+
+	if (size < 0 || pos > (uint64_t) size) {
+		return 0;
+	}
+
+	// Reading a header fails at the end of the archive, but also if
+	// the data is not a valid header; check which it was before
+	// anything is overwritten.
+
+	if (pos > INT64_MAX
+	 || !lha_arch_fseek(fstream, (int64_t) pos, SEEK_SET)) {
+		return 0;
+	}
+
+	c = fgetc(fstream);
+
+	if (c != 0 && c != EOF) {
+		return 0;
+	}
+
+	// Without any files, the end marker could just be a zero byte at
+	// the start of some other file. An archive with no files is only
+	// accepted if there is nothing else (or nothing at all) in it.
+
+	if (num_files == 0 && c == 0 && fgetc(fstream) != EOF) {
+		return 0;
+	}
+
+	*result = pos;
+
+	return 1;
+}
+
+LHAOutputStream *lha_output_stream_append_to(char *filename)
+{
+	LHAOutputStream *result;
+	FILE *fstream;
+	uint64_t pos;
+
+	fstream = fopen(filename, "r+b");
+
+	if (fstream == NULL) {
+		return NULL;
+	}
+
+	// Truncate the file to discard the end marker, and write the
+	// new files in its place.
+
+	if (!find_archive_end(fstream, &pos)
+	 || !lha_arch_truncate(fstream, pos)
+	 || !lha_arch_fseek(fstream, (int64_t) pos, SEEK_SET)) {
+		fclose(fstream);
+		return NULL;
+	}
+
+	result = lha_output_stream_new(&file_sink_owned, fstream);
+
+	if (result == NULL) {
+		fclose(fstream);
+	}
+
+	return result;
+}
+
+LHAOutputStream *lha_output_stream_to_FILE(FILE *stream)
+{
+	lha_arch_set_binary(stream);
+	return lha_output_stream_new(&file_sink_unowned, stream);
+}
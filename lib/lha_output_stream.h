@@ -0,0 +1,52 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_LHA_OUTPUT_STREAM_H
+#define LHASA_LHA_OUTPUT_STREAM_H
+
+#include <inttypes.h>
+#include "public/lha_output_stream.h"
+
+/**
+ * Write a block of data to the output stream.
+ *
+ * @param stream       The output stream.
+ * @param buf          Pointer to the data to write.
+ * @param buf_len      Size of the data, in bytes.
+ * @return             Non-zero if all the data was written, or zero if
+ *                     an error occurred.
+ */
+
+int lha_output_stream_write(LHAOutputStream *stream, const void *buf,
+                            size_t buf_len);
+
+/**
+ * Move the position at which data is written.
+ *
+ * @param stream       The output stream.
+ * @param offset       Number of bytes to move by, relative to the
+ *                     current position.
+ * @return             Non-zero for success, or zero if the stream does
+ *                     not support seeking, or an error occurred.
+ */
+
+int lha_output_stream_seek(LHAOutputStream *stream, int64_t offset);
+
+#endif /* #ifndef LHASA_LHA_OUTPUT_STREAM_H */
@@ -22,12 +22,19 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 
+#include "lha_allocator.h"
 #include "lha_arch.h"
 #include "lha_decoder.h"
 #include "lha_basic_reader.h"
 #include "public/lha_reader.h"
 #include "macbinary.h"
 
+// Size of the buffer used when decompressing a file to extract or check
+// it. This is large enough that most of the decoded data can be written
+// into it directly by the decoder, rather than copied in small pieces.
+
+#define DECODE_BUFFER_SIZE 16384
+
 typedef enum {
 
 	// Initial state at start of stream:
@@ -93,6 +100,17 @@ struct _LHAReader {
 	// of extraction.
 
 	LHAFileHeader *deferred_symlinks;
+
+	// Cache of open directory handles used when extracting files,
+	// to avoid resolving the full path on every operation. May be
+	// NULL if not supported.
+
+	LHAArchDirs *dirs;
+
+	// Performance counters, collected if stats_enabled is set.
+
+	LHAStats stats;
+	int stats_enabled;
 };
 
 /**
@@ -148,6 +166,10 @@ static int open_decoder(LHAReader *reader,
 		return 0;
 	}
 
+	if (reader->stats_enabled) {
+		lha_decoder_set_stats(reader->inner_decoder, &reader->stats);
+	}
+
 	// Set progress callback for decoder.
 
 	if (callback != NULL) {
@@ -179,7 +201,7 @@ LHAReader *lha_reader_new(LHAInputStream *stream)
 	LHABasicReader *basic_reader;
 	LHAReader *reader;
 
-	reader = calloc(1, sizeof(LHAReader));
+	reader = lha_calloc(1, sizeof(LHAReader));
 
 	if (reader == NULL) {
 		return NULL;
@@ -188,7 +210,7 @@ LHAReader *lha_reader_new(LHAInputStream *stream)
 	basic_reader = lha_basic_reader_new(stream);
 
 	if (basic_reader == NULL) {
-		free(reader);
+		lha_free(reader);
 		return NULL;
 	}
 
@@ -200,6 +222,8 @@ LHAReader *lha_reader_new(LHAInputStream *stream)
 	reader->dir_stack = NULL;
 	reader->dir_policy = LHA_READER_DIR_END_OF_DIR;
 	reader->deferred_symlinks = NULL;
+	reader->dirs = lha_arch_dirs_new();
+	reader->stats_enabled = 0;
 
 	return reader;
 }
@@ -220,8 +244,9 @@ void lha_reader_free(LHAReader *reader)
 		lha_file_header_free(header);
 	}
 
+	lha_arch_dirs_free(reader->dirs);
 	lha_basic_reader_free(reader->reader);
-	free(reader);
+	lha_free(reader);
 }
 
 void lha_reader_set_dir_policy(LHAReader *reader,
@@ -230,6 +255,11 @@ void lha_reader_set_dir_policy(LHAReader *reader,
 	reader->dir_policy = policy;
 }
 
+void lha_reader_set_recover(LHAReader *reader, int recover)
+{
+	lha_basic_reader_set_recover(reader->reader, recover);
+}
+
 /**
  * Check if the directory at the top of the stack should be popped.
  *
@@ -287,6 +317,27 @@ static int end_of_top_dir(LHAReader *reader)
 	}
 }
 
+// Read the next header from the input stream, counting the time taken
+// if counters are being collected.
+
+static void read_next_header(LHAReader *reader)
+{
+	uint64_t start;
+
+	if (!reader->stats_enabled) {
+		lha_basic_reader_next_file(reader->reader);
+		return;
+	}
+
+	start = lha_arch_time_ns();
+
+	if (lha_basic_reader_next_file(reader->reader) != NULL) {
+		++reader->stats.headers;
+	}
+
+	reader->stats.header_time += lha_arch_time_ns() - start;
+}
+
 // Read the next file from the input stream.
 
 LHAFileHeader *lha_reader_next_file(LHAReader *reader)
@@ -307,7 +358,7 @@ LHAFileHeader *lha_reader_next_file(LHAReader *reader)
 
 	if (reader->curr_file_type == CURR_FILE_START
 	 || reader->curr_file_type == CURR_FILE_NORMAL) {
-		lha_basic_reader_next_file(reader->reader);
+		read_next_header(reader);
 	}
 
 	// If the last file we returned was a 'fake' directory, we must
@@ -378,8 +429,9 @@ size_t lha_reader_read(LHAReader *reader, void *buf, size_t buf_len)
 
 static int do_decode(LHAReader *reader, FILE *output)
 {
-	uint8_t buf[64];
-	unsigned int bytes;
+	uint8_t buf[DECODE_BUFFER_SIZE];
+	size_t bytes, written;
+	uint64_t start;
 
 	// Decompress the current file.
 
@@ -387,7 +439,15 @@ static int do_decode(LHAReader *reader, FILE *output)
 		bytes = lha_reader_read(reader, buf, sizeof(buf));
 
 		if (output != NULL) {
-			if (fwrite(buf, 1, bytes, output) < bytes) {
+			start = reader->stats_enabled ? lha_arch_time_ns() : 0;
+			written = fwrite(buf, 1, bytes, output);
+
+			if (reader->stats_enabled) {
+				reader->stats.output_time
+				    += lha_arch_time_ns() - start;
+			}
+
+			if (written < bytes) {
 				return 0;
 			}
 		}
@@ -446,7 +506,8 @@ static FILE *open_output_file(LHAReader *reader, char *filename)
 		unix_perms = reader->curr_file->unix_perms;
 	}
 
-	return lha_arch_fopen(filename, unix_uid, unix_gid, unix_perms);
+	return lha_arch_fopen(reader->dirs, filename,
+	                      unix_uid, unix_gid, unix_perms);
 }
 
 /**
@@ -455,6 +516,7 @@ static FILE *open_output_file(LHAReader *reader, char *filename)
  * If possible, the more accurate Windows timestamp values are used;
  * otherwise normal Unix timestamps are used.
  *
+ * @param dirs     Cache of directory handles.
  * @param path     Path to the file or directory to set.
  * @param header   Pointer to file header structure containing the
  *                 timestamps to set.
@@ -462,7 +524,8 @@ static FILE *open_output_file(LHAReader *reader, char *filename)
  *                 or zero for failure.
  */
 
-static int set_timestamps_from_header(char *path, LHAFileHeader *header)
+static int set_timestamps_from_header(LHAArchDirs *dirs, char *path,
+                                      LHAFileHeader *header)
 {
 #if LHA_ARCH == LHA_ARCH_WINDOWS
 	if (LHA_FILE_HAVE_EXTRA(header, LHA_FILE_WINDOWS_TIMESTAMPS)) {
@@ -475,7 +538,7 @@ static int set_timestamps_from_header(char *path, LHAFileHeader *header)
 	} else // ....
 #endif
 	if (header->timestamp != 0) {
-		return lha_arch_utime(path, header->timestamp);
+		return lha_arch_utime(dirs, path, header->timestamp);
 	} else {
 		return 1;
 	}
@@ -488,22 +551,24 @@ static int set_timestamps_from_header(char *path, LHAFileHeader *header)
  * and permissions) should be set on a directory after the contents of
  * the directory has been extracted.
  *
+ * @param dirs       Cache of directory handles.
  * @param header     Pointer to file header structure containing the
  *                   metadata to set.
  * @param path       Path to the directory on which to set the metadata.
  * @return           Non-zero for success, or zero for failure.
  */
 
-static int set_directory_metadata(LHAFileHeader *header, char *path)
+static int set_directory_metadata(LHAArchDirs *dirs, LHAFileHeader *header,
+                                  char *path)
 {
 	// Set timestamp:
 
-	set_timestamps_from_header(path, header);
+	set_timestamps_from_header(dirs, path, header);
 
 	// Set owner and group:
 
 	if (LHA_FILE_HAVE_EXTRA(header, LHA_FILE_UNIX_UID_GID)) {
-		if (!lha_arch_chown(path, header->unix_uid,
+		if (!lha_arch_chown(dirs, path, header->unix_uid,
 		                    header->unix_gid)) {
 			// On most Unix systems, only root can change
 			// ownership. But if we can't change ownership,
@@ -519,7 +584,7 @@ static int set_directory_metadata(LHAFileHeader *header, char *path)
 	// Set permissions on directory:
 
 	if (LHA_FILE_HAVE_EXTRA(header, LHA_FILE_UNIX_PERMS)) {
-		if (!lha_arch_chmod(path, header->unix_perms)) {
+		if (!lha_arch_chmod(dirs, path, header->unix_perms)) {
 			return 0;
 		}
 	}
@@ -565,13 +630,14 @@ static int extract_directory(LHAReader *reader, char *path)
 		mode = 0777;
 	}
 
-	if (!lha_arch_mkdir(path, mode)) {
+	if (!lha_arch_mkdir(reader->dirs, path, mode)) {
 
 		// If the attempt to create the directory failed, it may
 		// be because the directory already exists. Return success
 		// if this is the case; it isn't really an error.
 
-		return lha_arch_exists(path) == LHA_FILE_DIRECTORY;
+		return lha_arch_exists(reader->dirs, path)
+		    == LHA_FILE_DIRECTORY;
 	}
 
 	// The directory has been created, but the metadata has not yet
@@ -580,7 +646,7 @@ static int extract_directory(LHAReader *reader, char *path)
 	// metadata now. Otherwise, save the directory for later.
 
 	if (reader->dir_policy == LHA_READER_DIR_PLAIN) {
-		set_directory_metadata(header, path);
+		set_directory_metadata(reader->dirs, header, path);
 	} else {
 		lha_file_header_add_ref(header);
 		header->_next = reader->dir_stack;
@@ -641,10 +707,11 @@ static int extract_file(LHAReader *reader, char *filename,
 	// Set timestamp on file:
 
 	if (result) {
-		set_timestamps_from_header(filename, reader->curr_file);
+		set_timestamps_from_header(reader->dirs, filename,
+		                           reader->curr_file);
 	}
 
-	free(tmp_filename);
+	lha_free(tmp_filename);
 
 	return result;
 }
@@ -745,7 +812,7 @@ static int extract_placeholder_symlink(LHAReader *reader, char *filename)
 	LHAFileHeader **rover;
 	FILE *f;
 
-	f = lha_arch_fopen(filename, -1, -1, 0600);
+	f = lha_arch_fopen(reader->dirs, filename, -1, -1, 0600);
 
 	if (f == NULL) {
 		return 0;
@@ -810,11 +877,12 @@ static int extract_symlink(LHAReader *reader, char *filename)
 		return extract_placeholder_symlink(reader, filename);
 	}
 
-	result = lha_arch_symlink(filename, reader->curr_file->symlink_target);
+	result = lha_arch_symlink(reader->dirs, filename,
+	                          reader->curr_file->symlink_target);
 
 	// TODO: Set symlink timestamp.
 
-	free(tmp_filename);
+	lha_free(tmp_filename);
 
 	return result;
 }
@@ -864,7 +932,8 @@ int lha_reader_extract(LHAReader *reader,
 			if (filename == NULL) {
 				filename = reader->curr_file->path;
 			}
-			set_directory_metadata(reader->curr_file, filename);
+			set_directory_metadata(reader->dirs, reader->curr_file,
+			                       filename);
 			return 1;
 
 		case CURR_FILE_DEFERRED_SYMLINK:
@@ -883,3 +952,19 @@ int lha_reader_current_is_fake(LHAReader *reader)
 	return reader->curr_file_type == CURR_FILE_FAKE_DIR
 	    || reader->curr_file_type == CURR_FILE_DEFERRED_SYMLINK;
 }
+
+void lha_reader_enable_stats(LHAReader *reader, int enable)
+{
+	memset(&reader->stats, 0, sizeof(LHAStats));
+	reader->stats_enabled = enable;
+
+	if (reader->inner_decoder != NULL) {
+		lha_decoder_set_stats(reader->inner_decoder,
+		                      enable ? &reader->stats : NULL);
+	}
+}
+
+void lha_reader_get_stats(LHAReader *reader, LHAStats *stats)
+{
+	memcpy(stats, &reader->stats, sizeof(LHAStats));
+}
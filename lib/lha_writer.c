@@ -0,0 +1,1354 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "crc16.h"
+#include "dedup_cache.h"
+#include "lha_allocator.h"
+#include "lha_arch.h"
+#include "lha_encoder.h"
+#include "lha_file_header.h"
+#include "lha_output_stream.h"
+#include "public/lha_writer.h"
+
+// Flags for the extra header fields that are copied from the header
+// passed to lha_writer_add_file().
+
+#define COPIED_FLAGS \
+	(LHA_FILE_UNIX_PERMS | LHA_FILE_UNIX_UID_GID \
+	 | LHA_FILE_WINDOWS_TIMESTAMPS | LHA_FILE_OS9_PERMS)
+
+#if LHA_ARCH == LHA_ARCH_WINDOWS
+#define DEFAULT_OS_TYPE LHA_OS_TYPE_WINNT
+#else
+#define DEFAULT_OS_TYPE LHA_OS_TYPE_UNIX
+#endif
+
+// Amount of data at the start of each file that is examined to decide
+// whether it is worth compressing.
+
+#define SAMPLE_SIZE       (64 * 1024)
+
+// Size of the hash table used to look for repeated strings in the
+// sample (a power of two).
+
+#define SAMPLE_HASH_BITS  12
+#define SAMPLE_HASH_SIZE  (1 << SAMPLE_HASH_BITS)
+
+// The sample is judged to be incompressible if the probability of two
+// bytes picked at random being the same is less than 1 / this value
+// (256 for random data), and less than 1 / REPEAT_DIVISOR of its
+// four-byte strings are repeats.
+
+#define FLAT_THRESHOLD    240
+#define REPEAT_DIVISOR    32
+
+// Files of up to this length are held in memory until they end, so
+// that they can be compared with earlier files.
+
+#define DEDUP_MAX_LENGTH  (1024 * 1024)
+
+// When files are compressed on other threads, files of up to this
+// length are held in memory and compressed as a job. Larger files are
+// compressed as they are written, once the earlier jobs have finished.
+
+#define JOB_MAX_LENGTH    (8 * 1024 * 1024)
+
+// Maximum number of files compressed at once. The ring buffer of jobs
+// has one more entry, for the file whose data is being collected.
+
+#define MAX_JOBS          64
+
+// A file compressed on another thread. It is compressed with its own
+// LHAWriter, which writes the header and compressed data into memory,
+// to be written to the output stream in order.
+
+typedef struct {
+	LHAOutputStream *stream;
+	LHAWriter *writer;
+	uint8_t *data;
+	size_t data_len, data_size;
+	uint8_t *output;
+	size_t output_len, output_size;
+	int cacheable, success;
+	LHAArchThread *thread;
+
+	// CRC of the data, if it is checked for duplicates. If duplicate
+	// is non-zero, the file is the same as one in an earlier job.
+
+	uint16_t crc;
+	int duplicate;
+} LHAWriterJob;
+
+struct _LHAWriter {
+	LHAOutputStream *stream;
+	int level;
+	unsigned int threads;
+	size_t buffer_size;
+	int auto_store;
+
+	// Whether the output stream can seek: -1 if not yet known.
+
+	int can_seek;
+
+	// Header for the current file, and whether it is still being
+	// written.
+
+	LHAFileHeader *curr_file;
+	int writing;
+
+	// Encoder compressing the data, or NULL if the data is stored.
+	// For stored data, the CRC and length are calculated here.
+
+	LHAEncoder *encoder;
+	uint16_t crc;
+	uint64_t length, compressed_length;
+
+	// Data at the start of the current file, held back until it is
+	// known whether the file is worth compressing, and (for small
+	// files) whether it is the same as an earlier file.
+
+	uint8_t *held;
+	size_t held_len, held_size, hold_limit;
+	int holding;
+
+	// Compressed data of earlier files, and the method requested for
+	// the current file. If cacheable is non-zero, the current file
+	// is added to the cache when it ends.
+
+	LHADedupCache dedup;
+	char requested_method[6];
+	int cacheable;
+
+	// Compressed data waiting for the header to be written.
+
+	uint8_t *buf;
+	size_t buf_len, buf_size;
+
+	// Length of the header, once it has been written.
+
+	size_t header_len;
+
+	// Files being compressed on other threads, in a ring buffer in
+	// the order they are to be written. If queued is non-zero, the
+	// current file is the last of these, and its data is being
+	// collected.
+
+	LHAWriterJob *jobs;
+	unsigned int max_jobs, first_job, pending_jobs;
+	int queued;
+
+	// Function called when each file has been written.
+
+	LHAWriterCallback callback;
+	void *callback_data;
+
+	// If non-zero, writing has failed.
+
+	int failed;
+};
+
+LHAWriter *lha_writer_new(LHAOutputStream *stream)
+{
+	LHAWriter *writer;
+
+	writer = lha_calloc(1, sizeof(LHAWriter));
+
+	if (writer == NULL) {
+		return NULL;
+	}
+
+	writer->stream = stream;
+	writer->level = LHA_ENCODER_DEFAULT_LEVEL;
+	writer->threads = 1;
+	writer->buffer_size = LHA_WRITER_DEFAULT_BUFFER_SIZE;
+	writer->auto_store = 1;
+	writer->can_seek = -1;
+	writer->curr_file = NULL;
+	writer->writing = 0;
+	writer->encoder = NULL;
+	writer->held = NULL;
+	writer->held_len = 0;
+	writer->held_size = 0;
+	writer->hold_limit = 0;
+	writer->holding = 0;
+	writer->cacheable = 0;
+	writer->buf = NULL;
+	writer->buf_len = 0;
+	writer->buf_size = 0;
+	writer->jobs = NULL;
+	writer->max_jobs = 1;
+	writer->first_job = 0;
+	writer->pending_jobs = 0;
+	writer->queued = 0;
+	writer->callback = NULL;
+	writer->callback_data = NULL;
+	writer->failed = 0;
+
+	lha_dedup_cache_init(&writer->dedup, LHA_WRITER_DEFAULT_DEDUP_SIZE);
+
+	return writer;
+}
+
+static void free_job(LHAWriterJob *job)
+{
+	if (job->writer != NULL) {
+		lha_writer_free(job->writer);
+	}
+
+	lha_output_stream_free(job->stream);
+	lha_free(job->data);
+	lha_free(job->output);
+}
+
+void lha_writer_free(LHAWriter *writer)
+{
+	LHAWriterJob *job;
+
+	// Wait for jobs still running, and discard their output.
+
+	while (writer->pending_jobs > 0) {
+		job = &writer->jobs[writer->first_job];
+
+		if (job->thread != NULL) {
+			lha_arch_thread_join(job->thread);
+		}
+
+		free_job(job);
+		writer->first_job = (writer->first_job + 1) % (MAX_JOBS + 1);
+		--writer->pending_jobs;
+	}
+
+	if (writer->encoder != NULL) {
+		lha_encoder_free(writer->encoder);
+	}
+
+	if (writer->curr_file != NULL) {
+		lha_file_header_free(writer->curr_file);
+	}
+
+	lha_dedup_cache_free(&writer->dedup);
+	lha_free(writer->held);
+	lha_free(writer->buf);
+	lha_free(writer->jobs);
+	lha_free(writer);
+}
+
+void lha_writer_set_level(LHAWriter *writer, int level)
+{
+	writer->level = level;
+}
+
+void lha_writer_set_threads(LHAWriter *writer, unsigned int threads)
+{
+	writer->threads = threads;
+}
+
+void lha_writer_set_jobs(LHAWriter *writer, unsigned int jobs)
+{
+	if (jobs == 0) {
+		jobs = lha_arch_num_cpus();
+	}
+
+	if (jobs > MAX_JOBS) {
+		jobs = MAX_JOBS;
+	}
+
+	writer->max_jobs = jobs;
+}
+
+void lha_writer_set_callback(LHAWriter *writer, LHAWriterCallback callback,
+                             void *user_data)
+{
+	writer->callback = callback;
+	writer->callback_data = user_data;
+}
+
+void lha_writer_set_buffer_size(LHAWriter *writer, size_t size)
+{
+	writer->buffer_size = size;
+}
+
+void lha_writer_set_auto_store(LHAWriter *writer, int auto_store)
+{
+	writer->auto_store = auto_store;
+}
+
+void lha_writer_set_dedup_size(LHAWriter *writer, size_t size)
+{
+	lha_dedup_cache_free(&writer->dedup);
+	lha_dedup_cache_init(&writer->dedup, size);
+}
+
+LHAFileHeader *lha_writer_curr_file(LHAWriter *writer)
+{
+	return writer->curr_file;
+}
+
+static int copy_string(char **dest, char *src)
+{
+	if (src == NULL) {
+		*dest = NULL;
+		return 1;
+	}
+
+	*dest = lha_strdup(src);
+
+	return *dest != NULL;
+}
+
+// Make a copy of the header passed to lha_writer_add_file(), containing
+// only the fields that are written.
+
+static LHAFileHeader *copy_header(LHAFileHeader *header)
+{
+	LHAFileHeader *result;
+
+	result = lha_calloc(1, sizeof(LHAFileHeader));
+
+	if (result == NULL) {
+		return NULL;
+	}
+
+	result->_refcount = 1;
+
+	memcpy(result->compress_method, header->compress_method, 5);
+	result->compress_method[5] = '\0';
+	result->header_level = 2;
+	result->os_type = header->os_type;
+	result->timestamp = header->timestamp;
+	result->extra_flags = header->extra_flags & COPIED_FLAGS;
+	result->unix_perms = header->unix_perms;
+	result->os9_perms = header->os9_perms;
+	result->unix_uid = header->unix_uid;
+	result->unix_gid = header->unix_gid;
+	result->win_creation_time = header->win_creation_time;
+	result->win_modification_time = header->win_modification_time;
+	result->win_access_time = header->win_access_time;
+
+	if (result->os_type == LHA_OS_TYPE_UNKNOWN) {
+		result->os_type = DEFAULT_OS_TYPE;
+	}
+
+	if (!copy_string(&result->path, header->path)
+	 || !copy_string(&result->filename, header->filename)
+	 || !copy_string(&result->symlink_target, header->symlink_target)
+	 || !copy_string(&result->unix_username, header->unix_username)
+	 || !copy_string(&result->unix_group, header->unix_group)) {
+		lha_file_header_free(result);
+		return NULL;
+	}
+
+	// Level 0 directory headers can have an empty filename.
+
+	if (result->filename != NULL && result->filename[0] == '\0') {
+		lha_free(result->filename);
+		result->filename = NULL;
+	}
+
+	return result;
+}
+
+// Check that a header describes a file that can be written. A symbolic
+// link is only recognized by its Unix permissions, so they are set if
+// necessary.
+
+static int check_header(LHAFileHeader *header)
+{
+	if (strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR) != 0) {
+		return header->filename != NULL
+		    && header->symlink_target == NULL;
+	} else if (header->symlink_target != NULL) {
+		if (!LHA_FILE_HAVE_EXTRA(header, LHA_FILE_UNIX_PERMS)) {
+			header->unix_perms = 0777;
+			header->extra_flags |= LHA_FILE_UNIX_PERMS;
+		}
+
+		header->unix_perms = (header->unix_perms & 07777) | 0120000;
+
+		return header->filename != NULL;
+	} else {
+		return header->path != NULL && header->filename == NULL;
+	}
+}
+
+// Encode the header for the current file, and write it to the output
+// stream.
+
+static int write_header(LHAWriter *writer)
+{
+	uint8_t *header;
+	size_t header_len;
+	int result;
+
+	header_len = lha_file_header_encode(writer->curr_file, NULL);
+
+	if (header_len == 0) {
+		return 0;
+	}
+
+	header = lha_malloc(header_len);
+
+	if (header == NULL) {
+		return 0;
+	}
+
+	lha_file_header_encode(writer->curr_file, header);
+	result = lha_output_stream_write(writer->stream, header, header_len);
+	lha_free(header);
+
+	writer->header_len = header_len;
+
+	return result;
+}
+
+// Write the header before all of the compressed data is known, so that
+// the data can be written straight to the output stream. The header is
+// filled in when the file ends; it includes the 64-bit file sizes
+// header, so that its length does not change whatever the sizes turn
+// out to be.
+
+static int write_header_early(LHAWriter *writer)
+{
+	writer->curr_file->extra_flags |= LHA_FILE_64BIT_SIZES;
+
+	if (!write_header(writer)
+	 || !lha_output_stream_write(writer->stream, writer->buf,
+	                             writer->buf_len)) {
+		return 0;
+	}
+
+	writer->buf_len = 0;
+
+	return 1;
+}
+
+// Write compressed data for the current file. The data is buffered
+// until the header has been written.
+
+static int write_data(LHAWriter *writer, const void *buf, size_t buf_len)
+{
+	uint8_t *new_buf;
+	size_t new_size;
+
+	writer->compressed_length += buf_len;
+
+	if (writer->header_len > 0) {
+		return lha_output_stream_write(writer->stream, buf, buf_len);
+	}
+
+	if (writer->buf_len + buf_len > writer->buf_size) {
+		new_size = writer->buf_size * 2;
+
+		if (new_size < writer->buf_len + buf_len) {
+			new_size = writer->buf_len + buf_len + 4096;
+		}
+
+		new_buf = lha_realloc(writer->buf, new_size);
+
+		if (new_buf == NULL) {
+			return 0;
+		}
+
+		writer->buf = new_buf;
+		writer->buf_size = new_size;
+	}
+
+	memcpy(writer->buf + writer->buf_len, buf, buf_len);
+	writer->buf_len += buf_len;
+
+	// Past the limit, if the stream can seek, stop buffering.
+
+	if (writer->buf_len > writer->buffer_size) {
+		if (writer->can_seek < 0) {
+			writer->can_seek =
+			    lha_output_stream_seek(writer->stream, 0);
+		}
+
+		if (writer->can_seek) {
+			return write_header_early(writer);
+		}
+	}
+
+	return 1;
+}
+
+// Callback passed to the encoder to write compressed data.
+
+static size_t encoder_callback(const void *buf, size_t buf_len,
+                               void *user_data)
+{
+	return write_data(user_data, buf, buf_len) ? buf_len : 0;
+}
+
+// Find the encoder for a compression method: NULL for a stored file or
+// a directory. Returns zero if there is no encoder for the method.
+
+static int find_encoder(const char *method, const LHAEncoderType **etype)
+{
+	*etype = NULL;
+
+	if (strcmp(method, "-lh0-") != 0
+	 && strcmp(method, LHA_COMPRESS_TYPE_DIR) != 0) {
+		*etype = lha_encoder_for_name(method);
+	}
+
+	return *etype != NULL || !strcmp(method, "-lh0-")
+	    || !strcmp(method, LHA_COMPRESS_TYPE_DIR);
+}
+
+// Set up to compress the current file as it is written.
+
+static int start_file(LHAWriter *writer, const LHAEncoderType *etype)
+{
+	if (etype != NULL) {
+		writer->encoder = lha_encoder_new(etype, encoder_callback,
+		                                  writer);
+
+		if (writer->encoder == NULL) {
+			return 0;
+		}
+
+		lha_encoder_set_level(writer->encoder, writer->level);
+
+		if (writer->threads != 1) {
+			lha_encoder_set_threads(writer->encoder,
+			                        writer->threads);
+		}
+	}
+
+	// Decide how much of the file to hold back before compressing it.
+
+	writer->hold_limit = 0;
+
+	if (etype != NULL && writer->dedup.max_size > 0) {
+		writer->hold_limit = DEDUP_MAX_LENGTH;
+	} else if (etype != NULL && writer->auto_store) {
+		writer->hold_limit = SAMPLE_SIZE;
+	}
+
+	writer->crc = 0;
+	writer->length = 0;
+	writer->compressed_length = 0;
+	writer->held_len = 0;
+	writer->holding = writer->hold_limit > 0;
+	writer->cacheable = 0;
+	memcpy(writer->requested_method, writer->curr_file->compress_method,
+	       6);
+	writer->buf_len = 0;
+	writer->header_len = 0;
+
+	return 1;
+}
+
+// Get a job from the ring buffer, counting from the oldest.
+
+static LHAWriterJob *job_at(LHAWriter *writer, unsigned int i)
+{
+	return &writer->jobs[(writer->first_job + i) % (MAX_JOBS + 1)];
+}
+
+// Write data for a job into memory.
+
+static int job_output_write(void *handle, const void *buf, size_t buf_len)
+{
+	LHAWriterJob *job = handle;
+	uint8_t *new_output;
+	size_t new_size;
+
+	if (job->output_len + buf_len > job->output_size) {
+		new_size = (job->output_len + buf_len) * 2;
+		new_output = lha_realloc(job->output, new_size);
+
+		if (new_output == NULL) {
+			return 0;
+		}
+
+		job->output = new_output;
+		job->output_size = new_size;
+	}
+
+	memcpy(job->output + job->output_len, buf, buf_len);
+	job->output_len += buf_len;
+
+	return 1;
+}
+
+static const LHAOutputStreamType job_output = {
+	job_output_write,
+	NULL,
+	NULL
+};
+
+// Stop compressing the current file, and store it instead.
+
+static void store_file(LHAWriter *writer)
+{
+	if (writer->encoder != NULL) {
+		lha_encoder_free(writer->encoder);
+		writer->encoder = NULL;
+	}
+
+	memcpy(writer->curr_file->compress_method, "-lh0-", 6);
+	writer->crc = 0;
+	writer->length = 0;
+}
+
+// Write the compressed data of an earlier file with the same contents
+// as the current file.
+
+static int write_duplicate(LHAWriter *writer, const LHADedupEntry *entry)
+{
+	store_file(writer);
+	memcpy(writer->curr_file->compress_method,
+	       entry->compress_method, 6);
+	writer->crc = entry->crc;
+	writer->length = entry->length;
+
+	return write_data(writer, entry->data, entry->data_len);
+}
+
+// Compress the file for a job; run on another thread.
+
+static void run_job(void *data)
+{
+	LHAWriterJob *job = data;
+
+	job->success = (job->data_len == 0
+	             || lha_writer_write(job->writer, job->data,
+	                                 job->data_len))
+	            && lha_writer_end_file(job->writer);
+}
+
+// If a job's file has the same contents as an earlier file, reuse the
+// compressed data for that file. Returns non-zero if it was reused.
+
+static int reuse_cached(LHAWriter *writer, LHAWriterJob *job)
+{
+	const LHADedupEntry *entry;
+	LHAWriter *job_writer = job->writer;
+
+	entry = lha_dedup_cache_find(&writer->dedup,
+	                             job_writer->requested_method,
+	                             job_writer->level, job->data,
+	                             job->data_len, job->crc);
+
+	if (entry == NULL) {
+		return 0;
+	}
+
+	job_writer->holding = 0;
+	job->success = write_duplicate(job_writer, entry)
+	            && lha_writer_end_file(job_writer);
+
+	return 1;
+}
+
+// Check whether a job that has not yet finished (and so has not been
+// added to the cache) is compressing a file with the same contents as
+// a newer job.
+
+static int pending_duplicate(LHAWriter *writer, LHAWriterJob *job)
+{
+	LHAWriterJob *other;
+	unsigned int i;
+
+	for (i = 0; i + 1 < writer->pending_jobs; ++i) {
+		other = job_at(writer, i);
+
+		if (other->cacheable && other->data_len == job->data_len
+		 && other->crc == job->crc
+		 && other->writer->level == job->writer->level
+		 && !strcmp(other->writer->requested_method,
+		            job->writer->requested_method)
+		 && !memcmp(other->data, job->data, job->data_len)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Wait for the oldest job to finish, and write its output.
+
+static int finish_job(LHAWriter *writer)
+{
+	LHAWriterJob *job;
+	LHAWriter *job_writer;
+	int success;
+
+	job = job_at(writer, 0);
+	job_writer = job->writer;
+
+	// A duplicate of a file that was still being compressed when it
+	// was added reuses that file's data, which is in the cache now.
+	// If it is not (the file failed, or the cache was too small),
+	// the file is compressed after all.
+
+	if (job->duplicate && !writer->failed && !reuse_cached(writer, job)) {
+		run_job(job);
+	}
+
+	if (job->thread != NULL) {
+		lha_arch_thread_join(job->thread);
+	}
+
+	success = job->success && !writer->failed
+	       && lha_output_stream_write(writer->stream, job->output,
+	                                  job->output_len);
+
+	if (success && job->cacheable) {
+		lha_dedup_cache_add(&writer->dedup,
+		                    job_writer->requested_method,
+		                    job_writer->level, job_writer->curr_file,
+		                    job->output + job_writer->header_len,
+		                    job->output_len - job_writer->header_len);
+	}
+
+	if (!success) {
+		writer->failed = 1;
+	}
+
+	if (writer->callback != NULL) {
+		writer->callback(job_writer->curr_file, success,
+		                 writer->callback_data);
+	}
+
+	free_job(job);
+	writer->first_job = (writer->first_job + 1) % (MAX_JOBS + 1);
+	--writer->pending_jobs;
+
+	return success;
+}
+
+static int finish_all_jobs(LHAWriter *writer)
+{
+	int success = 1;
+
+	while (writer->pending_jobs > 0) {
+		success = finish_job(writer) && success;
+	}
+
+	return success;
+}
+
+// Start collecting the data for the current file, to compress it as a
+// job.
+
+static int queue_file(LHAWriter *writer)
+{
+	LHAWriterJob *job;
+
+	if (writer->jobs == NULL) {
+		writer->jobs = lha_calloc(MAX_JOBS + 1, sizeof(LHAWriterJob));
+
+		if (writer->jobs == NULL) {
+			return 0;
+		}
+	}
+
+	if (writer->pending_jobs >= writer->max_jobs
+	 && !finish_job(writer)) {
+		return 0;
+	}
+
+	job = job_at(writer, writer->pending_jobs);
+	memset(job, 0, sizeof(LHAWriterJob));
+
+	job->stream = lha_output_stream_new(&job_output, job);
+
+	if (job->stream == NULL) {
+		return 0;
+	}
+
+	job->writer = lha_writer_new(job->stream);
+
+	if (job->writer == NULL) {
+		free_job(job);
+		return 0;
+	}
+
+	lha_writer_set_level(job->writer, writer->level);
+	lha_writer_set_auto_store(job->writer, writer->auto_store);
+	lha_writer_set_dedup_size(job->writer, 0);
+
+	if (!lha_writer_add_file(job->writer, writer->curr_file)) {
+		free_job(job);
+		return 0;
+	}
+
+	++writer->pending_jobs;
+	writer->queued = 1;
+
+	return 1;
+}
+
+int lha_writer_add_file(LHAWriter *writer, LHAFileHeader *header)
+{
+	const LHAEncoderType *etype;
+	LHAFileHeader *new_file;
+
+	if (writer->writing && !lha_writer_end_file(writer)) {
+		return 0;
+	}
+
+	if (writer->failed
+	 || !find_encoder(header->compress_method, &etype)) {
+		return 0;
+	}
+
+	new_file = copy_header(header);
+
+	if (new_file == NULL) {
+		return 0;
+	}
+
+	// Check that the header is valid, and not too long to write.
+
+	new_file->extra_flags |= LHA_FILE_64BIT_SIZES;
+
+	if (!check_header(new_file)
+	 || lha_file_header_encode(new_file, NULL) == 0) {
+		lha_file_header_free(new_file);
+		return 0;
+	}
+
+	new_file->extra_flags &= ~LHA_FILE_64BIT_SIZES;
+
+	if (writer->curr_file != NULL) {
+		lha_file_header_free(writer->curr_file);
+	}
+
+	writer->curr_file = new_file;
+
+	if (writer->max_jobs > 1) {
+		writer->writing = queue_file(writer);
+	} else {
+		writer->writing = finish_all_jobs(writer)
+		               && start_file(writer, etype);
+	}
+
+	return writer->writing;
+}
+
+// Pass data for the current file to the encoder, or if it is stored,
+// straight to write_data().
+
+static int write_uncompressed(LHAWriter *writer, const void *buf,
+                              size_t buf_len)
+{
+	if (writer->encoder != NULL) {
+		return lha_encoder_write(writer->encoder, buf, buf_len);
+	}
+
+	lha_crc16_buf(&writer->crc, (uint8_t *) buf, buf_len);
+	writer->length += buf_len;
+
+	return write_data(writer, buf, buf_len);
+}
+
+// Guess from a sample whether data is incompressible, typically because
+// it has already been compressed. Such data has a flat distribution of
+// byte values, and few repeated strings for the encoder to find.
+
+static int is_incompressible(const uint8_t *data, size_t len)
+{
+	uint32_t counts[256];
+	uint32_t strings[SAMPLE_HASH_SIZE];
+	uint64_t pairs;
+	uint32_t s, h;
+	size_t i, repeats;
+
+	if (len < 4) {
+		return 0;
+	}
+
+	memset(counts, 0, sizeof(counts));
+	memset(strings, 0, sizeof(strings));
+	repeats = 0;
+
+	for (i = 0; i < len; ++i) {
+		++counts[data[i]];
+	}
+
+	// Each entry in the hash table holds the last string seen with
+	// that hash, so only recent repeats are found; that is enough.
+
+	for (i = 0; i + 4 <= len; ++i) {
+		s = (uint32_t) data[i] | ((uint32_t) data[i + 1] << 8)
+		  | ((uint32_t) data[i + 2] << 16)
+		  | ((uint32_t) data[i + 3] << 24);
+		h = (uint32_t) (s * 2654435761UL) >> (32 - SAMPLE_HASH_BITS);
+
+		if (strings[h] == s) {
+			++repeats;
+		}
+
+		strings[h] = s;
+	}
+
+	// Count pairs of equal bytes, and compare with the number of
+	// pairs of bytes.
+
+	pairs = 0;
+
+	for (i = 0; i < 256; ++i) {
+		pairs += (uint64_t) counts[i] * (counts[i] - 1);
+	}
+
+	return pairs * FLAT_THRESHOLD < (uint64_t) len * (len - 1)
+	    && repeats < len / REPEAT_DIVISOR;
+}
+
+// Finish compressing the current file.
+
+static int finish_encoder(LHAWriter *writer)
+{
+	int result;
+
+	result = lha_encoder_finish(writer->encoder);
+	writer->crc = lha_encoder_get_crc(writer->encoder);
+	writer->length = lha_encoder_get_length(writer->encoder);
+
+	lha_encoder_free(writer->encoder);
+	writer->encoder = NULL;
+
+	return result;
+}
+
+// Add data for the current file to the data being held back.
+
+static int hold_data(LHAWriter *writer, const uint8_t *buf, size_t buf_len)
+{
+	uint8_t *new_held;
+	size_t new_size;
+
+	if (writer->held_len + buf_len > writer->held_size) {
+		new_size = writer->held_size * 2;
+
+		if (new_size < writer->held_len + buf_len) {
+			new_size = writer->held_len + buf_len;
+		}
+
+		if (new_size < SAMPLE_SIZE) {
+			new_size = SAMPLE_SIZE;
+		}
+
+		if (new_size > writer->hold_limit) {
+			new_size = writer->hold_limit;
+		}
+
+		new_held = lha_realloc(writer->held, new_size);
+
+		if (new_held == NULL) {
+			return 0;
+		}
+
+		writer->held = new_held;
+		writer->held_size = new_size;
+	}
+
+	memcpy(writer->held + writer->held_len, buf, buf_len);
+	writer->held_len += buf_len;
+
+	return 1;
+}
+
+// If the current file (all of which is held back) has the same
+// contents as an earlier file, reuse the compressed data for that
+// file. Otherwise, mark the file to be added to the cache.
+
+static int reuse_duplicate(LHAWriter *writer, int *reused)
+{
+	const LHADedupEntry *entry;
+	uint16_t crc;
+
+	*reused = 0;
+	crc = 0;
+	lha_crc16_buf(&crc, writer->held, writer->held_len);
+
+	entry = lha_dedup_cache_find(&writer->dedup,
+	                             writer->requested_method, writer->level,
+	                             writer->held, writer->held_len, crc);
+
+	if (entry == NULL) {
+		writer->cacheable = 1;
+		return 1;
+	}
+
+	*reused = 1;
+
+	return write_duplicate(writer, entry);
+}
+
+// Decide how to write the current file, once the data held back is
+// complete or the file has ended, and then write the data.
+
+static int write_held(LHAWriter *writer, int at_end)
+{
+	size_t sample_len;
+	int reused;
+
+	writer->holding = 0;
+
+	if (at_end && writer->dedup.max_size > 0) {
+		if (!reuse_duplicate(writer, &reused)) {
+			return 0;
+		} else if (reused) {
+			return 1;
+		}
+	}
+
+	if (!writer->auto_store) {
+		return write_uncompressed(writer, writer->held,
+		                          writer->held_len);
+	}
+
+	sample_len = writer->held_len;
+
+	if (sample_len > SAMPLE_SIZE) {
+		sample_len = SAMPLE_SIZE;
+	}
+
+	if (is_incompressible(writer->held, sample_len)) {
+		store_file(writer);
+	} else if (at_end && writer->held_len <= SAMPLE_SIZE) {
+		// The sample is the whole file, so it can simply be
+		// compressed, and stored instead if that does not make it
+		// any smaller (if the compressed data is still buffered).
+
+		if (!lha_encoder_write(writer->encoder, writer->held,
+		                       writer->held_len)
+		 || !finish_encoder(writer)) {
+			return 0;
+		}
+
+		if (writer->header_len > 0
+		 || writer->compressed_length < writer->held_len) {
+			return 1;
+		}
+
+		writer->compressed_length = 0;
+		writer->buf_len = 0;
+		store_file(writer);
+	}
+
+	return write_uncompressed(writer, writer->held, writer->held_len);
+}
+
+// Add data for the current file to the job that is to compress it. If
+// the file turns out to be too large, the earlier jobs are finished,
+// and the file is compressed as it is written instead.
+
+static int queue_data(LHAWriter *writer, const void *buf, size_t buf_len)
+{
+	const LHAEncoderType *etype;
+	LHAWriterJob *job;
+	uint8_t *data;
+	size_t data_len, new_size;
+	int result;
+
+	job = job_at(writer, writer->pending_jobs - 1);
+
+	if (job->data_len + buf_len <= JOB_MAX_LENGTH) {
+		if (job->data_len + buf_len > job->data_size) {
+			new_size = job->data_size * 2;
+
+			if (new_size < job->data_len + buf_len) {
+				new_size = job->data_len + buf_len;
+			}
+
+			if (new_size > JOB_MAX_LENGTH) {
+				new_size = JOB_MAX_LENGTH;
+			}
+
+			data = lha_realloc(job->data, new_size);
+
+			if (data == NULL) {
+				return 0;
+			}
+
+			job->data = data;
+			job->data_size = new_size;
+		}
+
+		memcpy(job->data + job->data_len, buf, buf_len);
+		job->data_len += buf_len;
+
+		return 1;
+	}
+
+	// The job is the last in the ring buffer, so it can simply be
+	// removed. The data collected so far is written again.
+
+	data = job->data;
+	data_len = job->data_len;
+	job->data = NULL;
+	free_job(job);
+	--writer->pending_jobs;
+	writer->queued = 0;
+
+	result = finish_all_jobs(writer)
+	      && find_encoder(writer->curr_file->compress_method, &etype)
+	      && start_file(writer, etype)
+	      && (data_len == 0 || lha_writer_write(writer, data, data_len))
+	      && lha_writer_write(writer, buf, buf_len);
+
+	lha_free(data);
+
+	return result;
+}
+
+int lha_writer_write(LHAWriter *writer, const void *buf, size_t buf_len)
+{
+	const uint8_t *p;
+	size_t n;
+	int result;
+
+	if (!writer->writing || writer->failed
+	 || !strcmp(writer->curr_file->compress_method,
+	            LHA_COMPRESS_TYPE_DIR)) {
+		return 0;
+	}
+
+	if (writer->queued) {
+		result = queue_data(writer, buf, buf_len);
+
+		if (!result) {
+			writer->failed = 1;
+		}
+
+		return result;
+	}
+
+	p = buf;
+	result = 1;
+
+	// Once the limit is reached and there is more data, the held
+	// data is written and the file is not held back any longer.
+
+	if (writer->holding) {
+		n = writer->hold_limit - writer->held_len;
+
+		if (n > buf_len) {
+			n = buf_len;
+		}
+
+		result = hold_data(writer, p, n);
+		p += n;
+		buf_len -= n;
+
+		if (result && buf_len > 0) {
+			result = write_held(writer, 0);
+		}
+	}
+
+	if (result && buf_len > 0) {
+		result = write_uncompressed(writer, p, buf_len);
+	}
+
+	if (!result) {
+		writer->failed = 1;
+	}
+
+	return result;
+}
+
+// Set the lengths and CRC in the header for the current file.
+
+static void set_lengths(LHAWriter *writer)
+{
+	LHAFileHeader *header = writer->curr_file;
+
+	header->crc = writer->crc;
+	header->length = writer->length;
+	header->compressed_length = writer->compressed_length;
+
+	if (header->length > SIZE_MAX) {
+		header->_old_length = SIZE_MAX;
+	} else {
+		header->_old_length = (size_t) header->length;
+	}
+
+	if (header->compressed_length > SIZE_MAX) {
+		header->_old_compressed_length = SIZE_MAX;
+	} else {
+		header->_old_compressed_length =
+		    (size_t) header->compressed_length;
+	}
+
+	if (header->length > 0xffffffffUL
+	 || header->compressed_length > 0xffffffffUL) {
+		header->extra_flags |= LHA_FILE_64BIT_SIZES;
+	}
+}
+
+// Go back and fill in a header written by write_header_early().
+
+static int rewrite_header(LHAWriter *writer)
+{
+	size_t header_len;
+	int64_t data_len;
+
+	header_len = writer->header_len;
+	data_len = (int64_t) writer->compressed_length;
+
+	return lha_output_stream_seek(writer->stream,
+	                              -(data_len + (int64_t) header_len))
+	    && write_header(writer)
+	    && writer->header_len == header_len
+	    && lha_output_stream_seek(writer->stream, data_len);
+}
+
+// Start the job for the current file, once all of its data has been
+// collected. The output is written when the job is finished.
+
+static int start_job(LHAWriter *writer)
+{
+	LHAWriterJob *job;
+	LHAWriter *job_writer;
+
+	job = job_at(writer, writer->pending_jobs - 1);
+	job_writer = job->writer;
+
+	if (writer->failed) {
+		job->success = 0;
+		return 0;
+	}
+
+	// Duplicate files are looked for here rather than by the job's
+	// own writer, so that the cache is only used on this thread.
+	// Files still being compressed are not in the cache yet, so
+	// they are checked too; a duplicate of one of them waits for it
+	// to finish.
+
+	if (job_writer->encoder != NULL && writer->dedup.max_size > 0
+	 && job->data_len <= DEDUP_MAX_LENGTH) {
+		job->crc = 0;
+		lha_crc16_buf(&job->crc, job->data, job->data_len);
+
+		if (reuse_cached(writer, job)) {
+			return 1;
+		} else if (pending_duplicate(writer, job)) {
+			job->duplicate = 1;
+			return 1;
+		}
+
+		job->cacheable = 1;
+	}
+
+	// Stored files and directories are not worth a thread. If a
+	// thread cannot be started, the file is compressed now.
+
+	if (job_writer->encoder != NULL) {
+		job->thread = lha_arch_thread_new(run_job, job);
+	}
+
+	if (job->thread == NULL) {
+		run_job(job);
+	}
+
+	return 1;
+}
+
+int lha_writer_end_file(LHAWriter *writer)
+{
+	int result;
+
+	if (!writer->writing) {
+		return 0;
+	}
+
+	writer->writing = 0;
+
+	if (writer->queued) {
+		writer->queued = 0;
+		return start_job(writer);
+	}
+
+	result = !writer->failed;
+
+	if (result && writer->holding) {
+		result = write_held(writer, 1);
+	}
+
+	writer->holding = 0;
+
+	if (writer->encoder != NULL) {
+		result = finish_encoder(writer) && result;
+	}
+
+	if (result) {
+		set_lengths(writer);
+
+		if (writer->cacheable && writer->header_len == 0) {
+			lha_dedup_cache_add(&writer->dedup,
+			                    writer->requested_method,
+			                    writer->level, writer->curr_file,
+			                    writer->buf, writer->buf_len);
+		}
+
+		if (writer->header_len > 0) {
+			result = rewrite_header(writer);
+		} else {
+			result = write_header(writer)
+			      && lha_output_stream_write(writer->stream,
+			                                 writer->buf,
+			                                 writer->buf_len);
+		}
+	}
+
+	writer->buf_len = 0;
+
+	if (!result) {
+		writer->failed = 1;
+	}
+
+	if (writer->callback != NULL) {
+		writer->callback(writer->curr_file, result,
+		                 writer->callback_data);
+	}
+
+	return result;
+}
+
+int lha_writer_finish(LHAWriter *writer)
+{
+	uint8_t end_marker = 0;
+
+	if (writer->writing) {
+		lha_writer_end_file(writer);
+	}
+
+	finish_all_jobs(writer);
+
+	// The end of the archive is marked by a zero byte where the
+	// next header would be.
+
+	if (!writer->failed
+	 && !lha_output_stream_write(writer->stream, &end_marker, 1)) {
+		writer->failed = 1;
+	}
+
+	return !writer->failed;
+}
@@ -36,10 +36,22 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define THRESHOLD 3
 
-// Size of output buffer.  Must be large enough to hold the results of
-// a complete "run" (see below).
+// Maximum output from a complete "run" (see below), and the maximum
+// amount of input data that a run can consume (a control byte, plus
+// two bytes for each command).
 
-#define OUTPUT_BUFFER_SIZE (15 + THRESHOLD) * 8
+#define MAX_RUN_OUTPUT ((15 + THRESHOLD) * 8)
+#define MAX_RUN_INPUT (1 + 2 * 8)
+
+// Size of output buffer. Each call to read() decodes runs until the
+// buffer is too full to be sure of holding another.
+
+#define OUTPUT_BUFFER_SIZE (MAX_RUN_OUTPUT * 16)
+
+// Size of the buffer used to read input data, so that the callback
+// function does not need to be invoked for every byte.
+
+#define INPUT_BUFFER_SIZE 1024
 
 // Decoder for the -lz5- compression method used by LArc.
 //
@@ -50,8 +62,11 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 typedef struct {
 	uint8_t ringbuf[RING_BUFFER_SIZE];
 	unsigned int ringbuf_pos;
+	uint8_t inbuf[INPUT_BUFFER_SIZE];
+	size_t inbuf_pos, inbuf_len;
 	LHADecoderCallback callback;
 	void *callback_data;
+	LHAStats *stats;
 } LHALZ5Decoder;
 
 static void fill_initial(LHALZ5Decoder *decoder)
@@ -101,86 +116,166 @@ static int lha_lz5_init(void *data, LHADecoderCallback callback,
 
 	fill_initial(decoder);
 	decoder->ringbuf_pos = RING_BUFFER_SIZE - START_OFFSET;
+	decoder->inbuf_pos = 0;
+	decoder->inbuf_len = 0;
 	decoder->callback = callback;
 	decoder->callback_data = callback_data;
+	decoder->stats = NULL;
 
 	return 1;
 }
 
-// Add a single byte to the output buffer.
+static void lha_lz5_set_stats(void *data, LHAStats *stats)
+{
+	LHALZ5Decoder *decoder = data;
 
-static void output_byte(LHALZ5Decoder *decoder, uint8_t *buf,
-                        size_t *buf_len, uint8_t b)
+	decoder->stats = stats;
+}
+
+// Refill the input buffer so that it contains at least enough data for
+// a complete run, if possible.
+
+static void fill_input(LHALZ5Decoder *decoder)
 {
-	buf[*buf_len] = b;
-	++*buf_len;
+	size_t remaining, bytes;
+
+	remaining = decoder->inbuf_len - decoder->inbuf_pos;
+
+	if (remaining >= MAX_RUN_INPUT) {
+		return;
+	}
+
+	// Move the remaining data to the start of the buffer and read
+	// as much as will fit after it.
 
-	decoder->ringbuf[decoder->ringbuf_pos] = b;
-	decoder->ringbuf_pos = (decoder->ringbuf_pos + 1) % RING_BUFFER_SIZE;
+	memmove(decoder->inbuf, decoder->inbuf + decoder->inbuf_pos,
+	        remaining);
+	decoder->inbuf_pos = 0;
+	decoder->inbuf_len = remaining;
+
+	while (decoder->inbuf_len < MAX_RUN_INPUT) {
+		bytes = decoder->callback(decoder->inbuf + decoder->inbuf_len,
+		                          INPUT_BUFFER_SIZE - decoder->inbuf_len,
+		                          decoder->callback_data);
+
+		if (bytes == 0) {
+			break;
+		}
+
+		decoder->inbuf_len += bytes;
+	}
 }
 
-// Output a "block" of data from the specified range in the ring buffer.
+// Copy a "block" of data from the specified range in the ring buffer
+// to the output. The ring buffer size is a power of two, so positions
+// can be wrapped with a mask.
 
-static void output_block(LHALZ5Decoder *decoder,
-                         uint8_t *buf,
-                         size_t *buf_len,
-                         unsigned int start,
-                         unsigned int len)
+static void output_block(LHALZ5Decoder *decoder, uint8_t *out,
+                         unsigned int start, unsigned int len)
 {
-	unsigned int i;
+	uint8_t *ringbuf;
+	unsigned int pos, i;
+	uint8_t b;
+
+	ringbuf = decoder->ringbuf;
+	pos = decoder->ringbuf_pos;
+
+	// The source and destination can overlap, so this must be
+	// copied a byte at a time.
 
 	for (i = 0; i < len; ++i) {
-		output_byte(decoder, buf, buf_len,
-		            decoder->ringbuf[(start + i) % RING_BUFFER_SIZE]);
+		b = ringbuf[(start + i) & (RING_BUFFER_SIZE - 1)];
+		out[i] = b;
+		ringbuf[pos] = b;
+		pos = (pos + 1) & (RING_BUFFER_SIZE - 1);
 	}
+
+	decoder->ringbuf_pos = pos;
 }
 
 // Process a "run" of LZ5-compressed data (a control byte followed by
-// eight "commands").
+// eight "commands"), appending the output to the buffer. Returns zero
+// if the end of the input stream was reached.
 
-static size_t lha_lz5_read(void *data, uint8_t *buf)
+static int decode_run(LHALZ5Decoder *decoder, uint8_t *buf, size_t *buf_len)
 {
-	LHALZ5Decoder *decoder = data;
-	uint8_t bitmap;
+	const uint8_t *in, *in_end;
+	uint8_t *out;
+	unsigned int bitmap, seqstart, seqlen;
 	unsigned int bit;
-	size_t result;
 
-	// Start from an empty buffer.
+	// Read the bitmap byte first.
 
-	result = 0;
+	fill_input(decoder);
 
-	// Read the bitmap byte first.
+	in = decoder->inbuf + decoder->inbuf_pos;
+	in_end = decoder->inbuf + decoder->inbuf_len;
 
-	if (!decoder->callback(&bitmap, 1, decoder->callback_data)) {
+	if (in >= in_end) {
 		return 0;
 	}
 
+	bitmap = *in++;
+	out = buf + *buf_len;
+
 	// Each bit in the bitmap is a command.
 	// If the bit is set, it is an "output byte" command.
 	// If it is not set, it is a "copy block" command.
 
 	for (bit = 0; bit < 8; ++bit) {
 		if ((bitmap & (1 << bit)) != 0) {
-			uint8_t b;
-
-			if (!decoder->callback(&b, 1, decoder->callback_data)) {
+			if (in >= in_end) {
 				break;
 			}
 
-			output_byte(decoder, buf, &result, b);
-		} else {
-			uint8_t cmd[2];
-			unsigned int seqstart, seqlen;
+			*out = *in;
+			decoder->ringbuf[decoder->ringbuf_pos] = *in;
+			decoder->ringbuf_pos = (decoder->ringbuf_pos + 1)
+			                     & (RING_BUFFER_SIZE - 1);
+			++in;
+			++out;
 
-			if (!decoder->callback(cmd, 2, decoder->callback_data)) {
+			if (decoder->stats != NULL) {
+				++decoder->stats->literals;
+			}
+		} else {
+			if (in_end - in < 2) {
 				break;
 			}
 
-			seqstart = (((unsigned int) cmd[1] & 0xf0) << 4)
-			         | cmd[0];
-			seqlen = ((unsigned int) cmd[1] & 0x0f) + THRESHOLD;
+			seqstart = (((unsigned int) in[1] & 0xf0) << 4) | in[0];
+			seqlen = ((unsigned int) in[1] & 0x0f) + THRESHOLD;
+			in += 2;
+
+			output_block(decoder, out, seqstart, seqlen);
+			out += seqlen;
+
+			if (decoder->stats != NULL) {
+				lha_decoder_count_copy(decoder->stats, seqlen);
+			}
+		}
+	}
+
+	decoder->inbuf_pos = (size_t) (in - decoder->inbuf);
+	*buf_len = (size_t) (out - buf);
+
+	return bit == 8;
+}
+
+// Decode as many runs as will fit in the output buffer.
+
+static size_t lha_lz5_read(void *data, uint8_t *buf)
+{
+	LHALZ5Decoder *decoder = data;
+	size_t result;
+
+	// Start from an empty buffer.
+
+	result = 0;
 
-			output_block(decoder, buf, &result, seqstart, seqlen);
+	while (result + MAX_RUN_OUTPUT <= OUTPUT_BUFFER_SIZE) {
+		if (!decode_run(decoder, buf, &result)) {
+			break;
 		}
 	}
 
@@ -193,5 +288,6 @@ const LHADecoderType lha_lz5_decoder = {
 	lha_lz5_read,
 	sizeof(LHALZ5Decoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_lz5_set_stats
 };
@@ -38,10 +38,14 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define THRESHOLD 2
 
-// Size of output buffer.  Must be large enough to hold the results of
-// the maximum copy operation.
+// Maximum number of bytes output by a single copy operation.
 
-#define OUTPUT_BUFFER_SIZE (15 + THRESHOLD)
+#define MAX_COPY_LENGTH (15 + THRESHOLD)
+
+// Size of output buffer. Each call to read() decodes commands until
+// the buffer is too full to be sure of holding another.
+
+#define OUTPUT_BUFFER_SIZE RING_BUFFER_SIZE
 
 // Decoder for the -lzs- compression method used by old versions of LArc.
 //
@@ -53,6 +57,7 @@ typedef struct {
 	BitStreamReader bit_stream_reader;
 	uint8_t ringbuf[RING_BUFFER_SIZE];
 	unsigned int ringbuf_pos;
+	LHAStats *stats;
 } LHALZSDecoder;
 
 static int lha_lzs_init(void *data, LHADecoderCallback callback,
@@ -64,49 +69,52 @@ static int lha_lzs_init(void *data, LHADecoderCallback callback,
 	decoder->ringbuf_pos = RING_BUFFER_SIZE - START_OFFSET;
 	bit_stream_reader_init(&decoder->bit_stream_reader, callback,
 	                       callback_data);
+	decoder->stats = NULL;
 
 	return 1;
 }
 
-// Add a single byte to the output buffer.
-
-static void output_byte(LHALZSDecoder *decoder, uint8_t *buf,
-                        size_t *buf_len, uint8_t b)
+static void lha_lzs_set_stats(void *data, LHAStats *stats)
 {
-	buf[*buf_len] = b;
-	++*buf_len;
+	LHALZSDecoder *decoder = data;
 
-	decoder->ringbuf[decoder->ringbuf_pos] = b;
-	decoder->ringbuf_pos = (decoder->ringbuf_pos + 1) % RING_BUFFER_SIZE;
+	decoder->stats = stats;
 }
 
-// Output a "block" of data from the specified range in the ring buffer.
+// Copy a "block" of data from the specified range in the ring buffer
+// to the output. The ring buffer size is a power of two, so positions
+// can be wrapped with a mask.
 
-static void output_block(LHALZSDecoder *decoder,
-                         uint8_t *buf,
-                         size_t *buf_len,
-                         unsigned int start,
-                         unsigned int len)
+static void output_block(LHALZSDecoder *decoder, uint8_t *out,
+                         unsigned int start, unsigned int len)
 {
-	unsigned int i;
+	uint8_t *ringbuf;
+	unsigned int pos, i;
+	uint8_t b;
+
+	ringbuf = decoder->ringbuf;
+	pos = decoder->ringbuf_pos;
+
+	// The source and destination can overlap, so this must be
+	// copied a byte at a time.
 
 	for (i = 0; i < len; ++i) {
-		output_byte(decoder, buf, buf_len,
-		            decoder->ringbuf[(start + i) % RING_BUFFER_SIZE]);
+		b = ringbuf[(start + i) & (RING_BUFFER_SIZE - 1)];
+		out[i] = b;
+		ringbuf[pos] = b;
+		pos = (pos + 1) & (RING_BUFFER_SIZE - 1);
 	}
+
+	decoder->ringbuf_pos = pos;
 }
 
-// Process a single command from the LZS input stream.
+// Process a single command from the LZS input stream, appending the
+// output to the buffer. Returns zero for failure.
 
-static size_t lha_lzs_read(void *data, uint8_t *buf)
+static int decode_command(LHALZSDecoder *decoder, uint8_t *buf,
+                          size_t *buf_len)
 {
-	LHALZSDecoder *decoder = data;
-	int bit;
-	size_t result;
-
-	// Start from an empty buffer.
-
-	result = 0;
+	int bit, cmd;
 
 	// Each command starts with a bit that signals the type:
 
@@ -119,27 +127,63 @@ static size_t lha_lzs_read(void *data, uint8_t *buf)
 	// What type of command is this?
 
 	if (bit) {
-		int b;
-
-		b = read_bits(&decoder->bit_stream_reader, 8);
+		cmd = read_bits(&decoder->bit_stream_reader, 8);
 
-		if (b < 0) {
+		if (cmd < 0) {
 			return 0;
 		}
 
-		output_byte(decoder, buf, &result, (uint8_t) b);
+		buf[*buf_len] = (uint8_t) cmd;
+		++*buf_len;
+
+		decoder->ringbuf[decoder->ringbuf_pos] = (uint8_t) cmd;
+		decoder->ringbuf_pos = (decoder->ringbuf_pos + 1)
+		                     & (RING_BUFFER_SIZE - 1);
+
+		if (decoder->stats != NULL) {
+			++decoder->stats->literals;
+		}
 	} else {
-		int pos, len;
+		unsigned int pos, len;
+
+		// Copy command: an 11-bit position and 4-bit length,
+		// read together.
 
-		pos = read_bits(&decoder->bit_stream_reader, 11);
-		len = read_bits(&decoder->bit_stream_reader, 4);
+		cmd = read_bits(&decoder->bit_stream_reader, 15);
 
-		if (pos < 0 || len < 0) {
+		if (cmd < 0) {
 			return 0;
 		}
 
-		output_block(decoder, buf, &result, (unsigned int) pos,
-		             (unsigned int) len + THRESHOLD);
+		pos = (unsigned int) cmd >> 4;
+		len = ((unsigned int) cmd & 0x0f) + THRESHOLD;
+
+		output_block(decoder, buf + *buf_len, pos, len);
+		*buf_len += len;
+
+		if (decoder->stats != NULL) {
+			lha_decoder_count_copy(decoder->stats, len);
+		}
+	}
+
+	return 1;
+}
+
+// Decode as many commands as will fit in the output buffer.
+
+static size_t lha_lzs_read(void *data, uint8_t *buf)
+{
+	LHALZSDecoder *decoder = data;
+	size_t result;
+
+	// Start from an empty buffer.
+
+	result = 0;
+
+	while (result + MAX_COPY_LENGTH <= OUTPUT_BUFFER_SIZE) {
+		if (!decode_command(decoder, buf, &result)) {
+			break;
+		}
 	}
 
 	return result;
@@ -151,5 +195,6 @@ const LHADecoderType lha_lzs_decoder = {
 	lha_lzs_read,
 	sizeof(LHALZSDecoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_lzs_set_stats
 };
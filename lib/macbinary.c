@@ -432,6 +432,7 @@ static const LHADecoderType macbinary_decoder_type = {
 	sizeof(MacBinaryDecoder),
 	OUTPUT_BUFFER_SIZE,
 	0,
+	NULL
 };
 
 LHADecoder *lha_macbinary_passthrough(LHADecoder *decoder,
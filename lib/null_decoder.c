@@ -56,5 +56,6 @@ const LHADecoderType lha_null_decoder = {
 	lha_null_read,
 	sizeof(LHANullDecoder),
 	BLOCK_READ_SIZE,
-	2048
+	2048,
+	NULL
 };
@@ -53,6 +53,11 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define OUTPUT_BUFFER_SIZE (MAX_BYTE_BLOCK_LEN + MAX_COPY_BLOCK_LEN)
 
+// Maximum depth of the trees in byte_decode_trees, and so the number
+// of bits used to index byte_decode_table.
+
+#define BYTE_DECODE_TABLE_BITS 5
+
 typedef struct {
 	BitStreamReader bit_stream_reader;
 
@@ -65,20 +70,31 @@ typedef struct {
 
 	const uint8_t *byte_decode_tree;
 
+	// Lookup table built from byte_decode_tree, so that an index can
+	// be decoded in a single step. Maps from the next bits in the
+	// input stream to the index (high bits) and the number of bits
+	// used to encode it (low 3 bits).
+
+	uint8_t byte_decode_table[1 << BYTE_DECODE_TABLE_BITS];
+
 	// History ring buffer.
 
 	uint8_t ringbuf[RING_BUFFER_SIZE];
 	unsigned int ringbuf_pos;
 
-	// History linked list, for adaptively encoding byte values.
+	// History list, for adaptively encoding byte values.
 
-	HistoryLinkedList history_list;
+	HistoryList history_list;
 
 	// Callback to read more compressed data from the input (see
 	// read_callback_wrapper below).
 
 	LHADecoderCallback callback;
 	void *callback_data;
+
+	// Counters, if being collected.
+
+	LHAStats *stats;
 } LHAPM1Decoder;
 
 // Table used to decode distance into history buffer to copy data.
@@ -215,9 +231,50 @@ static int lha_pm1_init(void *data, LHADecoderCallback callback,
 
 	init_history_list(&decoder->history_list);
 
+	decoder->stats = NULL;
+
 	return 1;
 }
 
+static void lha_pm1_set_stats(void *data, LHAStats *stats)
+{
+	LHAPM1Decoder *decoder = data;
+
+	decoder->stats = stats;
+}
+
+// Walk down the tree in byte_decode_tree, taking the path given by the
+// bits of 'code', and return the byte_decode_table entry for it.
+
+static uint8_t walk_byte_decode_tree(const uint8_t *ptr, unsigned int code)
+{
+	unsigned int child, bits;
+
+	if (ptr[0] == 0) {
+		return 0;
+	}
+
+	for (bits = 1; bits <= BYTE_DECODE_TABLE_BITS; ++bits) {
+		if ((code & (1 << (BYTE_DECODE_TABLE_BITS - bits))) == 0) {
+			child = (*ptr >> 4) & 0x0f;
+		} else {
+			child = *ptr & 0x0f;
+		}
+
+		// Reached a leaf node?
+
+		if (child >= 10) {
+			return (uint8_t) (((child - 10) << 3) | bits);
+		}
+
+		ptr += child;
+	}
+
+	// Not reached: all trees are at most BYTE_DECODE_TABLE_BITS deep.
+
+	return 0;
+}
+
 // Read the 5-bit header from the start of the input stream. This
 // specifies the table entry to use for byte decodes.
 
@@ -233,6 +290,18 @@ static int read_start_header(LHAPM1Decoder *decoder)
 
 	decoder->byte_decode_tree = byte_decode_trees[index];
 
+	// Build the lookup table for this tree.
+
+	for (index = 0; index < (1 << BYTE_DECODE_TABLE_BITS); ++index) {
+		decoder->byte_decode_table[index]
+		    = walk_byte_decode_tree(decoder->byte_decode_tree,
+		                            (unsigned int) index);
+	}
+
+	if (decoder->stats != NULL) {
+		++decoder->stats->table_rebuilds;
+	}
+
 	return 1;
 }
 
@@ -247,7 +316,7 @@ static void outputted_byte(LHAPM1Decoder *decoder, uint8_t b)
 	decoder->ringbuf_pos
 	    = (decoder->ringbuf_pos + 1) % RING_BUFFER_SIZE;
 
-	// Other updates: history linked list, output stream position:
+	// Other updates: history list, output stream position:
 
 	update_history_list(&decoder->history_list, b);
 	++decoder->output_stream_pos;
@@ -493,16 +562,20 @@ static size_t read_copy_command(LHAPM1Decoder *decoder, uint8_t *buf)
 		copy_index = (copy_index + 1) % RING_BUFFER_SIZE;
 	}
 
+	if (decoder->stats != NULL) {
+		lha_decoder_count_copy(decoder->stats, (size_t) count);
+	}
+
 	return count;
 }
 
-// Read the index into the byte decode table, using the byte_decode_tree
-// set at the start of the stream. Returns -1 for failure.
+// Read the index into the byte decode table by walking down the
+// byte_decode_tree a bit at a time. Returns -1 for failure.
 
-static int read_byte_decode_index(LHAPM1Decoder *decoder)
+static int walk_byte_decode_index(LHAPM1Decoder *decoder)
 {
 	const uint8_t *ptr;
-	unsigned int child;
+	unsigned int child, bits;
 	int bit;
 
 	ptr = decoder->byte_decode_tree;
@@ -514,7 +587,7 @@ static int read_byte_decode_index(LHAPM1Decoder *decoder)
 	// Walk down the tree, reading a bit at each node to determine
 	// which path to take.
 
-	for (;;) {
+	for (bits = 0; bits < BYTE_DECODE_TABLE_BITS; ++bits) {
 		bit = read_bit(&decoder->bit_stream_reader);
 
 		if (bit < 0) {
@@ -528,11 +601,38 @@ static int read_byte_decode_index(LHAPM1Decoder *decoder)
 		// Reached a leaf node?
 
 		if (child >= 10) {
-			return child - 10;
+			return (int) (child - 10);
 		}
 
 		ptr += child;
 	}
+
+	return -1;
+}
+
+// Read the index into the byte decode table, using the byte_decode_tree
+// set at the start of the stream. Returns -1 for failure.
+
+static int read_byte_decode_index(LHAPM1Decoder *decoder)
+{
+	uint8_t entry;
+	int code;
+
+	// Look up the next bits in the table built from the tree, then
+	// consume only the bits that were actually used. Near the end of
+	// the stream there may be too few bits left to look up the table,
+	// although a short code can still be decoded.
+
+	code = peek_bits(&decoder->bit_stream_reader, BYTE_DECODE_TABLE_BITS);
+
+	if (code < 0) {
+		return walk_byte_decode_index(decoder);
+	}
+
+	entry = decoder->byte_decode_table[code];
+	read_bits(&decoder->bit_stream_reader, entry & 0x07);
+
+	return entry >> 3;
 }
 
 // Read a single byte value from the input stream.
@@ -552,7 +652,7 @@ static int read_byte(LHAPM1Decoder *decoder)
 	}
 
 	// Decode value using byte_ranges table. This is actually
-	// a distance to walk along the history linked list - it
+	// a distance to walk along the history list - it
 	// is static huffman encoding, so that recently used byte
 	// values use fewer bits.
 
@@ -563,8 +663,7 @@ static int read_byte(LHAPM1Decoder *decoder)
 		return -1;
 	}
 
-	// Walk through the history linked list to get the actual
-	// value.
+	// Look up the actual value in the history list.
 
 	return find_in_history_list(&decoder->history_list, count);
 }
@@ -662,6 +761,10 @@ static size_t read_byte_block(LHAPM1Decoder *decoder, uint8_t *buf)
 
 	result = (size_t) block_len;
 
+	if (decoder->stats != NULL) {
+		decoder->stats->literals += result;
+	}
+
 	// Because this is a block of bytes, it can be assumed that the
 	// block ended for a copy command. The one exception is that if
 	// the maximum block length was reached, the block may have
@@ -709,5 +812,6 @@ const LHADecoderType lha_pm1_decoder = {
 	lha_pm1_read,
 	sizeof(LHAPM1Decoder),
 	OUTPUT_BUFFER_SIZE,
-	2048
+	2048,
+	lha_pm1_set_stats
 };
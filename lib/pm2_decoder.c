@@ -56,6 +56,12 @@ typedef uint8_t TreeElement;
 
 #define OFFSET_TREE_ELEMENTS  17
 
+// Number of bits decoded in a single step by the lookup tables built
+// for the code and offset trees.
+
+#define CODE_LOOKUP_BITS      8
+#define OFFSET_LOOKUP_BITS    6
+
 typedef enum {
 	PM2_REBUILD_UNBUILT,          // At start of stream
 	PM2_REBUILD_BUILD1,           // After 1KiB
@@ -80,9 +86,9 @@ typedef struct {
 	uint8_t ringbuf[RING_BUFFER_SIZE];
 	unsigned int ringbuf_pos;
 
-	// History linked list, for adaptively encoding byte values.
+	// History list, for adaptively encoding byte values.
 
-	HistoryLinkedList history_list;
+	HistoryList history_list;
 
 	// Array representing the huffman tree used for representing
 	// code values. A given node of the tree has children
@@ -91,6 +97,10 @@ typedef struct {
 
 	TreeElement code_tree[CODE_TREE_ELEMENTS];
 
+	// Lookup table built from code_tree to decode codes quickly.
+
+	TreeLookupEntry code_lookup[1 << CODE_LOOKUP_BITS];
+
 	// If zero, we don't need an offset tree:
 
 	int need_offset_tree;
@@ -100,13 +110,21 @@ typedef struct {
 
 	TreeElement offset_tree[OFFSET_TREE_ELEMENTS];
 
+	// Lookup table built from offset_tree.
+
+	TreeLookupEntry offset_lookup[1 << OFFSET_LOOKUP_BITS];
+
+	// Counters, if being collected.
+
+	LHAStats *stats;
+
 } LHAPM2Decoder;
 
 // Decode table for history value. Characters that appeared recently in
 // the history are more likely than ones that appeared a long time ago,
 // so the history value is huffman coded so that small values require
 // fewer bits. The history value is then used to search within the
-// history linked list to get the actual character.
+// history list to get the actual character.
 
 static const VariableLengthTable history_decode[] = {
 	{   0, 3 },   //   0 + (1 << 3) =   8
@@ -161,9 +179,18 @@ static int lha_pm2_decoder_init(void *data, LHADecoderCallback callback,
 	init_tree(decoder->code_tree, CODE_TREE_ELEMENTS);
 	init_tree(decoder->offset_tree, OFFSET_TREE_ELEMENTS);
 
+	decoder->stats = NULL;
+
 	return 1;
 }
 
+static void lha_pm2_decoder_set_stats(void *data, LHAStats *stats)
+{
+	LHAPM2Decoder *decoder = data;
+
+	decoder->stats = stats;
+}
+
 // Read the list of code lengths to use for the code tree and construct
 // the code_tree structure.
 
@@ -344,6 +371,17 @@ static void rebuild_tree(LHAPM2Decoder *decoder)
 			decoder->tree_rebuild_remaining = 4096;
 			break;
 	}
+
+	// Regenerate the lookup tables to match the new trees.
+
+	build_tree_lookup(decoder->code_tree, decoder->code_lookup,
+	                  CODE_LOOKUP_BITS);
+	build_tree_lookup(decoder->offset_tree, decoder->offset_lookup,
+	                  OFFSET_LOOKUP_BITS);
+
+	if (decoder->stats != NULL) {
+		++decoder->stats->table_rebuilds;
+	}
 }
 
 static void output_byte(LHAPM2Decoder *decoder, uint8_t *buf,
@@ -391,6 +429,10 @@ static void read_single_byte(LHAPM2Decoder *decoder, unsigned int code,
 
 	b = find_in_history_list(&decoder->history_list, (uint8_t) offset);
 	output_byte(decoder, buf, buf_len, b);
+
+	if (decoder->stats != NULL) {
+		++decoder->stats->literals;
+	}
 }
 
 // Calculate how many bytes from history to copy:
@@ -433,8 +475,10 @@ static int history_get_offset(LHAPM2Decoder *decoder, unsigned int code)
 
 	else if (code < 20) {
 
-		val = read_from_tree(&decoder->bit_stream_reader,
-		                     decoder->offset_tree);
+		val = read_from_tree_lookup(&decoder->bit_stream_reader,
+		                            decoder->offset_tree,
+		                            decoder->offset_lookup,
+		                            OFFSET_LOOKUP_BITS);
 
 		if (val < 0) {
 			return -1;
@@ -489,6 +533,10 @@ static void copy_from_history(LHAPM2Decoder *decoder, unsigned int code,
 		return;
 	}
 
+	if (decoder->stats != NULL) {
+		lha_decoder_count_copy(decoder->stats, (size_t) to_copy);
+	}
+
 	// Perform copy.
 
 	start = decoder->ringbuf_pos + RING_BUFFER_SIZE - 1
@@ -522,7 +570,9 @@ static size_t lha_pm2_decoder_read(void *data, uint8_t *buf)
 
 	result = 0;
 
-	code = read_from_tree(&decoder->bit_stream_reader, decoder->code_tree);
+	code = read_from_tree_lookup(&decoder->bit_stream_reader,
+	                             decoder->code_tree, decoder->code_lookup,
+	                             CODE_LOOKUP_BITS);
 
 	if (code < 0) {
 		return 0;
@@ -544,5 +594,6 @@ const LHADecoderType lha_pm2_decoder = {
 	lha_pm2_decoder_read,
 	sizeof(LHAPM2Decoder),
 	OUTPUT_BUFFER_SIZE,
-	RING_BUFFER_SIZE
+	RING_BUFFER_SIZE,
+	lha_pm2_decoder_set_stats
 };
@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_PUBLIC_LHA_ALLOCATOR_H
+#define LHASA_PUBLIC_LHA_ALLOCATOR_H
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_allocator.h
+ *
+ * @brief Memory allocator hooks.
+ *
+ * By default, the library allocates memory using the standard C library
+ * functions (malloc, realloc and free). This file defines an interface
+ * that allows a program embedding the library to supply its own
+ * allocator instead, for example to account for memory used or to
+ * allocate from a custom memory pool.
+ */
+
+/**
+ * Structure containing pointers to callback functions used to allocate
+ * and free memory.
+ */
+
+typedef struct {
+
+	/**
+	 * Allocate a block of memory.
+	 *
+	 * @param size         Size of the block to allocate, in bytes.
+	 * @param user_data    The user_data field from this structure.
+	 * @return             Pointer to the allocated block, or NULL if
+	 *                     the memory could not be allocated.
+	 */
+
+	void *(*malloc)(size_t size, void *user_data);
+
+	/**
+	 * Resize a block of memory, with the same semantics as the
+	 * standard C realloc() function.
+	 *
+	 * @param ptr          Pointer to the block to resize, or NULL.
+	 * @param size         New size of the block, in bytes.
+	 * @param user_data    The user_data field from this structure.
+	 * @return             Pointer to the resized block, or NULL if
+	 *                     the memory could not be allocated (in which
+	 *                     case the original block is left unchanged).
+	 */
+
+	void *(*realloc)(void *ptr, size_t size, void *user_data);
+
+	/**
+	 * Free a block of memory.
+	 *
+	 * @param ptr          Pointer to the block to free, or NULL.
+	 * @param user_data    The user_data field from this structure.
+	 */
+
+	void (*free)(void *ptr, void *user_data);
+
+	/** Extra pointer passed to each of the callback functions. */
+
+	void *user_data;
+
+} LHAAllocator;
+
+/**
+ * Set the allocator used by the library for all memory allocation.
+ *
+ * The allocator is global to the library. It should be set before any
+ * other library objects are created, and must not be changed while any
+ * objects allocated with a previous allocator are still in use, as those
+ * objects will be freed using the new allocator.
+ *
+ * The library may call the allocator from several threads at once:
+ * when an encoder uses more than one thread (see
+ * @ref lha_encoder_set_threads), or a writer compresses more than one
+ * file at once (see @ref lha_writer_set_jobs). In that case, the
+ * callback functions must be thread-safe.
+ *
+ * @param allocator    Pointer to a @ref LHAAllocator structure containing
+ *                     the callback functions to use, or NULL to restore
+ *                     the default allocator. The structure is copied, so
+ *                     it need not remain valid after this call.
+ */
+
+void lha_set_allocator(const LHAAllocator *allocator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_ALLOCATOR_H */
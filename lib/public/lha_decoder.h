@@ -24,6 +24,8 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <inttypes.h>
 
+#include "lha_stats.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -182,6 +184,22 @@ uint16_t lha_decoder_get_crc(LHADecoder *decoder);
 
 uint64_t lha_decoder_get_length(LHADecoder *decoder);
 
+/**
+ * Collect performance counters for a decoder.
+ *
+ * Counters are added to the values already in the structure, so the
+ * same structure can be used to accumulate totals for several decoders;
+ * it should be initialized to zero before first use.
+ *
+ * @param decoder        The decoder.
+ * @param stats          Pointer to the structure in which to accumulate
+ *                       counters, or NULL to stop collecting them. The
+ *                       structure must remain valid until the decoder
+ *                       is freed or this function is called again.
+ */
+
+void lha_decoder_set_stats(LHADecoder *decoder, LHAStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,251 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_PUBLIC_LHA_ENCODER_H
+#define LHASA_PUBLIC_LHA_ENCODER_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_encoder.h
+ *
+ * @brief Raw LHA data encoder.
+ *
+ * This file defines the interface to the compression code, which can
+ * be used to generate the raw compressed data stored in an LZH file.
+ * It is the counterpart of the decoder interface in @ref lha_decoder.h.
+ *
+ * An @ref LHAEncoderType for a compression algorithm is retrieved using
+ * the @ref lha_encoder_for_name function, and passed to
+ * @ref lha_encoder_new to create an @ref LHAEncoder. Uncompressed data
+ * is then passed to the encoder with @ref lha_encoder_write, and
+ * compressed data is passed to a callback function as it is generated.
+ * When all the data has been written, @ref lha_encoder_finish must be
+ * called to flush the remaining compressed data.
+ */
+
+/**
+ * Lowest (fastest) compression level.
+ */
+
+#define LHA_ENCODER_MIN_LEVEL      1
+
+/**
+ * Highest (slowest) compression level, giving the smallest output.
+ */
+
+#define LHA_ENCODER_MAX_LEVEL      9
+
+/**
+ * Compression level used if none is set.
+ */
+
+#define LHA_ENCODER_DEFAULT_LEVEL  5
+
+/**
+ * Opaque type representing a type of encoder.
+ *
+ * This is an implementation of the compression code for one of the
+ * algorithms used in LZH archive files. Pointers to these structures are
+ * retrieved by using the @ref lha_encoder_for_name function.
+ */
+
+typedef struct _LHAEncoderType LHAEncoderType;
+
+/**
+ * Opaque type representing an instance of an encoder.
+ *
+ * This is an encoder structure being used to compress a stream of
+ * data. Instantiated using the @ref lha_encoder_new function and freed
+ * using the @ref lha_encoder_free function.
+ */
+
+typedef struct _LHAEncoder LHAEncoder;
+
+/**
+ * Callback function invoked when an encoder has compressed data to
+ * write.
+ *
+ * @param buf        Pointer to the compressed data.
+ * @param buf_len    Size of the data, in bytes.
+ * @param user_data  Extra pointer passed to the encoder.
+ * @return           Number of bytes written. If this is less than
+ *                   buf_len, the encoder treats it as an error.
+ */
+
+typedef size_t (*LHAEncoderCallback)(const void *buf, size_t buf_len,
+                                     void *user_data);
+
+/**
+ * Get the encoder type for the specified name.
+ *
+ * @param name           String identifying the compression algorithm,
+ *                       for example, "-lh5-".
+ * @return               Pointer to the encoder type, or NULL if there
+ *                       is no encoder for the specified algorithm.
+ */
+
+const LHAEncoderType *lha_encoder_for_name(const char *name);
+
+/**
+ * Allocate a new encoder for the specified type.
+ *
+ * @param etype          The encoder type.
+ * @param callback       Callback function for the encoder to call to
+ *                       write compressed data.
+ * @param callback_data  Extra data to pass to the callback function.
+ * @return               Pointer to the new encoder, or NULL for failure.
+ */
+
+LHAEncoder *lha_encoder_new(const LHAEncoderType *etype,
+                            LHAEncoderCallback callback,
+                            void *callback_data);
+
+/**
+ * Free an encoder.
+ *
+ * @param encoder        The encoder to free.
+ */
+
+void lha_encoder_free(LHAEncoder *encoder);
+
+/**
+ * Set the compression level, which trades speed against the size of
+ * the compressed data. Lower levels search for matches using hash
+ * chains; higher levels use binary trees, and check whether it is
+ * better to delay a match by one or two bytes ("lazy" matching). The
+ * highest level uses "optimal parsing", which is considerably slower:
+ * the data is divided into blocks, and the cheapest sequence of
+ * commands for each block is found, using the sizes of the codes
+ * built for the block by the previous attempt. This must be called
+ * before any data is written.
+ *
+ * @param encoder        The encoder.
+ * @param level          The compression level, from
+ *                       @ref LHA_ENCODER_MIN_LEVEL to
+ *                       @ref LHA_ENCODER_MAX_LEVEL. Values outside
+ *                       this range are clamped to it.
+ */
+
+void lha_encoder_set_level(LHAEncoder *encoder, int level);
+
+/**
+ * Set the maximum number of earlier positions that the encoder's match
+ * finder examines when looking for a match. Larger values give better
+ * compression at the cost of speed. This overrides the value chosen
+ * by @ref lha_encoder_set_level, so should be called after it, and
+ * before any data is written.
+ *
+ * @param encoder        The encoder.
+ * @param depth          Maximum number of positions to examine; must be
+ *                       at least one.
+ */
+
+void lha_encoder_set_chain_depth(LHAEncoder *encoder, unsigned int depth);
+
+/**
+ * Set the number of threads used to compress the data. With more than
+ * one thread, the data is divided into chunks of 1 MiB, and the
+ * commands for several chunks are found at the same time. Each chunk
+ * is compressed knowing the history before it, so there is little loss
+ * of compression, and the compressed data does not depend on the
+ * number of threads used, only on whether there is more than one. Only
+ * large streams benefit; the encoder may also use fewer threads than
+ * requested. This must be called before any data is written.
+ *
+ * @param encoder        The encoder.
+ * @param threads        Number of threads to use, or zero to use one
+ *                       for each processor.
+ * @return               Non-zero for success, or zero if memory could
+ *                       not be allocated for the threads, in which
+ *                       case the encoder uses a single thread.
+ */
+
+int lha_encoder_set_threads(LHAEncoder *encoder, unsigned int threads);
+
+/**
+ * Compress more data.
+ *
+ * The encoder buffers data internally, so compressed data may not be
+ * passed to the callback function until later calls, or until
+ * @ref lha_encoder_finish is called.
+ *
+ * @param encoder        The encoder.
+ * @param buf            Pointer to the data to compress.
+ * @param buf_len        Size of the data, in bytes.
+ * @return               Non-zero for success, or zero if the callback
+ *                       function failed to write compressed data.
+ */
+
+int lha_encoder_write(LHAEncoder *encoder, const uint8_t *buf,
+                      size_t buf_len);
+
+/**
+ * Finish compressing, writing all remaining compressed data.
+ *
+ * No more data may be written to the encoder after this is called.
+ *
+ * @param encoder        The encoder.
+ * @return               Non-zero for success, or zero if the callback
+ *                       function failed to write compressed data.
+ */
+
+int lha_encoder_finish(LHAEncoder *encoder);
+
+/**
+ * Get the 16-bit CRC of the data written to the encoder, for storing
+ * in the file header.
+ *
+ * @param encoder        The encoder.
+ * @return               16-bit CRC of the data written so far.
+ */
+
+uint16_t lha_encoder_get_crc(LHAEncoder *encoder);
+
+/**
+ * Get the number of bytes of uncompressed data written to the encoder.
+ *
+ * @param encoder        The encoder.
+ * @return               The number of bytes written.
+ */
+
+uint64_t lha_encoder_get_length(LHAEncoder *encoder);
+
+/**
+ * Get the number of bytes of compressed data passed to the callback
+ * function so far. After @ref lha_encoder_finish has been called, this
+ * is the compressed length to store in the file header.
+ *
+ * @param encoder        The encoder.
+ * @return               The number of compressed bytes.
+ */
+
+uint64_t lha_encoder_get_compressed_length(LHAEncoder *encoder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_ENCODER_H */
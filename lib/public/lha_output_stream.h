@@ -0,0 +1,167 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_PUBLIC_LHA_OUTPUT_STREAM_H
+#define LHASA_PUBLIC_LHA_OUTPUT_STREAM_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_output_stream.h
+ *
+ * @brief LHA output stream structure.
+ *
+ * This file defines the functions relating to the @ref LHAOutputStream
+ * structure, used to write data to an LZH file. It is the counterpart
+ * of @ref lha_input_stream.h.
+ */
+
+/**
+ * Opaque structure, representing an output stream used to write data
+ * to an LZH file.
+ */
+
+typedef struct _LHAOutputStream LHAOutputStream;
+
+/**
+ * Structure containing pointers to callback functions to write data to
+ * the output stream.
+ */
+
+typedef struct {
+
+	/**
+	 * Write a block of data.
+	 *
+	 * @param handle       Handle pointer.
+	 * @param buf          Pointer to the data to write.
+	 * @param buf_len      Size of the data, in bytes.
+	 * @return             Non-zero if all the data was written, or
+	 *                     zero for error.
+	 */
+
+	int (*write)(void *handle, const void *buf, size_t buf_len);
+
+	/**
+	 * Move the position at which data is written, relative to the
+	 * current position. This is an optional function; it is used
+	 * to go back and fill in the header of a file after its data
+	 * has been written. A seek of zero bytes is used to check
+	 * whether the stream can seek.
+	 *
+	 * @param handle       Handle pointer.
+	 * @param offset       Number of bytes to move by; negative to
+	 *                     move backwards.
+	 * @return             Non-zero for success, or zero for failure.
+	 */
+
+	int (*seek)(void *handle, int64_t offset);
+
+	/**
+	 * Close the output stream.
+	 *
+	 * @param handle       Handle pointer.
+	 */
+
+	void (*close)(void *handle);
+
+} LHAOutputStreamType;
+
+/**
+ * Create new @ref LHAOutputStream structure, using a set of generic
+ * functions to write LHA data.
+ *
+ * @param type         Pointer to a @ref LHAOutputStreamType structure
+ *                     containing callback functions to write data.
+ * @param handle       Handle pointer to be passed to callback functions.
+ * @return             Pointer to a new @ref LHAOutputStream or NULL for
+ *                     error.
+ */
+
+LHAOutputStream *lha_output_stream_new(const LHAOutputStreamType *type,
+                                       void *handle);
+
+/**
+ * Create new @ref LHAOutputStream, writing to the specified filename.
+ * The file is created, or truncated if it already exists, and is
+ * automatically closed when the output stream is freed.
+ *
+ * @param filename     Name of the file to write to.
+ * @return             Pointer to a new @ref LHAOutputStream or NULL for
+ *                     error.
+ */
+
+LHAOutputStream *lha_output_stream_to(char *filename);
+
+/**
+ * Create new @ref LHAOutputStream, to add more files to an existing
+ * LZH file with an @ref LHAWriter.
+ *
+ * The headers of the files already in the archive are read to find
+ * the end of the archive. The file is truncated there, and the output
+ * stream writes from that point, so that the files already in the
+ * archive are not rewritten. The archive is complete again once
+ * @ref lha_writer_finish has been called; if an error occurs before
+ * then, the files that were already in the archive can still be read.
+ * A file without any valid headers is only treated as an archive if it
+ * is empty, or contains nothing but the end of archive marker.
+ *
+ * The file is automatically closed when the output stream is freed.
+ *
+ * @param filename     Name of the LZH file to add files to.
+ * @return             Pointer to a new @ref LHAOutputStream, or NULL
+ *                     if the file could not be opened, or the end of
+ *                     the archive could not be found (for example,
+ *                     because it is corrupt). In that case the file
+ *                     is not modified.
+ */
+
+LHAOutputStream *lha_output_stream_append_to(char *filename);
+
+/**
+ * Create new @ref LHAOutputStream, to write to an already-open FILE
+ * pointer. The FILE is not closed when the output stream is freed; the
+ * calling code must close it.
+ *
+ * @param stream       The open FILE structure to which to write data.
+ * @return             Pointer to a new @ref LHAOutputStream or NULL for
+ *                     error.
+ */
+
+LHAOutputStream *lha_output_stream_to_FILE(FILE *stream);
+
+/**
+ * Free an @ref LHAOutputStream structure.
+ *
+ * @param stream       The output stream.
+ */
+
+void lha_output_stream_free(LHAOutputStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_OUTPUT_STREAM_H */
@@ -24,6 +24,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "lha_decoder.h"
 #include "lha_input_stream.h"
 #include "lha_file_header.h"
+#include "lha_stats.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -136,6 +137,22 @@ void lha_reader_free(LHAReader *reader);
 void lha_reader_set_dir_policy(LHAReader *reader,
                                LHAReaderDirPolicy policy);
 
+/**
+ * Set whether to try to recover from corrupted archives.
+ *
+ * By default, reading stops when an invalid file header is encountered.
+ * In recovery mode, the reader instead scans forward through the input
+ * stream to find the next valid header and continues from there. To
+ * avoid mistaking compressed data for a header, only headers protected
+ * by a checksum or CRC are accepted. Recovery mode is slower than normal
+ * reading, as every header is checked in this way before it is read.
+ *
+ * @param reader     The @ref LHAReader structure.
+ * @param recover    Non-zero to enable recovery mode.
+ */
+
+void lha_reader_set_recover(LHAReader *reader, int recover);
+
 /**
  * Read the header of the next archived file from the input stream.
  *
@@ -209,6 +226,32 @@ int lha_reader_extract(LHAReader *reader,
 
 int lha_reader_current_is_fake(LHAReader *reader);
 
+/**
+ * Enable or disable collection of performance counters.
+ *
+ * When enabled, the reader counts the time spent reading file headers
+ * and writing extracted files, along with the counters collected by
+ * the decoders for each file (see @ref lha_decoder_set_stats). Enabling
+ * collection resets all counters to zero.
+ *
+ * @param reader         The @ref LHAReader structure.
+ * @param enable         Non-zero to enable collection.
+ */
+
+void lha_reader_enable_stats(LHAReader *reader, int enable);
+
+/**
+ * Get the performance counters collected so far.
+ *
+ * If collection has not been enabled, all counters are zero.
+ *
+ * @param reader         The @ref LHAReader structure.
+ * @param stats          Pointer to a structure in which to store the
+ *                       counters.
+ */
+
+void lha_reader_get_stats(LHAReader *reader, LHAStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,117 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_PUBLIC_LHA_STATS_H
+#define LHASA_PUBLIC_LHA_STATS_H
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_stats.h
+ *
+ * @brief Performance counters.
+ *
+ * Decoders and readers can optionally collect counters about the work
+ * they do: how much data was processed, where the time was spent, and
+ * some details of the compressed data. These are cheap enough to leave
+ * enabled in production, and are intended to help track down
+ * performance problems. When collection is not enabled, there is
+ * negligible overhead.
+ *
+ * See @ref lha_decoder_set_stats and @ref lha_reader_enable_stats.
+ */
+
+/**
+ * Number of buckets in the copy length histogram.
+ */
+
+#define LHA_STATS_COPY_LENGTH_BUCKETS 16
+
+/**
+ * Structure containing performance counters.
+ *
+ * All times are in nanoseconds, measured from a monotonic clock.
+ */
+
+typedef struct {
+
+	/** Number of bytes of compressed data read by decoders. */
+
+	uint64_t bytes_in;
+
+	/** Number of bytes of decompressed data produced by decoders. */
+
+	uint64_t bytes_out;
+
+	/** Number of times decoders invoked the input callback. */
+
+	uint64_t input_calls;
+
+	/** Number of file headers read. */
+
+	uint64_t headers;
+
+	/** Time spent reading and parsing file headers. */
+
+	uint64_t header_time;
+
+	/** Time spent decompressing data, not including the CRC. */
+
+	uint64_t decode_time;
+
+	/** Time spent calculating the CRC of decompressed data. */
+
+	uint64_t crc_time;
+
+	/** Time spent writing decompressed data to output files. */
+
+	uint64_t output_time;
+
+	/**
+	 * Number of times a decoder rebuilt its Huffman tables; for most
+	 * algorithms, this is the number of compressed blocks.
+	 */
+
+	uint64_t table_rebuilds;
+
+	/** Number of literal bytes decoded. */
+
+	uint64_t literals;
+
+	/**
+	 * Histogram of the lengths of copies from the history buffer.
+	 * Bucket n counts copies with lengths in the range
+	 * 2^n <= length < 2^(n+1); the last bucket also counts any longer
+	 * copies.
+	 */
+
+	uint64_t copy_lengths[LHA_STATS_COPY_LENGTH_BUCKETS];
+
+} LHAStats;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_STATS_H */
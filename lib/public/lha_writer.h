@@ -0,0 +1,318 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_PUBLIC_LHA_WRITER_H
+#define LHASA_PUBLIC_LHA_WRITER_H
+
+#include "lha_encoder.h"
+#include "lha_output_stream.h"
+#include "lha_file_header.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file lha_writer.h
+ *
+ * @brief LHA file writer.
+ *
+ * This file contains the interface functions for the @ref LHAWriter
+ * structure, used to create an LZH file. It is the counterpart of
+ * @ref lha_reader.h.
+ *
+ * Each file is started by calling @ref lha_writer_add_file with an
+ * @ref LHAFileHeader describing it, and its contents are then passed
+ * to @ref lha_writer_write. When all files have been added,
+ * @ref lha_writer_finish writes the end of the archive.
+ *
+ * Files are written with level 2 headers. The header comes before the
+ * compressed data, but the compressed length is not known until all
+ * of the data has been compressed, so the compressed data for each
+ * file is buffered in memory. If the output stream can seek, data
+ * beyond the limit set with @ref lha_writer_set_buffer_size is
+ * written straight to the stream instead, and the header is filled in
+ * afterwards; otherwise the whole file is buffered. The archive is
+ * always written in a single pass, so it can be written to a pipe or
+ * network connection.
+ *
+ * Several files can be compressed at once on separate threads (see
+ * @ref lha_writer_set_jobs). They are still written to the archive in
+ * the order that they were added.
+ */
+
+/**
+ * Opaque structure used to write an LZH file.
+ */
+
+typedef struct _LHAWriter LHAWriter;
+
+/**
+ * Default limit on the amount of compressed data buffered for each
+ * file when writing to an output stream that can seek.
+ */
+
+#define LHA_WRITER_DEFAULT_BUFFER_SIZE  (1024 * 1024)
+
+/**
+ * Default limit on the memory used to keep the compressed data of
+ * earlier files, to reuse for duplicate files.
+ */
+
+#define LHA_WRITER_DEFAULT_DEDUP_SIZE   (16 * 1024 * 1024)
+
+/**
+ * Callback function invoked when each file has been written to the
+ * archive (see @ref lha_writer_set_callback).
+ *
+ * @param header     Header of the file, as written: the compression
+ *                   method used, lengths and CRC are filled in. The
+ *                   pointer is only valid until the callback returns.
+ * @param success    Non-zero if the file was written, or zero if an
+ *                   error occurred.
+ * @param user_data  Extra pointer passed to
+ *                   @ref lha_writer_set_callback.
+ */
+
+typedef void (*LHAWriterCallback)(LHAFileHeader *header, int success,
+                                  void *user_data);
+
+/**
+ * Create a new @ref LHAWriter to write data to an @ref LHAOutputStream.
+ *
+ * @param stream     The output stream to write data to.
+ * @return           Pointer to a new @ref LHAWriter structure,
+ *                   or NULL for error.
+ */
+
+LHAWriter *lha_writer_new(LHAOutputStream *stream);
+
+/**
+ * Free a @ref LHAWriter structure. If @ref lha_writer_finish has not
+ * been called, the archive is incomplete.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ */
+
+void lha_writer_free(LHAWriter *writer);
+
+/**
+ * Set the compression level used for the files that follow. See
+ * @ref lha_encoder_set_level.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param level      The compression level.
+ */
+
+void lha_writer_set_level(LHAWriter *writer, int level);
+
+/**
+ * Set the number of threads used to compress each of the files that
+ * follow. See @ref lha_encoder_set_threads.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param threads    Number of threads, or zero for one per processor.
+ */
+
+void lha_writer_set_threads(LHAWriter *writer, unsigned int threads);
+
+/**
+ * Set the number of files that are compressed at once.
+ *
+ * Archives often contain many small files, which cannot be split
+ * between threads (see @ref lha_writer_set_threads) to any effect.
+ * With more than one job, the data of each file of up to 8MiB is
+ * collected in memory, and when the file ends, it is compressed on a
+ * separate thread while the following files are added. The files are
+ * written in order as their jobs finish; when the limit is reached,
+ * @ref lha_writer_add_file waits for the oldest job. A file that turns
+ * out to be larger is compressed as it is written, after the earlier
+ * jobs have finished, using the threads set with
+ * @ref lha_writer_set_threads.
+ *
+ * Each job uses a single thread. The lengths of a file are not known
+ * when @ref lha_writer_end_file returns; they are passed to the
+ * callback set with @ref lha_writer_set_callback instead. An error
+ * compressing a file is reported to the callback when its job is
+ * finished, and the functions called after that fail, as they do
+ * after any other error.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param jobs       Number of files, or zero for one per processor.
+ *                   The default is one, to compress each file as it is
+ *                   written.
+ */
+
+void lha_writer_set_jobs(LHAWriter *writer, unsigned int jobs);
+
+/**
+ * Set a function to be called when each file has been written to the
+ * archive. It is called on the thread calling the other
+ * @ref LHAWriter functions, once for each file successfully added
+ * with @ref lha_writer_add_file, in the order that the files were
+ * added.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param callback   The function to call, or NULL for none.
+ * @param user_data  Extra pointer to pass to the callback.
+ */
+
+void lha_writer_set_callback(LHAWriter *writer, LHAWriterCallback callback,
+                             void *user_data);
+
+/**
+ * Set whether files that would not be made smaller by compressing them
+ * are stored instead (with the "-lh0-" method).
+ *
+ * When enabled, the start of each file to be compressed is examined
+ * before it is passed to the encoder. If it looks like data that has
+ * already been compressed (images, video, other archives), the whole
+ * file is stored, to save the time spent compressing it. Files of
+ * less than 64KiB are also stored if compressing them does not make
+ * them smaller.
+ * The method actually used can be found from the header returned by
+ * @ref lha_writer_curr_file.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param auto_store Non-zero to enable (the default), or zero to
+ *                   always use the compression method given for each
+ *                   file.
+ */
+
+void lha_writer_set_auto_store(LHAWriter *writer, int auto_store);
+
+/**
+ * Set the limit on the memory used to detect duplicate files.
+ *
+ * Archives often contain several copies of the same file. The
+ * compressed data of files of up to 1MiB is kept in memory (up to
+ * this limit, discarding the oldest first), and when a later file
+ * has the same contents and is written with the same compression
+ * method and level, the data is reused rather than compressing the
+ * file again. Each copy still has its own header and its own copy of
+ * the data in the archive, as the LZH format has no way of referring
+ * to another file's data. Files of up to 1MiB are held in memory
+ * until they end, in order to compare them.
+ *
+ * Changing the limit discards the data kept for earlier files.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param size       Limit, in bytes, or zero to disable the detection
+ *                   of duplicate files. The default is
+ *                   @ref LHA_WRITER_DEFAULT_DEDUP_SIZE.
+ */
+
+void lha_writer_set_dedup_size(LHAWriter *writer, size_t size);
+
+/**
+ * Set the limit on the amount of compressed data buffered for each
+ * file, when the output stream can seek.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param size       Limit, in bytes. The default is
+ *                   @ref LHA_WRITER_DEFAULT_BUFFER_SIZE.
+ */
+
+void lha_writer_set_buffer_size(LHAWriter *writer, size_t size);
+
+/**
+ * Start a new file in the archive. If a file is already being
+ * written, it is ended first, as with @ref lha_writer_end_file.
+ *
+ * These fields of the header are used: compress_method, path,
+ * filename, symlink_target, os_type, timestamp, unix_username,
+ * unix_group, and the fields indicated by the
+ * @ref LHA_FILE_UNIX_PERMS, @ref LHA_FILE_UNIX_UID_GID and
+ * @ref LHA_FILE_WINDOWS_TIMESTAMPS flags in extra_flags. The other
+ * fields are ignored, and the header is not modified. The header may
+ * be one returned by @ref lha_reader_next_file.
+ *
+ * For a directory or symbolic link, the compression method is
+ * @ref LHA_COMPRESS_TYPE_DIR, and no data may be written. Otherwise,
+ * the compression method is "-lh0-" to store the file uncompressed,
+ * or one for which there is an encoder (see
+ * @ref lha_encoder_for_name); the file may be stored instead (see
+ * @ref lha_writer_set_auto_store). If os_type is zero, the OS type of
+ * this system is used.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param header     Header describing the file.
+ * @return           Non-zero for success, or zero if the header is
+ *                   invalid or an error occurred.
+ */
+
+int lha_writer_add_file(LHAWriter *writer, LHAFileHeader *header);
+
+/**
+ * Write some of the (uncompressed) data for the current file,
+ * compressing it as appropriate.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @param buf        Pointer to the data to write.
+ * @param buf_len    Size of the data, in bytes.
+ * @return           Non-zero for success, or zero if there is no
+ *                   current file that can contain data, or an error
+ *                   occurred.
+ */
+
+int lha_writer_write(LHAWriter *writer, const void *buf, size_t buf_len);
+
+/**
+ * End the current file, writing its header and any compressed data
+ * still buffered.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @return           Non-zero for success, or zero if there is no
+ *                   current file, or an error occurred.
+ */
+
+int lha_writer_end_file(LHAWriter *writer);
+
+/**
+ * Get the header of the last file added with @ref lha_writer_add_file.
+ * After the file has been ended, this contains the lengths and CRC
+ * of the file as written, unless it is being compressed as a job (see
+ * @ref lha_writer_set_jobs).
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @return           Pointer to the header, or NULL if no file has been
+ *                   added. This pointer is only valid until the next
+ *                   time that lha_writer_add_file is called.
+ */
+
+LHAFileHeader *lha_writer_curr_file(LHAWriter *writer);
+
+/**
+ * Finish the archive, ending the current file if there is one,
+ * waiting for any files still being compressed, and writing the
+ * marker for the end of the archive.
+ *
+ * @param writer     The @ref LHAWriter structure.
+ * @return           Non-zero for success, or zero if an error occurred
+ *                   while writing the archive.
+ */
+
+int lha_writer_finish(LHAWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef LHASA_PUBLIC_LHA_WRITER_H */
@@ -34,6 +34,20 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define TREE_NODE_LEAF    (TreeElement) (1 << (sizeof(TreeElement) * 8 - 1))
 
+// Entry in a lookup table used to decode the first few bits of a code
+// in a single step, instead of walking the tree one bit at a time.
+
+typedef struct {
+	// Tree element reached after following the bits: either a leaf,
+	// or a node from which the rest of the code must be walked.
+
+	TreeElement node;
+
+	// Number of bits followed to reach the node.
+
+	uint8_t bits;
+} TreeLookupEntry;
+
 // Structure used to hold data needed to build the tree.
 
 typedef struct {
@@ -221,6 +235,46 @@ static void display_tree(TreeElement *tree, unsigned int node, int offset)
 }
 */
 
+// Fill in the entries in a lookup table for codes that begin with the
+// given bits, which lead to the given tree element.
+
+static void fill_tree_lookup(TreeElement *tree, TreeLookupEntry *lookup,
+                             unsigned int lookup_bits, TreeElement node,
+                             unsigned int code, unsigned int code_len)
+{
+	unsigned int i, start, count;
+
+	// Stop at a leaf, or when all the bits of the table have been
+	// used up. All entries that begin with this code map here.
+
+	if ((node & TREE_NODE_LEAF) != 0 || code_len >= lookup_bits) {
+		start = code << (lookup_bits - code_len);
+		count = 1U << (lookup_bits - code_len);
+
+		for (i = 0; i < count; ++i) {
+			lookup[start + i].node = node;
+			lookup[start + i].bits = (uint8_t) code_len;
+		}
+
+		return;
+	}
+
+	fill_tree_lookup(tree, lookup, lookup_bits, tree[node],
+	                 code << 1, code_len + 1);
+	fill_tree_lookup(tree, lookup, lookup_bits, tree[node + 1],
+	                 (code << 1) | 1, code_len + 1);
+}
+
+// Build a lookup table with (1 << lookup_bits) entries that decodes
+// the first lookup_bits bits of a code read using the given tree.
+// This must be called again whenever the tree is rebuilt.
+
+static void build_tree_lookup(TreeElement *tree, TreeLookupEntry *lookup,
+                              unsigned int lookup_bits)
+{
+	fill_tree_lookup(tree, lookup, lookup_bits, tree[0], 0, 0);
+}
+
 // Read bits from the input stream, traversing the specified tree
 // from the root node until we reach a leaf.  The leaf value is
 // returned.
@@ -249,3 +303,43 @@ static int read_from_tree(BitStreamReader *reader, TreeElement *tree)
 
 	return (int) (code & ~TREE_NODE_LEAF);
 }
+
+// Read a code from the input stream using the specified tree and the
+// lookup table built for it by build_tree_lookup(). The lookup table
+// resolves short codes with a single peek; longer codes continue to
+// walk the tree from where the table left off.
+
+static int read_from_tree_lookup(BitStreamReader *reader, TreeElement *tree,
+                                 TreeLookupEntry *lookup,
+                                 unsigned int lookup_bits)
+{
+	TreeElement code;
+	int bits, bit;
+
+	// Near the end of the stream there may not be enough bits left
+	// to use the table. Fall back to walking the whole tree.
+
+	bits = peek_bits(reader, lookup_bits);
+
+	if (bits < 0) {
+		return read_from_tree(reader, tree);
+	}
+
+	read_bits(reader, lookup[bits].bits);
+	code = lookup[bits].node;
+
+	while ((code & TREE_NODE_LEAF) == 0) {
+
+		bit = read_bit(reader);
+
+		if (bit < 0) {
+			return -1;
+		}
+
+		code = tree[code + (unsigned int) bit];
+	}
+
+	// Mask off leaf bit to get the plain code.
+
+	return (int) (code & ~TREE_NODE_LEAF);
+}
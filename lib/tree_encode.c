@@ -0,0 +1,288 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Common Huffman code construction, used by the encoders.
+//
+// This is the counterpart of tree_decode.c: given the frequency of
+// each symbol, a length is chosen for each code, and the codes are then
+// assigned in the same order in which build_tree() places them in the
+// decoding tree, so that the decoder can reconstruct the codes from
+// their lengths alone.
+//
+// This file is implemented as a "template" file to be #include-d by
+// other files.
+
+// Maximum number of symbols in a code.
+
+#define MAX_TREE_CODES 512
+
+// Maximum length of a code, in bits.
+
+#define MAX_CODE_LENGTH 16
+
+typedef struct {
+	uint32_t freq;
+	uint16_t symbol;
+} TreeEncodeLeaf;
+
+// Sort leaves by increasing frequency; ties are broken by symbol, so
+// that the result does not depend on the qsort() implementation.
+
+static int compare_leaves(const void *a, const void *b)
+{
+	const TreeEncodeLeaf *leaf_a = a, *leaf_b = b;
+
+	if (leaf_a->freq != leaf_b->freq) {
+		return leaf_a->freq < leaf_b->freq ? -1 : 1;
+	}
+
+	return (int) leaf_a->symbol - (int) leaf_b->symbol;
+}
+
+// Calculate the depth of each leaf in a Huffman tree for the given
+// leaves, which must be sorted by increasing frequency. The tree is
+// built with the two-queue method: leaves are taken in order from one
+// queue, and new internal nodes are appended to a second queue, which
+// is also in increasing order of weight.
+
+static void huffman_depths(TreeEncodeLeaf *leaves, unsigned int num_leaves,
+                           unsigned int *depths)
+{
+	uint32_t weight[MAX_TREE_CODES * 2];
+	unsigned int parent[MAX_TREE_CODES * 2];
+	unsigned int next_leaf, next_node, num_nodes;
+	unsigned int i, j, child;
+
+	for (i = 0; i < num_leaves; ++i) {
+		weight[i] = leaves[i].freq;
+	}
+
+	next_leaf = 0;
+	next_node = num_leaves;
+	num_nodes = num_leaves;
+
+	while (num_nodes < num_leaves * 2 - 1) {
+
+		// Combine the two lowest weight nodes from either queue.
+
+		weight[num_nodes] = 0;
+
+		for (j = 0; j < 2; ++j) {
+			if (next_leaf < num_leaves
+			 && (next_node >= num_nodes
+			  || weight[next_leaf] <= weight[next_node])) {
+				child = next_leaf;
+				++next_leaf;
+			} else {
+				child = next_node;
+				++next_node;
+			}
+
+			parent[child] = num_nodes;
+			weight[num_nodes] += weight[child];
+		}
+
+		++num_nodes;
+	}
+
+	// Parents always come after their children, so the depths can be
+	// calculated working back from the root.
+
+	depths[num_nodes - 1] = 0;
+
+	for (i = num_nodes - 1; i > 0; --i) {
+		depths[i - 1] = depths[parent[i - 1]] + 1;
+	}
+}
+
+// Calculate the length of the code for each leaf, using the
+// package-merge algorithm to find the optimal lengths that are no
+// longer than MAX_CODE_LENGTH. The leaves must be sorted by increasing
+// frequency.
+//
+// The list for the first level contains the leaves. Each following
+// level's list contains the leaves merged with "packages" made from
+// pairs of items in the list before, in order of weight. The code
+// lengths are then found by taking the first 2n-2 items from the last
+// level's list: each leaf in them adds one to its length, and each
+// package in them means that the two items from which it was made are
+// taken from the level below. The leaves taken at each level are
+// always the lowest weight ones, so only the number of them needs to
+// be recorded.
+
+static void package_merge(TreeEncodeLeaf *leaves, unsigned int num_leaves,
+                          unsigned int *lengths)
+{
+	uint64_t weights[2][MAX_TREE_CODES * 2];
+	uint8_t is_leaf[MAX_CODE_LENGTH][MAX_TREE_CODES * 2];
+	unsigned int list_len[MAX_CODE_LENGTH];
+	unsigned int level, i, leaf, package, num_packages, num_taken;
+	uint64_t *prev, *cur, package_weight;
+
+	for (i = 0; i < num_leaves; ++i) {
+		weights[0][i] = leaves[i].freq;
+		is_leaf[0][i] = 1;
+		lengths[i] = 0;
+	}
+
+	list_len[0] = num_leaves;
+
+	for (level = 1; level < MAX_CODE_LENGTH; ++level) {
+		prev = weights[(level - 1) % 2];
+		cur = weights[level % 2];
+		num_packages = list_len[level - 1] / 2;
+		package_weight = 0;
+		leaf = 0;
+		package = 0;
+		i = 0;
+
+		// Merge the leaves with the packages; a leaf comes first
+		// if the weights are equal.
+
+		while (leaf < num_leaves || package < num_packages) {
+			if (package < num_packages) {
+				package_weight = prev[package * 2]
+				               + prev[package * 2 + 1];
+			}
+
+			if (package >= num_packages
+			 || (leaf < num_leaves
+			  && leaves[leaf].freq <= package_weight)) {
+				cur[i] = leaves[leaf].freq;
+				is_leaf[level][i] = 1;
+				++leaf;
+			} else {
+				cur[i] = package_weight;
+				is_leaf[level][i] = 0;
+				++package;
+			}
+
+			++i;
+		}
+
+		list_len[level] = i;
+	}
+
+	// Work back down through the levels, counting the leaves taken.
+
+	num_taken = num_leaves * 2 - 2;
+
+	for (level = MAX_CODE_LENGTH; level > 0; --level) {
+		num_packages = 0;
+		leaf = 0;
+
+		for (i = 0; i < num_taken; ++i) {
+			if (is_leaf[level - 1][i]) {
+				++lengths[leaf];
+				++leaf;
+			} else {
+				++num_packages;
+			}
+		}
+
+		num_taken = num_packages * 2;
+	}
+}
+
+// Build the lengths of the codes for the given symbol frequencies. No
+// code is longer than MAX_CODE_LENGTH bits. Returns the number of
+// symbols that are used; if fewer than two are used, all lengths are
+// zero, as a single code can be represented with no bits at all.
+
+static unsigned int build_code_lengths(uint32_t *freqs,
+                                       unsigned int num_codes,
+                                       uint8_t *code_lengths)
+{
+	TreeEncodeLeaf leaves[MAX_TREE_CODES];
+	unsigned int lengths[MAX_TREE_CODES * 2];
+	unsigned int num_leaves, i;
+
+	memset(code_lengths, 0, num_codes);
+
+	num_leaves = 0;
+
+	for (i = 0; i < num_codes; ++i) {
+		if (freqs[i] > 0) {
+			leaves[num_leaves].freq = freqs[i];
+			leaves[num_leaves].symbol = (uint16_t) i;
+			++num_leaves;
+		}
+	}
+
+	if (num_leaves < 2) {
+		return num_leaves;
+	}
+
+	qsort(leaves, num_leaves, sizeof(TreeEncodeLeaf), compare_leaves);
+
+	// A Huffman tree gives the optimal lengths, if none of them are
+	// too long. Otherwise, the slower package-merge algorithm is used.
+
+	huffman_depths(leaves, num_leaves, lengths);
+
+	for (i = 0; i < num_leaves; ++i) {
+		if (lengths[i] > MAX_CODE_LENGTH) {
+			package_merge(leaves, num_leaves, lengths);
+			break;
+		}
+	}
+
+	for (i = 0; i < num_leaves; ++i) {
+		code_lengths[leaves[i].symbol] = (uint8_t) lengths[i];
+	}
+
+	return num_leaves;
+}
+
+// Assign codes given their lengths. Shorter codes come first, and codes
+// of the same length are in order of symbol, matching build_tree().
+
+static void build_codes(uint8_t *code_lengths, unsigned int num_codes,
+                        uint16_t *codes)
+{
+	unsigned int length_count[MAX_CODE_LENGTH + 1];
+	unsigned int next_code[MAX_CODE_LENGTH + 1];
+	unsigned int i, len, code;
+
+	memset(length_count, 0, sizeof(length_count));
+
+	for (i = 0; i < num_codes; ++i) {
+		++length_count[code_lengths[i]];
+	}
+
+	code = 0;
+	length_count[0] = 0;
+
+	for (len = 1; len <= MAX_CODE_LENGTH; ++len) {
+		code = (code + length_count[len - 1]) << 1;
+		next_code[len] = code;
+	}
+
+	for (i = 0; i < num_codes; ++i) {
+		len = code_lengths[i];
+
+		if (len > 0) {
+			codes[i] = (uint16_t) next_code[len];
+			++next_code[len];
+		} else {
+			codes[i] = 0;
+		}
+	}
+}
@@ -0,0 +1,185 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dir_cache.h"
+
+// Initial number of hash table buckets. The table is doubled in size
+// whenever the number of entries exceeds the number of buckets.
+
+#define INITIAL_BUCKETS 256
+
+struct _LHADirCacheEntry {
+	LHADirCacheEntry *next;
+	unsigned int hash;
+	char path[1];
+};
+
+static unsigned int hash_path(const char *path)
+{
+	unsigned int result;
+
+	result = 5381;
+
+	for (; *path != '\0'; ++path) {
+		result = (result * 33) ^ (unsigned char) *path;
+	}
+
+	return result;
+}
+
+void lha_dir_cache_init(LHADirCache *cache)
+{
+	cache->buckets = NULL;
+	cache->num_buckets = 0;
+	cache->num_entries = 0;
+}
+
+void lha_dir_cache_free(LHADirCache *cache)
+{
+	LHADirCacheEntry *entry, *next;
+	unsigned int i;
+
+	for (i = 0; i < cache->num_buckets; ++i) {
+		for (entry = cache->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+	}
+
+	free(cache->buckets);
+	lha_dir_cache_init(cache);
+}
+
+// Resize the hash table to the specified number of buckets.
+
+static int resize_table(LHADirCache *cache, unsigned int num_buckets)
+{
+	LHADirCacheEntry **new_buckets;
+	LHADirCacheEntry *entry, *next;
+	unsigned int i, b;
+
+	new_buckets = calloc(num_buckets, sizeof(LHADirCacheEntry *));
+
+	if (new_buckets == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < cache->num_buckets; ++i) {
+		for (entry = cache->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			b = entry->hash % num_buckets;
+			entry->next = new_buckets[b];
+			new_buckets[b] = entry;
+		}
+	}
+
+	free(cache->buckets);
+	cache->buckets = new_buckets;
+	cache->num_buckets = num_buckets;
+
+	return 1;
+}
+
+int lha_dir_cache_contains(LHADirCache *cache, const char *path)
+{
+	LHADirCacheEntry *entry;
+	unsigned int hash;
+
+	if (cache->num_buckets == 0) {
+		return 0;
+	}
+
+	hash = hash_path(path);
+
+	for (entry = cache->buckets[hash % cache->num_buckets];
+	     entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && !strcmp(entry->path, path)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void lha_dir_cache_add(LHADirCache *cache, const char *path)
+{
+	LHADirCacheEntry *entry;
+	unsigned int b;
+
+	if (lha_dir_cache_contains(cache, path)) {
+		return;
+	}
+
+	// Grow the table if necessary. The cache is only an optimization,
+	// so if memory cannot be allocated, the path is just not added.
+
+	if (cache->num_entries >= cache->num_buckets) {
+		if (!resize_table(cache, cache->num_buckets == 0 ?
+		                         INITIAL_BUCKETS :
+		                         cache->num_buckets * 2)
+		 && cache->num_buckets == 0) {
+			return;
+		}
+	}
+
+	entry = malloc(sizeof(LHADirCacheEntry) + strlen(path));
+
+	if (entry == NULL) {
+		return;
+	}
+
+	entry->hash = hash_path(path);
+	strcpy(entry->path, path);
+
+	b = entry->hash % cache->num_buckets;
+	entry->next = cache->buckets[b];
+	cache->buckets[b] = entry;
+	++cache->num_entries;
+}
+
+void lha_dir_cache_remove(LHADirCache *cache, const char *path)
+{
+	LHADirCacheEntry **rover;
+	LHADirCacheEntry *entry;
+	unsigned int hash;
+
+	if (cache->num_buckets == 0) {
+		return;
+	}
+
+	hash = hash_path(path);
+	rover = &cache->buckets[hash % cache->num_buckets];
+
+	while (*rover != NULL) {
+		entry = *rover;
+
+		if (entry->hash == hash && !strcmp(entry->path, path)) {
+			*rover = entry->next;
+			free(entry);
+			--cache->num_entries;
+			return;
+		}
+
+		rover = &entry->next;
+	}
+}
@@ -0,0 +1,81 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_DIR_CACHE_H
+#define LHASA_DIR_CACHE_H
+
+typedef struct _LHADirCacheEntry LHADirCacheEntry;
+typedef struct _LHADirCache LHADirCache;
+
+// Set of paths to directories that are known to exist. This is used
+// during extract to avoid checking for the same parent directories
+// over and over again for every file that is extracted.
+
+struct _LHADirCache {
+	LHADirCacheEntry **buckets;
+	unsigned int num_buckets;
+	unsigned int num_entries;
+};
+
+/**
+ * Initialize a @ref LHADirCache structure.
+ *
+ * @param cache        The cache structure to initialize.
+ */
+
+void lha_dir_cache_init(LHADirCache *cache);
+
+/**
+ * Free all the entries in a @ref LHADirCache structure.
+ *
+ * @param cache        The cache structure.
+ */
+
+void lha_dir_cache_free(LHADirCache *cache);
+
+/**
+ * Query whether a directory path is in the cache.
+ *
+ * @param cache        The cache structure.
+ * @param path         Path to the directory.
+ * @return             Non-zero if the path is in the cache.
+ */
+
+int lha_dir_cache_contains(LHADirCache *cache, const char *path);
+
+/**
+ * Add a directory path to the cache.
+ *
+ * @param cache        The cache structure.
+ * @param path         Path to the directory, which is copied.
+ */
+
+void lha_dir_cache_add(LHADirCache *cache, const char *path);
+
+/**
+ * Remove a path from the cache, if it is present.
+ *
+ * @param cache        The cache structure.
+ * @param path         Path to remove.
+ */
+
+void lha_dir_cache_remove(LHADirCache *cache, const char *path);
+
+#endif /* #ifndef LHASA_DIR_CACHE_H */
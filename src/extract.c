@@ -25,6 +25,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "lib/lha_arch.h"
 
+#include "dir_cache.h"
 #include "extract.h"
 #include "safe.h"
 
@@ -242,7 +243,7 @@ static int check_parent_directory(char *path)
 {
 	LHAFileType file_type;
 
-	file_type = lha_arch_exists(path);
+	file_type = lha_arch_exists(NULL, path);
 
 	switch (file_type) {
 
@@ -253,7 +254,7 @@ static int check_parent_directory(char *path)
 		case LHA_FILE_NONE:
 			// Create the missing directory:
 
-			if (!lha_arch_mkdir(path, 0755)) {
+			if (!lha_arch_mkdir(NULL, path, 0755)) {
 				safe_fprintf(stderr, "Failed to create parent "
 				             "directory %s", path);
 				fprintf(stderr, "\n");
@@ -276,17 +277,12 @@ static int check_parent_directory(char *path)
 	return 1;
 }
 
-// Given a filename, create its parent directories as necessary.
+// Duplicate a path and strip off any trailing '/'s.
 
-static int make_parent_directories(char *orig_path)
+static char *strip_path(char *orig_path)
 {
-	int result;
-	char *p;
 	char *path;
-
-	result = 1;
-
-	// Duplicate the path and strip off any trailing '/'s:
+	char *p;
 
 	path = strdup(orig_path);
 
@@ -301,6 +297,44 @@ static int make_parent_directories(char *orig_path)
 		--p;
 	}
 
+	return path;
+}
+
+// Given a filename, create its parent directories as necessary.
+// Directories that have already been checked or created are recorded
+// in the cache, so that they do not have to be checked again for
+// every file that is extracted into them.
+
+static int make_parent_directories(LHADirCache *dir_cache, char *orig_path)
+{
+	int result;
+	char *p;
+	char *path;
+
+	result = 1;
+
+	path = strip_path(orig_path);
+
+	// If the immediate parent directory is in the cache, then all
+	// the directories above it must be too, so there is nothing
+	// more to do.
+
+	p = strrchr(path, '/');
+
+	if (p == NULL) {
+		free(path);
+		return 1;
+	}
+
+	*p = '\0';
+
+	if (lha_dir_cache_contains(dir_cache, path)) {
+		free(path);
+		return 1;
+	}
+
+	*p = '/';
+
 	// Iterate through the string, finding each path separator. At
 	// each place, temporarily chop off the end of the path to get
 	// each parent directory in turn.
@@ -318,9 +352,13 @@ static int make_parent_directories(char *orig_path)
 
 		// Check if this parent directory exists and create it:
 
-		if (!check_parent_directory(path)) {
-			result = 0;
-			break;
+		if (!lha_dir_cache_contains(dir_cache, path)) {
+			if (!check_parent_directory(path)) {
+				result = 0;
+				break;
+			}
+
+			lha_dir_cache_add(dir_cache, path);
 		}
 
 		// Restore path separator and advance to the next path.
@@ -334,6 +372,28 @@ static int make_parent_directories(char *orig_path)
 	return result;
 }
 
+// Update the directory cache after an archived file has been extracted.
+
+static void update_dir_cache(LHADirCache *dir_cache, char *filename,
+                             int is_dir, int success)
+{
+	char *path;
+
+	path = strip_path(filename);
+
+	// A newly created directory can be added to the cache. If anything
+	// else was extracted, it may have replaced a directory of the same
+	// name, so make sure that the path is not in the cache.
+
+	if (is_dir && success) {
+		lha_dir_cache_add(dir_cache, path);
+	} else {
+		lha_dir_cache_remove(dir_cache, path);
+	}
+
+	free(path);
+}
+
 // Prompt the user with a message, and return the first character of
 // the typed response.
 
@@ -365,11 +425,11 @@ static char prompt_user(const char *message)
 	return result;
 }
 
-// A file to be extracted already exists. Apply the overwrite policy
+// A file to be written already exists. Apply the overwrite policy
 // to decide whether to overwrite the existing file, prompting the
 // user if necessary.
 
-static int confirm_file_overwrite(char *filename, LHAOptions *options)
+int confirm_file_overwrite(char *filename, LHAOptions *options)
 {
 	char response;
 
@@ -407,13 +467,13 @@ static int confirm_file_overwrite(char *filename, LHAOptions *options)
 	return 0;
 }
 
-// Check if the file pointed to by the specified header exists.
+// Check if the specified file exists.
 
-static int file_exists(char *filename)
+int file_exists(char *filename)
 {
 	LHAFileType file_type;
 
-	file_type = lha_arch_exists(filename);
+	file_type = lha_arch_exists(NULL, filename);
 
 	if (file_type == LHA_FILE_ERROR) {
 		safe_fprintf(stderr, "Failed to read file type of '%s'",
@@ -429,7 +489,8 @@ static int file_exists(char *filename)
 
 static int extract_archived_file(LHAReader *reader,
                                  LHAFileHeader *header,
-                                 LHAOptions *options)
+                                 LHAOptions *options,
+                                 LHADirCache *dir_cache)
 {
 	ProgressCallbackData progress;
 	char *filename;
@@ -462,7 +523,7 @@ static int extract_archived_file(LHAReader *reader,
 
 	// Create parent directories for file:
 
-	if (!make_parent_directories(filename)) {
+	if (!make_parent_directories(dir_cache, filename)) {
 		free(filename);
 		return 0;
 	}
@@ -476,6 +537,8 @@ static int extract_archived_file(LHAReader *reader,
 	success = lha_reader_extract(reader, filename,
 	                             progress_callback, &progress);
 
+	update_dir_cache(dir_cache, filename, is_dir, success);
+
 	if (!lha_reader_current_is_fake(reader) && options->quiet < 2) {
 		if (progress.invoked) {
 			if (success) {
@@ -521,6 +584,10 @@ int test_file_crc(LHAFilter *filter, LHAOptions *options)
 		if (!test_archived_file_crc(filter->reader, header, options)) {
 			result = 0;
 		}
+
+		if (options->stats != NULL) {
+			lha_stats_report_member(options->stats, header);
+		}
 	}
 
 	return result;
@@ -579,12 +646,15 @@ static int extract_archive_dry_run(LHAFilter *filter, LHAOptions *options)
 
 int extract_archive(LHAFilter *filter, LHAOptions *options)
 {
+	LHADirCache dir_cache;
 	int result;
 
 	if (options->dry_run) {
 		return extract_archive_dry_run(filter, options);
 	}
 
+	lha_dir_cache_init(&dir_cache);
+
 	result = 1;
 
 	for (;;) {
@@ -596,20 +666,29 @@ int extract_archive(LHAFilter *filter, LHAOptions *options)
 			break;
 		}
 
-		if (!extract_archived_file(filter->reader, header, options)) {
+		if (!extract_archived_file(filter->reader, header, options,
+		                           &dir_cache)) {
 			result = 0;
 		}
+
+		if (options->stats != NULL) {
+			lha_stats_report_member(options->stats, header);
+		}
 	}
 
+	lha_dir_cache_free(&dir_cache);
+
 	return result;
 }
 
 // Dump contents of the current file from the specified reader to stdout.
+// If statistics are being collected, time spent writing is recorded.
 
-static int print_archived_file(LHAReader *reader)
+static int print_archived_file(LHAReader *reader, LHAStatsReport *stats)
 {
 	char buf[512];
-	size_t bytes;
+	size_t bytes, written;
+	uint64_t start;
 
 	for (;;) {
 		bytes = lha_reader_read(reader, buf, sizeof(buf));
@@ -617,7 +696,16 @@ static int print_archived_file(LHAReader *reader)
 			break;
 		}
 
-		if (fwrite(buf, 1, bytes, stdout) < bytes) {
+		if (stats != NULL) {
+			start = lha_arch_time_ns();
+			written = fwrite(buf, 1, bytes, stdout);
+			lha_stats_report_add_output(stats,
+			                            lha_arch_time_ns() - start);
+		} else {
+			written = fwrite(buf, 1, bytes, stdout);
+		}
+
+		if (written < bytes) {
 			return 0;
 		}
 	}
@@ -671,9 +759,14 @@ int print_archive(LHAFilter *filter, LHAOptions *options)
 
 		// If this is a normal file, dump the contents to stdout.
 
-		if (is_normal_file && !print_archived_file(filter->reader)) {
+		if (is_normal_file
+		 && !print_archived_file(filter->reader, options->stats)) {
 			return 0;
 		}
+
+		if (options->stats != NULL) {
+			lha_stats_report_member(options->stats, header);
+		}
 	}
 
 	return 1;
@@ -29,6 +29,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "config.h"
 #include "extract.h"
 #include "list.h"
+#include "transcode.h"
 
 typedef enum {
 	MODE_UNKNOWN,
@@ -36,7 +37,8 @@ typedef enum {
 	MODE_LIST_VERBOSE,
 	MODE_CRC_CHECK,
 	MODE_EXTRACT,
-	MODE_PRINT
+	MODE_PRINT,
+	MODE_TRANSCODE
 } ProgramMode;
 
 static void help_page(char *progname)
@@ -44,15 +46,21 @@ static void help_page(char *progname)
 	printf(
 	PACKAGE_NAME " v" PACKAGE_VERSION " command line LHA tool  "
 		"- Copyright (C) 2011-2025 Simon Howard\n"
-	"usage: %s [-]{lvtxep[q{num}][finv]}[w=<dir>] archive_file [file...]\n"
+	"usage: %s [--stats[=json]] [-]{lvtxep[q{num}][finv]}[w=<dir>] "
+		"archive_file [file...]\n"
+	"       %s [-]k[o{567}][q{num}][fn] archive_file new_archive_file "
+		"[file...]\n"
 	"commands:                          options:\n"
 	" l,v List / Verbose List            f  Force overwrite (no prompt)\n"
 	" t   Test file CRC in archive       i  Ignore directory path\n"
 	" x,e Extract from archive           n  Perform dry run\n"
 	" p   Print to stdout from archive   q{num}  Quiet mode\n"
-	"                                    v  Verbose\n"
+	" k   Recompress into new archive    v  Verbose\n"
 	"                                    w=<dir> Specify extract directory\n"
-	, progname);
+	"                                    o{567}  Use -lh5-/-lh6-/-lh7- (k)\n"
+	"long options (before command):\n"
+	" --stats[=json]  Print performance statistics for t, x, e, p\n"
+	, progname, progname);
 
 	exit(-1);
 }
@@ -65,8 +73,21 @@ static int do_command(ProgramMode mode, char *filename,
 	LHAInputStream *stream;
 	LHAReader *reader;
 	LHAFilter filter;
+	LHAStatsReport stats;
+	char *output_filename;
 	int result;
 
+	// The recompress command takes the name of the new archive before
+	// the list of files.
+
+	output_filename = NULL;
+
+	if (mode == MODE_TRANSCODE) {
+		output_filename = filters[0];
+		++filters;
+		--num_filters;
+	}
+
 	if (!strcmp(filename, "-")) {
 		fstream = stdin;
 	} else {
@@ -79,10 +100,29 @@ static int do_command(ProgramMode mode, char *filename,
 		}
 	}
 
+	// The files are compared rather than the names, as the same file
+	// can be reached by different paths.
+
+	if (mode == MODE_TRANSCODE
+	 && lha_arch_same_file(fstream, output_filename)) {
+		fprintf(stderr, "LHa: Error: Cannot overwrite %s with itself\n",
+		        filename);
+		exit(-1);
+	}
+
 	stream = lha_input_stream_from_FILE(fstream);
 	reader = lha_reader_new(stream);
 	lha_filter_init(&filter, reader, filters, num_filters);
 
+	// Statistics are only collected for commands that decompress.
+
+	if (options->stats_format != LHA_STATS_NONE
+	 && (mode == MODE_CRC_CHECK || mode == MODE_EXTRACT
+	  || mode == MODE_PRINT)) {
+		lha_stats_report_init(&stats, reader, options->stats_format);
+		options->stats = &stats;
+	}
+
 	result = 1;
 
 	switch (mode) {
@@ -106,10 +146,24 @@ static int do_command(ProgramMode mode, char *filename,
 			result = print_archive(&filter, options);
 			break;
 
+		case MODE_TRANSCODE:
+			result = transcode_archive(&filter, options,
+			                           output_filename);
+			break;
+
 		case MODE_UNKNOWN:
 			break;
 	}
 
+	// Printed to stderr so as not to get mixed up with the output
+	// of the 'p' command.
+
+	if (options->stats != NULL) {
+		lha_stats_report_print(&stats, stderr);
+		lha_stats_report_free(&stats);
+		options->stats = NULL;
+	}
+
 	lha_reader_free(reader);
 	lha_input_stream_free(stream);
 
@@ -126,6 +180,9 @@ static void init_options(LHAOptions *options)
 	options->dry_run = 0;
 	options->extract_path = NULL;
 	options->use_path = 1;
+	options->compress_method = NULL;
+	options->stats_format = LHA_STATS_NONE;
+	options->stats = NULL;
 }
 
 // Determine the program mode from the first character of the command
@@ -145,6 +202,8 @@ static ProgramMode mode_for_char(char c)
 			return MODE_EXTRACT;
 		case 'p':
 			return MODE_PRINT;
+		case 'k':
+			return MODE_TRANSCODE;
 		default:
 			return MODE_UNKNOWN;
 	}
@@ -185,6 +244,18 @@ static int parse_options(char *arg, LHAOptions *options)
 				options->overwrite_policy = LHA_OVERWRITE_ALL;
 				break;
 
+			// Compression method for new archives: -lh5-,
+			// -lh6- or -lh7-.
+			case 'o':
+				if (arg[1] < '5' || arg[1] > '7') {
+					return 0;
+				}
+				++arg;
+				options->compress_method =
+				    *arg == '5' ? "-lh5-"
+				  : *arg == '6' ? "-lh6-" : "-lh7-";
+				break;
+
 			// Verbose mode.
 			case 'v':
 				options->verbose = 1;
@@ -243,6 +314,22 @@ static int parse_command_line(char *cmd, ProgramMode *mode,
 	return 1;
 }
 
+// Parse a "long" option beginning with "--". These are an extension:
+// the Unix LHA tool has none, so they must appear before the command.
+
+static int parse_long_option(char *arg, LHAOptions *options)
+{
+	if (!strcmp(arg, "--stats")) {
+		options->stats_format = LHA_STATS_TEXT;
+	} else if (!strcmp(arg, "--stats=json")) {
+		options->stats_format = LHA_STATS_JSON;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
 int main(int argc, char *argv[])
 {
 	ProgramMode mode;
@@ -262,7 +349,23 @@ int main(int argc, char *argv[])
 
 	init_options(&options);
 
+	while (argc >= 2 && !strncmp(argv[1], "--", 2)) {
+		if (!parse_long_option(argv[1], &options)) {
+			help_page(argv[0]);
+		}
+
+		// Remove the option from the list, keeping argv[0].
+
+		argv[1] = argv[0];
+		++argv;
+		--argc;
+	}
+
 	if (argc >= 3 && parse_command_line(argv[1], &mode, &options)) {
+		if (mode == MODE_TRANSCODE && argc < 4) {
+			help_page(argv[0]);
+		}
+
 		return !do_command(mode, argv[2], &options,
 		                   argv + 3, argc - 3);
 	} else if (argc == 2) {
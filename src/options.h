@@ -21,6 +21,8 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #ifndef LHASA_OPTIONS_H
 #define LHASA_OPTIONS_H
 
+#include "stats.h"
+
 typedef enum {
 	LHA_OVERWRITE_PROMPT,
 	LHA_OVERWRITE_SKIP,
@@ -58,6 +60,19 @@ typedef struct {
 
 	int use_path;
 
+	// Compression method for new archives, or NULL for the default.
+
+	char *compress_method;
+
+	// Format in which to print performance statistics (--stats).
+
+	LHAStatsFormat stats_format;
+
+	// If not NULL, statistics are being collected into this report
+	// for the current command.
+
+	LHAStatsReport *stats;
+
 } LHAOptions;
 
 #endif /* #ifndef LHASA_OPTIONS_H */
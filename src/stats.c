@@ -0,0 +1,478 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/lha_arch.h"
+
+#if LHA_ARCH == LHA_ARCH_UNIX
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "safe.h"
+#include "stats.h"
+
+// Read process-wide figures from the operating system. Returns zero if
+// they are not available on this platform.
+
+static int read_process_stats(LHAProcessStats *stats, int *have_syscalls)
+{
+#if LHA_ARCH == LHA_ARCH_UNIX
+	struct rusage usage;
+	FILE *fstream;
+	char line[64];
+	unsigned long long value;
+
+	memset(stats, 0, sizeof(LHAProcessStats));
+	*have_syscalls = 0;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+	stats->user_time = (uint64_t) usage.ru_utime.tv_sec * 1000000000
+	                 + (uint64_t) usage.ru_utime.tv_usec * 1000;
+	stats->system_time = (uint64_t) usage.ru_stime.tv_sec * 1000000000
+	                   + (uint64_t) usage.ru_stime.tv_usec * 1000;
+	stats->blocks_in = usage.ru_inblock;
+	stats->blocks_out = usage.ru_oublock;
+	stats->voluntary_switches = usage.ru_nvcsw;
+	stats->involuntary_switches = usage.ru_nivcsw;
+
+	// System call counts are only available on Linux. Reading the
+	// file costs a few system calls itself, but that is the same at
+	// the start and end so it only adds a small constant.
+
+	fstream = fopen("/proc/self/io", "r");
+
+	if (fstream != NULL) {
+		while (fgets(line, sizeof(line), fstream) != NULL) {
+			if (sscanf(line, "rchar: %llu", &value) == 1) {
+				stats->read_bytes = value;
+			} else if (sscanf(line, "wchar: %llu", &value) == 1) {
+				stats->write_bytes = value;
+			} else if (sscanf(line, "syscr: %llu", &value) == 1) {
+				stats->read_calls = value;
+			} else if (sscanf(line, "syscw: %llu", &value) == 1) {
+				stats->write_calls = value;
+				*have_syscalls = 1;
+			}
+		}
+
+		fclose(fstream);
+	}
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void lha_stats_report_init(LHAStatsReport *report, LHAReader *reader,
+                           LHAStatsFormat format)
+{
+	report->reader = reader;
+	report->format = format;
+	report->output_time = 0;
+	report->members = NULL;
+	report->num_members = 0;
+
+	report->have_process = read_process_stats(&report->process_start,
+	                                          &report->have_syscalls);
+
+	lha_reader_enable_stats(reader, 1);
+	lha_reader_get_stats(reader, &report->mark);
+
+	report->start_time = lha_arch_time_ns();
+	report->mark_time = report->start_time;
+	report->end_time = report->start_time;
+}
+
+void lha_stats_report_free(LHAStatsReport *report)
+{
+	unsigned int i;
+
+	for (i = 0; i < report->num_members; ++i) {
+		free(report->members[i].name);
+	}
+
+	free(report->members);
+}
+
+void lha_stats_report_add_output(LHAStatsReport *report, uint64_t time)
+{
+	report->output_time += time;
+}
+
+static char *member_name(LHAFileHeader *header)
+{
+	const char *path, *filename;
+	char *result;
+
+	path = header->path != NULL ? header->path : "";
+	filename = header->filename != NULL ? header->filename : "";
+
+	result = malloc(strlen(path) + strlen(filename) + 1);
+
+	if (result != NULL) {
+		strcpy(result, path);
+		strcat(result, filename);
+	}
+
+	return result;
+}
+
+// Subtract the counters in 'start' from those in 'stats'.
+
+static void subtract_counters(LHAStats *stats, LHAStats *start)
+{
+	unsigned int i;
+
+	stats->bytes_in -= start->bytes_in;
+	stats->bytes_out -= start->bytes_out;
+	stats->input_calls -= start->input_calls;
+	stats->headers -= start->headers;
+	stats->header_time -= start->header_time;
+	stats->decode_time -= start->decode_time;
+	stats->crc_time -= start->crc_time;
+	stats->output_time -= start->output_time;
+	stats->table_rebuilds -= start->table_rebuilds;
+	stats->literals -= start->literals;
+
+	for (i = 0; i < LHA_STATS_COPY_LENGTH_BUCKETS; ++i) {
+		stats->copy_lengths[i] -= start->copy_lengths[i];
+	}
+}
+
+void lha_stats_report_member(LHAStatsReport *report, LHAFileHeader *header)
+{
+	LHAStatsMember *members, *member;
+	LHAStats now;
+	uint64_t now_time;
+
+	now_time = lha_arch_time_ns();
+	lha_reader_get_stats(report->reader, &now);
+
+	members = realloc(report->members,
+	                  sizeof(LHAStatsMember) * (report->num_members + 1));
+
+	if (members == NULL) {
+		return;
+	}
+
+	report->members = members;
+	member = &members[report->num_members];
+	++report->num_members;
+
+	member->name = member_name(header);
+	strncpy(member->method, header->compress_method,
+	        sizeof(member->method) - 1);
+	member->method[sizeof(member->method) - 1] = '\0';
+	member->compressed_length = header->compressed_length;
+	member->length = header->length;
+	member->time = now_time - report->mark_time;
+
+	// The counters for this file are the difference since the last
+	// file; output time measured by the tool itself is added on.
+
+	member->counters = now;
+	subtract_counters(&member->counters, &report->mark);
+	member->counters.output_time += report->output_time;
+
+	report->mark = now;
+	report->mark_time = now_time;
+	report->output_time = 0;
+}
+
+// Compression ratio, as the size of the compressed data as a percentage
+// of the original, in the same way as the 'l' command.
+
+static double ratio_percent(uint64_t compressed, uint64_t length)
+{
+	if (length == 0) {
+		return 100.0;
+	}
+
+	return (double) compressed * 100.0 / (double) length;
+}
+
+// Throughput in megabytes (10^6 bytes) per second.
+
+static double throughput(uint64_t bytes, uint64_t time)
+{
+	if (time == 0) {
+		return 0.0;
+	}
+
+	return (double) bytes * 1000.0 / (double) time;
+}
+
+static double ms(uint64_t time)
+{
+	return (double) time / 1000000.0;
+}
+
+// Sum the figures for all files.
+
+static void total_figures(LHAStatsReport *report, LHAStatsMember *total)
+{
+	LHAStatsMember *member;
+	unsigned int i, j;
+
+	memset(total, 0, sizeof(LHAStatsMember));
+
+	for (i = 0; i < report->num_members; ++i) {
+		member = &report->members[i];
+
+		total->compressed_length += member->compressed_length;
+		total->length += member->length;
+		total->counters.bytes_in += member->counters.bytes_in;
+		total->counters.bytes_out += member->counters.bytes_out;
+		total->counters.input_calls += member->counters.input_calls;
+		total->counters.headers += member->counters.headers;
+		total->counters.header_time += member->counters.header_time;
+		total->counters.decode_time += member->counters.decode_time;
+		total->counters.crc_time += member->counters.crc_time;
+		total->counters.output_time += member->counters.output_time;
+		total->counters.table_rebuilds
+		    += member->counters.table_rebuilds;
+		total->counters.literals += member->counters.literals;
+
+		for (j = 0; j < LHA_STATS_COPY_LENGTH_BUCKETS; ++j) {
+			total->counters.copy_lengths[j]
+			    += member->counters.copy_lengths[j];
+		}
+	}
+
+	total->time = report->end_time - report->start_time;
+}
+
+static void print_text_line(FILE *stream, const char *name,
+                            const char *method, LHAStatsMember *member)
+{
+	safe_fprintf(stream, " %-24.24s", name);
+	fprintf(stream, " %-5s %10lu %10lu %5.1f%% %10.3f %8.1f\n",
+	        method, (unsigned long) member->length,
+	        (unsigned long) member->compressed_length,
+	        ratio_percent(member->compressed_length, member->length),
+	        ms(member->time),
+	        throughput(member->counters.bytes_out, member->time));
+}
+
+static void print_text(LHAStatsReport *report, LHAStatsMember *total,
+                       FILE *stream)
+{
+	LHAProcessStats *start, *end;
+	unsigned int i;
+	char buf[32];
+
+	fprintf(stream, " %-24s %-5s %10s %10s %6s %10s %8s\n",
+	        "NAME", "METH", "ORIGINAL", "PACKED", "RATIO",
+	        "TIME(ms)", "MB/s");
+
+	for (i = 0; i < report->num_members; ++i) {
+		print_text_line(stream,
+		                report->members[i].name != NULL ?
+		                report->members[i].name : "",
+		                report->members[i].method,
+		                &report->members[i]);
+	}
+
+	snprintf(buf, sizeof(buf), "Total %u file%s", report->num_members,
+	         report->num_members == 1 ? "" : "s");
+	print_text_line(stream, buf, "", total);
+
+	fprintf(stream, "Time (ms):  header %.3f, decode %.3f, crc %.3f, "
+	                "output %.3f\n",
+	        ms(total->counters.header_time),
+	        ms(total->counters.decode_time),
+	        ms(total->counters.crc_time),
+	        ms(total->counters.output_time));
+	fprintf(stream, "Decoder:    %" PRIu64 " bytes in, %" PRIu64
+	                " bytes out, %" PRIu64 " input calls, %" PRIu64
+	                " table rebuilds\n",
+	        total->counters.bytes_in, total->counters.bytes_out,
+	        total->counters.input_calls,
+	        total->counters.table_rebuilds);
+
+	if (!report->have_process) {
+		return;
+	}
+
+	start = &report->process_start;
+	end = &report->process_end;
+
+	fprintf(stream, "CPU (ms):   user %.3f, system %.3f\n",
+	        ms(end->user_time - start->user_time),
+	        ms(end->system_time - start->system_time));
+
+	if (report->have_syscalls) {
+		fprintf(stream, "Syscalls:   %" PRIu64 " read (%" PRIu64
+		                " bytes), %" PRIu64 " write (%" PRIu64
+		                " bytes)\n",
+		        end->read_calls - start->read_calls,
+		        end->read_bytes - start->read_bytes,
+		        end->write_calls - start->write_calls,
+		        end->write_bytes - start->write_bytes);
+	}
+
+	fprintf(stream, "Block I/O:  %" PRIu64 " in, %" PRIu64 " out; "
+	                "context switches: %" PRIu64 " voluntary, %" PRIu64
+	                " involuntary\n",
+	        end->blocks_in - start->blocks_in,
+	        end->blocks_out - start->blocks_out,
+	        end->voluntary_switches - start->voluntary_switches,
+	        end->involuntary_switches - start->involuntary_switches);
+}
+
+// Print a string as a JSON string literal.
+
+static void print_json_string(FILE *stream, const char *s)
+{
+	const unsigned char *p;
+
+	fputc('"', stream);
+
+	for (p = (const unsigned char *) s; *p != '\0'; ++p) {
+		if (*p == '"' || *p == '\\') {
+			fprintf(stream, "\\%c", *p);
+		} else if (*p < 0x20 || *p >= 0x7f) {
+			// Filenames are not necessarily UTF-8; anything
+			// outside ASCII is escaped as the raw byte value.
+			fprintf(stream, "\\u%04x", *p);
+		} else {
+			fputc(*p, stream);
+		}
+	}
+
+	fputc('"', stream);
+}
+
+static void print_json_figures(FILE *stream, LHAStatsMember *member)
+{
+	fprintf(stream, "\"length\": %lu, \"compressed_length\": %lu, "
+	                "\"ratio\": %.4f, ",
+	        (unsigned long) member->length,
+	        (unsigned long) member->compressed_length,
+	        ratio_percent(member->compressed_length,
+	                      member->length) / 100.0);
+	fprintf(stream, "\"bytes_in\": %" PRIu64 ", \"bytes_out\": %" PRIu64
+	                ", \"input_calls\": %" PRIu64 ", "
+	                "\"table_rebuilds\": %" PRIu64 ", ",
+	        member->counters.bytes_in, member->counters.bytes_out,
+	        member->counters.input_calls,
+	        member->counters.table_rebuilds);
+	fprintf(stream, "\"time_ns\": %" PRIu64 ", \"header_ns\": %" PRIu64
+	                ", \"decode_ns\": %" PRIu64 ", \"crc_ns\": %" PRIu64
+	                ", \"output_ns\": %" PRIu64 ", "
+	                "\"throughput_mbps\": %.3f",
+	        member->time, member->counters.header_time,
+	        member->counters.decode_time, member->counters.crc_time,
+	        member->counters.output_time,
+	        throughput(member->counters.bytes_out, member->time));
+}
+
+static void print_json(LHAStatsReport *report, LHAStatsMember *total,
+                       FILE *stream)
+{
+	LHAProcessStats *start, *end;
+	LHAStatsMember *member;
+	unsigned int i;
+
+	// One file per line, so that the output is easy to process with
+	// line-based tools as well as a JSON parser.
+
+	fprintf(stream, "{\n  \"members\": [\n");
+
+	for (i = 0; i < report->num_members; ++i) {
+		member = &report->members[i];
+
+		fprintf(stream, "    {\"name\": ");
+		print_json_string(stream,
+		                  member->name != NULL ? member->name : "");
+		fprintf(stream, ", \"method\": ");
+		print_json_string(stream, member->method);
+		fprintf(stream, ", ");
+		print_json_figures(stream, member);
+		fprintf(stream, "}%s\n",
+		        i + 1 < report->num_members ? "," : "");
+	}
+
+	fprintf(stream, "  ],\n  \"total\": {\"members\": %u, ",
+	        report->num_members);
+	print_json_figures(stream, total);
+	fprintf(stream, "}");
+
+	if (report->have_process) {
+		start = &report->process_start;
+		end = &report->process_end;
+
+		fprintf(stream, ",\n  \"process\": {\"user_ns\": %" PRIu64
+		                ", \"system_ns\": %" PRIu64 ", ",
+		        end->user_time - start->user_time,
+		        end->system_time - start->system_time);
+
+		if (report->have_syscalls) {
+			fprintf(stream, "\"read_calls\": %" PRIu64
+			                ", \"read_bytes\": %" PRIu64
+			                ", \"write_calls\": %" PRIu64
+			                ", \"write_bytes\": %" PRIu64 ", ",
+			        end->read_calls - start->read_calls,
+			        end->read_bytes - start->read_bytes,
+			        end->write_calls - start->write_calls,
+			        end->write_bytes - start->write_bytes);
+		}
+
+		fprintf(stream, "\"blocks_in\": %" PRIu64
+		                ", \"blocks_out\": %" PRIu64
+		                ", \"voluntary_switches\": %" PRIu64
+		                ", \"involuntary_switches\": %" PRIu64 "}",
+		        end->blocks_in - start->blocks_in,
+		        end->blocks_out - start->blocks_out,
+		        end->voluntary_switches - start->voluntary_switches,
+		        end->involuntary_switches
+		          - start->involuntary_switches);
+	}
+
+	fprintf(stream, "\n}\n");
+}
+
+void lha_stats_report_print(LHAStatsReport *report, FILE *stream)
+{
+	LHAStatsMember total;
+	int have_syscalls = 0;
+
+	report->end_time = lha_arch_time_ns();
+	report->have_process = report->have_process
+	    && read_process_stats(&report->process_end, &have_syscalls);
+	report->have_syscalls = report->have_syscalls && have_syscalls;
+
+	total_figures(report, &total);
+
+	if (report->format == LHA_STATS_JSON) {
+		print_json(report, &total, stream);
+	} else {
+		print_text(report, &total, stream);
+	}
+
+	fflush(stream);
+}
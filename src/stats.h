@@ -0,0 +1,126 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_STATS_H
+#define LHASA_STATS_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "lha_reader.h"
+
+typedef enum {
+	LHA_STATS_NONE,
+	LHA_STATS_TEXT,
+	LHA_STATS_JSON
+} LHAStatsFormat;
+
+typedef struct _LHAStatsMember LHAStatsMember;
+typedef struct _LHAStatsReport LHAStatsReport;
+
+// Process-wide figures from the operating system. System call counts
+// are only available on Linux (from /proc/self/io).
+
+typedef struct {
+	uint64_t user_time, system_time;
+	uint64_t read_calls, write_calls;
+	uint64_t read_bytes, write_bytes;
+	uint64_t blocks_in, blocks_out;
+	uint64_t voluntary_switches, involuntary_switches;
+} LHAProcessStats;
+
+// Figures for a single archived file, built from the difference in the
+// reader's counters between the start and end of processing the file.
+
+struct _LHAStatsMember {
+	char *name;
+	char method[6];
+	size_t compressed_length;
+	size_t length;
+	uint64_t time;
+	LHAStats counters;
+};
+
+// Statistics collected for the "--stats" option: the per-file figures,
+// along with process-wide figures taken from the operating system (CPU
+// time, system calls) at the start and end of the run.
+
+struct _LHAStatsReport {
+	LHAReader *reader;
+	LHAStatsFormat format;
+	uint64_t start_time, end_time, mark_time;
+	LHAStats mark;
+	uint64_t output_time;
+	LHAStatsMember *members;
+	unsigned int num_members;
+	int have_process, have_syscalls;
+	LHAProcessStats process_start, process_end;
+};
+
+/**
+ * Initialize a @ref LHAStatsReport structure and enable collection of
+ * performance counters on the specified reader.
+ *
+ * @param report       The report structure to initialize.
+ * @param reader       The reader to collect counters from.
+ * @param format       Format in which to print the report.
+ */
+
+void lha_stats_report_init(LHAStatsReport *report, LHAReader *reader,
+                           LHAStatsFormat format);
+
+/**
+ * Free the contents of a @ref LHAStatsReport structure.
+ *
+ * @param report       The report structure.
+ */
+
+void lha_stats_report_free(LHAStatsReport *report);
+
+/**
+ * Record time spent by the tool itself writing decompressed data; the
+ * time is counted against the file currently being processed.
+ *
+ * @param report       The report structure.
+ * @param time         Time taken, in nanoseconds.
+ */
+
+void lha_stats_report_add_output(LHAStatsReport *report, uint64_t time);
+
+/**
+ * Record the figures for an archived file that has just been
+ * processed.
+ *
+ * @param report       The report structure.
+ * @param header       Header of the file.
+ */
+
+void lha_stats_report_member(LHAStatsReport *report, LHAFileHeader *header);
+
+/**
+ * Finish collecting statistics and print the report.
+ *
+ * @param report       The report structure.
+ * @param stream       Stream to print the report to.
+ */
+
+void lha_stats_report_print(LHAStatsReport *report, FILE *stream);
+
+#endif /* #ifndef LHASA_STATS_H */
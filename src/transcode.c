@@ -0,0 +1,337 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lib/lha_arch.h"
+#include "lib/lha_file_header.h"
+#include "lha_writer.h"
+
+#include "extract.h"
+#include "safe.h"
+#include "transcode.h"
+
+// Size of the buffer used to pass data from the reader to the writer.
+
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+// A file from the original archive, waiting for its new copy to be
+// written. Several files are compressed at once, so there is a queue
+// of these, in the order they were added to the new archive.
+
+typedef struct _TranscodeFile TranscodeFile;
+
+struct _TranscodeFile {
+	LHAFileHeader *header;
+	TranscodeFile *next;
+};
+
+typedef struct {
+	LHAOptions *options;
+	char *method;
+	LHAWriter *writer;
+	uint8_t *buf;
+	TranscodeFile *first_file, *last_file;
+	int success;
+} Transcoder;
+
+// Check that a file was written with the same contents as the original.
+// MacLHA archives can contain a MacBinary header that the reader strips
+// off, so the length and CRC of those are not expected to match.
+
+static int check_new_file(LHAFileHeader *header, LHAFileHeader *new_header)
+{
+	if (header->os_type == LHA_OS_TYPE_MACOS
+	 || !strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR)) {
+		return 1;
+	}
+
+	return new_header->length == header->length
+	    && new_header->crc == header->crc;
+}
+
+// Copy a header, changing the compression method to the new one
+// (except for directories).
+
+static void new_header(LHAFileHeader *result, LHAFileHeader *header,
+                       char *method)
+{
+	*result = *header;
+
+	if (strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR) != 0) {
+		memcpy(result->compress_method, method, 6);
+	}
+}
+
+static void print_result(Transcoder *transcoder, LHAFileHeader *header,
+                         char *new_method, int success)
+{
+	if (transcoder->options->quiet >= 2 && success) {
+		return;
+	}
+
+	safe_printf("%s%s",
+	            header->path != NULL ? header->path : "",
+	            header->filename != NULL ? header->filename : "");
+
+	if (success) {
+		printf("\t- Recompressed %s -> %s\n",
+		       header->compress_method, new_method);
+	} else {
+		printf("\t- Error recompressing\n");
+	}
+}
+
+// Called by the writer when the new copy of a file has been written.
+
+static void file_written(LHAFileHeader *written, int success,
+                         void *user_data)
+{
+	Transcoder *transcoder = user_data;
+	TranscodeFile *file;
+
+	file = transcoder->first_file;
+	transcoder->first_file = file->next;
+
+	if (transcoder->first_file == NULL) {
+		transcoder->last_file = NULL;
+	}
+
+	success = success && check_new_file(file->header, written);
+	print_result(transcoder, file->header, written->compress_method,
+	             success);
+
+	if (!success) {
+		transcoder->success = 0;
+	}
+
+	lha_file_header_free(file->header);
+	free(file);
+}
+
+// Add a file to the new archive, passing it from the reader to the
+// writer a piece at a time. The writer compresses small files on
+// separate threads, several at a time, and calls file_written() once
+// each has been written.
+
+static int transcode_file(Transcoder *transcoder, LHAReader *reader,
+                          LHAFileHeader *header)
+{
+	LHAFileHeader new_file;
+	TranscodeFile *file;
+	size_t n;
+
+	file = malloc(sizeof(TranscodeFile));
+
+	if (file == NULL) {
+		return 0;
+	}
+
+	new_header(&new_file, header, transcoder->method);
+
+	if (!lha_writer_add_file(transcoder->writer, &new_file)) {
+		print_result(transcoder, header, NULL, 0);
+		free(file);
+		return 0;
+	}
+
+	lha_file_header_add_ref(header);
+	file->header = header;
+	file->next = NULL;
+
+	if (transcoder->last_file != NULL) {
+		transcoder->last_file->next = file;
+	} else {
+		transcoder->first_file = file;
+	}
+
+	transcoder->last_file = file;
+
+	for (;;) {
+		n = lha_reader_read(reader, transcoder->buf, COPY_BUFFER_SIZE);
+
+		if (n == 0) {
+			return 1;
+		}
+
+		if (!lha_writer_write(transcoder->writer,
+		                      transcoder->buf, n)) {
+			return 0;
+		}
+	}
+}
+
+static void print_dry_run(LHAFileHeader *header, char *method)
+{
+	safe_printf("RECOMPRESS %s%s",
+	            header->path != NULL ? header->path : "",
+	            header->filename != NULL ? header->filename : "");
+
+	if (strcmp(header->compress_method, LHA_COMPRESS_TYPE_DIR) != 0) {
+		printf(" (%s -> %s)", header->compress_method, method);
+	}
+
+	printf("\n");
+}
+
+static int transcode_files(Transcoder *transcoder, LHAFilter *filter)
+{
+	LHAFileHeader *header;
+
+	while (transcoder->success) {
+		header = lha_filter_next_file(filter);
+
+		if (header == NULL) {
+			break;
+		}
+
+		if (transcoder->options->dry_run) {
+			print_dry_run(header, transcoder->method);
+		} else if (!transcode_file(transcoder, filter->reader,
+		                           header)) {
+			transcoder->success = 0;
+		}
+	}
+
+	return transcoder->success;
+}
+
+// lha k: recompress the files in an archive into a new archive.
+
+int transcode_archive(LHAFilter *filter, LHAOptions *options,
+                      char *output_filename)
+{
+	Transcoder transcoder;
+	LHAOutputStream *stream;
+	FILE *fstream;
+	char *temp_filename;
+	unsigned int threads;
+	int success;
+
+	transcoder.options = options;
+	transcoder.method = options->compress_method;
+	transcoder.writer = NULL;
+	transcoder.buf = NULL;
+	transcoder.first_file = NULL;
+	transcoder.last_file = NULL;
+	transcoder.success = 1;
+
+	if (transcoder.method == NULL) {
+		transcoder.method = "-lh7-";
+	}
+
+	// The headers are wanted in the order they appear in the archive.
+
+	lha_reader_set_dir_policy(filter->reader, LHA_READER_DIR_PLAIN);
+
+	if (options->dry_run) {
+		return transcode_files(&transcoder, filter);
+	}
+
+	// An existing file is only replaced as it would be when
+	// extracting.
+
+	if (file_exists(output_filename)
+	 && !confirm_file_overwrite(output_filename, options)) {
+		safe_printf("%s : Skipped...", output_filename);
+		printf("\n");
+		return 1;
+	}
+
+	// The new archive is written to a temporary file in the same
+	// directory, which only replaces the file with the new name once
+	// it is complete.
+
+	temp_filename = malloc(strlen(output_filename) + 8);
+
+	if (temp_filename == NULL) {
+		fprintf(stderr, "LHa: Error: Failed to allocate memory\n");
+		exit(-1);
+	}
+
+	sprintf(temp_filename, "%s.XXXXXX", output_filename);
+	fstream = lha_arch_fopen_temp(temp_filename);
+
+	if (fstream == NULL) {
+		fprintf(stderr, "LHa: Error: %s %s\n",
+		        output_filename, strerror(errno));
+		free(temp_filename);
+		return 0;
+	}
+
+	stream = lha_output_stream_to_FILE(fstream);
+	transcoder.buf = malloc(COPY_BUFFER_SIZE);
+
+	if (stream != NULL) {
+		transcoder.writer = lha_writer_new(stream);
+	}
+
+	if (transcoder.writer == NULL || transcoder.buf == NULL) {
+		fprintf(stderr, "LHa: Error: Failed to allocate memory\n");
+		exit(-1);
+	}
+
+	// Small files are compressed several at a time, one per thread,
+	// while large files are always split between at least two
+	// threads, so that the output does not depend on the number of
+	// processors.
+
+	threads = lha_arch_num_cpus();
+
+	if (threads < 2) {
+		threads = 2;
+	}
+
+	lha_writer_set_jobs(transcoder.writer, threads);
+	lha_writer_set_threads(transcoder.writer, threads);
+	lha_writer_set_callback(transcoder.writer, file_written, &transcoder);
+
+	// The writer is finished even after an error, so that the results
+	// for the files still being compressed are printed.
+
+	success = transcode_files(&transcoder, filter);
+	success = lha_writer_finish(transcoder.writer) && success
+	       && transcoder.success;
+
+	lha_writer_free(transcoder.writer);
+	lha_output_stream_free(stream);
+	free(transcoder.buf);
+
+	if (fclose(fstream) != 0) {
+		success = 0;
+	}
+
+	success = success && lha_arch_rename(temp_filename, output_filename);
+
+	// Do not leave behind an incomplete archive.
+
+	if (!success) {
+		fprintf(stderr, "LHa: Error: Failed to write %s\n",
+		        output_filename);
+		remove(temp_filename);
+	}
+
+	free(temp_filename);
+
+	return success;
+}
@@ -0,0 +1,611 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Benchmark program for the decompressors. Every sample in the
+// compressed/ and archives/ directories is decoded a number of times,
+// and the results are reported per compression method as one line of
+// "key=value" pairs, suitable for parsing by other tools and for
+// comparing between builds to catch performance regressions.
+//
+// For each sample, only the fastest of the iterations is counted, to
+// reduce noise from the rest of the system. The peak heap size is the
+// most memory allocated by the library at once while decoding with
+// that method; the peak RSS is for the whole process, so run with -m
+// to get a figure for a single method.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "lhasa.h"
+
+#define DEFAULT_ITERATIONS 10
+#define MAX_METHODS 32
+#define READ_BUFFER_SIZE 65536
+
+// Files larger than this are skipped. Some of the test archives contain
+// huge, highly repetitive files to test the handling of large lengths;
+// these would otherwise dominate the results.
+
+#define MAX_SAMPLE_LENGTH (64 * 1024 * 1024)
+
+typedef struct {
+	char *filename;
+	char *algorithm;
+	size_t len;
+} RawSample;
+
+typedef struct {
+	char method[6];
+	unsigned int samples;
+	uint64_t in_bytes;
+	uint64_t out_bytes;
+	double seconds;
+	size_t peak_heap;
+} MethodStats;
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len;
+	size_t pos;
+} MemoryStream;
+
+// Raw compressed streams, as in test-decoder.c.
+
+static const RawSample raw_samples[] = {
+	{ "compressed/lh0.bin", "-lh0-", 18092 },
+	{ "compressed/lh1.bin", "-lh1-", 18092 },
+	{ "compressed/lh5.bin", "-lh5-", 18092 },
+	{ "compressed/lh6.bin", "-lh6-", 18092 },
+	{ "compressed/lh7.bin", "-lh7-", 18092 },
+	{ "compressed/lzs.bin", "-lzs-", 18092 },
+	{ "compressed/lz5.bin", "-lz5-", 18092 },
+	{ "compressed/pm2.bin", "-pm2-", 18176 },
+};
+
+static MethodStats stats[MAX_METHODS];
+static unsigned int num_stats;
+
+static unsigned int iterations = DEFAULT_ITERATIONS;
+static char *only_method = NULL;
+
+static uint8_t read_buf[READ_BUFFER_SIZE];
+
+// Memory allocated by the library, tracked through the allocator hooks.
+// Each block is prefixed with its size. The prefix is padded so that
+// blocks are aligned the same as those returned by malloc().
+
+#define BLOCK_PREFIX_LEN 16
+
+static size_t heap_current, heap_peak;
+
+static void *tracking_malloc(size_t size, void *user_data)
+{
+	uint8_t *result;
+
+	result = malloc(size + BLOCK_PREFIX_LEN);
+
+	if (result == NULL) {
+		return NULL;
+	}
+
+	*((size_t *) result) = size;
+	heap_current += size;
+
+	if (heap_current > heap_peak) {
+		heap_peak = heap_current;
+	}
+
+	return result + BLOCK_PREFIX_LEN;
+}
+
+static void tracking_free(void *ptr, void *user_data)
+{
+	uint8_t *block;
+
+	if (ptr != NULL) {
+		block = (uint8_t *) ptr - BLOCK_PREFIX_LEN;
+		heap_current -= *((size_t *) block);
+		free(block);
+	}
+}
+
+static void *tracking_realloc(void *ptr, size_t size, void *user_data)
+{
+	uint8_t *block;
+	size_t old_size;
+
+	if (ptr == NULL) {
+		return tracking_malloc(size, user_data);
+	}
+
+	block = (uint8_t *) ptr - BLOCK_PREFIX_LEN;
+	old_size = *((size_t *) block);
+
+	block = realloc(block, size + BLOCK_PREFIX_LEN);
+
+	if (block == NULL) {
+		return NULL;
+	}
+
+	*((size_t *) block) = size;
+	heap_current = heap_current - old_size + size;
+
+	if (heap_current > heap_peak) {
+		heap_peak = heap_current;
+	}
+
+	return block + BLOCK_PREFIX_LEN;
+}
+
+static const LHAAllocator tracking_allocator = {
+	tracking_malloc,
+	tracking_realloc,
+	tracking_free,
+	NULL
+};
+
+static double time_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Returns true if the given method is to be benchmarked. Directories
+// and unknown methods are skipped.
+
+static int want_method(const char *method)
+{
+	if (only_method != NULL && strcmp(method, only_method) != 0) {
+		return 0;
+	}
+
+	return lha_decoder_for_name(method) != NULL;
+}
+
+// Find the statistics entry for the given method, creating it if
+// necessary.
+
+static MethodStats *stats_for_method(const char *method)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_stats; ++i) {
+		if (!strcmp(stats[i].method, method)) {
+			return &stats[i];
+		}
+	}
+
+	if (num_stats >= MAX_METHODS) {
+		return NULL;
+	}
+
+	memset(&stats[num_stats], 0, sizeof(MethodStats));
+	strcpy(stats[num_stats].method, method);
+
+	return &stats[num_stats++];
+}
+
+// Record the result of benchmarking one sample.
+
+static void add_result(const char *method, uint64_t in_bytes,
+                       uint64_t out_bytes, double seconds, size_t peak_heap)
+{
+	MethodStats *s;
+
+	s = stats_for_method(method);
+	assert(s != NULL);
+
+	++s->samples;
+	s->in_bytes += in_bytes;
+	s->out_bytes += out_bytes;
+	s->seconds += seconds;
+
+	if (peak_heap > s->peak_heap) {
+		s->peak_heap = peak_heap;
+	}
+}
+
+static int read_file_data(const char *filename, uint8_t **data, size_t *len)
+{
+	FILE *fstream;
+	long file_len;
+
+	fstream = fopen(filename, "rb");
+
+	if (fstream == NULL) {
+		return 0;
+	}
+
+	fseek(fstream, 0, SEEK_END);
+	file_len = ftell(fstream);
+	fseek(fstream, 0, SEEK_SET);
+
+	if (file_len < 0) {
+		fclose(fstream);
+		return 0;
+	}
+
+	*len = (size_t) file_len;
+	*data = malloc(*len + 1);
+	assert(*data != NULL);
+
+	if (fread(*data, 1, *len, fstream) != *len) {
+		free(*data);
+		fclose(fstream);
+		return 0;
+	}
+
+	fclose(fstream);
+
+	return 1;
+}
+
+// Callbacks for reading from a block of memory, used both for the raw
+// decoders and for LHAInputStream, so that disk I/O is not timed.
+
+static size_t memory_read(MemoryStream *stream, void *buf, size_t buf_len)
+{
+	size_t result;
+
+	result = stream->data_len - stream->pos;
+
+	if (buf_len < result) {
+		result = buf_len;
+	}
+
+	memcpy(buf, stream->data + stream->pos, result);
+	stream->pos += result;
+
+	return result;
+}
+
+static size_t decoder_read_callback(void *buf, size_t buf_len, void *user)
+{
+	return memory_read(user, buf, buf_len);
+}
+
+static int stream_read(void *handle, void *buf, size_t buf_len)
+{
+	return (int) memory_read(handle, buf, buf_len);
+}
+
+static int stream_skip(void *handle, size_t bytes)
+{
+	MemoryStream *stream = handle;
+
+	if (bytes > stream->data_len - stream->pos) {
+		return 0;
+	}
+
+	stream->pos += bytes;
+
+	return 1;
+}
+
+static const LHAInputStreamType memory_stream_type = {
+	stream_read,
+	stream_skip,
+	NULL
+};
+
+// Decode a raw compressed stream from compressed/.
+
+static void bench_raw_sample(const char *srcdir, const RawSample *sample)
+{
+	const LHADecoderType *dtype;
+	LHADecoder *decoder;
+	MemoryStream stream;
+	char filename[1024];
+	size_t len, heap_base, peak = 0;
+	uint64_t total = 0;
+	double start, elapsed, best = 0;
+	unsigned int i;
+
+	if (!want_method(sample->algorithm)) {
+		return;
+	}
+
+	snprintf(filename, sizeof(filename), "%s/%s",
+	         srcdir, sample->filename);
+
+	if (!read_file_data(filename, &stream.data, &stream.data_len)) {
+		fprintf(stderr, "Failed to read '%s'\n", filename);
+		exit(-1);
+	}
+
+	dtype = lha_decoder_for_name(sample->algorithm);
+	assert(dtype != NULL);
+
+	for (i = 0; i < iterations; ++i) {
+		stream.pos = 0;
+		heap_base = heap_current;
+		heap_peak = heap_current;
+		total = 0;
+
+		start = time_now();
+
+		decoder = lha_decoder_new(dtype, decoder_read_callback,
+		                          &stream, sample->len);
+		assert(decoder != NULL);
+
+		do {
+			len = lha_decoder_read(decoder, read_buf,
+			                       sizeof(read_buf));
+			total += len;
+		} while (len > 0);
+
+		lha_decoder_free(decoder);
+
+		elapsed = time_now() - start;
+
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+
+		if (heap_peak - heap_base > peak) {
+			peak = heap_peak - heap_base;
+		}
+	}
+
+	add_result(sample->algorithm, stream.data_len, total, best, peak);
+
+	free(stream.data);
+}
+
+// Decode every file in an archive. Only the time spent decoding file
+// data is counted, not the time spent parsing headers.
+
+static void bench_archive(const char *filename)
+{
+	LHAInputStream *input;
+	LHAReader *reader;
+	LHAFileHeader *header;
+	MemoryStream stream;
+	MethodStats iter_stats[MAX_METHODS], best_stats[MAX_METHODS];
+	unsigned int num_iter_stats, num_best_stats = 0;
+	unsigned int i, j;
+	uint64_t out_bytes;
+	size_t len, heap_base;
+	double start, elapsed;
+
+	if (!read_file_data(filename, &stream.data, &stream.data_len)) {
+		fprintf(stderr, "Failed to read '%s'\n", filename);
+		exit(-1);
+	}
+
+	for (i = 0; i < iterations; ++i) {
+		stream.pos = 0;
+		num_iter_stats = 0;
+
+		input = lha_input_stream_new(&memory_stream_type, &stream);
+		assert(input != NULL);
+		reader = lha_reader_new(input);
+		assert(reader != NULL);
+
+		while ((header = lha_reader_next_file(reader)) != NULL) {
+
+			if (!want_method(header->compress_method)
+			 || header->length > MAX_SAMPLE_LENGTH) {
+				continue;
+			}
+
+			// Find or create the entry for this method.
+
+			for (j = 0; j < num_iter_stats; ++j) {
+				if (!strcmp(iter_stats[j].method,
+				            header->compress_method)) {
+					break;
+				}
+			}
+
+			if (j == num_iter_stats) {
+				memset(&iter_stats[j], 0, sizeof(MethodStats));
+				memcpy(iter_stats[j].method,
+				       header->compress_method,
+				       sizeof(iter_stats[j].method));
+				++num_iter_stats;
+			}
+
+			heap_base = heap_current;
+			heap_peak = heap_current;
+			out_bytes = 0;
+
+			start = time_now();
+
+			do {
+				len = lha_reader_read(reader, read_buf,
+				                      sizeof(read_buf));
+				out_bytes += len;
+			} while (len > 0);
+
+			elapsed = time_now() - start;
+
+			++iter_stats[j].samples;
+			iter_stats[j].in_bytes += header->compressed_length;
+			iter_stats[j].out_bytes += out_bytes;
+			iter_stats[j].seconds += elapsed;
+
+			if (heap_peak - heap_base > iter_stats[j].peak_heap) {
+				iter_stats[j].peak_heap = heap_peak - heap_base;
+			}
+		}
+
+		lha_reader_free(reader);
+		lha_input_stream_free(input);
+
+		// Keep the fastest time seen for each method. The archive
+		// is decoded the same way every time, so the list of
+		// methods is the same on every iteration.
+
+		if (i == 0) {
+			memcpy(best_stats, iter_stats,
+			       num_iter_stats * sizeof(MethodStats));
+			num_best_stats = num_iter_stats;
+			continue;
+		}
+
+		for (j = 0; j < num_best_stats && j < num_iter_stats; ++j) {
+			if (iter_stats[j].seconds < best_stats[j].seconds) {
+				best_stats[j].seconds = iter_stats[j].seconds;
+			}
+		}
+	}
+
+	for (j = 0; j < num_best_stats; ++j) {
+		add_result(best_stats[j].method, best_stats[j].in_bytes,
+		           best_stats[j].out_bytes, best_stats[j].seconds,
+		           best_stats[j].peak_heap);
+	}
+
+	free(stream.data);
+}
+
+// Recursively benchmark all archives found in the given directory.
+
+static void bench_archive_dir(const char *path)
+{
+	DIR *dir;
+	struct dirent *entry;
+	struct stat st;
+	char filename[1024];
+
+	dir = opendir(path);
+
+	if (dir == NULL) {
+		fprintf(stderr, "Failed to open directory '%s'\n", path);
+		exit(-1);
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+
+		snprintf(filename, sizeof(filename), "%s/%s",
+		         path, entry->d_name);
+
+		if (stat(filename, &st) != 0) {
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			bench_archive_dir(filename);
+		} else if (S_ISREG(st.st_mode)) {
+			bench_archive(filename);
+		}
+	}
+
+	closedir(dir);
+}
+
+static int compare_stats(const void *a, const void *b)
+{
+	const MethodStats *sa = a, *sb = b;
+
+	return strcmp(sa->method, sb->method);
+}
+
+static void print_results(void)
+{
+	struct rusage usage;
+	MethodStats *s;
+	double mb_per_sec, ns_per_byte;
+	unsigned int i;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	qsort(stats, num_stats, sizeof(MethodStats), compare_stats);
+
+	for (i = 0; i < num_stats; ++i) {
+		s = &stats[i];
+
+		if (s->seconds > 0 && s->out_bytes > 0) {
+			mb_per_sec = (double) s->out_bytes / s->seconds / 1e6;
+			ns_per_byte = s->seconds * 1e9 / (double) s->out_bytes;
+		} else {
+			mb_per_sec = 0;
+			ns_per_byte = 0;
+		}
+
+		printf("method=%s samples=%u iterations=%u "
+		       "in_bytes=%" PRIu64 " out_bytes=%" PRIu64 " "
+		       "seconds=%.6f mb_per_sec=%.2f ns_per_byte=%.3f "
+		       "peak_heap=%lu peak_rss_kb=%ld\n",
+		       s->method, s->samples, iterations,
+		       s->in_bytes, s->out_bytes,
+		       s->seconds, mb_per_sec, ns_per_byte,
+		       (unsigned long) s->peak_heap, usage.ru_maxrss);
+	}
+}
+
+static void usage(char *progname)
+{
+	printf("Usage: %s [-n iterations] [-m method] [-d srcdir]\n",
+	       progname);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	char *srcdir = ".";
+	char path[1024];
+	unsigned int j;
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			iterations = (unsigned int) atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+			only_method = argv[++i];
+		} else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			srcdir = argv[++i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	if (iterations == 0) {
+		usage(argv[0]);
+	}
+
+	lha_set_allocator(&tracking_allocator);
+
+	for (j = 0; j < sizeof(raw_samples) / sizeof(RawSample); ++j) {
+		bench_raw_sample(srcdir, &raw_samples[j]);
+	}
+
+	snprintf(path, sizeof(path), "%s/archives", srcdir);
+	bench_archive_dir(path);
+
+	print_results();
+
+	return 0;
+}
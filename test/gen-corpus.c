@@ -0,0 +1,585 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+// Generator for large synthetic archives, for benchmarking.
+//
+// This uses the same approach as ghost-tester: valid compressed data is
+// produced by running random data through a decoder (see ghost_data.c).
+// Generating data this way is slow, so a small number of streams are
+// generated for each compression method up front, each long enough for
+// the largest file. Each file in the archive then uses a prefix of one
+// of these streams, decoded once to find its length and CRC. This makes
+// it practical to generate archives with hundreds of thousands of
+// files, or many gigabytes of data.
+//
+// The output is deterministic for a given set of options and random
+// seed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "lha_decoder.h"
+#include "ghost_data.h"
+
+// Number of different compressed streams to generate for each method.
+
+#define NUM_VARIANTS 4
+
+#define MAX_METHODS 16
+#define MAX_LEVELS 3
+
+// Timestamp stored in generated headers (2020-01-01 00:00:00); in
+// MS-DOS format for level 0/1 headers and Unix format for level 2.
+
+#define DOS_TIMESTAMP   (((2020 - 1980) << 25) | (1 << 21) | (1 << 16))
+#define UNIX_TIMESTAMP  1577836800
+
+typedef struct {
+	char *name;
+	uint8_t *variants[NUM_VARIANTS];
+	size_t variant_len[NUM_VARIANTS];
+} MethodData;
+
+typedef struct {
+	uint8_t *buf;
+	size_t buf_len;
+	size_t buf_pos;
+} StreamState;
+
+static MethodData methods[MAX_METHODS];
+static unsigned int num_methods;
+
+static unsigned int levels[MAX_LEVELS];
+static unsigned int num_levels;
+
+static uint64_t num_files = 1000;
+static size_t min_size = 64 * 1024, max_size = 64 * 1024;
+static unsigned int num_dirs = 0;
+static size_t sfx_len = 0;
+static unsigned int seed = 1;
+
+// Read a size in bytes, with an optional k, m or g suffix. Sizes too
+// large for a size_t are set to SIZE_MAX.
+
+static int parse_size(char *str, size_t *result)
+{
+	char *end;
+	unsigned long value;
+	size_t multiplier;
+
+	value = strtoul(str, &end, 10);
+
+	switch (*end) {
+		case 'k': case 'K':
+			multiplier = 1024;
+			++end;
+			break;
+		case 'm': case 'M':
+			multiplier = 1024 * 1024;
+			++end;
+			break;
+		case 'g': case 'G':
+			multiplier = 1024 * 1024 * 1024;
+			++end;
+			break;
+		default:
+			multiplier = 1;
+			break;
+	}
+
+	if (value > SIZE_MAX / multiplier) {
+		*result = SIZE_MAX;
+	} else {
+		*result = (size_t) value * multiplier;
+	}
+
+	return end != str && *end == '\0';
+}
+
+// Parse the argument to -s: either a single size, or a range of the
+// form "min-max".
+
+static int parse_size_range(char *str)
+{
+	char *p;
+
+	p = strchr(str, '-');
+
+	if (p == NULL) {
+		if (!parse_size(str, &min_size)) {
+			return 0;
+		}
+
+		max_size = min_size;
+		return 1;
+	}
+
+	*p = '\0';
+
+	return parse_size(str, &min_size) && parse_size(p + 1, &max_size)
+	    && min_size <= max_size;
+}
+
+// Parse comma-separated list of compression methods.
+
+static int parse_methods(char *str)
+{
+	char *p;
+
+	num_methods = 0;
+
+	for (p = strtok(str, ","); p != NULL; p = strtok(NULL, ",")) {
+		if (num_methods >= MAX_METHODS
+		 || lha_decoder_for_name(p) == NULL) {
+			fprintf(stderr, "Unknown compression method '%s'\n", p);
+			return 0;
+		}
+
+		methods[num_methods].name = p;
+		++num_methods;
+	}
+
+	return num_methods > 0;
+}
+
+// Parse comma-separated list of header levels.
+
+static int parse_levels(char *str)
+{
+	char *p;
+
+	num_levels = 0;
+
+	for (p = strtok(str, ","); p != NULL; p = strtok(NULL, ",")) {
+		if (num_levels >= MAX_LEVELS
+		 || strlen(p) != 1 || p[0] < '0' || p[0] > '2') {
+			fprintf(stderr, "Invalid header level '%s'\n", p);
+			return 0;
+		}
+
+		levels[num_levels] = (unsigned int) (p[0] - '0');
+		++num_levels;
+	}
+
+	return num_levels > 0;
+}
+
+// Random number in the range 0 <= n < limit, for limits that may be
+// larger than RAND_MAX.
+
+static uint64_t random_below(uint64_t limit)
+{
+	uint64_t result;
+
+	result = ((uint64_t) rand() << 31) ^ (uint64_t) rand();
+
+	return result % limit;
+}
+
+// Generate the compressed streams for each method.
+
+static void generate_methods(void)
+{
+	uint16_t crc16;
+	size_t buf_len;
+	unsigned int i, j;
+
+	// Random data usually decodes to more data than was read, but
+	// allow for expansion so that the decoder does not run out of
+	// input before producing enough output.
+
+	buf_len = max_size * 2 + 4096;
+
+	for (i = 0; i < num_methods; ++i) {
+		fprintf(stderr, "Generating %s data...\n", methods[i].name);
+
+		for (j = 0; j < NUM_VARIANTS; ++j) {
+			methods[i].variants[j] = malloc(buf_len);
+			assert(methods[i].variants[j] != NULL);
+
+			generate_data(methods[i].name, methods[i].variants[j],
+			              buf_len, max_size, &crc16, NULL);
+			methods[i].variant_len[j] = buf_len;
+		}
+	}
+}
+
+static size_t read_stream(void *buf, size_t buf_len, void *user_data)
+{
+	StreamState *state = user_data;
+	size_t to_copy;
+
+	to_copy = state->buf_len - state->buf_pos;
+
+	if (to_copy > buf_len) {
+		to_copy = buf_len;
+	}
+
+	memcpy(buf, state->buf + state->buf_pos, to_copy);
+	state->buf_pos += to_copy;
+
+	return to_copy;
+}
+
+// Decode the first 'length' bytes of a compressed stream, to find the
+// CRC of the decompressed data and how much of the stream was used.
+
+static void decode_prefix(char *method, uint8_t *data, size_t data_len,
+                          size_t length, size_t *compressed_len,
+                          uint16_t *crc)
+{
+	static uint8_t buf[65536];
+	const LHADecoderType *dtype;
+	LHADecoder *decoder;
+	StreamState state;
+	size_t total, bytes;
+
+	dtype = lha_decoder_for_name(method);
+	assert(dtype != NULL);
+
+	state.buf = data;
+	state.buf_len = data_len;
+	state.buf_pos = 0;
+
+	decoder = lha_decoder_new(dtype, read_stream, &state, length);
+	assert(decoder != NULL);
+
+	total = 0;
+
+	do {
+		bytes = lha_decoder_read(decoder, buf, sizeof(buf));
+		total += bytes;
+	} while (bytes > 0);
+
+	assert(total == length);
+
+	*crc = lha_decoder_get_crc(decoder);
+	*compressed_len = state.buf_pos;
+
+	lha_decoder_free(decoder);
+}
+
+// Add an extended header to a level 1/2 header. The data may include
+// 0xff path separators. Returns the new length of the header.
+
+static size_t add_ext_header(uint8_t *buf, size_t len, uint8_t type,
+                             char *data)
+{
+	size_t data_len;
+
+	data_len = strlen(data);
+
+	// Each extended header is preceded by its length, which
+	// includes the length field and type byte.
+
+	write_uint16(buf + len, (uint16_t) (data_len + 3));
+	buf[len + 2] = type;
+	memcpy(buf + len + 3, data, data_len);
+
+	return len + data_len + 3;
+}
+
+// Construct the header for a file. Returns the header length.
+
+static size_t build_header(uint8_t *buf, unsigned int level, char *method,
+                           char *dir, char *filename,
+                           size_t compressed_len, size_t length,
+                           uint16_t crc)
+{
+	size_t header_len, base_len, path_len, ext_start;
+	char path[256];
+
+	memcpy(buf + 2, method, 5);
+	write_uint32(buf + 11, (uint32_t) length);
+	buf[19] = 0x20;
+	buf[20] = (uint8_t) level;
+
+	if (level == 0 || level == 1) {
+		write_uint32(buf + 15, DOS_TIMESTAMP);
+
+		// Level 0 headers store the full path in the filename
+		// field, using MS-DOS path separators. Level 1 headers
+		// store the directory in an extended header.
+
+		if (level == 0 && dir != NULL) {
+			snprintf(path, sizeof(path), "%s\\%s", dir, filename);
+		} else {
+			snprintf(path, sizeof(path), "%s", filename);
+		}
+
+		path_len = strlen(path);
+		buf[21] = (uint8_t) path_len;
+		memcpy(buf + 22, path, path_len);
+		write_uint16(buf + 22 + path_len, crc);
+		header_len = 24 + path_len;
+		base_len = header_len;
+
+		if (level == 1) {
+			buf[header_len++] = 'U';
+			ext_start = header_len;
+			base_len = header_len + 2;
+
+			if (dir != NULL) {
+				snprintf(path, sizeof(path), "%s\xff", dir);
+				header_len = add_ext_header(buf, header_len,
+				                            0x02, path);
+			}
+
+			write_uint16(buf + header_len, 0);
+			header_len += 2;
+
+			// The compressed length includes the extended
+			// headers, which begin with the length field of
+			// the first one.
+
+			compressed_len += header_len - ext_start - 2;
+		}
+
+		// The length and checksum only cover the base header, which
+		// ends with the length field of the first extended header.
+
+		write_uint32(buf + 7, (uint32_t) compressed_len);
+		buf[0] = (uint8_t) (base_len - 2);
+		buf[1] = calculate_checksum(buf + 2, base_len - 2);
+	} else {
+		write_uint32(buf + 7, (uint32_t) compressed_len);
+		write_uint32(buf + 15, UNIX_TIMESTAMP);
+		write_uint16(buf + 21, crc);
+		buf[23] = 'U';
+		header_len = 24;
+
+		header_len = add_ext_header(buf, header_len, 0x01, filename);
+
+		if (dir != NULL) {
+			snprintf(path, sizeof(path), "%s\xff", dir);
+			header_len = add_ext_header(buf, header_len,
+			                            0x02, path);
+		}
+
+		write_uint16(buf + header_len, 0);
+		header_len += 2;
+		write_uint16(buf, (uint16_t) header_len);
+	}
+
+	return header_len;
+}
+
+// Write some junk data to the start of the file, to simulate a
+// self-extracting archive. A '-' byte could look like the start of a
+// compression method, so these are avoided.
+
+static void write_sfx_stub(FILE *fstream)
+{
+	uint8_t buf[4096];
+	size_t remaining, chunk, i;
+
+	remaining = sfx_len;
+
+	while (remaining > 0) {
+		chunk = remaining < sizeof(buf) ? remaining : sizeof(buf);
+		fill_random(buf, chunk);
+
+		for (i = 0; i < chunk; ++i) {
+			if (buf[i] == '-') {
+				buf[i] = 0;
+			}
+		}
+
+		fwrite(buf, 1, chunk, fstream);
+		remaining -= chunk;
+	}
+}
+
+static void generate_archive(FILE *fstream)
+{
+	uint8_t header[512];
+	char filename[32], dirname[32];
+	MethodData *method;
+	uint64_t i, total_length, total_compressed;
+	size_t header_len, length, compressed_len;
+	unsigned int variant, level;
+	uint16_t crc;
+
+	write_sfx_stub(fstream);
+
+	total_length = 0;
+	total_compressed = 0;
+
+	for (i = 0; i < num_files; ++i) {
+		method = &methods[i % num_methods];
+		level = levels[i % num_levels];
+		variant = (unsigned int) random_below(NUM_VARIANTS);
+		length = min_size
+		       + (size_t) random_below(max_size - min_size + 1);
+
+		decode_prefix(method->name, method->variants[variant],
+		              method->variant_len[variant], length,
+		              &compressed_len, &crc);
+
+		snprintf(filename, sizeof(filename), "file%07" PRIu64 ".bin",
+		         i);
+
+		if (num_dirs > 0) {
+			snprintf(dirname, sizeof(dirname), "dir%04u",
+			         (unsigned int) (i % num_dirs));
+		}
+
+		header_len = build_header(header, level, method->name,
+		                          num_dirs > 0 ? dirname : NULL,
+		                          filename, compressed_len, length,
+		                          crc);
+
+		fwrite(header, 1, header_len, fstream);
+		fwrite(method->variants[variant], 1, compressed_len, fstream);
+
+		total_length += length;
+		total_compressed += header_len + compressed_len;
+	}
+
+	// End of archive marker.
+
+	fputc(0, fstream);
+
+	fprintf(stderr, "%" PRIu64 " files, %" PRIu64 " bytes of data, "
+	        "archive size %" PRIu64 " bytes\n",
+	        num_files, total_length, sfx_len + total_compressed + 1);
+}
+
+static void usage(char *progname)
+{
+	printf("Usage: %s [options] <output file>\n"
+	       "\n"
+	       "  -n count       Number of files (default 1000).\n"
+	       "  -s size        File size, or range 'min-max'; sizes\n"
+	       "                 can have a k, m or g suffix (default 64k).\n"
+	       "  -m methods     Comma-separated list of compression\n"
+	       "                 methods to cycle through (default -lh5-).\n"
+	       "  -l levels      Comma-separated list of header levels\n"
+	       "                 to cycle through (default 0,1,2).\n"
+	       "  -d count       Spread files across directories.\n"
+	       "  -x size        Prepend junk data, as in a self-extractor.\n"
+	       "  -r seed        Random seed (default 1).\n",
+	       progname);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	char default_methods[] = "-lh5-";
+	char default_levels[] = "0,1,2";
+	char *output = NULL;
+	char *size_str = NULL;
+	FILE *fstream;
+	int i, ok;
+
+	parse_methods(default_methods);
+	parse_levels(default_levels);
+
+	for (i = 1; i < argc; ++i) {
+		if (argv[i][0] != '-' || argv[i][1] == '\0') {
+			if (output != NULL) {
+				usage(argv[0]);
+			}
+			output = argv[i];
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+		}
+
+		switch (argv[i][1]) {
+			case 'n':
+				num_files = strtoull(argv[i + 1], NULL, 10);
+				ok = num_files > 0;
+				break;
+			case 's':
+				size_str = strrchr(argv[i + 1], '-');
+				size_str = size_str != NULL ? size_str + 1
+				                            : argv[i + 1];
+				ok = parse_size_range(argv[i + 1]);
+				break;
+			case 'm':
+				ok = parse_methods(argv[i + 1]);
+				break;
+			case 'l':
+				ok = parse_levels(argv[i + 1]);
+				break;
+			case 'd':
+				num_dirs = (unsigned int) atoi(argv[i + 1]);
+				ok = 1;
+				break;
+			case 'x':
+				ok = parse_size(argv[i + 1], &sfx_len);
+				break;
+			case 'r':
+				seed = (unsigned int) atoi(argv[i + 1]);
+				ok = 1;
+				break;
+			default:
+				ok = 0;
+				break;
+		}
+
+		if (!ok || argv[i][2] != '\0') {
+			usage(argv[0]);
+		}
+
+		++i;
+	}
+
+	if (output == NULL || max_size == 0) {
+		usage(argv[0]);
+	}
+
+	// Lengths are stored in 32-bit header fields.
+
+	if (max_size > 0xffffffffUL) {
+		fprintf(stderr, "File size limit of %s bytes is too large: "
+		        "the maximum is 4294967295 (4g - 1).\n",
+		        size_str);
+		exit(-1);
+	}
+
+	srand(seed);
+	generate_methods();
+
+	if (!strcmp(output, "-")) {
+		fstream = stdout;
+	} else {
+		fstream = fopen(output, "wb");
+	}
+
+	if (fstream == NULL) {
+		fprintf(stderr, "Failed to open '%s' for writing\n", output);
+		exit(-1);
+	}
+
+	generate_archive(fstream);
+
+	if (fstream != stdout) {
+		fclose(fstream);
+	}
+
+	return 0;
+}
@@ -44,6 +44,7 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "lib/lha_arch.h"
 #include "lha_decoder.h"
 #include "crc32.h"
+#include "ghost_data.h"
 
 // Filename to use for archive file:
 
@@ -69,170 +70,6 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #define ARCHIVED_FILE_ALIGN  1024
 
-typedef struct {
-	uint8_t *buf;
-	size_t buf_len;
-	unsigned int buf_pos;
-} ReadDataCallback;
-
-// Write a 32-bit integer into the specified buffer.
-
-static void write_uint32(uint8_t *buf, uint32_t value)
-{
-	buf[0] = value & 0xff;
-	buf[1] = (value >> 8) & 0xff;
-	buf[2] = (value >> 16) & 0xff;
-	buf[3] = (value >> 24) & 0xff;
-}
-
-// Write a 16-bit integer into the specified buffer.
-
-static void write_uint16(uint8_t *buf, uint16_t value)
-{
-	buf[0] = value & 0xff;
-	buf[1] = (value >> 8) & 0xff;
-}
-
-// Fill the specified buffer with random data.
-
-static void fill_random(uint8_t *buf, size_t buf_len)
-{
-	unsigned int i;
-
-	for (i = 0; i < buf_len; ++i) {
-		buf[i] = rand() & 0xff;
-	}
-}
-
-/**
- * Callback function used by LHADecoder to read more data.
- *
- * @param buf        Buffer in which to read the data.
- * @param buf_len    Length of the buffer.
- * @param user_data  Pointer to the ReadDataCallback structure containing
- *                   the stream decompression state.
- * @return           Number of bytes read.
- */
-
-static size_t read_data(void *buf, size_t buf_len, void *user_data)
-{
-	ReadDataCallback *callback_data = user_data;
-	size_t to_copy;
-
-	to_copy = callback_data->buf_len - callback_data->buf_pos;
-
-	if (to_copy > buf_len) {
-		to_copy = buf_len;
-	}
-
-	memcpy(buf, callback_data->buf + callback_data->buf_pos, to_copy);
-	callback_data->buf_pos += to_copy;
-
-	return to_copy;
-}
-
-/**
- * Generate some test data that can be successfully decompressed using
- * the specified algorithm type.
- *
- * @param type             The algorithm to use for decompression.
- * @param buf              Pointer to the buffer to store the data.
- * @param buf_len          Length of the buffer.
- * @param uncompressed_len Number of bytes to decompress before stopping.
- * @param crc16            Pointer to a variable to store the 16-bit CRC.
- * @param crc32            Pointer to a variable to store the 32-bit CRC.
- */
-
-static void generate_data(char *type, uint8_t *buf, size_t buf_len,
-                          size_t uncompressed_len,
-                          uint16_t *crc16, uint32_t *crc32)
-{
-	LHADecoderType *dtype;
-	ReadDataCallback callback_data;
-	LHADecoder *decoder;
-	size_t decoded_stream_len;
-
-	dtype = lha_decoder_for_name(type);
-	assert(dtype != NULL);
-
-	// Fill the buffer with random data:
-
-	fill_random(buf, buf_len);
-
-	// Decompress as much data as possible. If we fail to decompress
-	// all the data, modify some of the data from the point just
-	// before we stopped and try again.
-	// This is essentially a genetic algorithm.
-
-	for (;;) {
-		callback_data.buf = buf;
-		callback_data.buf_len = buf_len;
-		callback_data.buf_pos = 0;
-
-		decoder = lha_decoder_new(dtype, read_data, &callback_data,
-					  uncompressed_len);
-
-		decoded_stream_len = 0;
-		*crc32 = 0;
-
-		for (;;) {
-			uint8_t decode_buf[128];
-			size_t decoded_bytes;
-
-			decoded_bytes = lha_decoder_read(decoder, decode_buf,
-							 sizeof(decode_buf));
-			if (decoded_bytes == 0) {
-				break;
-			}
-
-			crc32_buf(crc32, decode_buf, decoded_bytes);
-
-			decoded_stream_len += decoded_bytes;
-		}
-
-		*crc16 = lha_decoder_get_crc(decoder);
-
-		lha_decoder_free(decoder);
-
-		// Successfully decompressed all the data? We are done.
-
-		if (decoded_stream_len >= uncompressed_len) {
-			break;
-		}
-
-		// Modify some data from the end of the stream and try again.
-
-		if (callback_data.buf_pos < 6) {
-			fill_random(callback_data.buf, 6);
-		} else {
-			fill_random(callback_data.buf
-			            + callback_data.buf_pos - 6, 6);
-		}
-	}
-}
-
-/**
- * Calculate the LHA level 0 header checksum for the specified buffer.
- *
- * @param buf         Pointer to buffer containing the data to checksum.
- * @param buf_len     Length of the buffer.
- * @return            Checksum of the buffer.
- */
-
-static uint8_t calculate_checksum(uint8_t *buf, size_t buf_len)
-{
-	uint8_t result;
-	unsigned int i;
-
-	result = 0;
-
-	for (i = 0; i < buf_len; ++i) {
-		result = (result + buf[i]) & 0xff;
-	}
-
-	return result;
-}
-
 /**
  * Generate an archive file.
  *
@@ -0,0 +1,171 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lha_decoder.h"
+#include "crc32.h"
+#include "ghost_data.h"
+
+typedef struct {
+	uint8_t *buf;
+	size_t buf_len;
+	size_t buf_pos;
+} ReadDataCallback;
+
+void write_uint32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = value & 0xff;
+	buf[1] = (value >> 8) & 0xff;
+	buf[2] = (value >> 16) & 0xff;
+	buf[3] = (value >> 24) & 0xff;
+}
+
+void write_uint16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = value & 0xff;
+	buf[1] = (value >> 8) & 0xff;
+}
+
+void fill_random(uint8_t *buf, size_t buf_len)
+{
+	size_t i;
+
+	for (i = 0; i < buf_len; ++i) {
+		buf[i] = rand() & 0xff;
+	}
+}
+
+/**
+ * Callback function used by LHADecoder to read more data.
+ *
+ * @param buf        Buffer in which to read the data.
+ * @param buf_len    Length of the buffer.
+ * @param user_data  Pointer to the ReadDataCallback structure containing
+ *                   the stream decompression state.
+ * @return           Number of bytes read.
+ */
+
+static size_t read_data(void *buf, size_t buf_len, void *user_data)
+{
+	ReadDataCallback *callback_data = user_data;
+	size_t to_copy;
+
+	to_copy = callback_data->buf_len - callback_data->buf_pos;
+
+	if (to_copy > buf_len) {
+		to_copy = buf_len;
+	}
+
+	memcpy(buf, callback_data->buf + callback_data->buf_pos, to_copy);
+	callback_data->buf_pos += to_copy;
+
+	return to_copy;
+}
+
+void generate_data(char *type, uint8_t *buf, size_t buf_len,
+                   size_t uncompressed_len,
+                   uint16_t *crc16, uint32_t *crc32)
+{
+	const LHADecoderType *dtype;
+	ReadDataCallback callback_data;
+	LHADecoder *decoder;
+	size_t decoded_stream_len;
+
+	dtype = lha_decoder_for_name(type);
+	assert(dtype != NULL);
+
+	// Fill the buffer with random data:
+
+	fill_random(buf, buf_len);
+
+	// Decompress as much data as possible. If we fail to decompress
+	// all the data, modify some of the data from the point just
+	// before we stopped and try again.
+	// This is essentially a genetic algorithm.
+
+	for (;;) {
+		callback_data.buf = buf;
+		callback_data.buf_len = buf_len;
+		callback_data.buf_pos = 0;
+
+		decoder = lha_decoder_new(dtype, read_data, &callback_data,
+					  uncompressed_len);
+
+		decoded_stream_len = 0;
+
+		if (crc32 != NULL) {
+			*crc32 = 0;
+		}
+
+		for (;;) {
+			uint8_t decode_buf[4096];
+			size_t decoded_bytes;
+
+			decoded_bytes = lha_decoder_read(decoder, decode_buf,
+							 sizeof(decode_buf));
+			if (decoded_bytes == 0) {
+				break;
+			}
+
+			if (crc32 != NULL) {
+				crc32_buf(crc32, decode_buf, decoded_bytes);
+			}
+
+			decoded_stream_len += decoded_bytes;
+		}
+
+		*crc16 = lha_decoder_get_crc(decoder);
+
+		lha_decoder_free(decoder);
+
+		// Successfully decompressed all the data? We are done.
+
+		if (decoded_stream_len >= uncompressed_len) {
+			break;
+		}
+
+		// Modify some data from the end of the stream and try again.
+
+		if (callback_data.buf_pos < 6) {
+			fill_random(callback_data.buf, 6);
+		} else {
+			fill_random(callback_data.buf
+			            + callback_data.buf_pos - 6, 6);
+		}
+	}
+}
+
+uint8_t calculate_checksum(uint8_t *buf, size_t buf_len)
+{
+	uint8_t result;
+	size_t i;
+
+	result = 0;
+
+	for (i = 0; i < buf_len; ++i) {
+		result = (result + buf[i]) & 0xff;
+	}
+
+	return result;
+}
@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2011, 2012, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#ifndef LHASA_TEST_GHOST_DATA_H
+#define LHASA_TEST_GHOST_DATA_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+// Functions for generating synthetic compressed data, shared by
+// ghost-tester and gen-corpus. Valid compressed streams are generated
+// by running random data through a decoder: see generate_data().
+
+/**
+ * Write a 16-bit little-endian integer into the specified buffer.
+ *
+ * @param buf         Pointer to the buffer.
+ * @param value       Value to write.
+ */
+
+void write_uint16(uint8_t *buf, uint16_t value);
+
+/**
+ * Write a 32-bit little-endian integer into the specified buffer.
+ *
+ * @param buf         Pointer to the buffer.
+ * @param value       Value to write.
+ */
+
+void write_uint32(uint8_t *buf, uint32_t value);
+
+/**
+ * Fill the specified buffer with random data.
+ *
+ * @param buf         Pointer to the buffer.
+ * @param buf_len     Length of the buffer.
+ */
+
+void fill_random(uint8_t *buf, size_t buf_len);
+
+/**
+ * Generate some test data that can be successfully decompressed using
+ * the specified algorithm type.
+ *
+ * @param type             The algorithm to use for decompression.
+ * @param buf              Pointer to the buffer to store the data.
+ * @param buf_len          Length of the buffer.
+ * @param uncompressed_len Number of bytes to decompress before stopping.
+ * @param crc16            Pointer to a variable to store the 16-bit CRC.
+ * @param crc32            Pointer to a variable to store the 32-bit CRC,
+ *                         or NULL if it is not needed.
+ */
+
+void generate_data(char *type, uint8_t *buf, size_t buf_len,
+                   size_t uncompressed_len,
+                   uint16_t *crc16, uint32_t *crc32);
+
+/**
+ * Calculate the LHA level 0 header checksum for the specified buffer.
+ *
+ * @param buf         Pointer to buffer containing the data to checksum.
+ * @param buf_len     Length of the buffer.
+ * @return            Checksum of the buffer.
+ */
+
+uint8_t calculate_checksum(uint8_t *buf, size_t buf_len);
+
+#endif /* #ifndef LHASA_TEST_GHOST_DATA_H */
@@ -18,11 +18,14 @@ CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
 #include "lib/lha_basic_reader.h"
+#include "lib/lha_file_header.h"
+#include "lib/lha_allocator.h"
 #include "crc32.h"
 
 static LHABasicReader *reader_for_file(char *filename, LHAInputStream **stream)
@@ -132,6 +135,210 @@ static void test_read_sfx(void)
 	check_directory_for("archives/pmarc2/sfx.com",        "gpl-2.");
 }
 
+// Input stream that reads from a memory buffer.
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len;
+	size_t pos;
+} MemorySource;
+
+static int memory_source_read(void *handle, void *buf, size_t buf_len)
+{
+	MemorySource *source = handle;
+
+	if (buf_len > source->data_len - source->pos) {
+		buf_len = source->data_len - source->pos;
+	}
+
+	memcpy(buf, source->data + source->pos, buf_len);
+	source->pos += buf_len;
+
+	return (int) buf_len;
+}
+
+static const LHAInputStreamType memory_source = {
+	memory_source_read,
+	NULL,
+	NULL
+};
+
+// Check that an archive can still be read when it is preceded by
+// the specified number of bytes of junk data, as with a self-extractor.
+
+static void check_junk_prefix(uint8_t *archive, size_t archive_len,
+                              size_t junk_len)
+{
+	LHAInputStream *stream;
+	LHABasicReader *reader;
+	LHAFileHeader *header;
+	MemorySource source;
+	unsigned int i;
+
+	source.data_len = junk_len + archive_len;
+	source.data = malloc(source.data_len);
+	source.pos = 0;
+	assert(source.data != NULL);
+
+	// Fill with junk that contains lots of '-' and 'L' characters,
+	// but not any valid header.
+
+	for (i = 0; i < junk_len; ++i) {
+		source.data[i] = "-L-x"[i % 4];
+	}
+
+	memcpy(source.data + junk_len, archive, archive_len);
+
+	stream = lha_input_stream_new(&memory_source, &source);
+	assert(stream != NULL);
+	reader = lha_basic_reader_new(stream);
+	assert(reader != NULL);
+
+	header = lha_basic_reader_next_file(reader);
+	assert(header != NULL);
+	assert(!strcmp(header->filename, "gpl-2"));
+	assert(lha_basic_reader_next_file(reader) == NULL);
+
+	lha_basic_reader_free(reader);
+	lha_input_stream_free(stream);
+	free(source.data);
+}
+
+static void test_read_junk_prefix(void)
+{
+	uint8_t archive[16384];
+	size_t archive_len;
+	size_t junk_len;
+	FILE *fstream;
+
+	fstream = fopen("archives/lha213/lh5.lzh", "rb");
+	assert(fstream != NULL);
+	archive_len = fread(archive, 1, sizeof(archive), fstream);
+	fclose(fstream);
+
+	// Try offsets around the size of the buffer used to scan
+	// for the header.
+
+	for (junk_len = 0; junk_len < 64; ++junk_len) {
+		check_junk_prefix(archive, archive_len, junk_len);
+	}
+
+	for (junk_len = 4000; junk_len < 4200; ++junk_len) {
+		check_junk_prefix(archive, archive_len, junk_len);
+	}
+
+	check_junk_prefix(archive, archive_len, 100000);
+}
+
+// Count the files that can be read from the specified data.
+
+static unsigned int count_files(uint8_t *data, size_t data_len, int recover)
+{
+	LHAInputStream *stream;
+	LHABasicReader *reader;
+	MemorySource source;
+	unsigned int result;
+
+	source.data = data;
+	source.data_len = data_len;
+	source.pos = 0;
+
+	stream = lha_input_stream_new(&memory_source, &source);
+	assert(stream != NULL);
+	reader = lha_basic_reader_new(stream);
+	assert(reader != NULL);
+
+	lha_basic_reader_set_recover(reader, recover);
+
+	result = 0;
+
+	while (lha_basic_reader_next_file(reader) != NULL) {
+		++result;
+	}
+
+	lha_basic_reader_free(reader);
+	lha_input_stream_free(stream);
+
+	return result;
+}
+
+static void check_recover_for(char *filename, unsigned int num_files)
+{
+	uint8_t archive[16384];
+	size_t archive_len;
+	size_t header_len;
+	FILE *fstream;
+
+	fstream = fopen(filename, "rb");
+	assert(fstream != NULL);
+	archive_len = fread(archive, 1, sizeof(archive), fstream);
+	fclose(fstream);
+
+	// Uncorrupted archive reads the same in both modes.
+
+	assert(count_files(archive, archive_len, 0) == num_files);
+	assert(count_files(archive, archive_len, 1) == num_files);
+
+	// Corrupt the second header. The first header is a directory
+	// with a level 2 header, so its length is the first field.
+
+	header_len = archive[0] | (archive[1] << 8);
+	archive[header_len + 24] ^= 0xff;
+
+	assert(count_files(archive, archive_len, 0) == 1);
+	assert(count_files(archive, archive_len, 1) == num_files - 1);
+}
+
+// A header that is longer than the lead-in buffer can still be found
+// after a large amount of corrupted data.
+
+static void test_recover_long_header(void)
+{
+	LHAFileHeader header;
+	uint8_t *archive;
+	size_t junk_len, header_len, i;
+	char path[6001];
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.compress_method, "-lhd-", 6);
+	header.os_type = LHA_OS_TYPE_UNIX;
+
+	for (i = 0; i < sizeof(path) - 1; i += 2) {
+		path[i] = 'a';
+		path[i + 1] = '/';
+	}
+	path[sizeof(path) - 1] = '\0';
+	header.path = path;
+
+	header_len = lha_file_header_encode(&header, NULL);
+	assert(header_len > 6000);
+
+	// The corrupted data contains things that look like headers.
+
+	junk_len = 100000;
+	archive = malloc(junk_len + header_len + 1);
+	assert(archive != NULL);
+
+	for (i = 0; i < junk_len; ++i) {
+		archive[i] = "xx-lh5-"[i % 7];
+	}
+
+	lha_file_header_encode(&header, archive + junk_len);
+	archive[junk_len + header_len] = 0;
+
+	assert(count_files(archive, junk_len + header_len + 1, 0) == 0);
+	assert(count_files(archive, junk_len + header_len + 1, 1) == 1);
+
+	free(archive);
+}
+
+static void test_recover(void)
+{
+	check_recover_for("archives/lha_unix114i/h2_subdir.lzh", 3);
+	check_recover_for("archives/explzh_723/h2_subdir.lzh", 3);
+	test_recover_long_header();
+}
+
 // Check CRC of compressed data.
 
 static void check_crc_for(char *filename, uint32_t expected_crc,
@@ -242,13 +449,80 @@ static void test_decode(void)
 	check_decode_for("archives/pmarc2/pm2.pma");
 }
 
+// Allocator that counts the number of blocks currently allocated.
+
+typedef struct {
+	unsigned int allocated;
+	unsigned int total;
+} AllocCount;
+
+static void *counting_malloc(size_t size, void *user_data)
+{
+	AllocCount *count = user_data;
+
+	++count->allocated;
+	++count->total;
+
+	return malloc(size);
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *user_data)
+{
+	AllocCount *count = user_data;
+
+	if (ptr == NULL) {
+		++count->allocated;
+		++count->total;
+	}
+
+	return realloc(ptr, size);
+}
+
+static void counting_free(void *ptr, void *user_data)
+{
+	AllocCount *count = user_data;
+
+	--count->allocated;
+
+	free(ptr);
+}
+
+static void test_allocator(void)
+{
+	LHAAllocator allocator;
+	AllocCount count;
+
+	allocator.malloc = counting_malloc;
+	allocator.realloc = counting_realloc;
+	allocator.free = counting_free;
+	allocator.user_data = &count;
+
+	// Everything allocated must be freed through the allocator.
+
+	count.allocated = 0;
+	count.total = 0;
+	lha_set_allocator(&allocator);
+
+	check_decode_for("archives/lha213/lh5.lzh");
+	check_decode_for("archives/lha_unix114i/h1_lh7.lzh");
+	check_directory_for("archives/pmarc2/sfx.com", "gpl-2.");
+
+	lha_set_allocator(NULL);
+
+	assert(count.total > 0);
+	assert(count.allocated == 0);
+}
+
 int main(int argc, char *argv[])
 {
 	test_create_free();
 	test_read_directory();
 	test_read_sfx();
+	test_read_junk_prefix();
 	test_read_compressed();
 	test_decode();
+	test_recover();
+	test_allocator();
 
 	return 0;
 }
@@ -157,12 +157,42 @@ static void test_crc16_empty(void)
 	assert(crc == 0);
 }
 
+// Test CRC of larger blocks of data, at different alignments. Large
+// blocks may be handled by a different implementation, so check the
+// result against the CRC calculated a byte at a time.
+
+static void test_crc16_large(void)
+{
+	uint8_t data[1024];
+	unsigned int i, start, len;
+	uint16_t crc, expected;
+
+	for (i = 0; i < sizeof(data); ++i) {
+		data[i] = (uint8_t) ((i * 2654435761U) >> 24);
+	}
+
+	for (start = 0; start < 16; ++start) {
+		for (len = 0; len <= sizeof(data) - start; len += 7) {
+			expected = 0x1234;
+
+			for (i = 0; i < len; ++i) {
+				lha_crc16_buf(&expected, data + start + i, 1);
+			}
+
+			crc = 0x1234;
+			lha_crc16_buf(&crc, data + start, len);
+			assert(crc == expected);
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	test_crc16_pass();
 	test_crc16_progressive();
 	test_crc16_fail();
 	test_crc16_empty();
+	test_crc16_large();
 
 	return 0;
 }
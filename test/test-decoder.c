@@ -296,6 +296,82 @@ static void test_progress_feedback(void)
 	}
 }
 
+static void test_stats_for_file(DecoderTestData *file)
+{
+	DecompressState state;
+	LHAStats stats;
+	uint8_t *data;
+	uint8_t buf[64];
+	size_t data_len, x;
+	uint64_t copies;
+	LHADecoder *decoder;
+	unsigned int i;
+
+	read_file_data(file->filename, &data, &data_len);
+
+	decoder = create_decoder(&state, data, data_len,
+	                         file->algorithm, file->len);
+
+	memset(&stats, 0, sizeof(stats));
+	lha_decoder_set_stats(decoder, &stats);
+
+	do {
+		x = lha_decoder_read(decoder, buf, sizeof(buf));
+	} while (x > 0);
+
+	// Input and output counts must match what was actually read.
+
+	assert(stats.bytes_out == file->len);
+	assert(stats.bytes_in == state.pos);
+	assert(stats.input_calls > 0);
+
+	// Decoders for compressed data count literals and copies, and
+	// the Huffman-based ones count their table rebuilds.
+
+	copies = 0;
+
+	for (i = 0; i < LHA_STATS_COPY_LENGTH_BUCKETS; ++i) {
+		copies += stats.copy_lengths[i];
+	}
+
+	if (strcmp(file->algorithm, "-lh0-") != 0
+	 && strcmp(file->algorithm, "-lz4-") != 0
+	 && strcmp(file->algorithm, "-pm0-") != 0) {
+		assert(stats.literals > 0);
+		assert(copies > 0);
+		assert(stats.literals + copies < file->len);
+		assert(stats.copy_lengths[0] == 0);
+	} else {
+		assert(stats.literals == 0 && copies == 0);
+	}
+
+	if (!strcmp(file->algorithm, "-lh5-")
+	 || !strcmp(file->algorithm, "-lh6-")
+	 || !strcmp(file->algorithm, "-lh7-")
+	 || !strcmp(file->algorithm, "-pm2-")) {
+		assert(stats.table_rebuilds > 0);
+	}
+
+	// Collection can be stopped again.
+
+	lha_decoder_set_stats(decoder, NULL);
+	memset(&stats, 0, sizeof(stats));
+	lha_decoder_read(decoder, buf, sizeof(buf));
+	assert(stats.bytes_out == 0);
+
+	lha_decoder_free(decoder);
+	free(data);
+}
+
+static void test_stats(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(files) / sizeof(DecoderTestData); ++i) {
+		test_stats_for_file(&files[i]);
+	}
+}
+
 static void test_invalid_type(void)
 {
 	assert(lha_decoder_for_name("-lzx-") == NULL);
@@ -309,6 +385,7 @@ int main(int argc, char *argv[])
 	test_decompress();
 	test_decompress_truncated();
 	test_progress_feedback();
+	test_stats();
 	test_invalid_type();
 
 	return 0;
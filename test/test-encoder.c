@@ -0,0 +1,566 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "lib/crc16.h"
+#include "lib/lha_decoder.h"
+#include "lib/lha_encoder.h"
+
+// The encoders are tested by compressing data and checking that the
+// decoder for the same algorithm gives back the original data.
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len, data_size;
+	int fail;
+} CompressState;
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len;
+	size_t pos;
+} DecompressState;
+
+// Algorithms for which there is an encoder.
+
+static char *algorithms[] = {
+	"-lh5-", "-lh6-", "-lh7-",
+};
+
+// Uncompressed version of the test data in the compressed/ directory,
+// and the same data compressed by LHA with each algorithm.
+
+#define TEXT_FILENAME "compressed/lh0.bin"
+
+static char *text_compressed[] = {
+	"compressed/lh5.bin", "compressed/lh6.bin", "compressed/lh7.bin",
+};
+
+static void read_file_data(char *filename, uint8_t **data, size_t *len)
+{
+	FILE *fstream;
+
+	fstream = fopen(filename, "rb");
+	assert(fstream != NULL);
+
+	fseek(fstream, 0, SEEK_END);
+	*len = (size_t) ftell(fstream);
+	fseek(fstream, 0, SEEK_SET);
+
+	*data = malloc(*len);
+	assert(*data != NULL);
+
+	assert(fread(*data, 1, *len, fstream) == *len);
+
+	fclose(fstream);
+}
+
+// Callback function used by encoder to write compressed data.
+
+static size_t write_compressed_data(const void *buf, size_t buf_len,
+                                    void *user)
+{
+	CompressState *state = user;
+
+	if (state->fail) {
+		return 0;
+	}
+
+	if (state->data_len + buf_len > state->data_size) {
+		state->data_size = (state->data_len + buf_len) * 2;
+		state->data = realloc(state->data, state->data_size);
+		assert(state->data != NULL);
+	}
+
+	memcpy(state->data + state->data_len, buf, buf_len);
+	state->data_len += buf_len;
+
+	return buf_len;
+}
+
+// Callback function used by decoder to read compressed data.
+
+static size_t read_compressed_data(void *buf, size_t buf_len, void *user)
+{
+	DecompressState *state = user;
+	size_t result;
+
+	result = state->data_len - state->pos;
+
+	if (buf_len < result) {
+		result = buf_len;
+	}
+
+	memcpy(buf, state->data + state->pos, result);
+	state->pos += result;
+
+	return result;
+}
+
+// Compress data, passing it to the encoder chunk_len bytes at a time.
+// Returns the compressed data, which must be freed.
+
+static uint8_t *compress(char *algorithm, uint8_t *data, size_t data_len,
+                         size_t chunk_len, int level,
+                         unsigned int chain_depth, unsigned int threads,
+                         size_t *compressed_len)
+{
+	const LHAEncoderType *etype;
+	LHAEncoder *encoder;
+	CompressState state;
+	uint16_t crc;
+	size_t i, n;
+
+	etype = lha_encoder_for_name(algorithm);
+	assert(etype != NULL);
+
+	state.data = NULL;
+	state.data_len = 0;
+	state.data_size = 0;
+	state.fail = 0;
+
+	encoder = lha_encoder_new(etype, write_compressed_data, &state);
+	assert(encoder != NULL);
+
+	if (level != 0) {
+		lha_encoder_set_level(encoder, level);
+	}
+
+	if (chain_depth > 0) {
+		lha_encoder_set_chain_depth(encoder, chain_depth);
+	}
+
+	if (threads > 1) {
+		assert(lha_encoder_set_threads(encoder, threads));
+	}
+
+	for (i = 0; i < data_len; i += n) {
+		n = data_len - i;
+
+		if (n > chunk_len) {
+			n = chunk_len;
+		}
+
+		assert(lha_encoder_write(encoder, data + i, n));
+	}
+
+	assert(lha_encoder_finish(encoder));
+
+	// Check the CRC and lengths.
+
+	crc = 0;
+	lha_crc16_buf(&crc, data, data_len);
+
+	assert(lha_encoder_get_crc(encoder) == crc);
+	assert(lha_encoder_get_length(encoder) == data_len);
+	assert(lha_encoder_get_compressed_length(encoder) == state.data_len);
+
+	lha_encoder_free(encoder);
+
+	*compressed_len = state.data_len;
+
+	return state.data;
+}
+
+// Decompress data and check it matches the original.
+
+static void check_decompress(char *algorithm, uint8_t *compressed,
+                             size_t compressed_len, uint8_t *data,
+                             size_t data_len)
+{
+	const LHADecoderType *dtype;
+	LHADecoder *decoder;
+	DecompressState state;
+	uint8_t *buf;
+	size_t len;
+
+	state.data = compressed;
+	state.data_len = compressed_len;
+	state.pos = 0;
+
+	dtype = lha_decoder_for_name(algorithm);
+	assert(dtype != NULL);
+
+	decoder = lha_decoder_new(dtype, read_compressed_data, &state,
+	                          data_len);
+	assert(decoder != NULL);
+
+	buf = malloc(data_len + 1);
+	assert(buf != NULL);
+
+	len = lha_decoder_read(decoder, buf, data_len + 1);
+
+	assert(len == data_len);
+	assert(memcmp(buf, data, data_len) == 0);
+
+	// All the compressed data should have been used.
+
+	assert(state.pos == compressed_len);
+
+	free(buf);
+	lha_decoder_free(decoder);
+}
+
+// Compress and decompress data, returning the size of the compressed
+// data.
+
+static size_t round_trip(char *algorithm, uint8_t *data, size_t data_len,
+                         size_t chunk_len, int level,
+                         unsigned int chain_depth)
+{
+	uint8_t *compressed;
+	size_t compressed_len;
+
+	compressed = compress(algorithm, data, data_len, chunk_len,
+	                      level, chain_depth, 1, &compressed_len);
+	check_decompress(algorithm, compressed, compressed_len,
+	                 data, data_len);
+	free(compressed);
+
+	return compressed_len;
+}
+
+// Generate test data. 'kind' selects the type of data.
+
+static uint8_t *generate_data(unsigned int kind, size_t len)
+{
+	static const char *words[] = {
+		"the ", "quick ", "brown ", "fox ", "jumps ", "over ",
+		"lazy ", "dog ", "archive ", "\n", "compress ", "LHA ",
+	};
+	uint8_t *data;
+	uint32_t seed;
+	size_t i, n;
+
+	data = malloc(len + 16);
+	assert(data != NULL);
+
+	seed = 12345;
+
+	for (i = 0; i < len; ) {
+		seed = seed * 1103515245 + 12345;
+
+		switch (kind) {
+			// All zeros.
+			case 0:
+				data[i++] = 0;
+				break;
+
+			// Random, incompressible data.
+			case 1:
+				data[i++] = (uint8_t) (seed >> 16);
+				break;
+
+			// Text made from a small set of words.
+			case 2:
+				n = strlen(words[(seed >> 16) % 12]);
+				memcpy(data + i, words[(seed >> 16) % 12], n);
+				i += n;
+				break;
+
+			// Bytes with very uneven frequencies, so that the
+			// lengths of the codes must be limited.
+			case 4:
+				for (n = 0; n < 24 && (seed & (256 << n)) == 0;
+				     ++n);
+				data[i++] = (uint8_t) n;
+				break;
+
+			// A repeating pattern with a long period, that needs
+			// copies from far back.
+			default:
+				data[i] = (uint8_t) ((i % 7919) * 31);
+				++i;
+				break;
+		}
+	}
+
+	return data;
+}
+
+static void test_generated(void)
+{
+	static const size_t lengths[] = {
+		0, 1, 2, 3, 4, 100, 1000, 70000, 300000,
+	};
+	uint8_t *data;
+	unsigned int kind, i, j;
+
+	for (kind = 0; kind < 5; ++kind) {
+		for (i = 0; i < sizeof(lengths) / sizeof(*lengths); ++i) {
+			data = generate_data(kind, lengths[i]);
+
+			for (j = 0; j < sizeof(algorithms) / sizeof(char *);
+			     ++j) {
+				round_trip(algorithms[j], data, lengths[i],
+				           65536, 0, 0);
+			}
+
+			free(data);
+		}
+	}
+}
+
+// Compress the test text file, and check the compression ratio is
+// reasonable compared to the LHA tool.
+
+static void test_text(void)
+{
+	uint8_t *data, *reference;
+	size_t data_len, reference_len, compressed_len;
+	unsigned int i;
+
+	read_file_data(TEXT_FILENAME, &data, &data_len);
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		read_file_data(text_compressed[i], &reference,
+		               &reference_len);
+
+		compressed_len = round_trip(algorithms[i], data, data_len,
+		                            data_len, 0, 0);
+		assert(compressed_len < reference_len * 105 / 100);
+
+		// Very short chains still work, but compress less well.
+
+		assert(round_trip(algorithms[i], data, data_len, data_len,
+		                  0, 1) > compressed_len);
+
+		free(reference);
+	}
+
+	free(data);
+}
+
+// All compression levels give valid output, and the highest level gives
+// better compression than the lowest. Levels outside the valid range
+// are clamped to it.
+
+static void test_levels(void)
+{
+	uint8_t *data;
+	size_t data_len, lowest, highest;
+	unsigned int i;
+	int level;
+
+	read_file_data(TEXT_FILENAME, &data, &data_len);
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		for (level = LHA_ENCODER_MIN_LEVEL;
+		     level <= LHA_ENCODER_MAX_LEVEL; ++level) {
+			round_trip(algorithms[i], data, data_len, 1000,
+			           level, 0);
+		}
+
+		lowest = round_trip(algorithms[i], data, data_len, data_len,
+		                    LHA_ENCODER_MIN_LEVEL, 0);
+		highest = round_trip(algorithms[i], data, data_len, data_len,
+		                     LHA_ENCODER_MAX_LEVEL, 0);
+
+		assert(highest < lowest);
+
+		// The highest level uses optimal parsing, which should do
+		// better than lazy evaluation at the level below.
+
+		assert(highest < round_trip(algorithms[i], data, data_len,
+		                            data_len,
+		                            LHA_ENCODER_MAX_LEVEL - 1, 0));
+
+		assert(round_trip(algorithms[i], data, data_len, data_len,
+		                  -5, 0) == lowest);
+		assert(round_trip(algorithms[i], data, data_len, data_len,
+		                  100, 0) == highest);
+	}
+
+	free(data);
+}
+
+// Data that changes in character is divided into blocks with different
+// codes, so that it is little larger than the parts compressed
+// separately.
+
+static void test_mixed_data(void)
+{
+	static const unsigned int kinds[] = { 2, 1, 4, 3 };
+	uint8_t *data, *part;
+	size_t part_len, separate_len, mixed_len;
+	unsigned int i, j;
+
+	part_len = 100000;
+	data = malloc(part_len * 4);
+	assert(data != NULL);
+
+	for (i = 0; i < 4; ++i) {
+		part = generate_data(kinds[i], part_len);
+		memcpy(data + part_len * i, part, part_len);
+		free(part);
+	}
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		separate_len = 0;
+
+		for (j = 0; j < 4; ++j) {
+			separate_len += round_trip(algorithms[i],
+			                           data + part_len * j,
+			                           part_len, part_len, 0, 0);
+		}
+
+		mixed_len = round_trip(algorithms[i], data, part_len * 4,
+		                       65536, 0, 0);
+		assert(mixed_len < separate_len * 101 / 100);
+
+		round_trip(algorithms[i], data, part_len * 4, 65536,
+		           LHA_ENCODER_MAX_LEVEL, 0);
+	}
+
+	free(data);
+}
+
+// The compressed data must not depend on how the input is divided up
+// between calls to lha_encoder_write().
+
+static void check_chunked_writes(char *algorithm, int level,
+                                 uint8_t *data, size_t data_len)
+{
+	static const size_t chunk_lens[] = { 1, 7, 255, 4096, 100000 };
+	uint8_t *expected, *compressed;
+	size_t expected_len, compressed_len;
+	unsigned int i;
+
+	expected = compress(algorithm, data, data_len, data_len,
+	                    level, 0, 1, &expected_len);
+
+	for (i = 0; i < sizeof(chunk_lens) / sizeof(size_t); ++i) {
+		compressed = compress(algorithm, data, data_len,
+		                      chunk_lens[i], level, 0, 1,
+		                      &compressed_len);
+
+		assert(compressed_len == expected_len);
+		assert(memcmp(compressed, expected, expected_len) == 0);
+
+		free(compressed);
+	}
+
+	free(expected);
+}
+
+static void test_chunked_writes(void)
+{
+	uint8_t *data;
+	size_t data_len;
+	unsigned int i;
+
+	data_len = 200000;
+	data = generate_data(2, data_len);
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		check_chunked_writes(algorithms[i], 0, data, data_len);
+		check_chunked_writes(algorithms[i], LHA_ENCODER_MAX_LEVEL,
+		                     data, data_len);
+	}
+
+	free(data);
+}
+
+// With more than one thread, the data is compressed in chunks. The
+// result must not depend on the number of threads, and should be
+// little larger than when compressed with one.
+
+static void test_threads(void)
+{
+	uint8_t *data, *expected, *compressed;
+	size_t data_len, serial_len, expected_len, compressed_len;
+	unsigned int i;
+
+	data_len = 2500000;
+	data = generate_data(2, data_len);
+
+	for (i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+		free(compress(algorithms[i], data, data_len, 65536,
+		              0, 0, 1, &serial_len));
+
+		expected = compress(algorithms[i], data, data_len, 65536,
+		                    0, 0, 2, &expected_len);
+		check_decompress(algorithms[i], expected, expected_len,
+		                 data, data_len);
+		assert(expected_len < serial_len * 101 / 100);
+
+		compressed = compress(algorithms[i], data, data_len, 100000,
+		                      0, 0, 3, &compressed_len);
+		assert(compressed_len == expected_len);
+		assert(memcmp(compressed, expected, expected_len) == 0);
+
+		free(compressed);
+		free(expected);
+	}
+
+	free(data);
+}
+
+// Errors from the callback are reported by the encoder.
+
+static void test_write_failure(void)
+{
+	LHAEncoder *encoder;
+	CompressState state;
+	uint8_t *data;
+
+	data = generate_data(1, 100000);
+
+	state.data = NULL;
+	state.data_len = 0;
+	state.data_size = 0;
+	state.fail = 1;
+
+	encoder = lha_encoder_new(lha_encoder_for_name("-lh5-"),
+	                          write_compressed_data, &state);
+	assert(encoder != NULL);
+
+	lha_encoder_write(encoder, data, 100000);
+	assert(!lha_encoder_finish(encoder));
+
+	lha_encoder_free(encoder);
+	free(data);
+}
+
+static void test_invalid_type(void)
+{
+	assert(lha_encoder_for_name("-lh1-") == NULL);
+	assert(lha_encoder_for_name("-lzx-") == NULL);
+	assert(lha_encoder_for_name("") == NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	test_generated();
+	test_text();
+	test_levels();
+	test_mixed_data();
+	test_chunked_writes();
+	test_threads();
+	test_write_failure();
+	test_invalid_type();
+
+	return 0;
+}
@@ -0,0 +1,1140 @@
+/*
+
+Copyright (c) 2026, Simon Howard
+
+Permission to use, copy, modify, and/or distribute this software
+for any purpose with or without fee is hereby granted, provided
+that the above copyright notice and this permission notice appear
+in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "lib/crc16.h"
+#include "lib/public/lha_reader.h"
+#include "lib/public/lha_writer.h"
+
+// Archives are written to memory, and read back with LHAReader.
+
+typedef struct {
+	uint8_t *data;
+	size_t data_len, data_size, pos;
+	int seekable, fail;
+} MemoryStream;
+
+// A file to add to an archive.
+
+typedef struct {
+	char *compress_method;
+	char *path, *filename, *symlink_target;
+	unsigned int data_kind;
+	size_t data_len;
+	unsigned int extra_flags;
+} TestFile;
+
+static const TestFile test_files[] = {
+	{ "-lh5-", "dir/sub/", "text.txt", NULL, 0, 200000,
+	  LHA_FILE_UNIX_PERMS | LHA_FILE_UNIX_UID_GID },
+	{ "-lh7-", NULL, "random.bin", NULL, 1, 100000,
+	  LHA_FILE_WINDOWS_TIMESTAMPS },
+	{ "-lh0-", "dir/", "stored.bin", NULL, 0, 50000,
+	  LHA_FILE_UNIX_PERMS },
+	{ "-lh6-", NULL, "empty", NULL, 0, 0, 0 },
+	{ "-lhd-", "dir/sub/", NULL, NULL, 0, 0, LHA_FILE_UNIX_PERMS },
+	{ "-lhd-", "dir/", "link", "sub/text.txt", 0, 0, 0 },
+};
+
+#define NUM_TEST_FILES (sizeof(test_files) / sizeof(*test_files))
+
+static int memory_write(void *handle, const void *buf, size_t buf_len)
+{
+	MemoryStream *stream = handle;
+
+	if (stream->fail) {
+		return 0;
+	}
+
+	if (stream->pos + buf_len > stream->data_size) {
+		stream->data_size = (stream->pos + buf_len) * 2;
+		stream->data = realloc(stream->data, stream->data_size);
+		assert(stream->data != NULL);
+	}
+
+	memcpy(stream->data + stream->pos, buf, buf_len);
+	stream->pos += buf_len;
+
+	if (stream->pos > stream->data_len) {
+		stream->data_len = stream->pos;
+	}
+
+	return 1;
+}
+
+static int memory_seek(void *handle, int64_t offset)
+{
+	MemoryStream *stream = handle;
+
+	if (!stream->seekable
+	 || (int64_t) stream->pos + offset < 0
+	 || (int64_t) stream->pos + offset > (int64_t) stream->data_len) {
+		return 0;
+	}
+
+	stream->pos = (size_t) ((int64_t) stream->pos + offset);
+
+	return 1;
+}
+
+static const LHAOutputStreamType memory_output = {
+	memory_write,
+	memory_seek,
+	NULL
+};
+
+static int memory_read(void *handle, void *buf, size_t buf_len)
+{
+	MemoryStream *stream = handle;
+
+	if (buf_len > stream->data_len - stream->pos) {
+		buf_len = stream->data_len - stream->pos;
+	}
+
+	memcpy(buf, stream->data + stream->pos, buf_len);
+	stream->pos += buf_len;
+
+	return (int) buf_len;
+}
+
+static const LHAInputStreamType memory_input = {
+	memory_read,
+	NULL,
+	NULL
+};
+
+// Generate the contents of a test file: text, or random data.
+
+static uint8_t *generate_data(unsigned int kind, size_t len)
+{
+	static const char *words[] = {
+		"archive ", "header ", "level ", "two ", "\n", "lhasa ",
+	};
+	uint8_t *data;
+	uint32_t seed;
+	size_t i, n;
+
+	data = malloc(len + 16);
+	assert(data != NULL);
+
+	seed = 4321;
+
+	for (i = 0; i < len; ) {
+		seed = seed * 1103515245 + 12345;
+
+		if (kind == 0) {
+			n = strlen(words[(seed >> 16) % 6]);
+			memcpy(data + i, words[(seed >> 16) % 6], n);
+			i += n;
+		} else {
+			data[i++] = (uint8_t) (seed >> 16);
+		}
+	}
+
+	return data;
+}
+
+static void init_header(LHAFileHeader *header, const TestFile *file,
+                        unsigned int i)
+{
+	memset(header, 0, sizeof(LHAFileHeader));
+	memcpy(header->compress_method, file->compress_method, 6);
+	header->path = file->path;
+	header->filename = file->filename;
+	header->symlink_target = file->symlink_target;
+	header->os_type = LHA_OS_TYPE_UNIX;
+	header->timestamp = 1300000000 + i;
+	header->extra_flags = file->extra_flags;
+	header->unix_perms = 0100640 + i;
+	header->unix_uid = 1000 + i;
+	header->unix_gid = 100 + i;
+	header->win_creation_time = 0x01d0000000000000ULL + i;
+	header->win_modification_time = 0x01d0000000000001ULL + i;
+	header->win_access_time = 0x01d0000000000002ULL + i;
+
+	// Values that are ignored by the writer:
+
+	header->length = 12345;
+	header->crc = 0x1234;
+}
+
+// Called as each file is written, to check that the test files are
+// written in order.
+
+static void written_callback(LHAFileHeader *header, int success,
+                             void *user_data)
+{
+	unsigned int *count = user_data;
+	const TestFile *file;
+
+	assert(*count < NUM_TEST_FILES);
+	file = &test_files[*count];
+
+	assert(success);
+	assert(!strcmp(header->compress_method, file->compress_method));
+	assert(header->length == file->data_len);
+	++*count;
+}
+
+// Write the test files to an archive, in memory.
+
+static void write_archive(MemoryStream *stream, int seekable,
+                          size_t buffer_size, unsigned int jobs)
+{
+	LHAOutputStream *output;
+	LHAWriter *writer;
+	LHAFileHeader header;
+	uint8_t *data;
+	unsigned int i, written;
+	size_t j, n;
+
+	memset(stream, 0, sizeof(MemoryStream));
+	stream->seekable = seekable;
+
+	output = lha_output_stream_new(&memory_output, stream);
+	assert(output != NULL);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+
+	assert(lha_writer_curr_file(writer) == NULL);
+
+	// Use the methods given, even for random data, so that each of
+	// the encoders is tested.
+
+	lha_writer_set_auto_store(writer, 0);
+
+	if (buffer_size > 0) {
+		lha_writer_set_buffer_size(writer, buffer_size);
+	}
+
+	written = 0;
+	lha_writer_set_jobs(writer, jobs);
+	lha_writer_set_callback(writer, written_callback, &written);
+
+	for (i = 0; i < NUM_TEST_FILES; ++i) {
+		init_header(&header, &test_files[i], i);
+		assert(lha_writer_add_file(writer, &header));
+
+		data = generate_data(test_files[i].data_kind,
+		                     test_files[i].data_len);
+
+		for (j = 0; j < test_files[i].data_len; j += n) {
+			n = test_files[i].data_len - j;
+
+			if (n > 10000) {
+				n = 10000;
+			}
+
+			assert(lha_writer_write(writer, data + j, n));
+		}
+
+		free(data);
+
+		// Directories cannot contain data.
+
+		if (!strcmp(test_files[i].compress_method, "-lhd-")) {
+			assert(!lha_writer_write(writer, "x", 1));
+		}
+
+		assert(lha_writer_curr_file(writer) != NULL);
+	}
+
+	assert(lha_writer_finish(writer));
+	assert(written == NUM_TEST_FILES);
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+}
+
+// Read back an archive written by write_archive(), and check that it
+// contains the test files. Returns the number of headers with the
+// 64-bit file sizes header.
+
+static unsigned int check_archive(MemoryStream *stream)
+{
+	LHAInputStream *input;
+	LHAReader *reader;
+	LHAFileHeader *header;
+	const TestFile *file;
+	uint8_t *data, *buf;
+	unsigned int i, num_64bit;
+
+	stream->pos = 0;
+	input = lha_input_stream_new(&memory_input, stream);
+	assert(input != NULL);
+	reader = lha_reader_new(input);
+	assert(reader != NULL);
+
+	num_64bit = 0;
+
+	for (i = 0; i < NUM_TEST_FILES; ++i) {
+		file = &test_files[i];
+		header = lha_reader_next_file(reader);
+		assert(header != NULL);
+
+		assert(header->header_level == 2);
+		assert(!strcmp(header->compress_method,
+		               file->compress_method));
+		assert(header->os_type == LHA_OS_TYPE_UNIX);
+		assert(header->timestamp == 1300000000 + i);
+		assert(LHA_FILE_HAVE_EXTRA(header, LHA_FILE_COMMON_CRC));
+		assert(header->length == file->data_len);
+
+		if (file->path == NULL) {
+			assert(header->path == NULL);
+		} else {
+			assert(!strcmp(header->path, file->path));
+		}
+
+		if (file->filename == NULL) {
+			assert(header->filename == NULL);
+		} else {
+			assert(!strcmp(header->filename, file->filename));
+		}
+
+		if (file->symlink_target == NULL) {
+			assert(header->symlink_target == NULL);
+		} else {
+			assert(!strcmp(header->symlink_target,
+			               file->symlink_target));
+			assert(header->unix_perms == 0120777);
+		}
+
+		if ((file->extra_flags & LHA_FILE_UNIX_PERMS) != 0) {
+			assert(header->unix_perms == 0100640 + i);
+		}
+
+		if ((file->extra_flags & LHA_FILE_UNIX_UID_GID) != 0) {
+			assert(LHA_FILE_HAVE_EXTRA(header,
+			                           LHA_FILE_UNIX_UID_GID));
+			assert(header->unix_uid == 1000 + i);
+			assert(header->unix_gid == 100 + i);
+		} else {
+			assert(!LHA_FILE_HAVE_EXTRA(header,
+			                            LHA_FILE_UNIX_UID_GID));
+		}
+
+		if ((file->extra_flags & LHA_FILE_WINDOWS_TIMESTAMPS) != 0) {
+			assert(header->win_creation_time
+			       == 0x01d0000000000000ULL + i);
+			assert(header->win_modification_time
+			       == 0x01d0000000000001ULL + i);
+			assert(header->win_access_time
+			       == 0x01d0000000000002ULL + i);
+		}
+
+		if (LHA_FILE_HAVE_EXTRA(header, LHA_FILE_64BIT_SIZES)) {
+			++num_64bit;
+		}
+
+		// Check the contents; lha_reader_check() checks the CRC.
+
+		data = generate_data(file->data_kind, file->data_len);
+		buf = malloc(file->data_len + 1);
+		assert(buf != NULL);
+
+		assert(lha_reader_read(reader, buf, file->data_len + 1)
+		       == file->data_len);
+		assert(memcmp(buf, data, file->data_len) == 0);
+
+		free(buf);
+		free(data);
+	}
+
+	assert(lha_reader_next_file(reader) == NULL);
+
+	// The end of the archive is marked with a single zero byte.
+
+	assert(stream->data[stream->data_len - 1] == 0);
+
+	lha_reader_free(reader);
+	lha_input_stream_free(input);
+
+	return num_64bit;
+}
+
+static void test_write_read(void)
+{
+	MemoryStream buffered, seekable, spilled, unseekable, jobs;
+
+	// With the default buffer size, the archive is the same whether
+	// or not the stream can seek.
+
+	write_archive(&buffered, 0, 0, 1);
+	assert(check_archive(&buffered) == 0);
+
+	write_archive(&seekable, 1, 0, 1);
+	assert(seekable.data_len == buffered.data_len);
+	assert(memcmp(seekable.data, buffered.data,
+	              buffered.data_len) == 0);
+
+	// With a small buffer, the headers are written before the data
+	// of the larger files, and filled in afterwards. These headers
+	// include the 64-bit file sizes.
+
+	write_archive(&spilled, 1, 1000, 1);
+	assert(check_archive(&spilled) == 3);
+
+	// If the stream cannot seek, the limit has no effect.
+
+	write_archive(&unseekable, 0, 1000, 1);
+	assert(unseekable.data_len == buffered.data_len);
+	assert(memcmp(unseekable.data, buffered.data,
+	              buffered.data_len) == 0);
+
+	// Nor does it when files are compressed as jobs, as the whole
+	// of each file is held in memory.
+
+	write_archive(&jobs, 1, 1000, 4);
+	assert(jobs.data_len == buffered.data_len);
+	assert(memcmp(jobs.data, buffered.data, buffered.data_len) == 0);
+
+	free(buffered.data);
+	free(seekable.data);
+	free(spilled.data);
+	free(unseekable.data);
+	free(jobs.data);
+}
+
+// Headers of all lengths can be read back: a byte of padding is added
+// to headers whose length has a low byte of zero.
+
+static void test_header_lengths(void)
+{
+	LHAOutputStream *output;
+	LHAInputStream *input;
+	LHAWriter *writer;
+	LHAReader *reader;
+	LHAFileHeader header, *read_header;
+	MemoryStream stream;
+	char filename[300];
+	unsigned int i;
+
+	for (i = 1; i < sizeof(filename); ++i) {
+		memset(&stream, 0, sizeof(stream));
+		output = lha_output_stream_new(&memory_output, &stream);
+		writer = lha_writer_new(output);
+		assert(writer != NULL);
+
+		memset(filename, 'a', i);
+		filename[i] = '\0';
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.compress_method, "-lh0-", 6);
+		header.filename = filename;
+
+		assert(lha_writer_add_file(writer, &header));
+		assert(lha_writer_finish(writer));
+		assert((stream.data[0] & 0xff) != 0);
+
+		lha_writer_free(writer);
+		lha_output_stream_free(output);
+
+		stream.pos = 0;
+		input = lha_input_stream_new(&memory_input, &stream);
+		reader = lha_reader_new(input);
+		read_header = lha_reader_next_file(reader);
+		assert(read_header != NULL);
+		assert(!strcmp(read_header->filename, filename));
+		assert(lha_reader_next_file(reader) == NULL);
+
+		lha_reader_free(reader);
+		lha_input_stream_free(input);
+		free(stream.data);
+	}
+}
+
+static void test_invalid(void)
+{
+	LHAOutputStream *output;
+	LHAWriter *writer;
+	LHAFileHeader header;
+	MemoryStream stream;
+
+	memset(&stream, 0, sizeof(stream));
+	output = lha_output_stream_new(&memory_output, &stream);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+
+	// No file to write data to.
+
+	assert(!lha_writer_write(writer, "x", 1));
+	assert(!lha_writer_end_file(writer));
+
+	// Methods without an encoder, and missing names.
+
+	memset(&header, 0, sizeof(header));
+	header.filename = "file";
+	memcpy(header.compress_method, "-lh1-", 6);
+	assert(!lha_writer_add_file(writer, &header));
+	memcpy(header.compress_method, "-xyz-", 6);
+	assert(!lha_writer_add_file(writer, &header));
+
+	memcpy(header.compress_method, "-lh5-", 6);
+	header.filename = NULL;
+	assert(!lha_writer_add_file(writer, &header));
+
+	memcpy(header.compress_method, "-lhd-", 6);
+	assert(!lha_writer_add_file(writer, &header));
+
+	assert(lha_writer_finish(writer));
+	assert(stream.data_len == 1);
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+	free(stream.data);
+}
+
+static void failed_callback(LHAFileHeader *header, int success,
+                            void *user_data)
+{
+	unsigned int *count = user_data;
+
+	assert(!success);
+	++*count;
+}
+
+// Errors writing to the output stream are reported.
+
+static void test_write_failure(void)
+{
+	LHAOutputStream *output;
+	LHAWriter *writer;
+	LHAFileHeader header;
+	MemoryStream stream;
+	unsigned int failed;
+	uint8_t *data;
+
+	data = generate_data(1, 100000);
+
+	memset(&stream, 0, sizeof(stream));
+	stream.fail = 1;
+	output = lha_output_stream_new(&memory_output, &stream);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+
+	memset(&header, 0, sizeof(header));
+	header.filename = "file";
+	memcpy(header.compress_method, "-lh5-", 6);
+
+	assert(lha_writer_add_file(writer, &header));
+	lha_writer_write(writer, data, 100000);
+	assert(!lha_writer_end_file(writer));
+	assert(!lha_writer_add_file(writer, &header));
+	assert(!lha_writer_finish(writer));
+
+	lha_writer_free(writer);
+
+	// When files are compressed as jobs, the error is found when the
+	// first file is written, and reported for each file.
+
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+	lha_writer_set_jobs(writer, 2);
+	failed = 0;
+	lha_writer_set_callback(writer, failed_callback, &failed);
+
+	assert(lha_writer_add_file(writer, &header));
+	assert(lha_writer_write(writer, data, 100000));
+	assert(lha_writer_add_file(writer, &header));
+	assert(lha_writer_write(writer, data, 100000));
+	assert(!lha_writer_finish(writer));
+	assert(failed == 2);
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+	free(data);
+}
+
+// Write a single file with the given contents, and return the
+// compression method that was used for it.
+
+static const char *auto_store_method(const uint8_t *data, size_t len,
+                                     int auto_store)
+{
+	static char method[6];
+	LHAOutputStream *output;
+	LHAInputStream *input;
+	LHAWriter *writer;
+	LHAReader *reader;
+	LHAFileHeader header, *read_header;
+	MemoryStream stream;
+	uint8_t *buf;
+	size_t i, n;
+
+	memset(&stream, 0, sizeof(stream));
+	output = lha_output_stream_new(&memory_output, &stream);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+	lha_writer_set_auto_store(writer, auto_store);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.compress_method, "-lh5-", 6);
+	header.filename = "file";
+	assert(lha_writer_add_file(writer, &header));
+
+	for (i = 0; i < len; i += n) {
+		n = len - i < 5000 ? len - i : 5000;
+		assert(lha_writer_write(writer, data + i, n));
+	}
+
+	assert(lha_writer_end_file(writer));
+	memcpy(method, lha_writer_curr_file(writer)->compress_method, 6);
+	assert(lha_writer_finish(writer));
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+
+	// Whatever the method, the file can be read back.
+
+	stream.pos = 0;
+	input = lha_input_stream_new(&memory_input, &stream);
+	reader = lha_reader_new(input);
+	read_header = lha_reader_next_file(reader);
+	assert(read_header != NULL);
+	assert(!strcmp(read_header->compress_method, method));
+	assert(read_header->length == len);
+
+	if (!strcmp(method, "-lh0-")) {
+		assert(read_header->compressed_length == len);
+	}
+
+	buf = malloc(len + 1);
+	assert(buf != NULL);
+	assert(lha_reader_read(reader, buf, len + 1) == len);
+	assert(memcmp(buf, data, len) == 0);
+
+	lha_reader_free(reader);
+	lha_input_stream_free(input);
+	free(stream.data);
+	free(buf);
+
+	return method;
+}
+
+// Data that cannot be compressed is stored instead.
+
+static void test_auto_store(void)
+{
+	uint8_t *text, *random, *repeated;
+	size_t i;
+
+	text = generate_data(0, 300000);
+	random = generate_data(1, 300000);
+
+	// Random data with long repeats can be compressed, even though
+	// its bytes are evenly distributed.
+
+	repeated = malloc(300000);
+	assert(repeated != NULL);
+
+	for (i = 0; i < 300000; ++i) {
+		repeated[i] = random[i % 3000];
+	}
+
+	assert(!strcmp(auto_store_method(text, 300000, 1), "-lh5-"));
+	assert(!strcmp(auto_store_method(random, 300000, 1), "-lh0-"));
+	assert(!strcmp(auto_store_method(random, 300000, 0), "-lh5-"));
+	assert(!strcmp(auto_store_method(repeated, 300000, 1), "-lh5-"));
+
+	// Files that fit within the sample are compressed and checked.
+
+	assert(!strcmp(auto_store_method(text, 1000, 1), "-lh5-"));
+	assert(!strcmp(auto_store_method(random, 1000, 1), "-lh0-"));
+	assert(!strcmp(auto_store_method(random, 70000, 1), "-lh0-"));
+	assert(!strcmp(auto_store_method(random, 2, 1), "-lh0-"));
+	assert(!strcmp(auto_store_method(text, 0, 1), "-lh0-"));
+	assert(!strcmp(auto_store_method(text, 0, 0), "-lh5-"));
+
+	free(text);
+	free(random);
+	free(repeated);
+}
+
+// Files used to test the detection of duplicates: some are the same,
+// some have the same length and CRC without being the same.
+
+#define DEDUP_FILE_LEN   20000
+#define NUM_DEDUP_FILES  6
+
+static uint8_t *dedup_files[NUM_DEDUP_FILES];
+
+static void make_dedup_files(void)
+{
+	uint8_t *text, *random;
+	uint16_t crc, prefix_crc, want_crc;
+	unsigned int i;
+
+	text = generate_data(0, DEDUP_FILE_LEN);
+	random = generate_data(1, DEDUP_FILE_LEN);
+
+	for (i = 0; i < NUM_DEDUP_FILES; ++i) {
+		dedup_files[i] = malloc(DEDUP_FILE_LEN);
+		assert(dedup_files[i] != NULL);
+	}
+
+	memcpy(dedup_files[0], text, DEDUP_FILE_LEN);
+	memcpy(dedup_files[1], random, DEDUP_FILE_LEN);
+	memcpy(dedup_files[2], text, DEDUP_FILE_LEN);
+	memcpy(dedup_files[3], random, DEDUP_FILE_LEN);
+
+	// The last two bytes of this one are chosen to give the same
+	// CRC as the text file, though it is different.
+
+	memcpy(dedup_files[4], text, DEDUP_FILE_LEN);
+	dedup_files[4][0] = 'x';
+
+	want_crc = 0;
+	lha_crc16_buf(&want_crc, text, DEDUP_FILE_LEN);
+	prefix_crc = 0;
+	lha_crc16_buf(&prefix_crc, dedup_files[4], DEDUP_FILE_LEN - 2);
+
+	for (i = 0; i < 0x10000; ++i) {
+		dedup_files[4][DEDUP_FILE_LEN - 2] = (uint8_t) (i & 0xff);
+		dedup_files[4][DEDUP_FILE_LEN - 1] = (uint8_t) (i >> 8);
+		crc = prefix_crc;
+		lha_crc16_buf(&crc, dedup_files[4] + DEDUP_FILE_LEN - 2, 2);
+
+		if (crc == want_crc) {
+			break;
+		}
+	}
+
+	assert(i < 0x10000);
+
+	memcpy(dedup_files[5], text, DEDUP_FILE_LEN);
+
+	free(text);
+	free(random);
+}
+
+// Write the files to an archive, with the last one written at a
+// different level.
+
+static void write_dedup_archive(MemoryStream *stream, size_t dedup_size,
+                                unsigned int jobs)
+{
+	LHAOutputStream *output;
+	LHAWriter *writer;
+	LHAFileHeader header;
+	unsigned int i;
+
+	memset(stream, 0, sizeof(MemoryStream));
+	output = lha_output_stream_new(&memory_output, stream);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+	lha_writer_set_dedup_size(writer, dedup_size);
+	lha_writer_set_jobs(writer, jobs);
+
+	for (i = 0; i < NUM_DEDUP_FILES; ++i) {
+		if (i == NUM_DEDUP_FILES - 1) {
+			lha_writer_set_level(writer, 1);
+		}
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.compress_method, "-lh5-", 6);
+		header.filename = "file";
+		assert(lha_writer_add_file(writer, &header));
+		assert(lha_writer_write(writer, dedup_files[i],
+		                        DEDUP_FILE_LEN / 2));
+		assert(lha_writer_write(writer,
+		                        dedup_files[i] + DEDUP_FILE_LEN / 2,
+		                        DEDUP_FILE_LEN / 2));
+	}
+
+	assert(lha_writer_finish(writer));
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+}
+
+// Read back an archive written by write_dedup_archive(), returning the
+// compressed lengths of the files.
+
+static void check_dedup_archive(MemoryStream *stream, size_t *lengths)
+{
+	LHAInputStream *input;
+	LHAReader *reader;
+	LHAFileHeader *header;
+	uint8_t buf[DEDUP_FILE_LEN + 1];
+	unsigned int i;
+
+	stream->pos = 0;
+	input = lha_input_stream_new(&memory_input, stream);
+	reader = lha_reader_new(input);
+	assert(reader != NULL);
+
+	for (i = 0; i < NUM_DEDUP_FILES; ++i) {
+		header = lha_reader_next_file(reader);
+		assert(header != NULL);
+		lengths[i] = header->compressed_length;
+		assert(lha_reader_read(reader, buf, sizeof(buf))
+		       == DEDUP_FILE_LEN);
+		assert(memcmp(buf, dedup_files[i], DEDUP_FILE_LEN) == 0);
+	}
+
+	assert(lha_reader_next_file(reader) == NULL);
+
+	lha_reader_free(reader);
+	lha_input_stream_free(input);
+}
+
+// Duplicate files reuse the data of earlier files, giving exactly the
+// same archive as compressing them again.
+
+static void test_dedup(void)
+{
+	MemoryStream with_dedup, without_dedup, small_cache, jobs;
+	MemoryStream pending_jobs;
+	size_t lengths[NUM_DEDUP_FILES];
+	unsigned int i;
+
+	make_dedup_files();
+
+	write_dedup_archive(&with_dedup, LHA_WRITER_DEFAULT_DEDUP_SIZE, 1);
+	write_dedup_archive(&without_dedup, 0, 1);
+	write_dedup_archive(&small_cache, 100, 1);
+
+	// With two jobs, the first file has been written by the time
+	// the third ends, so it is found in the cache. With more, it is
+	// still being compressed, and the third waits for it.
+
+	write_dedup_archive(&jobs, LHA_WRITER_DEFAULT_DEDUP_SIZE, 2);
+	write_dedup_archive(&pending_jobs, LHA_WRITER_DEFAULT_DEDUP_SIZE, 8);
+
+	check_dedup_archive(&with_dedup, lengths);
+	assert(lengths[2] == lengths[0]);
+	assert(lengths[3] == DEDUP_FILE_LEN);
+	assert(lengths[5] != lengths[0]);
+
+	assert(with_dedup.data_len == without_dedup.data_len);
+	assert(memcmp(with_dedup.data, without_dedup.data,
+	              with_dedup.data_len) == 0);
+
+	assert(small_cache.data_len == without_dedup.data_len);
+	assert(memcmp(small_cache.data, without_dedup.data,
+	              small_cache.data_len) == 0);
+
+	assert(jobs.data_len == without_dedup.data_len);
+	assert(memcmp(jobs.data, without_dedup.data,
+	              jobs.data_len) == 0);
+
+	assert(pending_jobs.data_len == without_dedup.data_len);
+	assert(memcmp(pending_jobs.data, without_dedup.data,
+	              pending_jobs.data_len) == 0);
+
+	free(with_dedup.data);
+	free(without_dedup.data);
+	free(small_cache.data);
+	free(jobs.data);
+	free(pending_jobs.data);
+
+	for (i = 0; i < NUM_DEDUP_FILES; ++i) {
+		free(dedup_files[i]);
+	}
+}
+
+// Length of a file too large to be compressed as a job.
+
+#define LARGE_FILE_LEN  (9 * 1024 * 1024)
+
+static void count_callback(LHAFileHeader *header, int success,
+                           void *user_data)
+{
+	unsigned int *count = user_data;
+
+	assert(success);
+	assert(header->length == (*count == 1 ? LARGE_FILE_LEN
+	                                      : 1000 + *count));
+	++*count;
+}
+
+// Write an archive containing a large file between two small ones.
+
+static void write_large_archive(MemoryStream *stream, uint8_t *large,
+                                unsigned int jobs)
+{
+	static const char *filenames[] = { "a", "large", "c" };
+	LHAOutputStream *output;
+	LHAWriter *writer;
+	LHAFileHeader header;
+	unsigned int i, written;
+	size_t j;
+
+	memset(stream, 0, sizeof(MemoryStream));
+	output = lha_output_stream_new(&memory_output, stream);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+	lha_writer_set_jobs(writer, jobs);
+
+	written = 0;
+	lha_writer_set_callback(writer, count_callback, &written);
+
+	for (i = 0; i < 3; ++i) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.compress_method, "-lh5-", 6);
+		header.filename = (char *) filenames[i];
+		assert(lha_writer_add_file(writer, &header));
+
+		if (i == 1) {
+			for (j = 0; j < LARGE_FILE_LEN; j += 1024 * 1024) {
+				assert(lha_writer_write(writer, large + j,
+				                        1024 * 1024));
+			}
+		} else {
+			assert(lha_writer_write(writer, large, 1000 + i));
+		}
+	}
+
+	assert(lha_writer_finish(writer));
+	assert(written == 3);
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+}
+
+// A file too large to be compressed as a job is written in order after
+// the jobs before it have finished.
+
+static void test_large_job(void)
+{
+	MemoryStream single, jobs;
+	uint8_t *large;
+
+	// Random data is stored rather than compressed, which keeps this
+	// quick.
+
+	large = generate_data(1, LARGE_FILE_LEN);
+
+	write_large_archive(&single, large, 1);
+	write_large_archive(&jobs, large, 4);
+
+	assert(jobs.data_len == single.data_len);
+	assert(memcmp(jobs.data, single.data, single.data_len) == 0);
+
+	free(large);
+	free(single.data);
+	free(jobs.data);
+}
+
+// Temporary file used to test adding files to an existing archive.
+
+#define APPEND_FILENAME "test-writer-append.lzh"
+
+// Copy a file to APPEND_FILENAME, adding some extra data to the end.
+
+static void copy_file(const char *filename, const char *extra,
+                      size_t extra_len)
+{
+	FILE *in, *out;
+	uint8_t buf[4096];
+	size_t n;
+
+	in = fopen(filename, "rb");
+	assert(in != NULL);
+	out = fopen(APPEND_FILENAME, "wb");
+	assert(out != NULL);
+
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		assert(fwrite(buf, 1, n, out) == n);
+	}
+
+	assert(fwrite(extra, 1, extra_len, out) == extra_len);
+
+	fclose(in);
+	fclose(out);
+}
+
+// Write APPEND_FILENAME with the given contents.
+
+static void write_file(const char *data, size_t data_len)
+{
+	FILE *out;
+
+	out = fopen(APPEND_FILENAME, "wb");
+	assert(out != NULL);
+	assert(fwrite(data, 1, data_len, out) == data_len);
+	fclose(out);
+}
+
+static long file_size(const char *filename)
+{
+	FILE *fstream;
+	long result;
+
+	fstream = fopen(filename, "rb");
+	assert(fstream != NULL);
+	assert(fseek(fstream, 0, SEEK_END) == 0);
+	result = ftell(fstream);
+	fclose(fstream);
+
+	return result;
+}
+
+// Read an archive, checking the contents of every file, and return the
+// number of files in it.
+
+static unsigned int check_file_archive(const char *filename)
+{
+	LHAInputStream *input;
+	LHAReader *reader;
+	unsigned int result;
+
+	input = lha_input_stream_from((char *) filename);
+	assert(input != NULL);
+	reader = lha_reader_new(input);
+	assert(reader != NULL);
+
+	result = 0;
+
+	while (lha_reader_next_file(reader) != NULL) {
+		assert(lha_reader_check(reader, NULL, NULL));
+		++result;
+	}
+
+	lha_reader_free(reader);
+	lha_input_stream_free(input);
+
+	return result;
+}
+
+// Add some files to APPEND_FILENAME.
+
+static void append_files(unsigned int num_files)
+{
+	LHAOutputStream *output;
+	LHAWriter *writer;
+	LHAFileHeader header;
+	uint8_t *data;
+	unsigned int i;
+
+	output = lha_output_stream_append_to(APPEND_FILENAME);
+	assert(output != NULL);
+	writer = lha_writer_new(output);
+	assert(writer != NULL);
+
+	data = generate_data(0, 50000);
+
+	for (i = 0; i < num_files; ++i) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.compress_method, "-lh5-", 6);
+		header.filename = "appended.txt";
+		assert(lha_writer_add_file(writer, &header));
+		assert(lha_writer_write(writer, data, 50000 - i));
+	}
+
+	assert(lha_writer_finish(writer));
+
+	lha_writer_free(writer);
+	lha_output_stream_free(output);
+	free(data);
+}
+
+// Files can be added to an existing archive.
+
+static void test_append(void)
+{
+	unsigned int num_files;
+	char data[50], archive[100];
+	FILE *fstream;
+	long size;
+	size_t n;
+
+	// Add to an archive created by another program, twice, and to
+	// one in a self-extractor.
+
+	copy_file("archives/lha213/lh5.lzh", "", 0);
+	num_files = check_file_archive(APPEND_FILENAME);
+	append_files(2);
+	assert(check_file_archive(APPEND_FILENAME) == num_files + 2);
+	append_files(1);
+	assert(check_file_archive(APPEND_FILENAME) == num_files + 3);
+
+	copy_file("archives/lha213/sfx.exe", "", 0);
+	num_files = check_file_archive(APPEND_FILENAME);
+	append_files(1);
+	assert(check_file_archive(APPEND_FILENAME) == num_files + 1);
+
+	// Anything after the end of the archive is discarded.
+
+	copy_file("archives/lha213/lh5.lzh", "trailing data", 13);
+	size = file_size(APPEND_FILENAME);
+	append_files(0);
+	assert(file_size(APPEND_FILENAME) == size - 13);
+
+	// An empty file becomes an archive, as does an archive with no
+	// files, which is just the end marker.
+
+	fclose(fopen(APPEND_FILENAME, "wb"));
+	append_files(1);
+	assert(check_file_archive(APPEND_FILENAME) == 1);
+
+	write_file("", 1);
+	append_files(1);
+	assert(check_file_archive(APPEND_FILENAME) == 1);
+
+	// Files that are not archives are not modified.
+
+	copy_file("archives/lha213/README", "", 0);
+	size = file_size(APPEND_FILENAME);
+	assert(lha_output_stream_append_to(APPEND_FILENAME) == NULL);
+	assert(file_size(APPEND_FILENAME) == size);
+
+	// An archive whose last file is cut short is not modified either.
+
+	fstream = fopen("archives/lha213/subdir.lzh", "rb");
+	assert(fstream != NULL);
+	n = fread(archive, 1, sizeof(archive), fstream);
+	fclose(fstream);
+	write_file(archive, n - 6);
+	assert(lha_output_stream_append_to(APPEND_FILENAME) == NULL);
+	assert(file_size(APPEND_FILENAME) == (long) n - 6);
+
+	// Including those that start with a zero byte, which looks like
+	// the end marker of an archive with no files.
+
+	memset(data, 'x', sizeof(data));
+	data[0] = '\0';
+	write_file(data, sizeof(data));
+	assert(lha_output_stream_append_to(APPEND_FILENAME) == NULL);
+	assert(file_size(APPEND_FILENAME) == sizeof(data));
+
+	remove(APPEND_FILENAME);
+	assert(lha_output_stream_append_to(APPEND_FILENAME) == NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	test_write_read();
+	test_header_lengths();
+	test_auto_store();
+	test_dedup();
+	test_large_job();
+	test_append();
+	test_invalid();
+	test_write_failure();
+
+	return 0;
+}